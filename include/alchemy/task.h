@@ -91,6 +91,20 @@ typedef struct RT_TASK_INFO RT_TASK_INFO;
 
 #define NO_ALCHEMY_TASK	((RT_TASK){ 0, 0 })
 
+/**
+ * @brief Release group descriptor
+ * @anchor RT_RELGROUP
+ *
+ * A release group drives the periodic release points of tasks with
+ * harmonic periods from a single timer. Release groups are
+ * process-local, and available over Cobalt only.
+ */
+struct RT_RELGROUP {
+	int fd;
+};
+
+typedef struct RT_RELGROUP RT_RELGROUP;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -127,6 +141,14 @@ CURRENT_DECL(int, rt_task_set_periodic(RT_TASK *task,
 
 int rt_task_wait_period(unsigned long *overruns_r);
 
+int rt_relgroup_create(RT_RELGROUP *group,
+		       RTIME idate, RTIME period);
+
+int rt_relgroup_delete(RT_RELGROUP *group);
+
+int rt_task_join_relgroup(RT_RELGROUP *group,
+			  unsigned int multiplier);
+
 int rt_task_sleep(RTIME delay);
 
 int rt_task_sleep_until(RTIME date);
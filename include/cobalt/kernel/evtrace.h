@@ -0,0 +1,83 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef _COBALT_KERNEL_EVTRACE_H
+#define _COBALT_KERNEL_EVTRACE_H
+
+#include <linux/percpu.h>
+#include <linux/log2.h>
+#include <cobalt/kernel/lock.h>
+#include <cobalt/kernel/clock.h>
+#include <cobalt/uapi/kernel/evtrace.h>
+
+#ifdef CONFIG_XENO_OPT_EVTRACE
+
+#define XNEVTRACE_RECORDS \
+	rounddown_pow_of_two(CONFIG_XENO_OPT_EVTRACE_RECORDS)
+
+DECLARE_PER_CPU(struct cobalt_evtrace_ring *, xnevtrace_ring);
+
+/*
+ * Log an event into the ring of the current CPU. Writers are
+ * serialized by masking hard irqs, which also pins us on the CPU;
+ * readers only get a consistent view of the records older than
+ * the head they sampled.
+ */
+static inline void xnevtrace_log(int type, pid_t pid,
+				 __u64 arg0, __u64 arg1)
+{
+	struct cobalt_evtrace_ring *ring;
+	struct cobalt_evtrace_rec *rec;
+	int cpu;
+	spl_t s;
+
+	splhigh(s);
+
+	cpu = ipipe_processor_id();
+	ring = per_cpu(xnevtrace_ring, cpu);
+	if (likely(ring)) {
+		rec = ring->recs + (ring->head & (XNEVTRACE_RECORDS - 1));
+		rec->ts = xnclock_core_read_raw();
+		rec->type = type;
+		rec->cpu = cpu;
+		rec->pid = pid;
+		rec->arg0 = arg0;
+		rec->arg1 = arg1;
+		smp_wmb();
+		ring->head++;
+	}
+
+	splexit(s);
+}
+
+int xnevtrace_init(void);
+
+void xnevtrace_cleanup(void);
+
+#else /* !CONFIG_XENO_OPT_EVTRACE */
+
+/* Do not even evaluate the arguments, some are not cheap to get. */
+#define xnevtrace_log(__type, __pid, __arg0, __arg1)	do { } while (0)
+
+static inline int xnevtrace_init(void)
+{
+	return 0;
+}
+
+static inline void xnevtrace_cleanup(void) { }
+
+#endif /* !CONFIG_XENO_OPT_EVTRACE */
+
+#endif /* !_COBALT_KERNEL_EVTRACE_H */
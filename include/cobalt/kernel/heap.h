@@ -21,6 +21,7 @@
 
 #include <linux/string.h>
 #include <linux/rbtree.h>
+#include <linux/percpu.h>
 #include <cobalt/kernel/lock.h>
 #include <cobalt/kernel/list.h>
 #include <cobalt/uapi/kernel/types.h>
@@ -78,6 +79,36 @@ struct xnheap_range {
 	size_t size;
 };
 
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+/*
+ * Per-CPU caching of bucketed blocks. Each CPU owns a magazine of
+ * free blocks for every bucket size, which is refilled from or
+ * drained to the heap by batches of XNHEAP_MAG_BATCH blocks. The
+ * overall amount of memory a CPU may cache is capped to a share of
+ * the heap size, see XNHEAP_MAG_SHARE.
+ */
+#define XNHEAP_MAG_SIZE		16
+#define XNHEAP_MAG_BATCH	(XNHEAP_MAG_SIZE / 2)
+/* All CPUs together cache 1/XNHEAP_MAG_SHARE of the heap at most. */
+#define XNHEAP_MAG_SHARE	8
+
+struct xnheap_magazine {
+	int count;
+	void *blocks[XNHEAP_MAG_SIZE];
+};
+
+struct xnheap_cpucache {
+	struct xnheap_magazine mags[XNHEAP_MAX_BUCKETS];
+	/* Bytes held in the magazines. */
+	size_t cached;
+	/* Requests served from the magazines. */
+	unsigned long hits;
+	/* Batched transfers from/to the heap. */
+	unsigned long refills;
+	unsigned long drains;
+};
+#endif
+
 struct xnheap {
 	void *membase;
 	struct rb_root addr_tree;
@@ -89,6 +120,10 @@ struct xnheap {
 	char name[XNOBJECT_NAME_LEN];
 	DECLARE_XNLOCK(lock);
 	struct list_head next;
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+	struct xnheap_cpucache __percpu *cpucache;
+	size_t cache_limit;
+#endif
 };
 
 extern struct xnheap cobalt_heap;
@@ -107,16 +142,26 @@ size_t xnheap_get_size(const struct xnheap *heap)
 	return heap->usable_size;
 }
 
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+size_t xnheap_get_cached(const struct xnheap *heap);
+#else
+static inline
+size_t xnheap_get_cached(const struct xnheap *heap)
+{
+	return 0;
+}
+#endif
+
 static inline
 size_t xnheap_get_used(const struct xnheap *heap)
 {
-	return heap->used_size;
+	return heap->used_size - xnheap_get_cached(heap);
 }
 
 static inline
 size_t xnheap_get_free(const struct xnheap *heap)
 {
-	return heap->usable_size - heap->used_size;
+	return heap->usable_size - xnheap_get_used(heap);
 }
 
 int xnheap_init(struct xnheap *heap,
@@ -37,6 +37,7 @@
 #define XNPIPE_USER_WSYNC        0x40
 #define XNPIPE_USER_WSYNC_READY  0x80
 #define XNPIPE_USER_LCONN        0x100
+#define XNPIPE_USER_EVENTFD      0x200
 
 #define XNPIPE_USER_ALL_WAIT \
 (XNPIPE_USER_WREAD|XNPIPE_USER_WSYNC)
@@ -51,6 +52,7 @@ struct xnpipe_mh {
 };
 
 struct xnpipe_state;
+struct vm_area_struct;
 
 struct xnpipe_operations {
 	void (*output)(struct xnpipe_mh *mh, void *xstate);
@@ -59,11 +61,14 @@ struct xnpipe_operations {
 	void (*free_ibuf)(void *buf, void *xstate);
 	void (*free_obuf)(void *buf, void *xstate);
 	void (*release)(void *xstate);
+	int (*mmap)(struct vm_area_struct *vma, void *xstate);
+	int (*pending)(void *xstate);
 };
 
 struct xnpipe_state {
 	struct list_head slink;	/* Link on sleep queue */
 	struct list_head alink;	/* Link on async queue */
+	struct list_head elink;	/* Link on eventfd queue */
 
 	struct list_head inq;		/* From user-space to kernel */
 	int nrinq;
@@ -76,6 +81,7 @@ struct xnpipe_state {
 	/* Linux kernel part */
 	unsigned long status;
 	struct fasync_struct *asyncq;
+	struct eventfd_ctx *efd;
 	wait_queue_head_t readq;	/* open/read/poll waiters */
 	wait_queue_head_t syncq;	/* sync waiters */
 	int wcount;			/* number of waiters on this minor */
@@ -106,6 +112,8 @@ ssize_t xnpipe_send(int minor,
 
 ssize_t xnpipe_mfixup(int minor, struct xnpipe_mh *mh, ssize_t size);
 
+int xnpipe_kick(int minor);
+
 ssize_t xnpipe_recv(int minor,
 		    struct xnpipe_mh **pmh, xnticks_t timeout);
 
@@ -24,6 +24,8 @@
 #include <linux/rbtree.h>
 #include <cobalt/kernel/heap.h>
 
+struct rtdm_fd_table;
+
 struct cobalt_umm {
 	struct xnheap heap;
 	atomic_t refcount;
@@ -35,7 +37,7 @@ struct cobalt_ppd {
 	unsigned long mayday_tramp;
 	atomic_t refcnt;
 	char *exe_path;
-	struct rb_root fds;
+	struct rtdm_fd_table *fds;
 };
 
 extern struct cobalt_ppd cobalt_kernel_ppd;
@@ -32,6 +32,8 @@ struct xnpnode;
 struct xnobject {
 	void *objaddr;
 	const char *key;	  /* !< Hash key. May be NULL if anonynous. */
+	char keybuf[XNOBJECT_NAME_LEN]; /* !< Copy of short keys. */
+	unsigned int hash;	  /* !< Hash value of key. */
 	unsigned long cstamp;		  /* !< Creation stamp. */
 #ifdef CONFIG_XENO_OPT_VFILE
 	struct xnpnode *pnode;	/* !< v-file information class. */
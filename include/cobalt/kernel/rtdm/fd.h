@@ -162,6 +162,66 @@ ssize_t rtdm_recvmsg_handler(struct rtdm_fd *fd, struct user_msghdr *msg, int fl
  */
 ssize_t rtdm_sendmsg_handler(struct rtdm_fd *fd, const struct user_msghdr *msg, int flags);
 
+/** Max. number of messages passed to batch handlers at once. */
+#define RTDM_MMSG_BATCH  8
+
+/**
+ * Receive multiple messages handler (optional)
+ *
+ * @param[in] fd File descriptor
+ * @param[in,out] msgvec Vector of message descriptors as passed by
+ * the user, automatically mirrored to safe kernel memory in case of
+ * user mode call
+ * @param[in] vlen Number of entries in @a msgvec, at most
+ * RTDM_MMSG_BATCH
+ * @param[in] flags Message flags as passed by the user
+ *
+ * The handler is only called from primary mode. It should receive
+ * as many messages as possible in a single pass, setting the @a
+ * msg_len field of each entry it fills. If MSG_WAITFORONE is set,
+ * only the first message of the vector may block.
+ *
+ * @return On success, the number of messages received, which may be
+ * lower than @a vlen. On failure, a negative error code if no message
+ * could be received at all. -ENOSYS makes RTDM process the vector
+ * with the receive message handler instead.
+ *
+ * @note RTDM falls back to calling the receive message handler
+ * repeatedly for drivers which do not provide this handler.
+ *
+ * @see @c recvmmsg() in Linux.
+ */
+int rtdm_recvmmsg_handler(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			  unsigned int vlen, int flags);
+
+/**
+ * Transmit multiple messages handler (optional)
+ *
+ * @param[in] fd File descriptor
+ * @param[in,out] msgvec Vector of message descriptors as passed by
+ * the user, automatically mirrored to safe kernel memory in case of
+ * user mode call
+ * @param[in] vlen Number of entries in @a msgvec, at most
+ * RTDM_MMSG_BATCH
+ * @param[in] flags Message flags as passed by the user
+ *
+ * The handler is only called from primary mode. It should send as
+ * many messages as possible in a single pass, setting the @a msg_len
+ * field of each entry it processes.
+ *
+ * @return On success, the number of messages sent, which may be
+ * lower than @a vlen. On failure, a negative error code if no message
+ * could be sent at all. -ENOSYS makes RTDM process the vector with
+ * the transmit message handler instead.
+ *
+ * @note RTDM falls back to calling the transmit message handler
+ * repeatedly for drivers which do not provide this handler.
+ *
+ * @see @c sendmmsg() in Linux.
+ */
+int rtdm_sendmmsg_handler(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			  unsigned int vlen, int flags);
+
 /**
  * Select handler
  *
@@ -277,6 +337,12 @@ struct rtdm_fd_ops {
 	/** See rtdm_sendmsg_handler(). */
 	ssize_t (*sendmsg_nrt)(struct rtdm_fd *fd,
 			       const struct user_msghdr *msg, int flags);
+	/** See rtdm_recvmmsg_handler(). */
+	int (*recvmmsg_rt)(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			   unsigned int vlen, int flags);
+	/** See rtdm_sendmmsg_handler(). */
+	int (*sendmmsg_rt)(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			   unsigned int vlen, int flags);
 	/** See rtdm_select_handler(). */
 	int (*select)(struct rtdm_fd *fd,
 		      struct xnselector *selector,
@@ -369,7 +435,7 @@ ssize_t rtdm_fd_recvmsg(int ufd, struct user_msghdr *msg, int flags);
 
 int __rtdm_fd_recvmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 		       unsigned int flags, void __user *u_timeout,
-		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user *u_mmsg),
+		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user **u_mmsg_p),
 		       int (*put_mmsg)(void __user **u_mmsg_p, const struct mmsghdr *mmsg),
 		       int (*get_timespec)(struct timespec *ts, const void __user *u_ts));
 
@@ -378,7 +444,7 @@ ssize_t rtdm_fd_sendmsg(int ufd, const struct user_msghdr *msg,
 
 int __rtdm_fd_sendmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 		       unsigned int flags,
-		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user *u_mmsg),
+		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user **u_mmsg_p),
 		       int (*put_mmsg)(void __user **u_mmsg_p, const struct mmsghdr *mmsg));
 
 int rtdm_fd_mmap(int ufd, struct _rtdm_mmap_request *rma,
@@ -0,0 +1,79 @@
+/*
+ * Xenomai is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * Xenomai is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Xenomai; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef _COBALT_KERNEL_SCHED_EDF_H
+#define _COBALT_KERNEL_SCHED_EDF_H
+
+#ifndef _COBALT_KERNEL_SCHED_H
+#error "please don't include cobalt/kernel/sched-edf.h directly"
+#endif
+
+/**
+ * @addtogroup cobalt_core_sched
+ * @{
+ */
+
+#ifdef CONFIG_XENO_OPT_SCHED_EDF
+
+#define XNSCHED_EDF_MIN_PRIO	1
+#define XNSCHED_EDF_MAX_PRIO	255
+
+/* Bandwidth is expressed as a fixed-point fraction of a CPU. */
+#define XNSCHED_EDF_BW_SHIFT	20
+#define XNSCHED_EDF_BW_ONE	(1UL << XNSCHED_EDF_BW_SHIFT)
+
+extern struct xnsched_class xnsched_class_edf;
+
+struct xnsched_edf_data {
+	struct xnthread *thread;
+	struct xnsched_edf_param param;
+	/* Absolute deadline of the current instance. */
+	xnticks_t deadline;
+	/* Runtime left to the current instance. */
+	xnticks_t budget;
+	/* Date the thread was last switched in. */
+	xnticks_t resume_date;
+	/* Release date of the next instance, when throttled. */
+	xnticks_t release;
+	/* Bandwidth reserved on @bw_sched. */
+	unsigned long bw;
+	struct xnsched *bw_sched;
+	struct xntimer budget_timer;
+	struct xntimer repl_timer;
+	bool active;
+	bool throttled;
+};
+
+struct xnsched_edf {
+	/* Runnable threads, by increasing absolute deadline. */
+	struct list_head runnable;
+	/* Overall bandwidth reserved by the member threads. */
+	unsigned long bw;
+};
+
+static inline int xnsched_edf_init_thread(struct xnthread *thread)
+{
+	thread->edf = NULL;
+	thread->edf_deadline = 0;
+
+	return 0;
+}
+
+#endif /* !CONFIG_XENO_OPT_SCHED_EDF */
+
+/** @} */
+
+#endif /* !_COBALT_KERNEL_SCHED_EDF_H */
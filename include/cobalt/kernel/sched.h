@@ -27,6 +27,7 @@
 #include <cobalt/kernel/sched-weak.h>
 #include <cobalt/kernel/sched-sporadic.h>
 #include <cobalt/kernel/sched-quota.h>
+#include <cobalt/kernel/sched-edf.h>
 #include <cobalt/kernel/vfile.h>
 #include <cobalt/kernel/assert.h>
 #include <asm/xenomai/machine.h>
@@ -85,6 +86,10 @@ struct xnsched {
 #ifdef CONFIG_XENO_OPT_SCHED_QUOTA
 	/*!< Context of runtime quota scheduling. */
 	struct xnsched_quota quota;
+#endif
+#ifdef CONFIG_XENO_OPT_SCHED_EDF
+	/*!< Context of EDF scheduling class. */
+	struct xnsched_edf edf;
 #endif
 	/*!< Interrupt nesting level. */
 	volatile unsigned inesting;
@@ -113,6 +118,12 @@ struct xnsched {
 	/*!< Currently active account */
 	xnstat_exectime_t *current_account;
 #endif
+#ifdef CONFIG_XENO_OPT_SCHED_CLUSTER
+	/*!< Cluster threads pushed away from this CPU. */
+	unsigned long nr_pushed;
+	/*!< Cluster threads pulled to this CPU. */
+	unsigned long nr_pulled;
+#endif
 };
 
 DECLARE_PER_CPU(struct xnsched, nksched);
@@ -174,6 +185,15 @@ struct xnsched_class {
 	void (*sched_protectprio)(struct xnthread *thread, int prio);
 	int (*sched_declare)(struct xnthread *thread,
 			     const union xnsched_policy_param *p);
+	/**
+	 * Validate new base scheduling parameters for a thread which
+	 * is already a member of the class, before they are applied
+	 * by sched_setparam(). Unlike the latter, this handler may
+	 * fail, e.g. when the new settings do not pass admission
+	 * control.
+	 */
+	int (*sched_chkparam)(struct xnthread *thread,
+			      const union xnsched_policy_param *p);
 	void (*sched_forget)(struct xnthread *thread);
 	void (*sched_kick)(struct xnthread *thread);
 #ifdef CONFIG_XENO_OPT_VFILE
@@ -434,6 +454,23 @@ void xnsched_migrate(struct xnthread *thread,
 void xnsched_migrate_passive(struct xnthread *thread,
 			     struct xnsched *sched);
 
+#ifdef CONFIG_XENO_OPT_SCHED_CLUSTER
+
+void __xnsched_cluster_push(struct xnthread *thread);
+
+/* nklock locked, interrupts off. thread is ready to run. */
+static inline void xnsched_cluster_push(struct xnthread *thread)
+{
+	if (xnthread_test_state(thread, XNCLUSTER))
+		__xnsched_cluster_push(thread);
+}
+
+#else /* !CONFIG_XENO_OPT_SCHED_CLUSTER */
+
+static inline void xnsched_cluster_push(struct xnthread *thread) { }
+
+#endif /* !CONFIG_XENO_OPT_SCHED_CLUSTER */
+
 /**
  * @fn void xnsched_rotate(struct xnsched *sched, struct xnsched_class *sched_class, const union xnsched_policy_param *sched_param)
  * @brief Rotate a scheduler runqueue.
@@ -485,6 +522,11 @@ static inline int xnsched_init_thread(struct xnthread *thread)
 	if (ret)
 		return ret;
 #endif /* CONFIG_XENO_OPT_SCHED_QUOTA */
+#ifdef CONFIG_XENO_OPT_SCHED_EDF
+	ret = xnsched_edf_init_thread(thread);
+	if (ret)
+		return ret;
+#endif /* CONFIG_XENO_OPT_SCHED_EDF */
 
 	return ret;
 }
@@ -533,6 +575,16 @@ static inline int xnsched_declare(struct xnsched_class *sched_class,
 	return 0;
 }
 
+static inline int xnsched_chkparam(struct xnsched_class *sched_class,
+				   struct xnthread *thread,
+				   const union xnsched_policy_param *p)
+{
+	if (sched_class->sched_chkparam)
+		return sched_class->sched_chkparam(thread, p);
+
+	return 0;
+}
+
 static inline int xnsched_calc_wprio(struct xnsched_class *sched_class,
 				     int prio)
 {
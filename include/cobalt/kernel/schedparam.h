@@ -55,6 +55,14 @@ struct xnsched_quota_param {
 	int tgid;	/* thread group id. */
 };
 
+struct xnsched_edf_param {
+	int prio;
+	xnticks_t runtime;
+	xnticks_t deadline;
+	xnticks_t period;
+	xnticks_t abs_deadline;	/* current absolute deadline. */
+};
+
 union xnsched_policy_param {
 	struct xnsched_idle_param idle;
 	struct xnsched_rt_param rt;
@@ -70,6 +78,9 @@ union xnsched_policy_param {
 #ifdef CONFIG_XENO_OPT_SCHED_QUOTA
 	struct xnsched_quota_param quota;
 #endif
+#ifdef CONFIG_XENO_OPT_SCHED_EDF
+	struct xnsched_edf_param edf;
+#endif
 };
 
 /** @} */
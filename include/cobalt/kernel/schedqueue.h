@@ -71,6 +71,15 @@ static inline int xnsched_weightq(struct xnsched_mlq *q)
 	return find_first_bit(q->prio_map, XNSCHED_MLQ_LEVELS);
 }
 
+static inline struct xnthread *xnsched_headq(struct xnsched_mlq *q)
+{
+	if (q->elems == 0)
+		return NULL;
+
+	return list_first_entry(q->heads + xnsched_weightq(q),
+				struct xnthread, rlink);
+}
+
 typedef struct xnsched_mlq xnsched_queue_t;
 
 #else /* ! CONFIG_XENO_OPT_SCALABLE_SCHED */
@@ -95,6 +104,13 @@ typedef struct list_head xnsched_queue_t;
 		__t = list_first_entry(__q, struct xnthread, rlink);	\
 		__t->cprio;						\
 	})
+#define xnsched_headq(__q)							\
+	({									\
+		struct xnthread *__t = NULL;					\
+		if (!list_empty(__q))						\
+			__t = list_first_entry(__q, struct xnthread, rlink);	\
+		__t;								\
+	})
 	
 
 #endif /* !CONFIG_XENO_OPT_SCALABLE_SCHED */
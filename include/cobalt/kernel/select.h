@@ -32,6 +32,20 @@
 #define XNSELECT_EXCEPT    2
 #define XNSELECT_MAX_TYPES 3
 
+struct xnselect_item {
+	unsigned int index;
+	unsigned int events;	/* (1 << type) mask of watched events. */
+	unsigned int pending;	/* (1 << type) mask of ready events. */
+	__u64 cookie;
+	struct list_head link;	/* link in selector ready list */
+};
+
+struct xnselect_event {
+	unsigned int index;
+	unsigned int events;
+	__u64 cookie;
+};
+
 struct xnselector {
 	struct xnsynch synchbase;
 	struct fds {
@@ -40,6 +54,9 @@ struct xnselector {
 	} fds [XNSELECT_MAX_TYPES];
 	struct list_head destroy_link;
 	struct list_head bindings; /* only used by xnselector_destroy */
+	/* Persistent selectors only. */
+	struct xnselect_item **items;
+	struct list_head ready;
 };
 
 #define __NFDBITS__	(8 * sizeof(unsigned long))
@@ -130,6 +147,22 @@ void xnselect_destroy(struct xnselect *select_block);
 
 int xnselector_init(struct xnselector *selector);
 
+int xnselector_init_persistent(struct xnselector *selector);
+
+int xnselector_add_item(struct xnselector *selector,
+			struct xnselect_item *item);
+
+int xnselector_mod_item(struct xnselector *selector,
+			unsigned int index,
+			unsigned int events, __u64 cookie);
+
+struct xnselect_item *
+xnselector_del_item(struct xnselector *selector, unsigned int index);
+
+int xnselector_wait(struct xnselector *selector,
+		    struct xnselect_event *events, int maxevents,
+		    xnticks_t timeout, xntmode_t timeout_mode);
+
 int xnselect(struct xnselector *selector,
 	     fd_set *out_fds[XNSELECT_MAX_TYPES],
 	     fd_set *in_fds[XNSELECT_MAX_TYPES],
@@ -20,7 +20,9 @@
 #ifndef _COBALT_KERNEL_STAT_H
 #define _COBALT_KERNEL_STAT_H
 
+#include <linux/bitops.h>
 #include <cobalt/kernel/clock.h>
+#include <cobalt/uapi/kernel/thread.h>
 
 /*
  * @ingroup cobalt_core_thread
@@ -108,10 +110,67 @@ static inline void xnstat_counter_set(xnstat_counter_t *c, unsigned long value)
 	c->counter = value;
 }
 
+#ifdef CONFIG_XENO_OPT_STATS_LATENCY
+
+typedef struct xnstat_latency {
+	xnticks_t release;	/* Release date, zero if not pending */
+	xnticks_t max;
+	xnticks_t sum;
+	unsigned long count;
+	unsigned long buckets[XNSTAT_LATENCY_BUCKETS];
+} xnstat_latency_t;
+
+/* Mark the release date of a thread which just became runnable. */
+static inline void xnstat_latency_release(xnstat_latency_t *l)
+{
+	l->release = xnclock_core_read_raw();
+}
+
+/*
+ * Account the wakeup latency of a thread being switched in, if
+ * released since it last ran. Bucket #n collects the latencies
+ * which are 2^(n-1) <= latency < 2^n clock ticks.
+ */
+static inline void xnstat_latency_account(xnstat_latency_t *l)
+{
+	xnticks_t delta;
+	int n;
+
+	if (l->release == 0)
+		return;
+
+	delta = xnclock_core_read_raw() - l->release;
+	l->release = 0;
+	n = fls64(delta);
+	if (n >= XNSTAT_LATENCY_BUCKETS)
+		n = XNSTAT_LATENCY_BUCKETS - 1;
+	l->buckets[n]++;
+	l->count++;
+	l->sum += delta;
+	if (delta > l->max)
+		l->max = delta;
+}
+
+#else /* !CONFIG_XENO_OPT_STATS_LATENCY */
+
+typedef struct xnstat_latency {
+} xnstat_latency_t;
+
+#define xnstat_latency_release(l)	do { } while (0)
+#define xnstat_latency_account(l)	do { } while (0)
+
+#endif /* !CONFIG_XENO_OPT_STATS_LATENCY */
+
 #else /* !CONFIG_XENO_OPT_STATS */
 typedef struct xnstat_exectime {
 } xnstat_exectime_t;
 
+typedef struct xnstat_latency {
+} xnstat_latency_t;
+
+#define xnstat_latency_release(l)	do { } while (0)
+#define xnstat_latency_account(l)	do { } while (0)
+
 #define xnstat_percpu_data					NULL
 #define xnstat_exectime_now()					({ 0; })
 #define xnstat_exectime_update(sched, date)			do { } while (0)
@@ -131,6 +190,40 @@ typedef struct xnstat_counter {
 #define xnstat_counter_set(c, value) do { } while (0)
 #endif /* CONFIG_XENO_OPT_STATS */
 
+#ifdef CONFIG_XENO_OPT_STATS_MAP
+
+struct xnsched;
+struct xnthread;
+
+int xnstat_map_init(void);
+
+void xnstat_map_cleanup(void);
+
+void xnstat_map_attach(struct xnthread *thread);
+
+void xnstat_map_detach(struct xnthread *thread);
+
+void xnstat_map_update(struct xnthread *thread);
+
+void xnstat_map_switch(struct xnsched *sched,
+		       struct xnthread *prev, struct xnthread *next);
+
+#else /* !CONFIG_XENO_OPT_STATS_MAP */
+
+static inline int xnstat_map_init(void)
+{
+	return 0;
+}
+
+static inline void xnstat_map_cleanup(void) { }
+
+#define xnstat_map_attach(thread)		do { } while (0)
+#define xnstat_map_detach(thread)		do { } while (0)
+#define xnstat_map_update(thread)		do { } while (0)
+#define xnstat_map_switch(sched, prev, next)	do { } while (0)
+
+#endif /* !CONFIG_XENO_OPT_STATS_MAP */
+
 /* Account the exectime of the current account until now, switch to
    new_account, and return the previous one. */
 #define xnstat_exectime_switch(sched, new_account) \
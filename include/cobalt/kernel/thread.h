@@ -39,7 +39,7 @@
  * @{
  */
 #define XNTHREAD_BLOCK_BITS   (XNSUSP|XNPEND|XNDELAY|XNDORMANT|XNRELAX|XNMIGRATE|XNHELD)
-#define XNTHREAD_MODE_BITS    (XNRRB|XNWARN|XNTRAPLB)
+#define XNTHREAD_MODE_BITS    (XNRRB|XNWARN|XNTRAPLB|XNCLUSTER)
 
 struct xnthread;
 struct xnsched;
@@ -85,6 +85,17 @@ struct xnthread_personality {
 	struct module *module;
 };
 
+/*
+ * Threads with harmonic periods may share the timer of a release
+ * group instead of arming their own periodic timer. Each member is
+ * released every relgroup_mult expiries of the group timer.
+ */
+struct xnrelgroup {
+	struct xntimer timer;		/* Shared release timer */
+	struct list_head members;	/* Member threads, by priority */
+	xnticks_t ticks;		/* Elapsed group periods */
+};
+
 struct xnthread {
 	struct xnarchtcb tcb;	/* Architecture-dependent block */
 
@@ -107,6 +118,10 @@ struct xnthread {
 	struct xnsched_quota_group *quota; /* Quota scheduling group. */
 	struct list_head quota_expired;
 	struct list_head quota_next;
+#endif
+#ifdef CONFIG_XENO_OPT_SCHED_EDF
+	struct xnsched_edf_data *edf; /* EDF scheduling data. */
+	xnticks_t edf_deadline;	/* Queuing deadline (may be inherited) */
 #endif
 	cpumask_t affinity;	/* Processor affinity. */
 
@@ -162,6 +177,14 @@ struct xnthread {
 
 	struct xntimer ptimer;		/* Periodic timer */
 
+	struct xnrelgroup *relgroup;	/* Release group, if any */
+
+	struct list_head relgroup_next;	/* Link in release group */
+
+	unsigned int relgroup_mult;	/* Period, in group periods */
+
+	xnticks_t relgroup_release;	/* Next release, in group periods */
+
 	xnticks_t rrperiod;		/* Allotted round-robin period (ns) */
 
   	struct xnthread_wait_context *wcontext;	/* Active wait context. */
@@ -173,6 +196,10 @@ struct xnthread {
 		xnstat_counter_t pf;	/* Number of page faults */
 		xnstat_exectime_t account; /* Execution time accounting entity */
 		xnstat_exectime_t lastperiod; /* Interval marker for execution time reports */
+		xnstat_latency_t latency; /* Wakeup latency histogram */
+#ifdef CONFIG_XENO_OPT_STATS_MAP
+		struct cobalt_stats_thread *slot; /* Binary stats record */
+#endif
 	} stat;
 
 	struct xnselector *selector;    /* For select. */
@@ -320,6 +347,12 @@ static inline void xnthread_sync_window(struct xnthread *thread)
 	}
 }
 
+static inline void xnthread_set_oncpu(struct xnthread *thread, int oncpu)
+{
+	if (thread->u_window)
+		thread->u_window->oncpu = oncpu;
+}
+
 static inline
 void xnthread_clear_sync_window(struct xnthread *thread, int state_bits)
 {
@@ -476,6 +509,21 @@ int xnthread_set_periodic(struct xnthread *thread,
 
 int xnthread_wait_period(unsigned long *overruns_r);
 
+void xnrelgroup_init(struct xnrelgroup *group,
+		     struct xnclock *clock,
+		     struct xnsched *sched);
+
+int xnrelgroup_start(struct xnrelgroup *group,
+		     xnticks_t idate,
+		     xntmode_t timeout_mode,
+		     xnticks_t period);
+
+void xnrelgroup_destroy(struct xnrelgroup *group);
+
+int xnthread_join_relgroup(struct xnthread *thread,
+			   struct xnrelgroup *group,
+			   unsigned int mult);
+
 int xnthread_set_slice(struct xnthread *thread,
 		       xnticks_t quantum);
 
@@ -187,6 +187,118 @@ typedef struct { } xntimerq_it_t;
 #define xntimerq_it_begin(q,i)	((void) (i), xntimerq_head(q))
 #define xntimerq_it_next(q,i,h) ((void) (i), xntimerq_next((q),(h)))
 
+#define xntimerq_advance(q, now) do { } while (0)
+#define xntimerq_set_clock(q, c) do { } while (0)
+
+#elif defined(CONFIG_XENO_OPT_TIMER_WHEEL)
+
+/*
+ * Hierarchical timing wheel. Each level has XNTIMERQ_WHEEL_SLOTS
+ * slots, a slot of level N covering 2^(XNTIMERQ_WHEEL_SHIFT + N *
+ * XNTIMERQ_WHEEL_BITS) clock ticks. A timer is hashed to the lowest
+ * level which spans its date from the base date of the wheel, so
+ * that insertion and removal are O(1). The earliest and second
+ * earliest timers are cached, so that the next hardware shot is
+ * always programmed for their exact date; the wheel is only scanned
+ * for refilling the cache when one of these timers goes away. Such
+ * refill walks the first busy slot of every level, and the far
+ * bucket if it may hold an earlier date, so its cost is linear in
+ * the number of timers queued there.
+ */
+#define XNTIMERQ_WHEEL_BITS	6
+#define XNTIMERQ_WHEEL_SLOTS	(1 << XNTIMERQ_WHEEL_BITS)
+#define XNTIMERQ_WHEEL_MASK	(XNTIMERQ_WHEEL_SLOTS - 1)
+#define XNTIMERQ_WHEEL_LEVELS	5
+#define XNTIMERQ_WHEEL_SHIFT	10
+/* Extra buckets for timers due before the base date, or beyond reach. */
+#define XNTIMERQ_WHEEL_EARLY	(XNTIMERQ_WHEEL_LEVELS * XNTIMERQ_WHEEL_SLOTS)
+#define XNTIMERQ_WHEEL_FAR	(XNTIMERQ_WHEEL_EARLY + 1)
+#define XNTIMERQ_WHEEL_BUCKETS	(XNTIMERQ_WHEEL_FAR + 1)
+
+typedef struct {
+	unsigned long long date;
+	int prio;
+	unsigned int bucket;
+	struct list_head link;
+} xntimerh_t;
+
+#define xntimerh_date(h) ((h)->date)
+#define xntimerh_prio(h) ((h)->prio)
+#define xntimerh_init(h) do { } while (0)
+
+typedef struct {
+	xntimerh_t *head;
+	xntimerh_t *second;
+	/* Clock the dates refer to, for rebasing an empty wheel. */
+	struct xnclock *clock;
+	/* All wheel dates are later or equal to this one. */
+	xnticks_t base;
+	/* Lower bound of the dates in the far bucket. */
+	xnticks_t farmin;
+	u64 map[XNTIMERQ_WHEEL_LEVELS];
+	struct list_head buckets[XNTIMERQ_WHEEL_BUCKETS];
+} xntimerq_t;
+
+void xntimerq_init(xntimerq_t *q);
+
+#define xntimerq_set_clock(q, c) ((q)->clock = (c))
+#define xntimerq_destroy(q) do { } while (0)
+#define xntimerq_empty(q) ((q)->head == NULL)
+
+#define xntimerq_head(q) ((q)->head)
+
+static inline xntimerh_t *xntimerq_second(xntimerq_t *q, xntimerh_t *h)
+{
+	/* Only the second timer following the head is cached. */
+	XENO_BUG_ON(COBALT, h != q->head);
+
+	return q->second;
+}
+
+void xntimerq_insert(xntimerq_t *q, xntimerh_t *holder);
+
+void __xntimerq_refill(xntimerq_t *q, xntimerh_t *holder);
+
+static inline void xntimerq_remove(xntimerq_t *q, xntimerh_t *holder)
+{
+	unsigned int b = holder->bucket;
+
+	list_del(&holder->link);
+
+	if (b < XNTIMERQ_WHEEL_EARLY && list_empty(&q->buckets[b]))
+		q->map[b / XNTIMERQ_WHEEL_SLOTS] &=
+			~(1ULL << (b & XNTIMERQ_WHEEL_MASK));
+
+	if (holder == q->head || holder == q->second)
+		__xntimerq_refill(q, holder);
+}
+
+void xntimerq_advance(xntimerq_t *q, xnticks_t now);
+
+typedef struct {
+	unsigned int bucket;
+} xntimerq_it_t;
+
+xntimerh_t *__xntimerq_it_scan(xntimerq_t *q, xntimerq_it_t *it);
+
+static inline xntimerh_t *xntimerq_it_begin(xntimerq_t *q, xntimerq_it_t *it)
+{
+	it->bucket = 0;
+
+	return __xntimerq_it_scan(q, it);
+}
+
+static inline xntimerh_t *xntimerq_it_next(xntimerq_t *q, xntimerq_it_t *it,
+					   xntimerh_t *h)
+{
+	if (!list_is_last(&h->link, &q->buckets[it->bucket]))
+		return list_entry(h->link.next, xntimerh_t, link);
+
+	it->bucket++;
+
+	return __xntimerq_it_scan(q, it);
+}
+
 #else /* CONFIG_XENO_OPT_TIMER_LIST */
 
 typedef struct xntlholder xntimerh_t;
@@ -209,6 +321,8 @@ typedef struct { } xntimerq_it_t;
 
 #define xntimerq_it_begin(q,i)  ((void) (i), xntlist_head(q))
 #define xntimerq_it_next(q,i,h) ((void) (i), xntlist_next((q),(h)))
+#define xntimerq_advance(q, now) do { } while (0)
+#define xntimerq_set_clock(q, c) do { } while (0)
 
 #endif /* CONFIG_XENO_OPT_TIMER_LIST */
 
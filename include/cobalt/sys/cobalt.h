@@ -23,6 +23,7 @@
 #include <pthread.h>
 #include <sched.h>
 #include <semaphore.h>
+#include <mqueue.h>
 #include <errno.h>
 #include <stdio.h>
 #include <time.h>
@@ -30,6 +31,7 @@
 #include <boilerplate/list.h>
 #include <cobalt/uapi/kernel/synch.h>
 #include <cobalt/uapi/kernel/vdso.h>
+#include <cobalt/uapi/kernel/stats.h>
 #include <cobalt/uapi/corectl.h>
 #include <cobalt/uapi/mutex.h>
 #include <cobalt/uapi/event.h>
@@ -37,10 +39,46 @@
 #include <cobalt/uapi/thread.h>
 #include <cobalt/uapi/cond.h>
 #include <cobalt/uapi/sem.h>
+#include <cobalt/uapi/select.h>
+#include <cobalt/uapi/ioring.h>
+#include <cobalt/uapi/mqueue.h>
 #include <cobalt/ticks.h>
 
 #define cobalt_commit_memory(p) __cobalt_commit_memory(p, sizeof(*p))
 
+struct cobalt_ioring {
+	int fd;
+	unsigned int sq_tail;
+	unsigned int sq_mask;
+	unsigned int cq_mask;
+	struct cobalt_ioring_state *state;
+	struct cobalt_ioring_sqe *sq;
+	struct cobalt_ioring_cqe *cq;
+};
+
+struct cobalt_stats {
+	const struct cobalt_stats_header *header;
+};
+
+struct cobalt_stats_threadinfo {
+	pid_t pid;
+	int cpu;
+	int cprio;
+	__u32 status;
+	__u64 xtime;
+	__u64 msw;
+	__u64 csw;
+	__u64 xsc;
+	__u64 pf;
+	char name[XNOBJECT_NAME_LEN];
+};
+
+struct cobalt_stats_cpuinfo {
+	int curr;
+	__u64 csw;
+	__u64 runtime;
+};
+
 struct cobalt_tsd_hook {
 	void (*create_tsd)(void);
 	void (*delete_tsd)(void);
@@ -124,6 +162,65 @@ int cobalt_event_inquire(cobalt_event_t *event,
 
 int cobalt_event_destroy(cobalt_event_t *event);
 
+int cobalt_selector_create(int flags);
+
+int cobalt_selector_ctl(int sfd, int op, int fd,
+			struct cobalt_selector_event *ev);
+
+int cobalt_selector_wait(int sfd, struct cobalt_selector_event *events,
+			 int maxevents, const struct timespec *timeout);
+
+int cobalt_ioring_init(struct cobalt_ioring *ring,
+		       unsigned int entries, int flags);
+
+void cobalt_ioring_destroy(struct cobalt_ioring *ring);
+
+struct cobalt_ioring_sqe *cobalt_ioring_get_sqe(struct cobalt_ioring *ring);
+
+int cobalt_ioring_submit(struct cobalt_ioring *ring);
+
+struct cobalt_ioring_cqe *cobalt_ioring_peek_cqe(struct cobalt_ioring *ring);
+
+void cobalt_ioring_cqe_seen(struct cobalt_ioring *ring);
+
+int cobalt_relgroup_create(clockid_t clock_id,
+			   const struct timespec *idate,
+			   const struct timespec *period);
+
+int cobalt_relgroup_destroy(int gfd);
+
+int cobalt_relgroup_join(int gfd, unsigned int multiplier);
+
+int cobalt_relgroup_leave(void);
+
+int cobalt_relgroup_wait(unsigned long *overruns_r);
+
+void *cobalt_mq_map(mqd_t mqd, size_t *slotsz_r);
+
+int cobalt_mq_unmap(mqd_t mqd, void *pool);
+
+int cobalt_mq_reserve(mqd_t mqd, unsigned int *slot_r,
+		      const struct timespec *abs_timeout);
+
+int cobalt_mq_commit(mqd_t mqd, unsigned int slot, size_t len,
+		     unsigned int prio);
+
+ssize_t cobalt_mq_consume(mqd_t mqd, unsigned int *slot_r,
+			  unsigned int *prio_r,
+			  const struct timespec *abs_timeout);
+
+int cobalt_mq_release(mqd_t mqd, unsigned int slot);
+
+int cobalt_stats_open(struct cobalt_stats *st);
+
+void cobalt_stats_close(struct cobalt_stats *st);
+
+int cobalt_stats_read_thread(struct cobalt_stats *st, unsigned int slot,
+			     struct cobalt_stats_threadinfo *ti);
+
+int cobalt_stats_read_cpu(struct cobalt_stats *st, unsigned int cpu,
+			  struct cobalt_stats_cpuinfo *ci);
+
 int cobalt_sem_inquire(sem_t *sem, struct cobalt_sem_info *info,
 		       pid_t *waitlist, size_t waitsz);
 
@@ -33,6 +33,10 @@ extern int __cobalt_print_bufcount;
 
 extern int __cobalt_print_syncdelay;
 
+extern int __cobalt_print_deferred;
+
+extern int __cobalt_mutex_spin;
+
 static inline define_config_tunable(main_prio, int, prio)
 {
 	__cobalt_main_prio = prio;
@@ -73,6 +77,26 @@ static inline read_config_tunable(print_sync_delay, int)
 	return __cobalt_print_syncdelay;
 }
 
+static inline define_config_tunable(print_deferred, int, on)
+{
+	__cobalt_print_deferred = on;
+}
+
+static inline read_config_tunable(print_deferred, int)
+{
+	return __cobalt_print_deferred;
+}
+
+static inline define_config_tunable(mutex_spin_count, int, count)
+{
+	__cobalt_mutex_spin = count;
+}
+
+static inline read_config_tunable(mutex_spin_count, int)
+{
+	return __cobalt_mutex_spin;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,72 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#ifndef _COBALT_UAPI_IORING_H
+#define _COBALT_UAPI_IORING_H
+
+#include <cobalt/uapi/kernel/types.h>
+
+#define COBALT_IORING_MAX_ENTRIES	256
+
+/* Submission opcodes. */
+#define COBALT_IORING_OP_NOP		0
+#define COBALT_IORING_OP_READ		1
+#define COBALT_IORING_OP_WRITE		2
+#define COBALT_IORING_OP_IOCTL		3
+#define COBALT_IORING_OP_RECVMSG	4
+#define COBALT_IORING_OP_SENDMSG	5
+
+/*
+ * Submission entry. @addr is the user buffer (read/write), the
+ * request argument (ioctl) or a struct msghdr (recvmsg/sendmsg).
+ * @len is the buffer size, the ioctl request code or the message
+ * flags respectively.
+ */
+struct cobalt_ioring_sqe {
+	__u8 opcode;
+	__u8 __pad[3];
+	__s32 fd;
+	__u32 len;
+	__u32 __pad2;
+	__u64 addr;
+	__u64 user_data;
+};
+
+struct cobalt_ioring_cqe {
+	__u64 user_data;
+	__s32 res;
+	__u32 __pad;
+};
+
+/*
+ * Ring state shared between the kernel and the application, living
+ * in the private Cobalt heap. The application produces submissions
+ * at sq_tail and consumes completions at cq_head, the kernel does
+ * the converse. Indexes are free-running, entry counts are powers of
+ * two. Both arrays are located at the given offsets from the start
+ * of this structure.
+ */
+struct cobalt_ioring_state {
+	__u32 sq_head;
+	__u32 sq_tail;
+	__u32 cq_head;
+	__u32 cq_tail;
+	__u32 sq_entries;
+	__u32 cq_entries;
+	__u32 sq_offset;
+	__u32 cq_offset;
+};
+
+#endif /* !_COBALT_UAPI_IORING_H */
@@ -0,0 +1,77 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#ifndef _COBALT_UAPI_KERNEL_EVTRACE_H
+#define _COBALT_UAPI_KERNEL_EVTRACE_H
+
+#include <linux/types.h>
+
+#define COBALT_EVTRACE_DEV	"evtrace"
+#define COBALT_EVTRACE_MAGIC	0x45565452
+
+/* Record types. */
+#define COBALT_EVTRACE_NONE	0
+#define COBALT_EVTRACE_SWITCH	1	/* arg0: next pid, arg1: next prio */
+#define COBALT_EVTRACE_TIMER	2	/* arg0: lateness (ticks), arg1: timer */
+#define COBALT_EVTRACE_IRQ	3	/* arg0: irq */
+#define COBALT_EVTRACE_CLOCK	4	/* arg0: irq */
+#define COBALT_EVTRACE_HARDEN	5
+#define COBALT_EVTRACE_RELAX	6	/* arg0: reason */
+
+/*
+ * Fixed-size trace record. @ts is a raw clock reading, which
+ * cobalt_evtrace_header.clock_freq converts to time. @pid is the
+ * host pid of the running thread when the event was logged.
+ */
+struct cobalt_evtrace_rec {
+	__u64 ts;
+	__u16 type;
+	__u16 cpu;
+	__u32 pid;
+	__u64 arg0;
+	__u64 arg1;
+};
+
+/*
+ * Per-CPU ring. @head counts the records logged so far on this CPU
+ * and is free-running, the most recent record lives at
+ * recs[(head - 1) & (nr_records - 1)]. The writer bumps @head after
+ * each record is complete, a reader may not trust the slot which
+ * immediately follows the last record it saw.
+ */
+struct cobalt_evtrace_ring {
+	__u32 head;
+	__u32 __pad[15];
+	struct cobalt_evtrace_rec recs[0];
+};
+
+/*
+ * Layout information, available from the first page of the mapping
+ * and through EVTRACE_RTIOC_INFO. Ring #cpu lives at ring_offset +
+ * cpu * ring_size bytes from the start of the mapping.
+ */
+struct cobalt_evtrace_header {
+	__u32 magic;
+	__u32 nr_cpus;
+	__u32 nr_records;
+	__u32 ring_size;
+	__u64 clock_freq;
+	__u32 ring_offset;
+	__u32 map_size;
+};
+
+#define EVTRACE_RTIOC_INFO	_IOR(RTDM_CLASS_COBALT, 0, struct cobalt_evtrace_header)
+
+#endif /* !_COBALT_UAPI_KERNEL_EVTRACE_H */
@@ -25,6 +25,7 @@
 #define XNPIPEIOC_OFLUSH	_IO(XNPIPE_IOCTL_BASE, 2)
 #define XNPIPEIOC_FLUSH		XNPIPEIOC_OFLUSH
 #define XNPIPEIOC_SETSIG	_IO(XNPIPE_IOCTL_BASE, 3)
+#define XNPIPEIOC_SETEVENTFD	_IO(XNPIPE_IOCTL_BASE, 4)
 
 #define XNPIPE_NORMAL	0x0
 #define XNPIPE_URGENT	0x1
@@ -0,0 +1,95 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#ifndef _COBALT_UAPI_KERNEL_STATS_H
+#define _COBALT_UAPI_KERNEL_STATS_H
+
+#include <linux/types.h>
+#include <cobalt/uapi/kernel/limits.h>
+
+#define COBALT_STATS_DEV	"stats"
+#define COBALT_STATS_MAGIC	0x53544154
+#define COBALT_STATS_VERSION	1
+
+/* cobalt_stats_thread.flags */
+#define COBALT_STATS_SLOT_USED	0x1
+
+/*
+ * Every record is guarded by a sequence count, which is odd while
+ * the kernel updates the record. A reader must sample @seq, copy
+ * the record, then check that @seq was even and did not change in
+ * the meantime, retrying otherwise.
+ */
+
+/*
+ * Per-thread record. Counters are published each time the thread
+ * is switched out, @exectime is a raw clock count which does not
+ * include the time spent running since the last switch in: the
+ * per-CPU record tells whether the thread is currently running,
+ * and since when.
+ */
+struct cobalt_stats_thread {
+	__u32 seq;
+	__u32 flags;
+	__s32 pid;
+	__u32 cpu;
+	__s32 cprio;
+	__u32 state;
+	__u64 exectime;
+	__u64 csw;
+	__u64 msw;
+	__u64 xsc;
+	__u64 pf;
+	char name[XNOBJECT_NAME_LEN];
+};
+
+/*
+ * Per-CPU record. @curr is the slot of the running thread, or -1
+ * if it has none. @switch_date is the raw clock count at which it
+ * was switched in. @csw counts the context switches on this CPU.
+ */
+struct cobalt_stats_cpu {
+	__u32 seq;
+	__s32 curr;
+	__u64 csw;
+	__u64 switch_date;
+	__u32 __pad[10];
+};
+
+/*
+ * Layout information, available from the first page of the mapping
+ * and through STATS_RTIOC_INFO. Record #n of each kind lives at
+ * <kind>_offset + n * <kind>_size bytes from the start of the
+ * mapping. Later versions may only append fields to the records,
+ * so readers must use the record sizes as strides. @overflows
+ * counts the threads which could not get a slot.
+ */
+struct cobalt_stats_header {
+	__u32 magic;
+	__u32 version;
+	__u32 nr_cpus;
+	__u32 nr_slots;
+	__u32 cpu_offset;
+	__u32 cpu_size;
+	__u32 thread_offset;
+	__u32 thread_size;
+	__u64 clock_freq;
+	__u32 map_size;
+	__u32 overflows;
+};
+
+#define STATS_RTIOC_INFO	_IOR(RTDM_CLASS_COBALT, 1, struct cobalt_stats_header)
+
+#endif /* !_COBALT_UAPI_KERNEL_STATS_H */
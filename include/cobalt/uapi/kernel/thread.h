@@ -51,6 +51,7 @@
 #define XNJOINED  0x00080000 /**< Another thread waits for joining this thread */
 #define XNTRAPLB  0x00100000 /**< Trap lock break (i.e. may not sleep with sched lock) */
 #define XNDEBUG   0x00200000 /**< User-level debugging enabled */
+#define XNCLUSTER 0x00400000 /**< May migrate within its CPU affinity set */
 
 /** @} */
 
@@ -100,14 +101,42 @@
  * 'r' -> Undergoes round-robin.
  * 't' -> Runtime mode errors notified.
  * 'L' -> Lock breaks trapped.
+ * 'c' -> Cluster scheduling.
  */
-#define XNTHREAD_STATE_LABELS  "SWDRU..X.HbTlrt.....L."
+#define XNTHREAD_STATE_LABELS  "SWDRU..X.HbTlrt.....L.c"
 
 struct xnthread_user_window {
 	__u32 state;
 	__u32 info;
 	__u32 grant_value;
 	__u32 pp_pending;
+	__u32 oncpu;	/* Running in primary mode */
+};
+
+/*
+ * Binary wakeup latency snapshot, as read from
+ * /proc/xenomai/sched/latency.bin: a header followed by one record
+ * per thread. Bucket #0 counts null latencies, bucket #n counts those
+ * which are below limits_ns[n] and not below limits_ns[n-1]. The
+ * last bucket also collects all latencies beyond its lower bound.
+ */
+#define XNSTAT_LATENCY_MAGIC	0x4c415448
+#define XNSTAT_LATENCY_BUCKETS	32
+
+struct xnstat_latency_header {
+	__u32 magic;
+	__u32 nr_buckets;
+	__u64 limits_ns[XNSTAT_LATENCY_BUCKETS];
+};
+
+struct xnstat_latency_record {
+	__u32 cpu;
+	__s32 pid;
+	__u64 count;
+	__u64 sum_ns;
+	__u64 max_ns;
+	__u64 buckets[XNSTAT_LATENCY_BUCKETS];
+	char name[XNOBJECT_NAME_LEN];
 };
 
 #endif /* !_COBALT_UAPI_KERNEL_THREAD_H */
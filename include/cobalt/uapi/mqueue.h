@@ -0,0 +1,36 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#ifndef _COBALT_UAPI_MQUEUE_H
+#define _COBALT_UAPI_MQUEUE_H
+
+/*
+ * Creation flag (mq_attr.mq_flags) enabling the zero-copy mode: the
+ * message payloads live in a pool which both ends map into their
+ * address space, and slot indices are exchanged instead of data.
+ */
+#define COBALT_MQ_ZEROCOPY	0x40000000
+
+/*
+ * Payload slots are laid out back to back in the pool, each slot
+ * being large enough for mq_msgsize bytes, rounded up to a cache
+ * line boundary.
+ */
+#define COBALT_MQ_SLOT_ALIGN	64
+
+#define cobalt_mq_slot_size(msgsize)					\
+	(((msgsize) + COBALT_MQ_SLOT_ALIGN - 1) & ~(COBALT_MQ_SLOT_ALIGN - 1))
+
+#endif /* !_COBALT_UAPI_MQUEUE_H */
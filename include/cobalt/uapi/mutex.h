@@ -28,6 +28,7 @@ struct cobalt_mutex_state {
 #define COBALT_MUTEX_COND_SIGNAL 0x00000001
 #define COBALT_MUTEX_ERRORCHECK  0x00000002
 	__u32 ceiling;
+	__u32 owner_winoff;	/* Owner's window, in the shared heap */
 };
 
 union cobalt_mutex_union {
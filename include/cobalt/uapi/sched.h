@@ -121,6 +121,19 @@ struct __sched_config_quota {
 
 #define sched_quota_confsz()  sizeof(struct __sched_config_quota)
 
+#ifndef SCHED_EDF
+#define SCHED_EDF		13
+#define sched_edf_runtime	sched_u.edf.__sched_runtime
+#define sched_edf_deadline	sched_u.edf.__sched_deadline
+#define sched_edf_period	sched_u.edf.__sched_period
+#endif	/* !SCHED_EDF */
+
+struct __sched_edf_param {
+	struct timespec __sched_runtime;
+	struct timespec __sched_deadline;
+	struct timespec __sched_period;
+};
+
 struct sched_param_ex {
 	int sched_priority;
 	union {
@@ -128,6 +141,7 @@ struct sched_param_ex {
 		struct __sched_rr_param rr;
 		struct __sched_tp_param tp;
 		struct __sched_quota_param quota;
+		struct __sched_edf_param edf;
 	} sched_u;
 };
 
@@ -121,6 +121,18 @@
 #define sc_cobalt_recvmmsg			98
 #define sc_cobalt_sendmmsg			99
 #define sc_cobalt_clock_adjtime			100
+#define sc_cobalt_selector_create		101
+#define sc_cobalt_selector_ctl			102
+#define sc_cobalt_selector_wait			103
+#define sc_cobalt_ioring_create			104
+#define sc_cobalt_ioring_enter			105
+#define sc_cobalt_relgroup_create		106
+#define sc_cobalt_relgroup_join			107
+#define sc_cobalt_relgroup_wait			108
+#define sc_cobalt_mq_reserve			109
+#define sc_cobalt_mq_commit			110
+#define sc_cobalt_mq_consume			111
+#define sc_cobalt_mq_release			112
 
 #define __NR_COBALT_SYSCALLS			128 /* Power of 2 */
 
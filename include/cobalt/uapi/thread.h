@@ -23,6 +23,7 @@
 #define PTHREAD_WARNSW             XNWARN
 #define PTHREAD_LOCK_SCHED         XNLOCK
 #define PTHREAD_DISABLE_LOCKBREAK  XNTRAPLB
+#define PTHREAD_CLUSTER            XNCLUSTER
 #define PTHREAD_CONFORMING     0
 
 struct cobalt_mutexattr {
@@ -648,8 +648,110 @@ struct sockaddr_ipc {
  * RT/non-RT, kernel space only
  */
 #define XDDP_MONITOR		4
+/**
+ * XDDP shared ring configuration
+ *
+ * Messages sent to a port are normally queued to the non real-time
+ * endpoint one by one, each of them being copied twice, and causing
+ * a wakeup of the Linux reader. When a shared ring is configured for
+ * the socket, messages sent to its port are copied once into a ring
+ * buffer which the Linux side maps via mmap(2) from /dev/rtp@em N
+ * instead, then consumes in place (see struct xddp_ring_ctl).
+ *
+ * The Linux reader is woken up only when @a batch messages are
+ * pending in the ring, or @a latency microseconds after the first
+ * message was added to the ring since the last wakeup, whichever
+ * comes first. Wakeups are delivered through the usual channels of
+ * /dev/rtp@em N, i.e. poll(2), SIGIO and the eventfd set by the
+ * XNPIPEIOC_SETEVENTFD request.
+ *
+ * When the ring is full, sending fails with -ENOMEM, and the message
+ * is counted in the @a dropped field of the ring control block.
+ * Messages larger than half of the data area are rejected with
+ * -EMSGSIZE.
+ * Streaming with MSG_MORE and urgent messages are not available to
+ * sockets with a shared ring.
+ *
+ * It is not allowed to configure a ring after the socket was
+ * bound. The ring memory is allocated by the @ref bind__AF_RTIPC
+ * "bind call".
+ *
+ * @param [in] level @ref sockopts_xddp "SOL_XDDP"
+ * @param [in] optname @b XDDP_RING
+ * @param [in] optval Pointer to struct xddp_ring_setup
+ * @param [in] optlen sizeof(struct xddp_ring_setup)
+ *
+ * @return 0 is returned upon success. Otherwise:
+ *
+ * - -EFAULT (Invalid data address given)
+ * - -EALREADY (socket already bound)
+ * - -EINVAL (@a optlen is invalid, or the ring size is zero or
+ * larger than 64 Mb)
+ * .
+ *
+ * @par Calling context:
+ * RT/non-RT
+ */
+#define XDDP_RING		5
 /** @} */
 
+/**
+ * Shared ring setup, see @ref XDDP_RING.
+ */
+struct xddp_ring_setup {
+	/**
+	 * Size of the data area, rounded up to a power of two, one
+	 * page at least.
+	 */
+	unsigned int size;
+	/** Pending messages triggering a wakeup (1 if zero). */
+	unsigned int batch;
+	/** Maximum wakeup delay in microseconds (no limit if zero). */
+	unsigned int latency;
+};
+
+/**
+ * Control block of a shared XDDP ring. The non real-time reader maps
+ * the ring from /dev/rtp@em N, with a length of one page for the
+ * control block, plus the size of the data area which starts on the
+ * next page.
+ *
+ * Messages are stored as records between the free-running @a head
+ * and @a tail byte indexes, both taken modulo @a size. The reader
+ * consumes the records up to @a tail, then updates @a head to give
+ * the space back to the real-time side.
+ */
+struct xddp_ring_ctl {
+	/** Consumer index, written by the reader. */
+	unsigned int head;
+	unsigned int __pad1[15];
+	/** Producer index, written by the real-time side. */
+	unsigned int tail;
+	/** Size of the data area. */
+	unsigned int size;
+	/** Count of messages dropped on overflow. */
+	unsigned int dropped;
+	unsigned int __pad2[13];
+};
+
+/**
+ * Record header in a shared XDDP ring, followed by @a len bytes of
+ * payload. Records with @ref XDDP_RING_PAD set carry no payload and
+ * fill the space up to the end of the data area.
+ */
+struct xddp_ring_rec {
+	/** Payload size. */
+	unsigned int len;
+	/** Record flags. */
+	unsigned int flags;
+};
+
+#define XDDP_RING_PAD		0x1
+
+/** Size of a ring record conveying @a len bytes of payload. */
+#define XDDP_RING_RECSZ(len)						\
+	((sizeof(struct xddp_ring_rec) + (len) + 7) & ~7U)
+
 /**
  * @anchor XDDP_EVENTS @name XDDP events
  * Specific events occurring on XDDP channels, which can be monitored
@@ -765,8 +867,105 @@ struct sockaddr_ipc {
  * RT/non-RT
  */
 #define IDDP_POOLSZ		2
+/**
+ * IDDP fan-out port configuration
+ *
+ * A fan-out port does not queue the messages it receives; instead,
+ * each message sent to such port is published to all the sockets
+ * which subscribed to it (see @ref IDDP_SUBSCRIBE). The payload is
+ * copied once into a buffer obtained from the pool of the fan-out
+ * socket, which is shared by reference among the subscribers, then
+ * released when the last of them has read it.
+ *
+ * Urgent messages (MSG_OOB) cannot be sent to a fan-out port.
+ *
+ * It is not allowed to turn a socket to a fan-out port after it was
+ * bound.
+ *
+ * @param [in] level @ref sockopts_iddp "SOL_IDDP"
+ * @param [in] optname @b IDDP_FANOUT
+ * @param [in] optval Pointer to a variable of type int, non-zero to
+ * enable fan-out
+ * @param [in] optlen sizeof(int)
+ *
+ * @return 0 is returned upon success. Otherwise:
+ *
+ * - -EFAULT (Invalid data address given)
+ * - -EALREADY (socket already bound)
+ * - -EINVAL (@a optlen is invalid)
+ * .
+ *
+ * @par Calling context:
+ * RT/non-RT
+ */
+#define IDDP_FANOUT		3
+/**
+ * IDDP fan-out subscription
+ *
+ * Subscribe the socket to the fan-out port @a port, which must be
+ * bound at the time of the call (see @ref IDDP_FANOUT). Messages
+ * published to this port are read from the subscribing socket like
+ * regular datagrams, along with those sent to the port it may be
+ * bound to; binding is not required for subscribing though.
+ *
+ * Up to @a depth published messages may be pending for the
+ * subscriber. When this limit is reached, @a policy determines the
+ * outcome of the next publication:
+ *
+ * - IDDP_SUB_DROP_OLDEST discards the oldest pending message for
+ * the subscriber, making room for the new one.
+ * - IDDP_SUB_DROP_NEWEST discards the new message for the subscriber.
+ * - IDDP_SUB_BLOCK makes the publisher wait until the subscriber
+ * reads a message, subject to the send timeout of the publishing
+ * socket (see @ref SO_SNDTIMEO).
+ * .
+ *
+ * A socket may subscribe to a single fan-out port at a time; passing
+ * @a port as -1 cancels the current subscription. Closing the
+ * fan-out port cancels all subscriptions to it, dropping the pending
+ * messages.
+ *
+ * getsockopt() returns the current subscription, with the count of
+ * messages discarded for the subscriber in @a drops.
+ *
+ * @param [in] level @ref sockopts_iddp "SOL_IDDP"
+ * @param [in] optname @b IDDP_SUBSCRIBE
+ * @param [in] optval Pointer to struct iddp_subscription
+ * @param [in] optlen sizeof(struct iddp_subscription)
+ *
+ * @return 0 is returned upon success. Otherwise:
+ *
+ * - -EFAULT (Invalid data address given)
+ * - -EINVAL (@a optlen, @a policy or @a depth is invalid)
+ * - -EBUSY (socket already subscribed to a port)
+ * - -ECONNREFUSED (no fan-out port bound to @a port)
+ * - -ENOMEM (not enough memory for the subscription)
+ * .
+ *
+ * @par Calling context:
+ * RT/non-RT
+ */
+#define IDDP_SUBSCRIBE		4
 /** @} */
 
+#define IDDP_SUB_DROP_OLDEST	0
+#define IDDP_SUB_DROP_NEWEST	1
+#define IDDP_SUB_BLOCK		2
+
+/**
+ * Fan-out subscription, see @ref IDDP_SUBSCRIBE.
+ */
+struct iddp_subscription {
+	/** Fan-out port, -1 to unsubscribe. */
+	int port;
+	/** Overflow policy, IDDP_SUB_*. */
+	int policy;
+	/** Maximum count of pending messages. */
+	unsigned int depth;
+	/** Messages discarded on overflow (output only). */
+	unsigned int drops;
+};
+
 #define SOL_BUFP		313
 /**
  * @anchor sockopts_bufp @name BUFP socket options
@@ -836,6 +1035,118 @@ struct sockaddr_ipc {
 #define BUFP_BUFSZ		2
 /** @} */
 
+#define RTIOC_TYPE_RTIPC	RTDM_CLASS_RTIPC
+
+/**
+ * @anchor ioctls_bufp @name BUFP zero-copy requests
+ * Exchanging data in place through a mapped BUFP buffer.
+ *
+ * The buffer of a bound BUFP socket can be mapped with @c mmap() by
+ * the receiving socket, and by any socket connected to it. mmap()
+ * always maps the buffer of the default destination of the socket,
+ * which is the socket itself after binding, or the peer set by
+ * @c connect(). The mapping must start at offset zero and span twice
+ * the buffer size, which must be a multiple of the page size: the
+ * buffer pages are mapped twice in a row, so that any span of the
+ * circular buffer is contiguous in the address space of the caller.
+ * The buffer remains valid until the last mapping is removed, even
+ * if the receiving socket is closed in the meantime.
+ *
+ * A writer acquires a span of free room from the buffer of its
+ * default destination, fills it in place, then commits the count of
+ * bytes written. A reader acquires a span of pending data from the
+ * buffer of its own socket, consumes it in place, then commits the
+ * count of bytes consumed. Acquiring waits for the requested length
+ * to become available, as @c send() and @c recv() do, with the same
+ * timeouts (SO_SNDTIMEO, SO_RCVTIMEO).
+ *
+ * A single span may be held at any time in each direction on a
+ * buffer. Regular send and receive operations block until the span
+ * in their direction is committed.
+ * @{ */
+/**
+ * Acquire a write span.
+ *
+ * @param [in,out] arg Pointer to struct bufp_span. On entry, @a len
+ * is the minimum count of bytes to acquire, and @a flags may contain
+ * MSG_DONTWAIT. On success, @a offset and @a len describe the span,
+ * which covers all the free room in the buffer.
+ *
+ * @return 0 is returned upon success. Otherwise:
+ *
+ * - -EINVAL (@a len is zero or larger than the buffer)
+ * - -EBUSY (a write span is already held on the buffer)
+ * - -EDESTADDRREQ (no default destination is set)
+ * - -ECONNRESET, -ECONNREFUSED (destination is not bound)
+ * - -EWOULDBLOCK (MSG_DONTWAIT set and not enough free room)
+ * - -ETIMEDOUT, -EINTR (wait aborted)
+ * .
+ *
+ * @par Calling context:
+ * RT/non-RT
+ */
+#define BUFP_WRACQUIRE		_IOWR(RTIOC_TYPE_RTIPC, 0x00, struct bufp_span)
+/**
+ * Commit a write span.
+ *
+ * @param [in] arg Pointer to struct bufp_span, @a len is the count
+ * of bytes written at the start of the span. Zero drops the span.
+ *
+ * @return 0 is returned upon success, -EINVAL if no write span is
+ * held by the socket or @a len exceeds it.
+ *
+ * @par Calling context:
+ * RT/non-RT
+ */
+#define BUFP_WRCOMMIT		_IOW(RTIOC_TYPE_RTIPC, 0x01, struct bufp_span)
+/**
+ * Acquire a read span.
+ *
+ * @param [in,out] arg Pointer to struct bufp_span. On entry, @a len
+ * is the minimum count of bytes to acquire, and @a flags may contain
+ * MSG_DONTWAIT. On success, @a offset and @a len describe the span,
+ * which covers all the data pending in the buffer.
+ *
+ * @return 0 is returned upon success. Otherwise:
+ *
+ * - -EINVAL (@a len is zero or larger than the buffer)
+ * - -EBUSY (a read span is already held on the buffer)
+ * - -EAGAIN (socket is not bound)
+ * - -EWOULDBLOCK (MSG_DONTWAIT set and not enough data)
+ * - -ETIMEDOUT, -EINTR (wait aborted)
+ * .
+ *
+ * @par Calling context:
+ * RT/non-RT
+ */
+#define BUFP_RDACQUIRE		_IOWR(RTIOC_TYPE_RTIPC, 0x02, struct bufp_span)
+/**
+ * Commit a read span.
+ *
+ * @param [in] arg Pointer to struct bufp_span, @a len is the count
+ * of bytes consumed from the start of the span.
+ *
+ * @return 0 is returned upon success, -EINVAL if no read span is
+ * held on the buffer or @a len exceeds it.
+ *
+ * @par Calling context:
+ * RT/non-RT
+ */
+#define BUFP_RDCOMMIT		_IOW(RTIOC_TYPE_RTIPC, 0x03, struct bufp_span)
+/** @} */
+
+/**
+ * Buffer span, see @ref ioctls_bufp "BUFP zero-copy requests".
+ */
+struct bufp_span {
+	/** Offset of the span into the mapping (output only). */
+	unsigned int offset;
+	/** Length of the span. */
+	unsigned int len;
+	/** MSG_DONTWAIT or zero (acquire only). */
+	int flags;
+};
+
 /**
  * @anchor sockopts_socket @name Socket level options
  * Setting and getting supported standard socket level options.
@@ -78,5 +78,10 @@ __COBALT_CALL32emu_THUNK(mmap)
 __COBALT_CALL32x_THUNK(mmap)
 __COBALT_CALL32emu_THUNK(backtrace)
 __COBALT_CALL32x_THUNK(backtrace)
+__COBALT_CALL32emu_THUNK(selector_wait)
+__COBALT_CALL32emu_THUNK(relgroup_create)
+__COBALT_CALL32emu_THUNK(relgroup_wait)
+__COBALT_CALL32emu_THUNK(mq_reserve)
+__COBALT_CALL32emu_THUNK(mq_consume)
 
 #endif /* !_COBALT_X86_ASM_SYSCALL32_TABLE_H */
@@ -24,6 +24,7 @@
 #include <cobalt/kernel/clock.h>
 #include <cobalt/kernel/arith.h>
 #include <cobalt/kernel/vdso.h>
+#include <cobalt/kernel/evtrace.h>
 #include <cobalt/uapi/time.h>
 #include <asm/xenomai/calibration.h>
 #include <trace/events/cobalt-core.h>
@@ -645,6 +646,7 @@ int xnclock_register(struct xnclock *clock, const cpumask_t *affinity)
 	for_each_online_cpu(cpu) {
 		tmd = xnclock_percpu_timerdata(clock, cpu);
 		xntimerq_init(&tmd->q);
+		xntimerq_set_clock(&tmd->q, clock);
 	}
 
 #ifdef CONFIG_XENO_OPT_STATS
@@ -745,6 +747,9 @@ void xnclock_tick(struct xnclock *clock)
 			break;
 
 		trace_cobalt_timer_expire(timer);
+		xnevtrace_log(COBALT_EVTRACE_TIMER,
+			      xnthread_host_pid(sched->curr),
+			      -delta, (unsigned long)timer);
 
 		xntimer_dequeue(timer, tmq);
 		xntimer_account_fired(timer);
@@ -791,6 +796,9 @@ void xnclock_tick(struct xnclock *clock)
 		xntimer_enqueue(timer, tmq);
 	}
 
+	/* Every outstanding timer is now due after this date. */
+	xntimerq_advance(tmq, now);
+
 	sched->status &= ~XNINTCK;
 
 	xnclock_program_shot(clock, sched);
@@ -0,0 +1,149 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/fcntl.h>
+#include <linux/ipipe.h>
+#include <cobalt/kernel/evtrace.h>
+#include <rtdm/driver.h>
+#include <asm/xenomai/machine.h>
+
+/*
+ * Binary event trace. A single vmalloc'ed area holds a header page
+ * followed by one ring per possible CPU, each starting on a page
+ * boundary. The whole area can be mapped read-only into user-space
+ * through the evtrace device, so that tools may snapshot the rings
+ * of a live system without any help from the kernel.
+ */
+
+DEFINE_PER_CPU(struct cobalt_evtrace_ring *, xnevtrace_ring);
+
+static void *evtrace_area;
+
+static struct cobalt_evtrace_header *evtrace_header;
+
+static int evtrace_open(struct rtdm_fd *fd, int oflags)
+{
+	if ((oflags & O_ACCMODE) != O_RDONLY)
+		return -EACCES;
+
+	return 0;
+}
+
+static int evtrace_ioctl_nrt(struct rtdm_fd *fd,
+			     unsigned int request, void __user *arg)
+{
+	switch (request) {
+	case EVTRACE_RTIOC_INFO:
+		return rtdm_safe_copy_to_user(fd, arg, evtrace_header,
+					      sizeof(*evtrace_header));
+	default:
+		return -EINVAL;
+	}
+}
+
+static int evtrace_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+	size_t len = vma->vm_end - vma->vm_start;
+
+	if (vma->vm_pgoff || len > evtrace_header->map_size)
+		return -EINVAL;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EACCES;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	return rtdm_mmap_vmem(vma, evtrace_area);
+}
+
+static struct rtdm_driver evtrace_driver = {
+	.profile_info	=	RTDM_PROFILE_INFO(evtrace,
+						  RTDM_CLASS_COBALT,
+						  RTDM_SUBCLASS_GENERIC,
+						  0),
+	.device_flags	=	RTDM_NAMED_DEVICE,
+	.device_count	=	1,
+	.ops = {
+		.open		=	evtrace_open,
+		.ioctl_nrt	=	evtrace_ioctl_nrt,
+		.mmap		=	evtrace_mmap,
+	},
+};
+
+static struct rtdm_device evtrace_device = {
+	.driver = &evtrace_driver,
+	.label = COBALT_EVTRACE_DEV,
+};
+
+int __init xnevtrace_init(void)
+{
+	struct cobalt_evtrace_header *h;
+	size_t ring_size, map_size;
+	int cpu, ret;
+
+	ring_size = PAGE_ALIGN(sizeof(struct cobalt_evtrace_ring) +
+			       XNEVTRACE_RECORDS *
+			       sizeof(struct cobalt_evtrace_rec));
+	map_size = PAGE_SIZE + ring_size * nr_cpu_ids;
+
+	evtrace_area = vmalloc_user(map_size);
+	if (evtrace_area == NULL)
+		return -ENOMEM;
+
+	h = evtrace_area;
+	h->magic = COBALT_EVTRACE_MAGIC;
+	h->nr_cpus = nr_cpu_ids;
+	h->nr_records = XNEVTRACE_RECORDS;
+	h->ring_size = ring_size;
+	h->clock_freq = cobalt_pipeline.clock_freq;
+	h->ring_offset = PAGE_SIZE;
+	h->map_size = map_size;
+	evtrace_header = h;
+
+	ret = rtdm_dev_register(&evtrace_device);
+	if (ret) {
+		vfree(evtrace_area);
+		evtrace_area = NULL;
+		return ret;
+	}
+
+	/* Start logging once everything is in place. */
+	for_each_possible_cpu(cpu)
+		per_cpu(xnevtrace_ring, cpu) =
+			evtrace_area + PAGE_SIZE + ring_size * cpu;
+
+	return 0;
+}
+
+void xnevtrace_cleanup(void)
+{
+	unsigned long flags;
+	int cpu;
+
+	/*
+	 * Writers run with hard irqs off, so once all CPUs have
+	 * synced with us, none of them may still refer to the rings.
+	 */
+	flags = ipipe_critical_enter(NULL);
+	for_each_possible_cpu(cpu)
+		per_cpu(xnevtrace_ring, cpu) = NULL;
+	ipipe_critical_exit(flags);
+
+	rtdm_dev_unregister(&evtrace_device);
+	vfree(evtrace_area);
+	evtrace_area = NULL;
+}
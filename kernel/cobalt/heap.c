@@ -61,6 +61,12 @@ struct vfile_priv {
 struct vfile_data {
 	size_t all_mem;
 	size_t free_mem;
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+	size_t cached_mem;
+	unsigned long hits;
+	unsigned long refills;
+	unsigned long drains;
+#endif
 	char name[XNOBJECT_NAME_LEN];
 };
 
@@ -85,6 +91,31 @@ static int vfile_rewind(struct xnvfile_snapshot_iterator *it)
 	return nrheaps;
 }
 
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+
+static void collect_cache_stats(struct xnheap *heap, struct vfile_data *p)
+{
+	struct xnheap_cpucache *cc;
+	int cpu;
+
+	p->cached_mem = xnheap_get_cached(heap);
+	p->hits = p->refills = p->drains = 0;
+
+	for_each_possible_cpu(cpu) {
+		cc = per_cpu_ptr(heap->cpucache, cpu);
+		p->hits += cc->hits;
+		p->refills += cc->refills;
+		p->drains += cc->drains;
+	}
+}
+
+#else
+
+static inline
+void collect_cache_stats(struct xnheap *heap, struct vfile_data *p) { }
+
+#endif
+
 static int vfile_next(struct xnvfile_snapshot_iterator *it, void *data)
 {
 	struct vfile_priv *priv = xnvfile_iterator_priv(it);
@@ -103,6 +134,7 @@ static int vfile_next(struct xnvfile_snapshot_iterator *it, void *data)
 
 	p->all_mem = xnheap_get_size(heap);
 	p->free_mem = xnheap_get_free(heap);
+	collect_cache_stats(heap, p);
 	knamecpy(p->name, heap->name);
 
 	return 1;
@@ -112,6 +144,21 @@ static int vfile_show(struct xnvfile_snapshot_iterator *it, void *data)
 {
 	struct vfile_data *p = data;
 
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+	if (p == NULL)
+		xnvfile_printf(it, "%9s %9s %9s %10s %10s %10s  %s\n",
+			       "TOTAL", "FREE", "CACHED",
+			       "HITS", "REFILLS", "DRAINS", "NAME");
+	else
+		xnvfile_printf(it, "%9zu %9zu %9zu %10lu %10lu %10lu  %s\n",
+			       p->all_mem,
+			       p->free_mem,
+			       p->cached_mem,
+			       p->hits,
+			       p->refills,
+			       p->drains,
+			       p->name);
+#else
 	if (p == NULL)
 		xnvfile_printf(it, "%9s %9s  %s\n",
 			       "TOTAL", "FREE", "NAME");
@@ -120,6 +167,7 @@ static int vfile_show(struct xnvfile_snapshot_iterator *it, void *data)
 			       p->all_mem,
 			       p->free_mem,
 			       p->name);
+#endif
 	return 0;
 }
 
@@ -511,45 +559,12 @@ static void *add_free_range(struct xnheap *heap,
 	return pagenr_to_addr(heap, pg);
 }
 
-/**
- * @fn void *xnheap_alloc(struct xnheap *heap, size_t size)
- * @brief Allocate a memory block from a memory heap.
- *
- * Allocates a contiguous region of memory from an active memory heap.
- * Such allocation is guaranteed to be time-bounded.
- *
- * @param heap The descriptor address of the heap to get memory from.
- *
- * @param size The size in bytes of the requested block.
- *
- * @return The address of the allocated region upon success, or NULL
- * if no memory is available from the specified heap.
- *
- * @coretags{unrestricted}
- */
-void *xnheap_alloc(struct xnheap *heap, size_t size)
+static void *alloc_block(struct xnheap *heap,
+			 size_t bsize, int log2size)
 {
-	int log2size, ilog, pg, b = -1;
-	size_t bsize;
+	int ilog, pg, b;
 	void *block;
-	spl_t s;
-
-	if (size == 0)
-		return NULL;
 
-	if (size < XNHEAP_MIN_ALIGN) {
-		bsize = size = XNHEAP_MIN_ALIGN;
-		log2size = XNHEAP_MIN_LOG2;
-	} else {
-		log2size = ilog2(size);
-		if (log2size < XNHEAP_PAGE_SHIFT) {
-			if (size & (size - 1))
-				log2size++;
-			bsize = 1 << log2size;
-		} else
-			bsize = ALIGN(size, XNHEAP_PAGE_SIZE);
-	}
-	
 	/*
 	 * Allocate entire pages directly from the pool whenever the
 	 * block is larger or equal to XNHEAP_PAGE_SIZE.  Otherwise,
@@ -562,74 +577,51 @@ void *xnheap_alloc(struct xnheap *heap, size_t size)
 	 * this list, in which case we should immediately add a fresh
 	 * page.
 	 */
-	xnlock_get_irqsave(&heap->lock, s);
-
 	if (bsize >= XNHEAP_PAGE_SIZE)
 		/* Add a range of contiguous free pages. */
-		block = add_free_range(heap, bsize, 0);
-	else {
-		ilog = log2size - XNHEAP_MIN_LOG2;
-		XENO_WARN_ON(MEMORY, ilog < 0 || ilog >= XNHEAP_MAX_BUCKETS);
-		pg = heap->buckets[ilog];
-		/*
-		 * Find a block in the heading page if any. If there
-		 * is none, there won't be any down the list: add a
-		 * new page right away.
-		 */
-		if (pg < 0 || heap->pagemap[pg].map == -1U)
-			block = add_free_range(heap, bsize, log2size);
-		else {
-			b = ffs(~heap->pagemap[pg].map) - 1;
-			/*
-			 * Got one block from the heading per-bucket
-			 * page, tag it as busy in the per-page
-			 * allocation map.
-			 */
-			heap->pagemap[pg].map |= (1U << b);
-			heap->used_size += bsize;
-			block = heap->membase +
-				(pg << XNHEAP_PAGE_SHIFT) +
-				(b << log2size);
-			if (heap->pagemap[pg].map == -1U)
-				move_page_back(heap, pg, log2size);
-		}
-	}
+		return add_free_range(heap, bsize, 0);
 
-	xnlock_put_irqrestore(&heap->lock, s);
+	ilog = log2size - XNHEAP_MIN_LOG2;
+	XENO_WARN_ON(MEMORY, ilog < 0 || ilog >= XNHEAP_MAX_BUCKETS);
+	pg = heap->buckets[ilog];
+	/*
+	 * Find a block in the heading page if any. If there is none,
+	 * there won't be any down the list: add a new page right
+	 * away.
+	 */
+	if (pg < 0 || heap->pagemap[pg].map == -1U)
+		return add_free_range(heap, bsize, log2size);
+
+	b = ffs(~heap->pagemap[pg].map) - 1;
+	/*
+	 * Got one block from the heading per-bucket page, tag it as
+	 * busy in the per-page allocation map.
+	 */
+	heap->pagemap[pg].map |= (1U << b);
+	heap->used_size += bsize;
+	block = heap->membase +
+		(pg << XNHEAP_PAGE_SHIFT) +
+		(b << log2size);
+	if (heap->pagemap[pg].map == -1U)
+		move_page_back(heap, pg, log2size);
 
 	return block;
 }
-EXPORT_SYMBOL_GPL(xnheap_alloc);
 
-/**
- * @fn void xnheap_free(struct xnheap *heap, void *block)
- * @brief Release a block to a memory heap.
- *
- * Releases a memory block to a heap.
- *
- * @param heap The heap descriptor.
- *
- * @param block The block to be returned to the heap.
- *
- * @coretags{unrestricted}
- */
-void xnheap_free(struct xnheap *heap, void *block)
+static bool free_block(struct xnheap *heap, void *block)
 {
 	unsigned long pgoff, boff;
 	int log2size, pg, n;
 	size_t bsize;
 	u32 oldmap;
-	spl_t s;
-
-	xnlock_get_irqsave(&heap->lock, s);
 
 	/* Compute the heading page number in the page map. */
 	pgoff = block - heap->membase;
 	pg = pgoff >> XNHEAP_PAGE_SHIFT;
 
 	if (!page_is_valid(heap, pg))
-		goto bad;
-	
+		return false;
+
 	switch (heap->pagemap[pg].type) {
 	case page_list:
 		bsize = heap->pagemap[pg].bsize;
@@ -643,10 +635,12 @@ void xnheap_free(struct xnheap *heap, void *block)
 		XENO_WARN_ON(MEMORY, bsize >= XNHEAP_PAGE_SIZE);
 		boff = pgoff & ~XNHEAP_PAGE_MASK;
 		if ((boff & (bsize - 1)) != 0) /* Not at block start? */
-			goto bad;
+			return false;
 
 		n = boff >> log2size; /* Block position in page. */
 		oldmap = heap->pagemap[pg].map;
+		if (XENO_DEBUG(MEMORY) && (oldmap & (1U << n)) == 0)
+			return false; /* Not busy, double free? */
 		heap->pagemap[pg].map &= ~(1U << n);
 
 		/*
@@ -666,13 +660,295 @@ void xnheap_free(struct xnheap *heap, void *block)
 
 	heap->used_size -= bsize;
 
+	return true;
+}
+
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+
+/*
+ * The magazines are per-CPU, so hard IRQs off on the local CPU is
+ * all we need for accessing them. The heap lock is only taken for
+ * moving blocks between a magazine and the heap, which we do by
+ * batches to amortize the locking cost.
+ *
+ * Other CPUs cannot reclaim the blocks a CPU holds, so the amount
+ * of memory each CPU may cache is capped by heap->cache_limit, which
+ * bounds the memory unavailable to a CPU running short of it.
+ */
+static int refill_magazine(struct xnheap *heap,
+			   struct xnheap_cpucache *cc,
+			   struct xnheap_magazine *mag,
+			   size_t bsize, int log2size)
+{
+	void *block;
+
+	xnlock_get(&heap->lock);
+
+	/* Always get the block the caller is about to consume. */
+	while (mag->count < XNHEAP_MAG_BATCH &&
+	       (mag->count == 0 || cc->cached + bsize <= heap->cache_limit)) {
+		block = alloc_block(heap, bsize, log2size);
+		if (block == NULL)
+			break;
+		mag->blocks[mag->count++] = block;
+		cc->cached += bsize;
+	}
+
+	xnlock_put(&heap->lock);
+
+	return mag->count;
+}
+
+static void drain_magazine(struct xnheap *heap,
+			   struct xnheap_cpucache *cc,
+			   struct xnheap_magazine *mag,
+			   size_t bsize, int nr)
+{
+	xnlock_get(&heap->lock);
+
+	while (nr-- > 0 && mag->count > 0) {
+		free_block(heap, mag->blocks[--mag->count]);
+		cc->cached -= bsize;
+	}
+
+	xnlock_put(&heap->lock);
+}
+
+static void *cache_alloc(struct xnheap *heap,
+			 size_t bsize, int log2size)
+{
+	struct xnheap_magazine *mag;
+	struct xnheap_cpucache *cc;
+	void *block = NULL;
+	int n;
+	spl_t s;
+
+	splhigh(s);
+
+	cc = raw_cpu_ptr(heap->cpucache);
+	mag = &cc->mags[log2size - XNHEAP_MIN_LOG2];
+	if (mag->count > 0) {
+		cc->hits++;
+		goto out;
+	}
+
+	cc->refills++;
+	if (refill_magazine(heap, cc, mag, bsize, log2size) > 0)
+		goto out;
+
+	/*
+	 * The heap ran out of memory for this size: give back
+	 * whatever our local magazines hold, then retry once.
+	 */
+	for (n = 0; n < XNHEAP_MAX_BUCKETS; n++)
+		drain_magazine(heap, cc, cc->mags + n,
+			       1UL << (n + XNHEAP_MIN_LOG2), XNHEAP_MAG_SIZE);
+
+	if (refill_magazine(heap, cc, mag, bsize, log2size) == 0)
+		goto fail;
+out:
+	block = mag->blocks[--mag->count];
+	cc->cached -= bsize;
+fail:
+	splexit(s);
+
+	return block;
+}
+
+static bool cache_free(struct xnheap *heap, void *block)
+{
+	struct xnheap_magazine *mag;
+	struct xnheap_cpucache *cc;
+	unsigned long pgoff;
+	int log2size, pg;
+	bool ret = true;
+	size_t bsize;
+	spl_t s;
+
+	/*
+	 * Cached blocks are not checked until they are drained, have
+	 * free_block() validate every release when debugging.
+	 */
+	if (XENO_DEBUG(MEMORY))
+		return false;
+
+	/*
+	 * The page entry of a busy block is stable until that block
+	 * is released, so we may peek at it locklessly. Multi-page
+	 * blocks and malformed addresses go through the slow path.
+	 */
+	pgoff = block - heap->membase;
+	pg = pgoff >> XNHEAP_PAGE_SHIFT;
+	if (!page_is_valid(heap, pg) ||
+	    heap->pagemap[pg].type == page_list)
+		return false;
+
+	log2size = heap->pagemap[pg].type;
+	if (pgoff & ((1UL << log2size) - 1))
+		return false;
+
+	bsize = 1UL << log2size;
+
+	splhigh(s);
+
+	cc = raw_cpu_ptr(heap->cpucache);
+	mag = &cc->mags[log2size - XNHEAP_MIN_LOG2];
+	if (mag->count >= XNHEAP_MAG_SIZE ||
+	    cc->cached + bsize > heap->cache_limit) {
+		cc->drains++;
+		drain_magazine(heap, cc, mag, bsize, XNHEAP_MAG_BATCH);
+		/* Other sizes may hold our share, release directly. */
+		if (cc->cached + bsize > heap->cache_limit) {
+			ret = false;
+			goto out;
+		}
+	} else
+		cc->hits++;
+
+	mag->blocks[mag->count++] = block;
+	cc->cached += bsize;
+out:
+	splexit(s);
+
+	return ret;
+}
+
+static int init_cache(struct xnheap *heap, size_t size)
+{
+	heap->cpucache = alloc_percpu(struct xnheap_cpucache);
+	if (heap->cpucache == NULL)
+		return -ENOMEM;
+
+	heap->cache_limit = size / (XNHEAP_MAG_SHARE * num_possible_cpus());
+
+	return 0;
+}
+
+/*
+ * Blocks sitting in the magazines are busy from the heap standpoint,
+ * but still available to requesters: report them as free memory.
+ * Magazines are updated locklessly by their owner CPU, so this is
+ * only exact when the heap is quiescent.
+ */
+size_t xnheap_get_cached(const struct xnheap *heap)
+{
+	struct xnheap_cpucache *cc;
+	size_t cached = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		cc = per_cpu_ptr(heap->cpucache, cpu);
+		cached += cc->cached;
+	}
+
+	return cached;
+}
+EXPORT_SYMBOL_GPL(xnheap_get_cached);
+
+static void destroy_cache(struct xnheap *heap)
+{
+	/* Cached blocks go away along with the heap memory. */
+	free_percpu(heap->cpucache);
+}
+
+#else /* !CONFIG_XENO_OPT_HEAP_MAGAZINES */
+
+static inline void *cache_alloc(struct xnheap *heap,
+				size_t bsize, int log2size)
+{
+	return NULL;
+}
+
+static inline bool cache_free(struct xnheap *heap, void *block)
+{
+	return false;
+}
+
+static inline int init_cache(struct xnheap *heap, size_t size)
+{
+	return 0;
+}
+
+static inline void destroy_cache(struct xnheap *heap) { }
+
+#endif /* !CONFIG_XENO_OPT_HEAP_MAGAZINES */
+
+/**
+ * @fn void *xnheap_alloc(struct xnheap *heap, size_t size)
+ * @brief Allocate a memory block from a memory heap.
+ *
+ * Allocates a contiguous region of memory from an active memory heap.
+ * Such allocation is guaranteed to be time-bounded.
+ *
+ * @param heap The descriptor address of the heap to get memory from.
+ *
+ * @param size The size in bytes of the requested block.
+ *
+ * @return The address of the allocated region upon success, or NULL
+ * if no memory is available from the specified heap.
+ *
+ * @coretags{unrestricted}
+ */
+void *xnheap_alloc(struct xnheap *heap, size_t size)
+{
+	int log2size;
+	size_t bsize;
+	void *block;
+	spl_t s;
+
+	if (size == 0)
+		return NULL;
+
+	if (size < XNHEAP_MIN_ALIGN) {
+		bsize = size = XNHEAP_MIN_ALIGN;
+		log2size = XNHEAP_MIN_LOG2;
+	} else {
+		log2size = ilog2(size);
+		if (log2size < XNHEAP_PAGE_SHIFT) {
+			if (size & (size - 1))
+				log2size++;
+			bsize = 1 << log2size;
+		} else
+			bsize = ALIGN(size, XNHEAP_PAGE_SIZE);
+	}
+
+	if (IS_ENABLED(CONFIG_XENO_OPT_HEAP_MAGAZINES) &&
+	    bsize < XNHEAP_PAGE_SIZE)
+		return cache_alloc(heap, bsize, log2size);
+
+	xnlock_get_irqsave(&heap->lock, s);
+	block = alloc_block(heap, bsize, log2size);
 	xnlock_put_irqrestore(&heap->lock, s);
 
-	return;
-bad:
+	return block;
+}
+EXPORT_SYMBOL_GPL(xnheap_alloc);
+
+/**
+ * @fn void xnheap_free(struct xnheap *heap, void *block)
+ * @brief Release a block to a memory heap.
+ *
+ * Releases a memory block to a heap.
+ *
+ * @param heap The heap descriptor.
+ *
+ * @param block The block to be returned to the heap.
+ *
+ * @coretags{unrestricted}
+ */
+void xnheap_free(struct xnheap *heap, void *block)
+{
+	bool ret;
+	spl_t s;
+
+	if (cache_free(heap, block))
+		return;
+
+	xnlock_get_irqsave(&heap->lock, s);
+	ret = free_block(heap, block);
 	xnlock_put_irqrestore(&heap->lock, s);
 
-	XENO_WARN(MEMORY, 1, "invalid block %p in heap %s",
+	XENO_WARN(MEMORY, !ret, "invalid block %p in heap %s",
 		  block, heap->name);
 }
 EXPORT_SYMBOL_GPL(xnheap_free);
@@ -728,13 +1004,14 @@ EXPORT_SYMBOL_GPL(xnheap_check_block);
  *   XNHEAP_MAX_HEAPSZ, or not aligned on PAGE_SIZE.
  *
  * - -ENOMEM is returned upon failure of allocating the meta-data area
- * used internally to maintain the heap.
+ * used internally to maintain the heap, including the per-CPU block
+ * caches if CONFIG_XENO_OPT_HEAP_MAGAZINES is enabled.
  *
  * @coretags{secondary-only}
  */
 int xnheap_init(struct xnheap *heap, void *membase, size_t size)
 {
-	int n, nrpages;
+	int n, nrpages, ret;
 	spl_t s;
 
 	secondary_mode_only();
@@ -754,6 +1031,12 @@ int xnheap_init(struct xnheap *heap, void *membase, size_t size)
 	if (heap->pagemap == NULL)
 		return -ENOMEM;
 
+	ret = init_cache(heap, size);
+	if (ret) {
+		kfree(heap->pagemap);
+		return ret;
+	}
+
 	heap->membase = membase;
 	heap->usable_size = size;
 	heap->used_size = 0;
@@ -804,6 +1087,7 @@ void xnheap_destroy(struct xnheap *heap)
 	nrheaps--;
 	xnvfile_touch_tag(&vfile_tag);
 	xnlock_put_irqrestore(&nklock, s);
+	destroy_cache(heap);
 	kfree(heap->pagemap);
 }
 EXPORT_SYMBOL_GPL(xnheap_destroy);
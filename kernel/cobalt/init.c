@@ -30,6 +30,8 @@
 #include <cobalt/kernel/pipe.h>
 #include <cobalt/kernel/select.h>
 #include <cobalt/kernel/vdso.h>
+#include <cobalt/kernel/evtrace.h>
+#include <cobalt/kernel/stat.h>
 #include <rtdm/fd.h>
 #include "rtdm/internal.h"
 #include "posix/internal.h"
@@ -382,10 +384,18 @@ static int __init xenomai_init(void)
 	if (ret)
 		goto cleanup_sys;
 
-	ret = cobalt_init();
+	ret = xnevtrace_init();
 	if (ret)
 		goto cleanup_rtdm;
 
+	ret = xnstat_map_init();
+	if (ret)
+		goto cleanup_evtrace;
+
+	ret = cobalt_init();
+	if (ret)
+		goto cleanup_stats;
+
 	rtdm_fd_init();
 
 	printk(XENO_INFO "Cobalt v%s (%s) %s%s%s%s\n",
@@ -398,6 +408,10 @@ static int __init xenomai_init(void)
 
 	return 0;
 
+cleanup_stats:
+	xnstat_map_cleanup();
+cleanup_evtrace:
+	xnevtrace_cleanup();
 cleanup_rtdm:
 	rtdm_cleanup();
 cleanup_sys:
@@ -26,6 +26,7 @@
 #include <cobalt/kernel/stat.h>
 #include <cobalt/kernel/clock.h>
 #include <cobalt/kernel/assert.h>
+#include <cobalt/kernel/evtrace.h>
 #include <trace/events/cobalt-core.h>
 
 /**
@@ -201,6 +202,8 @@ void xnintr_core_clock_handler(void)
 	prev = switch_core_irqstats(sched);
 
 	trace_cobalt_clock_entry(per_cpu(ipipe_percpu.hrtimer_irq, cpu));
+	xnevtrace_log(COBALT_EVTRACE_CLOCK, xnthread_host_pid(sched->curr),
+		      per_cpu(ipipe_percpu.hrtimer_irq, cpu), 0);
 
 	++sched->inesting;
 	sched->lflags |= XNINIRQ;
@@ -308,6 +311,8 @@ static void xnintr_vec_handler(unsigned int irq, void *cookie)
 	prev  = xnstat_exectime_get_current(sched);
 	start = xnstat_exectime_now();
 	trace_cobalt_irq_entry(irq);
+	xnevtrace_log(COBALT_EVTRACE_IRQ, xnthread_host_pid(sched->curr),
+		      irq, 0);
 
 	++sched->inesting;
 	sched->lflags |= XNINIRQ;
@@ -380,6 +385,8 @@ static void xnintr_edge_vec_handler(unsigned int irq, void *cookie)
 	prev  = xnstat_exectime_get_current(sched);
 	start = xnstat_exectime_now();
 	trace_cobalt_irq_entry(irq);
+	xnevtrace_log(COBALT_EVTRACE_IRQ, xnthread_host_pid(sched->curr),
+		      irq, 0);
 
 	++sched->inesting;
 	sched->lflags |= XNINIRQ;
@@ -584,6 +591,8 @@ static void xnintr_irq_handler(unsigned int irq, void *cookie)
 	prev  = xnstat_exectime_get_current(sched);
 	start = xnstat_exectime_now();
 	trace_cobalt_irq_entry(irq);
+	xnevtrace_log(COBALT_EVTRACE_IRQ, xnthread_host_pid(sched->curr),
+		      irq, 0);
 
 	++sched->inesting;
 	sched->lflags |= XNINIRQ;
@@ -26,6 +26,7 @@
 #include <linux/termios.h>
 #include <linux/spinlock.h>
 #include <linux/device.h>
+#include <linux/eventfd.h>
 #include <asm/io.h>
 #include <asm/uaccess.h>
 #include <cobalt/kernel/sched.h>
@@ -46,6 +47,10 @@ static LIST_HEAD(xnpipe_sleepq);
 
 static LIST_HEAD(xnpipe_asyncq);
 
+static LIST_HEAD(xnpipe_efdq);
+
+static DEFINE_SPINLOCK(xnpipe_efd_lock);
+
 int xnpipe_wakeup_apc;
 
 static struct class *xnpipe_class;
@@ -200,7 +205,7 @@ check_async:
 	 */
 	for (;;) {
 		if (list_empty(&xnpipe_asyncq))
-			goto out;
+			goto check_eventfd;
 
 		state = list_first_entry(&xnpipe_asyncq, struct xnpipe_state, alink);
 
@@ -208,7 +213,7 @@ check_async:
 			if (state->status & XNPIPE_USER_SIGIO)
 				break;
 			if (list_is_last(&state->alink, &xnpipe_asyncq))
-				goto out;
+				goto check_eventfd;
 			state = list_next_entry(state, alink);
 		}
 
@@ -217,6 +222,34 @@ check_async:
 		kill_fasync(&state->asyncq, xnpipe_asyncsig, POLL_IN);
 		xnlock_get_irqsave(&nklock, s);
 	}
+
+check_eventfd:
+	/*
+	 * Scan the eventfd queue, signaling the event counters
+	 * attached to the pipes which received input.
+	 */
+	for (;;) {
+		if (list_empty(&xnpipe_efdq))
+			goto out;
+
+		state = list_first_entry(&xnpipe_efdq, struct xnpipe_state, elink);
+
+		for (;;) {
+			if (state->status & XNPIPE_USER_EVENTFD)
+				break;
+			if (list_is_last(&state->elink, &xnpipe_efdq))
+				goto out;
+			state = list_next_entry(state, elink);
+		}
+
+		state->status &= ~XNPIPE_USER_EVENTFD;
+		xnlock_put_irqrestore(&nklock, s);
+		spin_lock(&xnpipe_efd_lock);
+		if (state->efd)
+			eventfd_signal(state->efd, 1);
+		spin_unlock(&xnpipe_efd_lock);
+		xnlock_get_irqsave(&nklock, s);
+	}
 out:
 	xnlock_put_irqrestore(&nklock, s);
 }
@@ -409,6 +442,11 @@ int xnpipe_disconnect(int minor)
 		need_sched = 1;
 	}
 
+	if (state->efd) {	/* Schedule eventfd signal. */
+		state->status |= XNPIPE_USER_EVENTFD;
+		need_sched = 1;
+	}
+
 cleanup:
 	/*
 	 * If xnpipe_release() has not fully run, enter lingering
@@ -484,6 +522,11 @@ ssize_t xnpipe_send(int minor, struct xnpipe_mh *mh, size_t size, int flags)
 		need_sched = 1;
 	}
 
+	if (state->efd) {	/* Schedule eventfd signal. */
+		state->status |= XNPIPE_USER_EVENTFD;
+		need_sched = 1;
+	}
+
 	if (need_sched)
 		xnpipe_schedule_request();
 
@@ -493,6 +536,56 @@ ssize_t xnpipe_send(int minor, struct xnpipe_mh *mh, size_t size, int flags)
 }
 EXPORT_SYMBOL_GPL(xnpipe_send);
 
+/*
+ * Wake up the user-space endpoint as if some message was sent,
+ * without queuing any. This is used by callers conveying data to
+ * user-space by other means, e.g. through shared memory.
+ */
+int xnpipe_kick(int minor)
+{
+	struct xnpipe_state *state;
+	int need_sched = 0;
+	spl_t s;
+
+	if (minor < 0 || minor >= XNPIPE_NDEVS)
+		return -ENODEV;
+
+	state = &xnpipe_states[minor];
+
+	xnlock_get_irqsave(&nklock, s);
+
+	if ((state->status & XNPIPE_KERN_CONN) == 0) {
+		xnlock_put_irqrestore(&nklock, s);
+		return -EBADF;
+	}
+
+	if ((state->status & XNPIPE_USER_CONN) == 0)
+		goto out;
+
+	if (state->status & XNPIPE_USER_WREAD) {
+		state->status |= XNPIPE_USER_WREAD_READY;
+		need_sched = 1;
+	}
+
+	if (state->asyncq) {
+		state->status |= XNPIPE_USER_SIGIO;
+		need_sched = 1;
+	}
+
+	if (state->efd) {
+		state->status |= XNPIPE_USER_EVENTFD;
+		need_sched = 1;
+	}
+
+	if (need_sched)
+		xnpipe_schedule_request();
+out:
+	xnlock_put_irqrestore(&nklock, s);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xnpipe_kick);
+
 ssize_t xnpipe_mfixup(int minor, struct xnpipe_mh *mh, ssize_t size)
 {
 	struct xnpipe_state *state;
@@ -677,6 +770,34 @@ EXPORT_SYMBOL_GPL(xnpipe_pollstate);
 		}							\
 	} while(0)
 
+static void xnpipe_set_eventfd(struct xnpipe_state *state,
+			       struct eventfd_ctx *efd)
+{
+	struct eventfd_ctx *oefd;
+	unsigned long flags;
+	spl_t s;
+
+	/*
+	 * xnpipe_efd_lock serializes with the wakeup APC, which
+	 * signals the event counter without holding the nklock.
+	 */
+	spin_lock_irqsave(&xnpipe_efd_lock, flags);
+	xnlock_get_irqsave(&nklock, s);
+	oefd = state->efd;
+	state->efd = efd;
+	if (efd && oefd == NULL)
+		list_add_tail(&state->elink, &xnpipe_efdq);
+	else if (efd == NULL && oefd) {
+		list_del(&state->elink);
+		state->status &= ~XNPIPE_USER_EVENTFD;
+	}
+	xnlock_put_irqrestore(&nklock, s);
+	spin_unlock_irqrestore(&xnpipe_efd_lock, flags);
+
+	if (oefd)
+		eventfd_ctx_put(oefd);
+}
+
 /*
  * Open the pipe from user-space.
  */
@@ -773,6 +894,12 @@ static int xnpipe_release(struct inode *inode, struct file *file)
 		xnlock_get_irqsave(&nklock, s);
 	}
 
+	if (state->efd) {	/* Drop the event counter */
+		xnlock_put_irqrestore(&nklock, s);
+		xnpipe_set_eventfd(state, NULL);
+		xnlock_get_irqsave(&nklock, s);
+	}
+
 	xnpipe_cleanup_user_conn(state, s);
 	/*
 	 * The extra state may not be available from now on, if
@@ -973,6 +1100,7 @@ retry:
 static long xnpipe_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct xnpipe_state *state = file->private_data;
+	struct eventfd_ctx *efd;
 	int ret = 0;
 	ssize_t n;
 	spl_t s;
@@ -1028,6 +1156,19 @@ static long xnpipe_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		xnpipe_asyncsig = arg;
 		break;
 
+	case XNPIPEIOC_SETEVENTFD:
+
+		/* A negative descriptor detaches the event counter. */
+		efd = NULL;
+		if ((int)arg >= 0) {
+			efd = eventfd_ctx_fdget((int)arg);
+			if (IS_ERR(efd))
+				return PTR_ERR(efd);
+		}
+
+		xnpipe_set_eventfd(state, efd);
+		break;
+
 	case FIONREAD:
 
 		n = (state->status & XNPIPE_KERN_CONN) ? state->ionrd : 0;
@@ -1088,7 +1229,9 @@ static unsigned xnpipe_poll(struct file *file, poll_table *pt)
 	else
 		r_mask |= POLLHUP;
 
-	if (!list_empty(&state->outq))
+	if (!list_empty(&state->outq) ||
+	    ((state->status & XNPIPE_KERN_CONN) && state->ops.pending &&
+	     state->ops.pending(state->xstate)))
 		r_mask |= (POLLIN | POLLRDNORM);
 	else
 		/*
@@ -1104,10 +1247,40 @@ static unsigned xnpipe_poll(struct file *file, poll_table *pt)
 	return r_mask | w_mask;
 }
 
+static int xnpipe_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct xnpipe_state *state = file->private_data;
+	int (*mmap)(struct vm_area_struct *vma, void *xstate);
+	void *xstate;
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	if ((state->status & XNPIPE_KERN_CONN) == 0) {
+		xnlock_put_irqrestore(&nklock, s);
+		return -EPIPE;
+	}
+
+	/*
+	 * The extra state lingers until we release the file, which
+	 * the mapping holds a reference on.
+	 */
+	mmap = state->ops.mmap;
+	xstate = state->xstate;
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	if (mmap == NULL)
+		return -ENODEV;
+
+	return mmap(vma, xstate);
+}
+
 static struct file_operations xnpipe_fops = {
 	.read = xnpipe_read,
 	.write = xnpipe_write,
 	.poll = xnpipe_poll,
+	.mmap = xnpipe_mmap,
 	.unlocked_ioctl = xnpipe_ioctl,
 	.open = xnpipe_open,
 	.release = xnpipe_release,
@@ -1124,6 +1297,7 @@ int xnpipe_mount(void)
 	     state < &xnpipe_states[XNPIPE_NDEVS]; state++) {
 		state->status = 0;
 		state->asyncq = NULL;
+		state->efd = NULL;
 		INIT_LIST_HEAD(&state->inq);
 		state->nrinq = 0;
 		INIT_LIST_HEAD(&state->outq);
@@ -204,6 +204,14 @@ int sys32_get_param_ex(int policy,
 	case SCHED_QUOTA:
 		p->sched_quota_group = cpex.sched_quota_group;
 		break;
+	case SCHED_EDF:
+		p->sched_edf_runtime.tv_sec = cpex.sched_edf_runtime.tv_sec;
+		p->sched_edf_runtime.tv_nsec = cpex.sched_edf_runtime.tv_nsec;
+		p->sched_edf_deadline.tv_sec = cpex.sched_edf_deadline.tv_sec;
+		p->sched_edf_deadline.tv_nsec = cpex.sched_edf_deadline.tv_nsec;
+		p->sched_edf_period.tv_sec = cpex.sched_edf_period.tv_sec;
+		p->sched_edf_period.tv_nsec = cpex.sched_edf_period.tv_nsec;
+		break;
 	}
 
 	return 0;
@@ -240,6 +248,14 @@ int sys32_put_param_ex(int policy,
 	case SCHED_QUOTA:
 		cpex.sched_quota_group = p->sched_quota_group;
 		break;
+	case SCHED_EDF:
+		cpex.sched_edf_runtime.tv_sec = p->sched_edf_runtime.tv_sec;
+		cpex.sched_edf_runtime.tv_nsec = p->sched_edf_runtime.tv_nsec;
+		cpex.sched_edf_deadline.tv_sec = p->sched_edf_deadline.tv_sec;
+		cpex.sched_edf_deadline.tv_nsec = p->sched_edf_deadline.tv_nsec;
+		cpex.sched_edf_period.tv_sec = p->sched_edf_period.tv_sec;
+		cpex.sched_edf_period.tv_nsec = p->sched_edf_period.tv_nsec;
+		break;
 	}
 
 	return cobalt_copy_to_user(u_cp, &cpex, sizeof(cpex));
@@ -59,6 +59,8 @@ static int do_conf_option(int option, void __user *u_buf, size_t u_bufsz)
 			val |= _CC_COBALT_SCHED_QUOTA;
 		if (IS_ENABLED(CONFIG_XENO_OPT_SCHED_TP))
 			val |= _CC_COBALT_SCHED_TP;
+		if (IS_ENABLED(CONFIG_XENO_OPT_SCHED_EDF))
+			val |= _CC_COBALT_SCHED_EDF;
 		break;
 	case _CC_COBALT_GET_DEBUG:
 		if (IS_ENABLED(CONFIG_XENO_OPT_DEBUG_COBALT))
@@ -0,0 +1,275 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/err.h>
+#include <linux/fcntl.h>
+#include <linux/log2.h>
+#include <cobalt/kernel/compat.h>
+#include <rtdm/fd.h>
+#include "internal.h"
+#include "process.h"
+#include "memory.h"
+#include "ioring.h"
+
+/*
+ * Submission/completion rings for batching RTDM I/O requests. The
+ * ring state is allocated from the private heap of the caller, which
+ * is shared with user-space, so that submissions can be queued and
+ * completions reaped without entering the kernel. A single
+ * ioring_enter() call from primary mode then runs all pending
+ * submissions in order.
+ *
+ * Like the regular I/O syscalls, a request the driver can only
+ * serve from secondary mode fails with -ENOSYS in primary mode. We
+ * stop there and return -ENOSYS, so that the syscall layer restarts
+ * ioring_enter() in secondary mode, which then runs that request
+ * only. The caller submits the remaining requests again, from
+ * primary mode.
+ */
+struct cobalt_ioring {
+	struct rtdm_fd fd;
+	struct cobalt_umm *umm;
+	struct cobalt_ioring_state *state;
+	struct cobalt_ioring_sqe *sq;
+	struct cobalt_ioring_cqe *cq;
+	unsigned int sq_mask;
+	unsigned int cq_mask;
+	unsigned int sq_head;
+	unsigned int cq_tail;
+	/* Restart pending from secondary mode, after @done requests. */
+	bool deferred;
+	unsigned int done;
+};
+
+static void ioring_close(struct rtdm_fd *fd)
+{
+	struct cobalt_ioring *ring = container_of(fd, struct cobalt_ioring, fd);
+
+	cobalt_umm_free(ring->umm, ring->state);
+	cobalt_umm_destroy(ring->umm);
+	xnfree(ring);
+}
+
+static struct rtdm_fd_ops ioring_ops = {
+	.close = ioring_close,
+};
+
+COBALT_SYSCALL(ioring_create, lostage,
+	       (unsigned int entries, int flags, __u32 __user *u_offset))
+{
+	struct cobalt_ioring_state *state;
+	struct cobalt_ioring *ring;
+	struct cobalt_umm *umm;
+	size_t sq_size, cq_size;
+	__u32 offset;
+	int ret, ufd;
+
+	if (flags & ~O_CLOEXEC)
+		return -EINVAL;
+
+	if (entries == 0 || entries > COBALT_IORING_MAX_ENTRIES)
+		return -EINVAL;
+
+	entries = roundup_pow_of_two(entries);
+	sq_size = entries * sizeof(struct cobalt_ioring_sqe);
+	cq_size = entries * 2 * sizeof(struct cobalt_ioring_cqe);
+
+	ring = xnmalloc(sizeof(*ring));
+	if (ring == NULL)
+		return -ENOMEM;
+
+	umm = &cobalt_ppd_get(0)->umm;
+	state = cobalt_umm_zalloc(umm, sizeof(*state) + sq_size + cq_size);
+	if (state == NULL) {
+		ret = -EAGAIN;
+		goto fail_state;
+	}
+
+	state->sq_entries = entries;
+	state->cq_entries = entries * 2;
+	state->sq_offset = sizeof(*state);
+	state->cq_offset = sizeof(*state) + sq_size;
+	ring->state = state;
+	ring->sq = (void *)state + state->sq_offset;
+	ring->cq = (void *)state + state->cq_offset;
+	ring->sq_mask = state->sq_entries - 1;
+	ring->cq_mask = state->cq_entries - 1;
+	ring->sq_head = 0;
+	ring->cq_tail = 0;
+	ring->deferred = false;
+	ring->done = 0;
+	/* The heap must survive the ring, which may be closed late. */
+	ring->umm = umm;
+	atomic_inc(&umm->refcount);
+
+	offset = cobalt_umm_offset(umm, state);
+	if (cobalt_copy_to_user(u_offset, &offset, sizeof(offset))) {
+		ret = -EFAULT;
+		goto fail_copy;
+	}
+
+	ufd = __rtdm_anon_getfd("[cobalt-ioring]", O_RDWR | flags);
+	if (ufd < 0) {
+		ret = ufd;
+		goto fail_copy;
+	}
+
+	ret = rtdm_fd_enter(&ring->fd, ufd, COBALT_IORING_MAGIC, &ioring_ops);
+	if (ret < 0)
+		goto fail;
+
+	ret = rtdm_fd_register(&ring->fd, ufd);
+	if (ret < 0)
+		goto fail;
+
+	return ufd;
+fail:
+	__rtdm_anon_putfd(ufd);
+fail_copy:
+	cobalt_umm_free(umm, state);
+	cobalt_umm_destroy(umm);
+fail_state:
+	xnfree(ring);
+
+	return ret;
+}
+
+static int get_msghdr(struct cobalt_ioring *ring, struct user_msghdr *m,
+		      void __user *u_msg)
+{
+#ifdef CONFIG_XENO_ARCH_SYS3264
+	if (rtdm_fd_is_compat(&ring->fd))
+		return sys32_get_msghdr(m, u_msg);
+#endif
+	return cobalt_copy_from_user(m, u_msg, sizeof(*m));
+}
+
+static int put_msghdr(struct cobalt_ioring *ring, void __user *u_msg,
+		      const struct user_msghdr *m)
+{
+#ifdef CONFIG_XENO_ARCH_SYS3264
+	if (rtdm_fd_is_compat(&ring->fd))
+		return sys32_put_msghdr(u_msg, m);
+#endif
+	return cobalt_copy_to_user(u_msg, m, sizeof(*m));
+}
+
+static int ioring_exec(struct cobalt_ioring *ring,
+		       const struct cobalt_ioring_sqe *sqe)
+{
+	void __user *u_addr = (void __user *)(unsigned long)sqe->addr;
+	struct user_msghdr m;
+	ssize_t ret;
+
+	switch (sqe->opcode) {
+	case COBALT_IORING_OP_NOP:
+		return 0;
+	case COBALT_IORING_OP_READ:
+		return rtdm_fd_read(sqe->fd, u_addr, sqe->len);
+	case COBALT_IORING_OP_WRITE:
+		return rtdm_fd_write(sqe->fd, u_addr, sqe->len);
+	case COBALT_IORING_OP_IOCTL:
+		return rtdm_fd_ioctl(sqe->fd, sqe->len, u_addr);
+	case COBALT_IORING_OP_RECVMSG:
+		ret = get_msghdr(ring, &m, u_addr);
+		if (ret)
+			return ret;
+		ret = rtdm_fd_recvmsg(sqe->fd, &m, sqe->len);
+		if (ret < 0)
+			return ret;
+		return put_msghdr(ring, u_addr, &m) ?: ret;
+	case COBALT_IORING_OP_SENDMSG:
+		ret = get_msghdr(ring, &m, u_addr);
+		return ret ?: rtdm_fd_sendmsg(sqe->fd, &m, sqe->len);
+	default:
+		return -EINVAL;
+	}
+}
+
+int __cobalt_ioring_enter(int ufd, unsigned int to_submit)
+{
+	struct cobalt_ioring_state *state;
+	struct cobalt_ioring_sqe sqe;
+	unsigned int sq_head, cq_tail, done = 0, n;
+	struct cobalt_ioring *ring;
+	bool resume = false;
+	struct rtdm_fd *fd;
+	int res, ret;
+
+	fd = rtdm_fd_get(ufd, COBALT_IORING_MAGIC);
+	if (IS_ERR(fd))
+		return PTR_ERR(fd);
+
+	ring = container_of(fd, struct cobalt_ioring, fd);
+	state = ring->state;
+
+	if (ring->deferred) {
+		/* Restarted in secondary mode, run the deferred request. */
+		ring->deferred = false;
+		resume = true;
+		done = ring->done;
+		to_submit = 1;
+	}
+
+	/*
+	 * The shared indexes may be scribbled over by the
+	 * application, only trust our private copy of the consumer
+	 * side, and bound the amount of work to the ring size.
+	 */
+	sq_head = ring->sq_head;
+	cq_tail = ring->cq_tail;
+	n = ACCESS_ONCE(state->sq_tail) - sq_head;
+	if (n > ring->sq_mask + 1)
+		n = ring->sq_mask + 1;
+	if (to_submit > n)
+		to_submit = n;
+	smp_rmb();
+
+	for (n = 0; n < to_submit; n++) {
+		/* Stop when the application lags behind on completions. */
+		if (cq_tail - ACCESS_ONCE(state->cq_head) > ring->cq_mask)
+			break;
+
+		sqe = ring->sq[sq_head & ring->sq_mask];
+		res = ioring_exec(ring, &sqe);
+		if (res == -ENOSYS && !resume && !xnsched_root_p()) {
+			ring->deferred = true;
+			ring->done = n;
+			break;
+		}
+
+		ring->cq[cq_tail & ring->cq_mask].user_data = sqe.user_data;
+		ring->cq[cq_tail & ring->cq_mask].res = res;
+		sq_head++;
+		cq_tail++;
+		smp_wmb();
+		state->sq_head = sq_head;
+		state->cq_tail = cq_tail;
+	}
+
+	ring->sq_head = sq_head;
+	ring->cq_tail = cq_tail;
+	ret = ring->deferred ? -ENOSYS : done + n;
+
+	rtdm_fd_put(fd);
+
+	return ret;
+}
+
+COBALT_SYSCALL(ioring_enter, probing,
+	       (int ufd, unsigned int to_submit))
+{
+	return __cobalt_ioring_enter(ufd, to_submit);
+}
@@ -0,0 +1,30 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef _COBALT_POSIX_IORING_H
+#define _COBALT_POSIX_IORING_H
+
+#include <cobalt/uapi/ioring.h>
+#include <xenomai/posix/syscall.h>
+
+int __cobalt_ioring_enter(int ufd, unsigned int to_submit);
+
+COBALT_SYSCALL_DECL(ioring_create,
+		    (unsigned int entries, int flags, __u32 __user *u_offset));
+
+COBALT_SYSCALL_DECL(ioring_enter,
+		    (int ufd, unsigned int to_submit));
+
+#endif /* !_COBALT_POSIX_IORING_H */
@@ -21,7 +21,7 @@
 #include <linux/mm.h>
 #include <linux/sched.h>
 #include <cobalt/kernel/select.h>
-#include <rtdm/fd.h>
+#include <rtdm/driver.h>
 #include "internal.h"
 #include "thread.h"
 #include "signal.h"
@@ -43,10 +43,16 @@ struct cobalt_mq {
 	struct xnsynch senders;
 	size_t memsize;
 	char *mem;
+	unsigned int msgsize;
 	struct list_head queued;
 	struct list_head avail;
 	int nrqueued;
 
+	/* Zero-copy mode: user-mappable payload pool. */
+	char *pool;
+	size_t poolsize;
+	size_t slotsize;
+
 	/* mq_notify */
 	struct siginfo si;
 	mqd_t target_qd;
@@ -64,13 +70,21 @@ struct cobalt_mq {
 
 struct cobalt_mqd {
 	struct cobalt_mq *mq;
+	struct list_head held;
 	struct rtdm_fd fd;
 };
 
+#define MQ_SLOT_RESERVED  1
+#define MQ_SLOT_CONSUMED  2
+
 struct cobalt_msg {
 	struct list_head link;
 	unsigned int prio;
 	size_t len;
+	/* Zero-copy mode. */
+	unsigned int slot;
+	int state;
+	struct cobalt_mqd *holder;
 	char data[0];
 };
 
@@ -99,10 +113,25 @@ static inline void mq_msg_free(struct cobalt_mq *mq, struct cobalt_msg * msg)
 	list_add(&msg->link, &mq->avail); /* For earliest re-use of the block. */
 }
 
+static inline char *mq_msg_data(struct cobalt_mq *mq, struct cobalt_msg *msg)
+{
+	if (mq->pool)
+		return mq->pool + msg->slot * mq->slotsize;
+
+	return msg->data;
+}
+
+static inline struct cobalt_msg *mq_slot_msg(struct cobalt_mq *mq,
+					     unsigned int slot)
+{
+	return (struct cobalt_msg *)(mq->mem + slot * mq->msgsize);
+}
+
 static inline int mq_init(struct cobalt_mq *mq, const struct mq_attr *attr)
 {
 	unsigned i, msgsize, memsize;
-	char *mem;
+	size_t slotsize = 0, poolsize = 0;
+	char *mem, *pool = NULL;
 
 	if (attr == NULL)
 		attr = &default_attr;
@@ -115,7 +144,21 @@ static inline int mq_init(struct cobalt_mq *mq, const struct mq_attr *attr)
 			return -EINVAL;
 	}
 
-	msgsize = attr->mq_msgsize + sizeof(struct cobalt_msg);
+	/*
+	 * In zero-copy mode, payloads go to a separate pool which is
+	 * mapped to user-space, the message blocks only hold the
+	 * bookkeeping data.
+	 */
+	msgsize = sizeof(struct cobalt_msg);
+	if (attr->mq_flags & COBALT_MQ_ZEROCOPY) {
+		slotsize = cobalt_mq_slot_size(attr->mq_msgsize);
+		if (attr->mq_maxmsg > SIZE_MAX / slotsize)
+			return -ENOSPC;
+		poolsize = PAGE_ALIGN(slotsize * attr->mq_maxmsg);
+		if (get_order(poolsize) > MAX_ORDER)
+			return -ENOSPC;
+	} else
+		msgsize += attr->mq_msgsize;
 
 	/* Align msgsize on natural boundary. */
 	if ((msgsize % sizeof(unsigned long)))
@@ -131,7 +174,21 @@ static inline int mq_init(struct cobalt_mq *mq, const struct mq_attr *attr)
 	if (mem == NULL)
 		return -ENOSPC;
 
+	if (poolsize) {
+		pool = xnheap_vmalloc(poolsize);
+		if (pool == NULL) {
+			xnheap_vfree(mem);
+			return -ENOSPC;
+		}
+		/* Do not leak stale kernel data to user-space. */
+		memset(pool, 0, poolsize);
+	}
+
 	mq->memsize = memsize;
+	mq->msgsize = msgsize;
+	mq->pool = pool;
+	mq->poolsize = poolsize;
+	mq->slotsize = slotsize;
 	INIT_LIST_HEAD(&mq->queued);
 	mq->nrqueued = 0;
 	xnsynch_init(&mq->receivers, XNSYNCH_PRIO, NULL);
@@ -142,10 +199,13 @@ static inline int mq_init(struct cobalt_mq *mq, const struct mq_attr *attr)
 	INIT_LIST_HEAD(&mq->avail);
 	for (i = 0; i < attr->mq_maxmsg; i++) {
 		struct cobalt_msg *msg = (struct cobalt_msg *) (mem + i * msgsize);
+		msg->slot = i;
+		msg->holder = NULL;
 		mq_msg_free(mq, msg);
 	}
 
 	mq->attr = *attr;
+	mq->attr.mq_flags &= COBALT_MQ_ZEROCOPY;
 	mq->target = NULL;
 	xnselect_init(&mq->read_select);
 	xnselect_init(&mq->write_select);
@@ -169,6 +229,8 @@ static inline void mq_destroy(struct cobalt_mq *mq)
 	xnselect_destroy(&mq->write_select);
 	xnregistry_remove(mq->handle);
 	xnheap_vfree(mq->mem);
+	if (mq->pool)
+		xnheap_vfree(mq->pool);
 	kfree(mq);
 
 	if (resched)
@@ -196,10 +258,57 @@ static int mq_unref(struct cobalt_mq *mq)
 	return mq_unref_inner(mq, s);
 }
 
+static void mq_release_msg(struct cobalt_mq *mq, struct cobalt_msg *msg);
+
+static inline void mq_hold_msg(struct cobalt_mqd *mqd,
+			       struct cobalt_msg *msg, int state)
+{
+	msg->state = state;
+	msg->holder = mqd;
+	list_add_tail(&msg->link, &mqd->held);
+}
+
+static inline void mq_unhold_msg(struct cobalt_msg *msg)
+{
+	list_del(&msg->link);
+	msg->holder = NULL;
+}
+
+static struct cobalt_msg *
+mq_held_msg(struct cobalt_mqd *mqd, unsigned int slot, int state)
+{
+	struct cobalt_mq *mq = mqd->mq;
+	struct cobalt_msg *msg;
+
+	if (slot >= mq->attr.mq_maxmsg)
+		return NULL;
+
+	msg = mq_slot_msg(mq, slot);
+	if (msg->holder != mqd || (state && msg->state != state))
+		return NULL;
+
+	return msg;
+}
+
 static void mqd_close(struct rtdm_fd *fd)
 {
 	struct cobalt_mqd *mqd = container_of(fd, struct cobalt_mqd, fd);
 	struct cobalt_mq *mq = mqd->mq;
+	struct cobalt_msg *msg;
+	spl_t s;
+
+	/* Give back the slots reserved or consumed via this descriptor. */
+	if (!list_empty(&mqd->held)) {
+		xnlock_get_irqsave(&nklock, s);
+		while (!list_empty(&mqd->held)) {
+			msg = list_first_entry(&mqd->held,
+					       struct cobalt_msg, link);
+			mq_unhold_msg(msg);
+			mq_release_msg(mq, msg);
+		}
+		xnsched_run();
+		xnlock_put_irqrestore(&nklock, s);
+	}
 
 	kfree(mqd);
 	mq_unref(mq);
@@ -259,9 +368,65 @@ mqd_select(struct rtdm_fd *fd, struct xnselector *selector,
 	return err;
 }
 
+static void mq_vmopen(struct vm_area_struct *vma)
+{
+	struct cobalt_mq *mq = vma->vm_private_data;
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+	++mq->refs;
+	xnlock_put_irqrestore(&nklock, s);
+}
+
+static void mq_vmclose(struct vm_area_struct *vma)
+{
+	struct cobalt_mq *mq = vma->vm_private_data;
+
+	mq_unref(mq);
+}
+
+static struct vm_operations_struct mq_vmops = {
+	.open = mq_vmopen,
+	.close = mq_vmclose,
+};
+
+static int mqd_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+	struct cobalt_mqd *mqd = container_of(fd, struct cobalt_mqd, fd);
+	struct cobalt_mq *mq = mqd->mq;
+	size_t len;
+	int ret;
+
+	if (mq->pool == NULL)
+		return -ENODEV;
+
+	len = vma->vm_end - vma->vm_start;
+	if (vma->vm_pgoff != 0 || len != mq->poolsize)
+		return -EINVAL;
+
+	if ((vma->vm_flags & VM_WRITE) &&
+	    (rtdm_fd_flags(fd) & COBALT_PERMS_MASK) == O_RDONLY)
+		return -EACCES;
+
+	if (xnarch_cache_aliasing())
+		vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+
+	ret = rtdm_mmap_vmem(vma, mq->pool);
+	if (ret)
+		return ret;
+
+	/* The mapping keeps the queue alive until it goes away. */
+	vma->vm_private_data = mq;
+	vma->vm_ops = &mq_vmops;
+	mq_vmopen(vma);
+
+	return 0;
+}
+
 static struct rtdm_fd_ops mqd_ops = {
 	.close = mqd_close,
 	.select = mqd_select,
+	.mmap = mqd_mmap,
 };
 
 static inline int mqd_create(struct cobalt_mq *mq, unsigned long flags, int ufd)
@@ -278,6 +443,7 @@ static inline int mqd_create(struct cobalt_mq *mq, unsigned long flags, int ufd)
 
 	mqd->fd.oflags = flags;
 	mqd->mq = mq;
+	INIT_LIST_HEAD(&mqd->held);
 
 	ret = rtdm_fd_enter(&mqd->fd, ufd, COBALT_MQD_MAGIC, &mqd_ops);
 	if (ret < 0)
@@ -673,7 +839,8 @@ static inline int mq_getattr(struct cobalt_mqd *mqd, struct mq_attr *attr)
 	mq = mqd->mq;
 	*attr = mq->attr;
 	xnlock_get_irqsave(&nklock, s);
-	attr->mq_flags = rtdm_fd_flags(&mqd->fd);
+	attr->mq_flags = rtdm_fd_flags(&mqd->fd) |
+		(mq->attr.mq_flags & COBALT_MQ_ZEROCOPY);
 	attr->mq_curmsgs = mq->nrqueued;
 	xnlock_put_irqrestore(&nklock, s);
 
@@ -919,7 +1086,7 @@ int __cobalt_mq_timedsend(mqd_t uqd, const void __user *u_buf, size_t len,
 		goto out;
 	}
 
-	ret = cobalt_copy_from_user(msg->data, u_buf, len);
+	ret = cobalt_copy_from_user(mq_msg_data(mqd->mq, msg), u_buf, len);
 	if (ret) {
 		mq_finish_rcv(mqd, msg);
 		goto out;
@@ -968,7 +1135,7 @@ int __cobalt_mq_timedreceive(mqd_t uqd, void __user *u_buf,
 		goto fail;
 	}
 
-	ret = cobalt_copy_to_user(u_buf, msg->data, msg->len);
+	ret = cobalt_copy_to_user(u_buf, mq_msg_data(mqd->mq, msg), msg->len);
 	if (ret) {
 		mq_finish_rcv(mqd, msg);
 		goto fail;
@@ -1010,3 +1177,197 @@ COBALT_SYSCALL(mq_timedreceive, primary,
 
 	return ret ?: cobalt_copy_to_user(u_len, &len, sizeof(*u_len));
 }
+
+static inline struct cobalt_mqd *cobalt_mqd_get_zc(mqd_t uqd)
+{
+	struct cobalt_mqd *mqd;
+
+	mqd = cobalt_mqd_get(uqd);
+	if (IS_ERR(mqd))
+		return mqd;
+
+	if (mqd->mq->pool == NULL) {
+		cobalt_mqd_put(mqd);
+		return ERR_PTR(-EINVAL);
+	}
+
+	return mqd;
+}
+
+int __cobalt_mq_reserve(mqd_t uqd, __u32 __user *u_slot,
+			const void __user *u_ts,
+			int (*fetch_timeout)(struct timespec *ts,
+					     const void __user *u_ts))
+{
+	struct cobalt_mqd *mqd;
+	struct cobalt_msg *msg;
+	__u32 slot;
+	int ret;
+	spl_t s;
+
+	mqd = cobalt_mqd_get_zc(uqd);
+	if (IS_ERR(mqd))
+		return PTR_ERR(mqd);
+
+	msg = mq_timedsend_inner(mqd, 0, u_ts, fetch_timeout);
+	if (IS_ERR(msg)) {
+		ret = PTR_ERR(msg);
+		goto out;
+	}
+
+	xnlock_get_irqsave(&nklock, s);
+	mq_hold_msg(mqd, msg, MQ_SLOT_RESERVED);
+	xnlock_put_irqrestore(&nklock, s);
+
+	slot = msg->slot;
+	ret = cobalt_copy_to_user(u_slot, &slot, sizeof(slot));
+	if (ret) {
+		xnlock_get_irqsave(&nklock, s);
+		mq_unhold_msg(msg);
+		mq_release_msg(mqd->mq, msg);
+		xnsched_run();
+		xnlock_put_irqrestore(&nklock, s);
+	}
+out:
+	cobalt_mqd_put(mqd);
+
+	return ret;
+}
+
+COBALT_SYSCALL(mq_reserve, primary,
+	       (mqd_t uqd, __u32 __user *u_slot,
+		const struct timespec __user *u_ts))
+{
+	return __cobalt_mq_reserve(uqd, u_slot,
+				   u_ts, u_ts ? mq_fetch_timeout : NULL);
+}
+
+COBALT_SYSCALL(mq_commit, primary,
+	       (mqd_t uqd, __u32 slot, __u32 len, unsigned int prio))
+{
+	struct cobalt_mqd *mqd;
+	struct cobalt_msg *msg;
+	int ret;
+	spl_t s;
+
+	mqd = cobalt_mqd_get_zc(uqd);
+	if (IS_ERR(mqd))
+		return PTR_ERR(mqd);
+
+	if (prio >= COBALT_MSGPRIOMAX) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (len > mqd->mq->attr.mq_msgsize) {
+		ret = -EMSGSIZE;
+		goto out;
+	}
+
+	xnlock_get_irqsave(&nklock, s);
+	msg = mq_held_msg(mqd, slot, MQ_SLOT_RESERVED);
+	if (msg)
+		mq_unhold_msg(msg);
+	xnlock_put_irqrestore(&nklock, s);
+	if (msg == NULL) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	msg->len = len;
+	msg->prio = prio;
+	ret = mq_finish_send(mqd, msg);
+out:
+	cobalt_mqd_put(mqd);
+
+	return ret;
+}
+
+int __cobalt_mq_consume(mqd_t uqd, __u32 __user *u_slot,
+			__u32 __user *u_len, unsigned int __user *u_prio,
+			const void __user *u_ts,
+			int (*fetch_timeout)(struct timespec *ts,
+					     const void __user *u_ts))
+{
+	struct cobalt_mqd *mqd;
+	struct cobalt_msg *msg;
+	__u32 slot, len;
+	unsigned int prio;
+	int ret;
+	spl_t s;
+
+	mqd = cobalt_mqd_get_zc(uqd);
+	if (IS_ERR(mqd))
+		return PTR_ERR(mqd);
+
+	msg = mq_timedrcv_inner(mqd, mqd->mq->attr.mq_msgsize,
+				u_ts, fetch_timeout);
+	if (IS_ERR(msg)) {
+		ret = PTR_ERR(msg);
+		goto out;
+	}
+
+	xnlock_get_irqsave(&nklock, s);
+	mq_hold_msg(mqd, msg, MQ_SLOT_CONSUMED);
+	xnlock_put_irqrestore(&nklock, s);
+
+	slot = msg->slot;
+	len = msg->len;
+	prio = msg->prio;
+	ret = cobalt_copy_to_user(u_slot, &slot, sizeof(slot));
+	if (ret == 0)
+		ret = cobalt_copy_to_user(u_len, &len, sizeof(len));
+	if (ret == 0 && u_prio)
+		ret = cobalt_copy_to_user(u_prio, &prio, sizeof(prio));
+	if (ret) {
+		/* The message is lost, as with mq_timedreceive(). */
+		xnlock_get_irqsave(&nklock, s);
+		mq_unhold_msg(msg);
+		mq_release_msg(mqd->mq, msg);
+		xnsched_run();
+		xnlock_put_irqrestore(&nklock, s);
+	}
+out:
+	cobalt_mqd_put(mqd);
+
+	return ret;
+}
+
+COBALT_SYSCALL(mq_consume, primary,
+	       (mqd_t uqd, __u32 __user *u_slot, __u32 __user *u_len,
+		unsigned int __user *u_prio,
+		const struct timespec __user *u_ts))
+{
+	return __cobalt_mq_consume(uqd, u_slot, u_len, u_prio,
+				   u_ts, u_ts ? mq_fetch_timeout : NULL);
+}
+
+COBALT_SYSCALL(mq_release, primary, (mqd_t uqd, __u32 slot))
+{
+	struct cobalt_mqd *mqd;
+	struct cobalt_msg *msg;
+	int ret = 0;
+	spl_t s;
+
+	mqd = cobalt_mqd_get_zc(uqd);
+	if (IS_ERR(mqd))
+		return PTR_ERR(mqd);
+
+	/*
+	 * Consumed slots go back to the pool, pending reservations
+	 * are cancelled.
+	 */
+	xnlock_get_irqsave(&nklock, s);
+	msg = mq_held_msg(mqd, slot, 0);
+	if (msg) {
+		mq_unhold_msg(msg);
+		mq_release_msg(mqd->mq, msg);
+		xnsched_run();
+	} else
+		ret = -EINVAL;
+	xnlock_put_irqrestore(&nklock, s);
+
+	cobalt_mqd_put(mqd);
+
+	return ret;
+}
@@ -22,6 +22,7 @@
 #include <linux/types.h>
 #include <linux/fcntl.h>
 #include <xenomai/posix/syscall.h>
+#include <cobalt/uapi/mqueue.h>
 
 struct mq_attr {
 	long mq_flags;
@@ -49,6 +50,17 @@ int __cobalt_mq_timedreceive(mqd_t uqd, void __user *u_buf,
 
 int __cobalt_mq_notify(mqd_t fd, const struct sigevent *evp);
 
+int __cobalt_mq_reserve(mqd_t uqd, __u32 __user *u_slot,
+			const void __user *u_ts,
+			int (*fetch_timeout)(struct timespec *ts,
+					     const void __user *u_ts));
+
+int __cobalt_mq_consume(mqd_t uqd, __u32 __user *u_slot,
+			__u32 __user *u_len, unsigned int __user *u_prio,
+			const void __user *u_ts,
+			int (*fetch_timeout)(struct timespec *ts,
+					     const void __user *u_ts));
+
 COBALT_SYSCALL_DECL(mq_open,
 		    (const char __user *u_name, int oflags,
 		     mode_t mode, struct mq_attr __user *u_attr));
@@ -71,4 +83,18 @@ COBALT_SYSCALL_DECL(mq_timedreceive,
 COBALT_SYSCALL_DECL(mq_notify,
 		    (mqd_t fd, const struct sigevent *__user evp));
 
+COBALT_SYSCALL_DECL(mq_reserve,
+		    (mqd_t uqd, __u32 __user *u_slot,
+		     const struct timespec __user *u_ts));
+
+COBALT_SYSCALL_DECL(mq_commit,
+		    (mqd_t uqd, __u32 slot, __u32 len, unsigned int prio));
+
+COBALT_SYSCALL_DECL(mq_consume,
+		    (mqd_t uqd, __u32 __user *u_slot, __u32 __user *u_len,
+		     unsigned int __user *u_prio,
+		     const struct timespec __user *u_ts));
+
+COBALT_SYSCALL_DECL(mq_release, (mqd_t uqd, __u32 slot));
+
 #endif /* !_COBALT_POSIX_MQUEUE_H */
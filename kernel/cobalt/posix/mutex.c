@@ -58,6 +58,7 @@ static int cobalt_mutex_init_inner(struct cobalt_mutex_shadow *shadow,
 
 	state->flags = (attr->type == PTHREAD_MUTEX_ERRORCHECK
 			? COBALT_MUTEX_ERRORCHECK : 0);
+	state->owner_winoff = 0;
 	mutex->attr = *attr;
 	INIT_LIST_HEAD(&mutex->conds);
 
@@ -0,0 +1,150 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/err.h>
+#include <linux/fcntl.h>
+#include <cobalt/kernel/thread.h>
+#include <rtdm/fd.h>
+#include "internal.h"
+#include "clock.h"
+#include "relgroup.h"
+
+/*
+ * Periodic release groups. Threads with harmonic periods join a
+ * group by file descriptor, then wait for their release points
+ * from the shared group timer instead of arming a periodic timer
+ * each.
+ */
+struct cobalt_relgroup {
+	struct rtdm_fd fd;
+	struct xnrelgroup group;
+};
+
+static void relgroup_close(struct rtdm_fd *fd)
+{
+	struct cobalt_relgroup *rg = container_of(fd, struct cobalt_relgroup, fd);
+
+	xnrelgroup_destroy(&rg->group);
+	xnfree(rg);
+}
+
+static struct rtdm_fd_ops relgroup_ops = {
+	.close = relgroup_close,
+};
+
+int __cobalt_relgroup_create(int clockid, const struct itimerspec *its)
+{
+	struct cobalt_relgroup *rg;
+	struct xnthread *curr;
+	struct xnclock *clock;
+	xnticks_t idate, period;
+	int ret, ufd;
+
+	if ((unsigned long)its->it_value.tv_nsec >= ONE_BILLION ||
+	    (unsigned long)its->it_interval.tv_nsec >= ONE_BILLION)
+		return -EINVAL;
+
+	period = ts2ns(&its->it_interval);
+	if (period == 0)
+		return -EINVAL;
+
+	clock = cobalt_clock_find(clockid);
+	if (IS_ERR(clock))
+		return PTR_ERR(clock);
+
+	rg = xnmalloc(sizeof(*rg));
+	if (rg == NULL)
+		return -ENOMEM;
+
+	ufd = __rtdm_anon_getfd("[cobalt-relgroup]", O_RDWR);
+	if (ufd < 0) {
+		ret = ufd;
+		goto fail_getfd;
+	}
+
+	curr = xnthread_current();
+	xnrelgroup_init(&rg->group, clock, curr ? curr->sched : NULL);
+
+	/* A null initial date means one period from now. */
+	idate = ts2ns(&its->it_value) ?: XN_INFINITE;
+	ret = xnrelgroup_start(&rg->group, idate,
+			       clock_flag(TIMER_ABSTIME, clockid), period);
+	if (ret)
+		goto fail;
+
+	ret = rtdm_fd_enter(&rg->fd, ufd, COBALT_RELGROUP_MAGIC, &relgroup_ops);
+	if (ret < 0)
+		goto fail;
+
+	ret = rtdm_fd_register(&rg->fd, ufd);
+	if (ret < 0)
+		goto fail;
+
+	return ufd;
+fail:
+	xnrelgroup_destroy(&rg->group);
+	__rtdm_anon_putfd(ufd);
+fail_getfd:
+	xnfree(rg);
+
+	return ret;
+}
+
+COBALT_SYSCALL(relgroup_create, lostage,
+	       (int clockid, const struct itimerspec __user *u_its))
+{
+	struct itimerspec its;
+	int ret;
+
+	ret = cobalt_copy_from_user(&its, u_its, sizeof(its));
+	if (ret)
+		return ret;
+
+	return __cobalt_relgroup_create(clockid, &its);
+}
+
+COBALT_SYSCALL(relgroup_join, primary, (int fd, unsigned int mult))
+{
+	struct xnthread *curr = xnthread_current();
+	struct cobalt_relgroup *rg;
+	struct rtdm_fd *rfd;
+	int ret;
+
+	if (fd < 0)
+		return xnthread_join_relgroup(curr, NULL, 0);
+
+	rfd = rtdm_fd_get(fd, COBALT_RELGROUP_MAGIC);
+	if (IS_ERR(rfd))
+		return PTR_ERR(rfd);
+
+	rg = container_of(rfd, struct cobalt_relgroup, fd);
+	ret = xnthread_join_relgroup(curr, &rg->group, mult);
+	rtdm_fd_put(rfd);
+
+	return ret;
+}
+
+COBALT_SYSCALL(relgroup_wait, primary, (unsigned long __user *u_overruns))
+{
+	unsigned long overruns = 0;
+	int ret;
+
+	ret = xnthread_wait_period(&overruns);
+	if (u_overruns && (ret == 0 || ret == -ETIMEDOUT) &&
+	    cobalt_copy_to_user(u_overruns, &overruns, sizeof(overruns)))
+		return -EFAULT;
+
+	return ret;
+}
@@ -0,0 +1,33 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef _COBALT_POSIX_RELGROUP_H
+#define _COBALT_POSIX_RELGROUP_H
+
+#include <linux/time.h>
+#include <xenomai/posix/syscall.h>
+
+int __cobalt_relgroup_create(int clockid, const struct itimerspec *its);
+
+COBALT_SYSCALL_DECL(relgroup_create,
+		    (int clockid, const struct itimerspec __user *u_its));
+
+COBALT_SYSCALL_DECL(relgroup_join,
+		    (int fd, unsigned int mult));
+
+COBALT_SYSCALL_DECL(relgroup_wait,
+		    (unsigned long __user *u_overruns));
+
+#endif /* !_COBALT_POSIX_RELGROUP_H */
@@ -110,6 +110,18 @@ cobalt_sched_policy_param(union xnsched_policy_param *param,
 		param->quota.tgid = param_ex->sched_quota_group;
 		sched_class = &xnsched_class_quota;
 		break;
+#endif
+#ifdef CONFIG_XENO_OPT_SCHED_EDF
+	case SCHED_EDF:
+		if (prio < XNSCHED_FIFO_MIN_PRIO ||
+		    prio > XNSCHED_FIFO_MAX_PRIO)
+			return NULL;
+		param->edf.prio = prio;
+		param->edf.runtime = ts2ns(&param_ex->sched_edf_runtime);
+		param->edf.deadline = ts2ns(&param_ex->sched_edf_deadline);
+		param->edf.period = ts2ns(&param_ex->sched_edf_period);
+		sched_class = &xnsched_class_edf;
+		break;
 #endif
 	default:
 		return NULL;
@@ -131,6 +143,7 @@ COBALT_SYSCALL(sched_minprio, current, (int policy))
 	case SCHED_SPORADIC:
 	case SCHED_TP:
 	case SCHED_QUOTA:
+	case SCHED_EDF:
 		ret = XNSCHED_FIFO_MIN_PRIO;
 		break;
 	case SCHED_COBALT:
@@ -159,6 +172,7 @@ COBALT_SYSCALL(sched_maxprio, current, (int policy))
 	case SCHED_SPORADIC:
 	case SCHED_TP:
 	case SCHED_QUOTA:
+	case SCHED_EDF:
 		ret = XNSCHED_FIFO_MAX_PRIO;
 		break;
 	case SCHED_COBALT:
@@ -0,0 +1,276 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/err.h>
+#include <linux/fcntl.h>
+#include <cobalt/kernel/select.h>
+#include <rtdm/fd.h>
+#include "internal.h"
+#include "clock.h"
+#include "selector.h"
+
+/*
+ * Persistent selectors: file descriptors are bound once to the
+ * selector when added, then readiness is collected from the ready
+ * list maintained by the core, instead of scanning fd sets on each
+ * call as select() does.
+ */
+struct cobalt_selfd {
+	struct rtdm_fd fd;
+	struct xnselector *selector;
+};
+
+#define COBALT_SELECTOR_EVENTS	\
+	(COBALT_SELECTOR_IN|COBALT_SELECTOR_OUT|COBALT_SELECTOR_ERR)
+
+/* Max. number of events returned by a single wait call. */
+#define COBALT_SELECTOR_BATCH	32
+
+static void selector_close(struct rtdm_fd *fd)
+{
+	struct cobalt_selfd *sfd = container_of(fd, struct cobalt_selfd, fd);
+
+	xnselector_destroy(sfd->selector);
+	xnfree(sfd);
+}
+
+static struct rtdm_fd_ops selector_ops = {
+	.close = selector_close,
+};
+
+COBALT_SYSCALL(selector_create, lostage, (int flags))
+{
+	struct cobalt_selfd *sfd;
+	int ret, ufd;
+
+	if (flags & ~O_CLOEXEC)
+		return -EINVAL;
+
+	sfd = xnmalloc(sizeof(*sfd));
+	if (sfd == NULL)
+		return -ENOMEM;
+
+	sfd->selector = xnmalloc(sizeof(*sfd->selector));
+	if (sfd->selector == NULL) {
+		ret = -ENOMEM;
+		goto fail_selector;
+	}
+
+	ret = xnselector_init_persistent(sfd->selector);
+	if (ret)
+		goto fail_init;
+
+	ufd = __rtdm_anon_getfd("[cobalt-selector]", O_RDWR | flags);
+	if (ufd < 0) {
+		ret = ufd;
+		goto fail_init;
+	}
+
+	ret = rtdm_fd_enter(&sfd->fd, ufd, COBALT_SELECTOR_MAGIC,
+			    &selector_ops);
+	if (ret < 0)
+		goto fail;
+
+	ret = rtdm_fd_register(&sfd->fd, ufd);
+	if (ret < 0)
+		goto fail;
+
+	return ufd;
+fail:
+	__rtdm_anon_putfd(ufd);
+fail_init:
+	/* Also releases the selector memory. */
+	xnselector_destroy(sfd->selector);
+fail_selector:
+	xnfree(sfd);
+
+	return ret;
+}
+
+static inline struct cobalt_selfd *sfd_get(int ufd)
+{
+	struct rtdm_fd *fd;
+
+	fd = rtdm_fd_get(ufd, COBALT_SELECTOR_MAGIC);
+	if (IS_ERR(fd)) {
+		int err = PTR_ERR(fd);
+		if (err == -EBADF && cobalt_current_process() == NULL)
+			err = -EPERM;
+		return ERR_PTR(err);
+	}
+
+	return container_of(fd, struct cobalt_selfd, fd);
+}
+
+static inline void sfd_put(struct cobalt_selfd *sfd)
+{
+	rtdm_fd_put(&sfd->fd);
+}
+
+static int bind_events(struct xnselector *selector, int fd,
+		       unsigned int events)
+{
+	unsigned int type;
+	int ret, bound;
+	spl_t s;
+
+	for (type = 0; type < XNSELECT_MAX_TYPES; type++) {
+		if ((events & (1 << type)) == 0)
+			continue;
+
+		/* Bindings persist until the fd or selector goes away. */
+		xnlock_get_irqsave(&nklock, s);
+		bound = __FD_ISSET__(fd, &selector->fds[type].expected);
+		xnlock_put_irqrestore(&nklock, s);
+		if (bound)
+			continue;
+
+		ret = rtdm_fd_select(fd, selector, type);
+		if (ret)
+			return ret == -ENOENT ? -EBADF : ret;
+	}
+
+	return 0;
+}
+
+int __cobalt_selector_ctl(int ufd, int op, int fd,
+			  const struct cobalt_selector_event *ev)
+{
+	struct xnselect_item *item;
+	struct cobalt_selfd *sfd;
+	int ret;
+
+	if (fd < 0 || fd >= __FD_SETSIZE || fd == ufd)
+		return -EINVAL;
+
+	if (op != COBALT_SELECTOR_DEL &&
+	    (ev->events & ~COBALT_SELECTOR_EVENTS))
+		return -EINVAL;
+
+	sfd = sfd_get(ufd);
+	if (IS_ERR(sfd))
+		return PTR_ERR(sfd);
+
+	switch (op) {
+	case COBALT_SELECTOR_ADD:
+		ret = bind_events(sfd->selector, fd, ev->events);
+		if (ret)
+			break;
+		item = xnmalloc(sizeof(*item));
+		if (item == NULL) {
+			ret = -ENOMEM;
+			break;
+		}
+		item->index = fd;
+		item->events = ev->events;
+		item->cookie = ev->data;
+		ret = xnselector_add_item(sfd->selector, item);
+		if (ret)
+			xnfree(item);
+		break;
+	case COBALT_SELECTOR_MOD:
+		ret = bind_events(sfd->selector, fd, ev->events);
+		if (ret)
+			break;
+		ret = xnselector_mod_item(sfd->selector, fd,
+					  ev->events, ev->data);
+		break;
+	case COBALT_SELECTOR_DEL:
+		item = xnselector_del_item(sfd->selector, fd);
+		if (item == NULL) {
+			ret = -ENOENT;
+			break;
+		}
+		xnfree(item);
+		ret = 0;
+		break;
+	default:
+		ret = -EINVAL;
+	}
+
+	sfd_put(sfd);
+
+	return ret;
+}
+
+COBALT_SYSCALL(selector_ctl, primary,
+	       (int ufd, int op, int fd,
+		const struct cobalt_selector_event __user *u_ev))
+{
+	struct cobalt_selector_event ev = { .events = 0 };
+
+	if (op != COBALT_SELECTOR_DEL &&
+	    cobalt_copy_from_user(&ev, u_ev, sizeof(ev)))
+		return -EFAULT;
+
+	return __cobalt_selector_ctl(ufd, op, fd, &ev);
+}
+
+int __cobalt_selector_wait(int ufd,
+			   struct cobalt_selector_event __user *u_ev,
+			   int maxevents, const struct timespec *ts)
+{
+	struct xnselect_event events[COBALT_SELECTOR_BATCH];
+	struct cobalt_selector_event ev;
+	xnticks_t timeout = XN_INFINITE;
+	struct cobalt_selfd *sfd;
+	int ret, n;
+
+	if (maxevents <= 0)
+		return -EINVAL;
+
+	if (maxevents > COBALT_SELECTOR_BATCH)
+		maxevents = COBALT_SELECTOR_BATCH;
+
+	if (ts) {
+		if ((unsigned long)ts->tv_nsec >= ONE_BILLION)
+			return -EINVAL;
+		timeout = ts2ns(ts);
+		if (timeout == 0)
+			timeout = XN_NONBLOCK;
+	}
+
+	sfd = sfd_get(ufd);
+	if (IS_ERR(sfd))
+		return PTR_ERR(sfd);
+
+	ret = xnselector_wait(sfd->selector, events, maxevents,
+			      timeout, XN_RELATIVE);
+
+	sfd_put(sfd);
+
+	for (n = 0; n < ret; n++) {
+		ev.events = events[n].events;
+		ev.fd = events[n].index;
+		ev.data = events[n].cookie;
+		if (cobalt_copy_to_user(u_ev + n, &ev, sizeof(ev)))
+			return -EFAULT;
+	}
+
+	return ret;
+}
+
+COBALT_SYSCALL(selector_wait, nonrestartable,
+	       (int ufd, struct cobalt_selector_event __user *u_ev,
+		int maxevents, const struct timespec __user *u_ts))
+{
+	struct timespec ts;
+
+	if (u_ts && cobalt_copy_from_user(&ts, u_ts, sizeof(ts)))
+		return -EFAULT;
+
+	return __cobalt_selector_wait(ufd, u_ev, maxevents,
+				      u_ts ? &ts : NULL);
+}
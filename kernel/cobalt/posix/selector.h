@@ -0,0 +1,40 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef _COBALT_POSIX_SELECTOR_H
+#define _COBALT_POSIX_SELECTOR_H
+
+#include <linux/time.h>
+#include <cobalt/uapi/select.h>
+#include <xenomai/posix/syscall.h>
+
+int __cobalt_selector_ctl(int ufd, int op, int fd,
+			  const struct cobalt_selector_event *ev);
+
+int __cobalt_selector_wait(int ufd,
+			   struct cobalt_selector_event __user *u_ev,
+			   int maxevents, const struct timespec *ts);
+
+COBALT_SYSCALL_DECL(selector_create, (int flags));
+
+COBALT_SYSCALL_DECL(selector_ctl,
+		    (int ufd, int op, int fd,
+		     const struct cobalt_selector_event __user *u_ev));
+
+COBALT_SYSCALL_DECL(selector_wait,
+		    (int ufd, struct cobalt_selector_event __user *u_ev,
+		     int maxevents, const struct timespec __user *u_ts));
+
+#endif /* !_COBALT_POSIX_SELECTOR_H */
@@ -42,6 +42,9 @@
 #include "event.h"
 #include "timerfd.h"
 #include "io.h"
+#include "selector.h"
+#include "ioring.h"
+#include "relgroup.h"
 #include "corectl.h"
 #include "../debug.h"
 #include <trace/events/cobalt-posix.h>
@@ -34,6 +34,8 @@
 #include "event.h"
 #include "mqueue.h"
 #include "io.h"
+#include "selector.h"
+#include "relgroup.h"
 #include "../debug.h"
 
 COBALT_SYSCALL32emu(thread_create, init,
@@ -807,9 +809,12 @@ static int get_timespec32(struct timespec *ts,
 	return sys32_get_timespec(ts, u_ts);
 }
 
-static int get_mmsg32(struct mmsghdr *mmsg, void __user *u_mmsg)
+static int get_mmsg32(struct mmsghdr *mmsg, void __user **u_mmsg_p)
 {
-	return sys32_get_mmsghdr(mmsg, u_mmsg);
+	struct compat_mmsghdr __user **p = (struct compat_mmsghdr **)u_mmsg_p,
+		*q __user = (*p)++;
+
+	return sys32_get_mmsghdr(mmsg, q);
 }
 
 static int put_mmsg32(void __user **u_mmsg_p, const struct mmsghdr *mmsg)
@@ -909,6 +914,71 @@ COBALT_SYSCALL32emu(backtrace, current,
 	return 0;
 }
 
+COBALT_SYSCALL32emu(selector_wait, nonrestartable,
+		    (int ufd, struct cobalt_selector_event __user *u_ev,
+		     int maxevents, const struct compat_timespec __user *u_ts))
+{
+	struct timespec ts;
+	int ret;
+
+	if (u_ts) {
+		ret = sys32_get_timespec(&ts, u_ts);
+		if (ret)
+			return ret;
+	}
+
+	return __cobalt_selector_wait(ufd, u_ev, maxevents,
+				      u_ts ? &ts : NULL);
+}
+
+COBALT_SYSCALL32emu(relgroup_create, lostage,
+		    (int clockid, const struct compat_itimerspec __user *u_its))
+{
+	struct itimerspec its;
+	int ret;
+
+	ret = sys32_get_itimerspec(&its, u_its);
+	if (ret)
+		return ret;
+
+	return __cobalt_relgroup_create(clockid, &its);
+}
+
+COBALT_SYSCALL32emu(relgroup_wait, primary,
+		    (compat_ulong_t __user *u_overruns))
+{
+	unsigned long overruns = 0;
+	compat_ulong_t coverruns;
+	int ret;
+
+	ret = xnthread_wait_period(&overruns);
+	if (u_overruns && (ret == 0 || ret == -ETIMEDOUT)) {
+		coverruns = overruns;
+		if (cobalt_copy_to_user(u_overruns, &coverruns,
+					sizeof(coverruns)))
+			return -EFAULT;
+	}
+
+	return ret;
+}
+
+COBALT_SYSCALL32emu(mq_reserve, primary,
+		    (mqd_t uqd, __u32 __user *u_slot,
+		     const struct compat_timespec __user *u_ts))
+{
+	return __cobalt_mq_reserve(uqd, u_slot,
+				   u_ts, u_ts ? sys32_fetch_timeout : NULL);
+}
+
+COBALT_SYSCALL32emu(mq_consume, primary,
+		    (mqd_t uqd, __u32 __user *u_slot,
+		     __u32 __user *u_len, unsigned int __user *u_prio,
+		     const struct compat_timespec __user *u_ts))
+{
+	return __cobalt_mq_consume(uqd, u_slot, u_len, u_prio,
+				   u_ts, u_ts ? sys32_fetch_timeout : NULL);
+}
+
 #ifdef COBALT_SYSCALL32x
 
 COBALT_SYSCALL32x(mq_timedreceive, primary,
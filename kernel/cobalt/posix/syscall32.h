@@ -225,4 +225,25 @@ COBALT_SYSCALL32emu_DECL(sem_timedwait,
 			 (struct cobalt_sem_shadow __user *u_sem,
 			  struct compat_timespec __user *u_ts));
 
+COBALT_SYSCALL32emu_DECL(selector_wait,
+			 (int ufd, struct cobalt_selector_event __user *u_ev,
+			  int maxevents,
+			  const struct compat_timespec __user *u_ts));
+
+COBALT_SYSCALL32emu_DECL(relgroup_create,
+			 (int clockid,
+			  const struct compat_itimerspec __user *u_its));
+
+COBALT_SYSCALL32emu_DECL(relgroup_wait,
+			 (compat_ulong_t __user *u_overruns));
+
+COBALT_SYSCALL32emu_DECL(mq_reserve,
+			 (mqd_t uqd, __u32 __user *u_slot,
+			  const struct compat_timespec __user *u_ts));
+
+COBALT_SYSCALL32emu_DECL(mq_consume,
+			 (mqd_t uqd, __u32 __user *u_slot,
+			  __u32 __user *u_len, unsigned int __user *u_prio,
+			  const struct compat_timespec __user *u_ts));
+
 #endif /* !_COBALT_POSIX_SYSCALL32_H */
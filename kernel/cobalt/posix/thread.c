@@ -347,6 +347,14 @@ int __cobalt_thread_getschedparam_ex(struct cobalt_thread *thread,
 		goto out;
 	}
 #endif
+#ifdef CONFIG_XENO_OPT_SCHED_EDF
+	if (base_class == &xnsched_class_edf) {
+		ns2ts(&param_ex->sched_edf_runtime, base_thread->edf->param.runtime);
+		ns2ts(&param_ex->sched_edf_deadline, base_thread->edf->param.deadline);
+		ns2ts(&param_ex->sched_edf_period, base_thread->edf->param.period);
+		goto out;
+	}
+#endif
 
 out:
 	xnlock_put_irqrestore(&nklock, s);
@@ -440,9 +448,12 @@ static void pthread_discard(struct cobalt_thread *thread)
 
 static inline int pthread_setmode_np(int clrmask, int setmask, int *mode_r)
 {
-	const int valid_flags = XNLOCK|XNWARN|XNTRAPLB;
+	int valid_flags = XNLOCK|XNWARN|XNTRAPLB;
 	int old;
 
+	if (IS_ENABLED(CONFIG_XENO_OPT_SCHED_CLUSTER))
+		valid_flags |= XNCLUSTER;
+
 	/*
 	 * The conforming mode bit is actually zero, since jumping to
 	 * this code entailed switching to primary mode already.
@@ -699,6 +710,7 @@ COBALT_SYSCALL(thread_setname, current,
 
 	ksformat(thread->threadbase.name,
 		 XNOBJECT_NAME_LEN - 1, "%s", name);
+	xnstat_map_update(&thread->threadbase);
 	p = xnthread_host_task(&thread->threadbase);
 	get_task_struct(p);
 
@@ -880,6 +892,17 @@ const char *cobalt_trace_parse_sched_params(struct trace_seq *p, int policy,
 				 params->sched_priority,
 				 params->sched_tp_partition);
 		break;
+	case SCHED_EDF:
+		trace_seq_printf(p, "priority=%d, runtime=(%ld.%09ld), "
+				 "deadline=(%ld.%09ld), period=(%ld.%09ld)",
+				 params->sched_priority,
+				 params->sched_edf_runtime.tv_sec,
+				 params->sched_edf_runtime.tv_nsec,
+				 params->sched_edf_deadline.tv_sec,
+				 params->sched_edf_deadline.tv_nsec,
+				 params->sched_edf_period.tv_sec,
+				 params->sched_edf_period.tv_nsec);
+		break;
 	case SCHED_NORMAL:
 		break;
 	case SCHED_SPORADIC:
@@ -17,12 +17,16 @@
  */
 
 #include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/rculist.h>
+#include <linux/workqueue.h>
 #include <cobalt/kernel/sched.h>
 #include <cobalt/kernel/heap.h>
 #include <cobalt/kernel/registry.h>
 #include <cobalt/kernel/thread.h>
 #include <cobalt/kernel/apc.h>
 #include <cobalt/kernel/assert.h>
+#include <cobalt/uapi/kernel/urw.h>
 
 /**
  * @ingroup cobalt_core
@@ -36,6 +40,9 @@
  * yet, the registry can be asked to set up a rendez-vous, blocking
  * the caller until the object is eventually registered.
  *
+ * Keys are indexed by a hash table which grows with the number of
+ * named objects. Looking up a key does not require holding nklock.
+ *
  *@{
  */
 
@@ -50,16 +57,50 @@ static unsigned int nr_active_objects;
 
 static unsigned long next_object_stamp;
 
-static struct hlist_head *object_index;
+/*
+ * The key index is read locklessly, writers serialize on nklock and
+ * flag their updates through index_urw so that readers may detect
+ * them and retry. Since object slots are never released, readers may
+ * safely walk a chain which is being changed under their feet.
+ *
+ * The index is doubled when the average chain length exceeds
+ * REGISTRY_INDEX_LOAD, by moving the chains one at a time to the
+ * next index from a work queue. Chains below migrate_pos in the
+ * current index have been moved already. Readers running over the
+ * head domain cannot rely on RCU, so retired indexes are only freed
+ * upon cleanup; the geometric growth bounds the overhead.
+ */
+struct registry_index {
+	struct registry_index *retired;
+	unsigned int bits;
+	struct hlist_head heads[0];
+};
+
+#define REGISTRY_INDEX_MIN_BITS	8
+#define REGISTRY_INDEX_LOAD	2
+
+static struct registry_index *object_index;
+
+static struct registry_index *next_index;
 
-static int nr_object_entries;
+static unsigned int migrate_pos;
+
+static unsigned int nr_hashed_objects;
+
+static unsigned int nr_index_resizes;
+
+static DEFINE_URW(index_urw);
+
+static void grow_callback(struct work_struct *work);
+
+static DECLARE_WORK(registry_grow_work, grow_callback);
+
+static int grow_apc;
 
 static struct xnsynch register_synch;
 
 #ifdef CONFIG_XENO_OPT_VFILE
 
-#include <linux/workqueue.h>
-
 static void proc_callback(struct work_struct *work);
 
 static void registry_proc_schedule(void *cookie);
@@ -74,9 +115,46 @@ static struct xnvfile_directory registry_vfroot;
 
 static int usage_vfile_show(struct xnvfile_regular_iterator *it, void *data)
 {
+	unsigned int n, len, maxlen = 0, nr_used = 0, nr_buckets, nr_hashed;
+	struct registry_index *idx;
+	struct hlist_node *node;
+	unsigned long load;
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+	idx = object_index;
+	nr_hashed = nr_hashed_objects;
+	xnlock_put_irqrestore(&nklock, s);
+
+	/*
+	 * Scan one chain at a time, so that we don't hold nklock for
+	 * long. Entries moving to a larger index in the meantime
+	 * might be missed, the figures are indicative only.
+	 */
+	nr_buckets = 1U << idx->bits;
+	for (n = 0; n < nr_buckets; n++) {
+		len = 0;
+		xnlock_get_irqsave(&nklock, s);
+		hlist_for_each(node, &idx->heads[n])
+			len++;
+		xnlock_put_irqrestore(&nklock, s);
+		if (len > 0)
+			nr_used++;
+		if (len > maxlen)
+			maxlen = len;
+	}
+
+	load = nr_hashed * 100UL / nr_buckets;
+
 	xnvfile_printf(it, "%u/%u\n",
 		       nr_active_objects,
 		       CONFIG_XENO_OPT_REGISTRY_NRSLOTS);
+	xnvfile_printf(it, "hash buckets: %u (%u used)\n", nr_buckets, nr_used);
+	xnvfile_printf(it, "hashed keys:  %u\n", nr_hashed);
+	xnvfile_printf(it, "load factor:  %lu.%02lu\n", load / 100, load % 100);
+	xnvfile_printf(it, "max chain:    %u\n", maxlen);
+	xnvfile_printf(it, "resizes:      %u\n", nr_index_resizes);
+
 	return 0;
 }
 
@@ -90,23 +168,54 @@ static struct xnvfile_regular usage_vfile = {
 
 #endif /* CONFIG_XENO_OPT_VFILE */
 
-unsigned xnregistry_hash_size(void)
+static inline unsigned int registry_index_max_bits(void)
+{
+	return max(order_base_2(CONFIG_XENO_OPT_REGISTRY_NRSLOTS),
+		   REGISTRY_INDEX_MIN_BITS);
+}
+
+static struct registry_index *registry_index_alloc(unsigned int bits)
 {
-	static const int primes[] = {
-		101, 211, 307, 401, 503, 601,
-		701, 809, 907, 1009, 1103
-	};
+	struct registry_index *idx;
+	unsigned int n;
 
-#define obj_hash_max(n)			 \
-((n) < sizeof(primes) / sizeof(int) ? \
- (n) : sizeof(primes) / sizeof(int) - 1)
+	idx = kmalloc(sizeof(*idx) + (sizeof(struct hlist_head) << bits),
+		      GFP_KERNEL);
+	if (idx == NULL)
+		return NULL;
 
-	return primes[obj_hash_max(CONFIG_XENO_OPT_REGISTRY_NRSLOTS / 100)];
+	idx->retired = NULL;
+	idx->bits = bits;
+	for (n = 0; n < (1U << bits); n++)
+		INIT_HLIST_HEAD(&idx->heads[n]);
+
+	return idx;
+}
+
+static void registry_index_free(struct registry_index *idx)
+{
+	struct registry_index *retired;
+
+	while (idx) {
+		retired = idx->retired;
+		kfree(idx);
+		idx = retired;
+	}
+}
+
+static void registry_grow_schedule(void *cookie)
+{
+	schedule_work(&registry_grow_work);
+}
+
+unsigned xnregistry_hash_size(void)
+{
+	return 1U << object_index->bits;
 }
 
 int xnregistry_init(void)
 {
-	int n, ret __maybe_unused;
+	int n, ret;
 
 	registry_obj_slots = kmalloc(CONFIG_XENO_OPT_REGISTRY_NRSLOTS *
 				     sizeof(struct xnobject), GFP_KERNEL);
@@ -138,6 +247,7 @@ int xnregistry_init(void)
 
 	for (n = 0; n < CONFIG_XENO_OPT_REGISTRY_NRSLOTS; n++) {
 		registry_obj_slots[n].objaddr = NULL;
+		INIT_HLIST_NODE(&registry_obj_slots[n].hlink);
 		list_add_tail(&registry_obj_slots[n].link, &free_object_list);
 	}
 
@@ -145,25 +255,37 @@ int xnregistry_init(void)
 	list_get_entry(&free_object_list, struct xnobject, link);
 	nr_active_objects = 1;
 
-	nr_object_entries = xnregistry_hash_size();
-	object_index = kmalloc(sizeof(*object_index) *
-				      nr_object_entries, GFP_KERNEL);
-
+	object_index = registry_index_alloc(REGISTRY_INDEX_MIN_BITS);
 	if (object_index == NULL) {
-#ifdef CONFIG_XENO_OPT_VFILE
-		xnvfile_destroy_regular(&usage_vfile);
-		xnvfile_destroy_dir(&registry_vfroot);
-		xnapc_free(proc_apc);
-#endif /* CONFIG_XENO_OPT_VFILE */
-		return -ENOMEM;
+		ret = -ENOMEM;
+		goto fail_index;
+	}
+
+	grow_apc = xnapc_alloc("registry_grow", &registry_grow_schedule, NULL);
+	if (grow_apc < 0) {
+		ret = grow_apc;
+		goto fail_apc;
 	}
 
-	for (n = 0; n < nr_object_entries; n++)
-		INIT_HLIST_HEAD(&object_index[n]);
+	next_index = NULL;
+	nr_hashed_objects = 0;
+	nr_index_resizes = 0;
 
 	xnsynch_init(&register_synch, XNSYNCH_FIFO, NULL);
 
 	return 0;
+
+fail_apc:
+	registry_index_free(object_index);
+fail_index:
+#ifdef CONFIG_XENO_OPT_VFILE
+	xnvfile_destroy_regular(&usage_vfile);
+	xnvfile_destroy_dir(&registry_vfroot);
+	xnapc_free(proc_apc);
+#endif /* CONFIG_XENO_OPT_VFILE */
+	kfree(registry_obj_slots);
+
+	return ret;
 }
 
 void xnregistry_cleanup(void)
@@ -176,9 +298,9 @@ void xnregistry_cleanup(void)
 
 	flush_scheduled_work();
 
-	for (n = 0; n < nr_object_entries; n++)
-		hlist_for_each_entry_safe(ecurr, enext, 
-					&object_index[n], hlink) {
+	for (n = 0; n < (1U << object_index->bits); n++)
+		hlist_for_each_entry_safe(ecurr, enext,
+					&object_index->heads[n], hlink) {
 			pnode = ecurr->pnode;
 			if (pnode == NULL)
 				continue;
@@ -195,7 +317,9 @@ void xnregistry_cleanup(void)
 		}
 #endif /* CONFIG_XENO_OPT_VFILE */
 
-	kfree(object_index);
+	xnapc_free(grow_apc);
+	cancel_work_sync(&registry_grow_work);
+	registry_index_free(object_index);
 	xnsynch_destroy(&register_synch);
 
 #ifdef CONFIG_XENO_OPT_VFILE
@@ -513,50 +637,202 @@ static unsigned registry_hash_crunch(const char *key)
 			h = (h ^ (g >> HQON)) ^ g;
 	}
 
-	return h % nr_object_entries;
+	return h;
 }
 
-static inline int registry_hash_enter(const char *key, struct xnobject *object)
+static struct hlist_head *registry_hash_bucket(unsigned int hash)
+{
+	struct registry_index *idx, *next;
+	unsigned int pos;
+
+	idx = ACCESS_ONCE(object_index);
+	next = ACCESS_ONCE(next_index);
+	pos = hash_32(hash, idx->bits);
+	if (next && pos < ACCESS_ONCE(migrate_pos))
+		return &next->heads[hash_32(hash, next->bits)];
+
+	return &idx->heads[pos];
+}
+
+/*
+ * Without nklock, only keys copied to the object slot may be
+ * compared: a key string owned by the caller of xnregistry_enter()
+ * may be released as soon as the object is removed. A matching hash
+ * on any other key ends a lockless walk, so that the caller retries
+ * with nklock held.
+ */
+static struct xnobject *registry_hash_walk(struct hlist_head *head,
+					   const char *key, unsigned int hash,
+					   bool locked)
 {
+	int n = CONFIG_XENO_OPT_REGISTRY_NRSLOTS;
+	struct hlist_node *node;
 	struct xnobject *ecurr;
-	unsigned s;
+	const char *ekey;
+
+	/*
+	 * A node moved or removed concurrently may lead us to another
+	 * chain, possibly looping back to a chain we have been
+	 * walking already: bound the walk, the caller will retry.
+	 */
+	for (node = ACCESS_ONCE(head->first); node && n-- > 0;
+	     node = ACCESS_ONCE(node->next)) {
+		ecurr = hlist_entry(node, struct xnobject, hlink);
+		ekey = ACCESS_ONCE(ecurr->key);
+		if (ecurr->hash != hash || ekey == NULL)
+			continue;
+		if (ekey == ecurr->keybuf) {
+			if (strncmp(key, ekey, sizeof(ecurr->keybuf)) == 0)
+				return ecurr;
+		} else if (!locked)
+			return NULL;
+		else if (strcmp(key, ekey) == 0)
+			return ecurr;
+	}
+
+	return NULL;
+}
+
+static inline void registry_hash_check_load(void)
+{
+	struct registry_index *idx = object_index;
+
+	if (next_index == NULL &&
+	    nr_hashed_objects > (REGISTRY_INDEX_LOAD << idx->bits) &&
+	    idx->bits < registry_index_max_bits())
+		__xnapc_schedule(grow_apc);
+}
 
-	object->key = key;
-	s = registry_hash_crunch(key);
+static inline int registry_hash_enter(const char *key, struct xnobject *object)
+{
+	struct hlist_head *head;
+	unsigned int hash;
+	urwstate_t tmp;
 
-	hlist_for_each_entry(ecurr, &object_index[s], hlink)
-		if (ecurr == object || strcmp(key, ecurr->key) == 0)
-			return -EEXIST;
+	hash = registry_hash_crunch(key);
+	head = registry_hash_bucket(hash);
+	if (registry_hash_walk(head, key, hash, true))
+		return -EEXIST;
 
-	hlist_add_head(&object->hlink, &object_index[s]);
+	/*
+	 * A lockless reader may still be walking through this slot
+	 * from a former life, update the key copy under the write
+	 * block so that it retries.
+	 */
+	unsynced_write_block(&tmp, &index_urw) {
+		if (strlen(key) < sizeof(object->keybuf)) {
+			strcpy(object->keybuf, key);
+			object->key = object->keybuf;
+		} else
+			object->key = key;
+		object->hash = hash;
+		hlist_add_head_rcu(&object->hlink, head);
+	}
+
+	nr_hashed_objects++;
+	registry_hash_check_load();
 
 	return 0;
 }
 
 static inline int registry_hash_remove(struct xnobject *object)
 {
-	unsigned int s = registry_hash_crunch(object->key);
-	struct xnobject *ecurr;
+	urwstate_t tmp;
 
-	hlist_for_each_entry(ecurr, &object_index[s], hlink)
-		if (ecurr == object) {
-			hlist_del(&ecurr->hlink);
-			return 0;
-		}
+	if (hlist_unhashed(&object->hlink))
+		return -ESRCH;
 
-	return -ESRCH;
+	/*
+	 * Keep the forward link intact, a reader might be walking
+	 * through this node.
+	 */
+	unsynced_write_block(&tmp, &index_urw) {
+		hlist_del_init_rcu(&object->hlink);
+	}
+
+	nr_hashed_objects--;
+
+	return 0;
 }
 
-static struct xnobject *registry_hash_find(const char *key)
+/*
+ * May be called locklessly, or with nklock held, in which case no
+ * update may be in progress and the read block is never restarted.
+ */
+static struct xnobject *registry_hash_find(const char *key, bool locked)
 {
+	unsigned int hash = registry_hash_crunch(key);
+	struct xnobject *object = NULL;
+	urwstate_t tmp;
+
+	unsynced_read_block(&tmp, &index_urw) {
+		object = registry_hash_walk(registry_hash_bucket(hash),
+					    key, hash, locked);
+	}
+
+	return object;
+}
+
+static void grow_callback(struct work_struct *work)
+{
+	struct registry_index *idx, *next;
+	struct hlist_node *enext;
 	struct xnobject *ecurr;
+	unsigned int pos;
+	urwstate_t tmp;
+	spl_t s;
 
-	hlist_for_each_entry(ecurr, 
-			&object_index[registry_hash_crunch(key)], hlink)
-		if (strcmp(key, ecurr->key) == 0)
-			return ecurr;
+	xnlock_get_irqsave(&nklock, s);
+	idx = object_index;
+	if (next_index ||
+	    nr_hashed_objects <= (REGISTRY_INDEX_LOAD << idx->bits) ||
+	    idx->bits >= registry_index_max_bits()) {
+		xnlock_put_irqrestore(&nklock, s);
+		return;
+	}
+	xnlock_put_irqrestore(&nklock, s);
 
-	return NULL;
+	next = registry_index_alloc(idx->bits + 1);
+	if (next == NULL)
+		return;
+
+	xnlock_get_irqsave(&nklock, s);
+	unsynced_write_block(&tmp, &index_urw) {
+		migrate_pos = 0;
+		next_index = next;
+	}
+	xnlock_put_irqrestore(&nklock, s);
+
+	/*
+	 * Move a single chain at a time, so that we don't hold nklock
+	 * for long. Concurrent updates go to the proper index
+	 * depending on migrate_pos.
+	 */
+	for (pos = 0; pos < (1U << idx->bits); pos++) {
+		xnlock_get_irqsave(&nklock, s);
+		unsynced_write_block(&tmp, &index_urw) {
+			hlist_for_each_entry_safe(ecurr, enext,
+						  &idx->heads[pos], hlink) {
+				hlist_del_rcu(&ecurr->hlink);
+				hlist_add_head_rcu(&ecurr->hlink,
+					&next->heads[hash_32(ecurr->hash,
+							     next->bits)]);
+			}
+			migrate_pos = pos + 1;
+		}
+		xnlock_put_irqrestore(&nklock, s);
+	}
+
+	xnlock_get_irqsave(&nklock, s);
+	unsynced_write_block(&tmp, &index_urw) {
+		next->retired = idx;
+		object_index = next;
+		next_index = NULL;
+	}
+	nr_index_resizes++;
+	/* Keys may have kept pouring in while moving. */
+	registry_hash_check_load();
+	xnlock_put_irqrestore(&nklock, s);
 }
 
 struct registry_wait_context {
@@ -756,6 +1032,13 @@ int xnregistry_bind(const char *key, xnticks_t timeout, int timeout_mode,
 	if (key == NULL)
 		return -EINVAL;
 
+	/* Most binds find their target on entry: go lockless first. */
+	object = registry_hash_find(key, false);
+	if (object) {
+		*phandle = object - registry_obj_slots;
+		return 0;
+	}
+
 	xnlock_get_irqsave(&nklock, s);
 
 	if (timeout_mode == XN_RELATIVE &&
@@ -765,7 +1048,7 @@ int xnregistry_bind(const char *key, xnticks_t timeout, int timeout_mode,
 	}
 
 	for (;;) {
-		object = registry_hash_find(key);
+		object = registry_hash_find(key, true);
 		if (object) {
 			*phandle = object - registry_obj_slots;
 			goto unlock_and_exit;
@@ -877,7 +1160,7 @@ int xnregistry_unlink(const char *key)
 
 	xnlock_get_irqsave(&nklock, s);
 
-	object = registry_hash_find(key);
+	object = registry_hash_find(key, true);
 	if (object == NULL) {
 		ret = -ESRCH;
 		goto unlock_and_exit;
@@ -25,6 +25,8 @@
 #include <linux/poll.h>
 #include <linux/kthread.h>
 #include <linux/fdtable.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
 #include <cobalt/kernel/registry.h>
 #include <cobalt/kernel/lock.h>
 #include <cobalt/kernel/ppd.h>
@@ -37,13 +39,24 @@
 
 #define RTDM_SETFL_MASK (O_NONBLOCK)
 
-DEFINE_PRIVATE_XNLOCK(fdtree_lock);
+#define RTDM_FD_TABLE_MIN 64
+
+DEFINE_PRIVATE_XNLOCK(fdtable_lock);
+static DEFINE_MUTEX(fdtable_resize_mutex);
 static LIST_HEAD(rtdm_fd_cleanup_queue);
 static struct semaphore rtdm_fd_cleanup_sem;
 
-struct rtdm_fd_index {
-	struct xnid id;
-	struct rtdm_fd *fd;
+/*
+ * Per-process table of RTDM descriptors, directly indexed by the
+ * user-side fd number. Slots are read and updated under fdtable_lock
+ * only. The table is replaced by a larger copy when a descriptor
+ * beyond its end is registered; @seq tracks slot updates so that the
+ * copy can be built without holding the lock.
+ */
+struct rtdm_fd_table {
+	unsigned int size;
+	unsigned long seq;
+	struct rtdm_fd *fds[0];
 };
 
 static int enosys(void)
@@ -60,23 +73,110 @@ static void nop_close(struct rtdm_fd *fd)
 {
 }
 
-static inline struct rtdm_fd_index *
-fetch_fd_index(struct cobalt_ppd *p, int ufd)
+static inline struct rtdm_fd *fetch_fd(struct cobalt_ppd *p, int ufd)
 {
-	struct xnid *id = xnid_fetch(&p->fds, ufd);
-	if (id == NULL)
+	struct rtdm_fd_table *t = p->fds;
+
+	if (t == NULL || (unsigned int)ufd >= t->size)
 		return NULL;
 
-	return container_of(id, struct rtdm_fd_index, id);
+	return t->fds[ufd];
 }
 
-static struct rtdm_fd *fetch_fd(struct cobalt_ppd *p, int ufd)
+static inline void store_fd(struct cobalt_ppd *p, int ufd,
+			    struct rtdm_fd *fd)
 {
-	struct rtdm_fd_index *idx = fetch_fd_index(p, ufd);
-	if (idx == NULL)
+	struct rtdm_fd_table *t = p->fds;
+
+	t->fds[ufd] = fd;
+	t->seq++;
+}
+
+static struct rtdm_fd_table *alloc_fd_table(unsigned int size)
+{
+	struct rtdm_fd_table *t;
+	size_t len;
+
+	len = sizeof(*t) + size * sizeof(t->fds[0]);
+	if (len <= PAGE_SIZE)
+		t = kzalloc(len, GFP_KERNEL);
+	else
+		t = vzalloc(len);
+	if (t == NULL)
 		return NULL;
 
-	return idx->fd;
+	t->size = size;
+
+	return t;
+}
+
+static void free_fd_table(struct rtdm_fd_table *t)
+{
+	if (is_vmalloc_addr(t))
+		vfree(t);
+	else
+		kfree(t);
+}
+
+static int expand_fd_table(struct cobalt_ppd *p, int ufd)
+{
+	struct rtdm_fd_table *old, *new = NULL;
+	unsigned int size = RTDM_FD_TABLE_MIN;
+	unsigned long seq;
+	spl_t s;
+
+	while (size <= (unsigned int)ufd)
+		size <<= 1;
+
+	/*
+	 * Only one expansion may run at a time, which guarantees that
+	 * the current table cannot be released under our feet while
+	 * we copy it without holding fdtable_lock. Slot updates
+	 * racing with the copy are detected via the sequence count,
+	 * in which case we try again.
+	 */
+	mutex_lock(&fdtable_resize_mutex);
+
+	for (;;) {
+		xnlock_get_irqsave(&fdtable_lock, s);
+		old = p->fds;
+		seq = old ? old->seq : 0;
+		xnlock_put_irqrestore(&fdtable_lock, s);
+
+		if (old && old->size > (unsigned int)ufd)
+			break;
+
+		if (new == NULL) {
+			new = alloc_fd_table(size);
+			if (new == NULL) {
+				mutex_unlock(&fdtable_resize_mutex);
+				return -ENOMEM;
+			}
+		}
+
+		if (old)
+			memcpy(new->fds, old->fds,
+			       old->size * sizeof(old->fds[0]));
+
+		xnlock_get_irqsave(&fdtable_lock, s);
+		if (p->fds == old && (old == NULL || old->seq == seq)) {
+			p->fds = new;
+			xnlock_put_irqrestore(&fdtable_lock, s);
+			/* Readers hold fdtable_lock, none may see old. */
+			if (old)
+				free_fd_table(old);
+			new = NULL;
+			break;
+		}
+		xnlock_put_irqrestore(&fdtable_lock, s);
+	}
+
+	mutex_unlock(&fdtable_resize_mutex);
+
+	if (new)
+		free_fd_table(new);
+
+	return 0;
 }
 
 #define assign_invalid_handler(__handler)				\
@@ -174,25 +274,25 @@ int rtdm_fd_enter(struct rtdm_fd *fd, int ufd, unsigned int magic,
 
 int rtdm_fd_register(struct rtdm_fd *fd, int ufd)
 {
-	struct rtdm_fd_index *idx;
 	struct cobalt_ppd *ppd;
-	spl_t s;
 	int ret = 0;
+	spl_t s;
 
-	ppd = cobalt_ppd_get(0);
-	idx = kmalloc(sizeof(*idx), GFP_KERNEL);
-	if (idx == NULL)
-		return -ENOMEM;
+	if (ufd < 0)
+		return -EBADF;
 
-	idx->fd = fd;
+	ppd = cobalt_ppd_get(0);
+	ret = expand_fd_table(ppd, ufd);
+	if (ret)
+		return ret;
 
-	xnlock_get_irqsave(&fdtree_lock, s);
-	ret = xnid_enter(&ppd->fds, &idx->id, ufd);
-	xnlock_put_irqrestore(&fdtree_lock, s);
-	if (ret < 0) {
-		kfree(idx);
+	/* The table never shrinks, ufd is still covered. */
+	xnlock_get_irqsave(&fdtable_lock, s);
+	if (fetch_fd(ppd, ufd))
 		ret = -EBUSY;
-	}
+	else
+		store_fd(ppd, ufd, fd);
+	xnlock_put_irqrestore(&fdtable_lock, s);
 
 	return ret;
 }
@@ -217,7 +317,7 @@ struct rtdm_fd *rtdm_fd_get(int ufd, unsigned int magic)
 	struct rtdm_fd *fd;
 	spl_t s;
 
-	xnlock_get_irqsave(&fdtree_lock, s);
+	xnlock_get_irqsave(&fdtable_lock, s);
 	fd = fetch_fd(p, ufd);
 	if (fd == NULL || (magic != 0 && fd->magic != magic)) {
 		fd = ERR_PTR(-EBADF);
@@ -226,7 +326,7 @@ struct rtdm_fd *rtdm_fd_get(int ufd, unsigned int magic)
 
 	++fd->refs;
 out:
-	xnlock_put_irqrestore(&fdtree_lock, s);
+	xnlock_put_irqrestore(&fdtable_lock, s);
 
 	return fd;
 }
@@ -251,11 +351,11 @@ static int fd_cleanup_thread(void *data)
 				return 0;
 		} while (err);
 
-		xnlock_get_irqsave(&fdtree_lock, s);
+		xnlock_get_irqsave(&fdtable_lock, s);
 		fd = list_first_entry(&rtdm_fd_cleanup_queue,
 				struct rtdm_fd, cleanup);
 		list_del(&fd->cleanup);
-		xnlock_put_irqrestore(&fdtree_lock, s);
+		xnlock_put_irqrestore(&fdtable_lock, s);
 
 		fd->ops->close(fd);
 	}
@@ -273,7 +373,7 @@ static void __put_fd(struct rtdm_fd *fd, spl_t s)
 	int destroy;
 
 	destroy = --fd->refs == 0;
-	xnlock_put_irqrestore(&fdtree_lock, s);
+	xnlock_put_irqrestore(&fdtable_lock, s);
 
 	if (!destroy)
 		return;
@@ -288,9 +388,9 @@ static void __put_fd(struct rtdm_fd *fd, spl_t s)
 			},
 		};
 
-		xnlock_get_irqsave(&fdtree_lock, s);
+		xnlock_get_irqsave(&fdtable_lock, s);
 		list_add_tail(&fd->cleanup, &rtdm_fd_cleanup_queue);
-		xnlock_put_irqrestore(&fdtree_lock, s);
+		xnlock_put_irqrestore(&fdtable_lock, s);
 
 		ipipe_post_work_root(&closework, work);
 	}
@@ -310,7 +410,7 @@ void rtdm_fd_put(struct rtdm_fd *fd)
 {
 	spl_t s;
 
-	xnlock_get_irqsave(&fdtree_lock, s);
+	xnlock_get_irqsave(&fdtable_lock, s);
 	__put_fd(fd, s);
 }
 EXPORT_SYMBOL_GPL(rtdm_fd_put);
@@ -333,13 +433,13 @@ int rtdm_fd_lock(struct rtdm_fd *fd)
 {
 	spl_t s;
 
-	xnlock_get_irqsave(&fdtree_lock, s);
+	xnlock_get_irqsave(&fdtable_lock, s);
 	if (fd->refs == 0) {
-		xnlock_put_irqrestore(&fdtree_lock, s);
+		xnlock_put_irqrestore(&fdtable_lock, s);
 		return -EIDRM;
 	}
 	++fd->refs;
-	xnlock_put_irqrestore(&fdtree_lock, s);
+	xnlock_put_irqrestore(&fdtable_lock, s);
 
 	return 0;
 }
@@ -359,7 +459,7 @@ void rtdm_fd_unlock(struct rtdm_fd *fd)
 {
 	spl_t s;
 
-	xnlock_get_irqsave(&fdtree_lock, s);
+	xnlock_get_irqsave(&fdtable_lock, s);
 	/* Warn if fd was unreferenced. */
 	XENO_WARN_ON(COBALT, fd->refs <= 0);
 	__put_fd(fd, s);
@@ -589,6 +689,44 @@ struct cobalt_recvmmsg_timer {
 	struct xnthread *waiter;
 };
 
+static int recvmmsg_batch(struct rtdm_fd *fd, void __user *u_msgvec,
+			  unsigned int vlen, unsigned int flags,
+			  int (*get_mmsg)(struct mmsghdr *mmsg, void __user **u_mmsg_p),
+			  int (*put_mmsg)(void __user **u_mmsg_p, const struct mmsghdr *mmsg),
+			  int *datagrams_r)
+{
+	void __user *u_p = u_msgvec, *u_q = u_msgvec;
+	struct mmsghdr mmsgv[RTDM_MMSG_BATCH];
+	unsigned int n, count;
+	int ret, done;
+
+	while (vlen > 0) {
+		count = min_t(unsigned int, vlen, RTDM_MMSG_BATCH);
+		for (n = 0; n < count; n++) {
+			ret = get_mmsg(&mmsgv[n], &u_q);
+			if (ret)
+				return ret;
+		}
+		done = fd->ops->recvmmsg_rt(fd, mmsgv, count, flags);
+		if (done <= 0)
+			return done;
+		for (n = 0; n < done; n++) {
+			ret = put_mmsg(&u_p, &mmsgv[n]);
+			if (ret)
+				return ret;
+			(*datagrams_r)++;
+		}
+		/* OOB data requires immediate handling. */
+		if (done < count || (mmsgv[done - 1].msg_hdr.msg_flags & MSG_OOB))
+			break;
+		vlen -= count;
+		if (flags & MSG_WAITFORONE)
+			flags |= MSG_DONTWAIT;
+	}
+
+	return 0;
+}
+
 static void recvmmsg_timeout_handler(struct xntimer *timer)
 {
 	struct cobalt_recvmmsg_timer *rq;
@@ -600,7 +738,7 @@ static void recvmmsg_timeout_handler(struct xntimer *timer)
 
 int __rtdm_fd_recvmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 		       unsigned int flags, void __user *u_timeout,
-		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user *u_mmsg),
+		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user **u_mmsg_p),
 		       int (*put_mmsg)(void __user **u_mmsg_p, const struct mmsghdr *mmsg),
 		       int (*get_timespec)(struct timespec *ts, const void __user *u_ts))
 {
@@ -609,9 +747,9 @@ int __rtdm_fd_recvmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 	struct timespec ts = { 0 };
 	int ret, datagrams = 0;
 	xnticks_t timeout = 0;
+	void __user *u_p, *u_q;
 	struct mmsghdr mmsg;
 	struct rtdm_fd *fd;
-	void __user *u_p;
 	ssize_t len;
 	spl_t s;
 	
@@ -658,8 +796,17 @@ int __rtdm_fd_recvmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 	if (fd->oflags & O_NONBLOCK)
 		flags |= MSG_DONTWAIT;
 
+	if (fd->ops->recvmmsg_rt) {
+		ret = recvmmsg_batch(fd, u_msgvec, vlen, flags,
+				     get_mmsg, put_mmsg, &datagrams);
+		/* -ENOSYS asks for the per-message handler. */
+		if (ret != -ENOSYS)
+			vlen = 0;
+	}
+
 	for (u_p = u_msgvec; vlen > 0; vlen--) {
-		ret = get_mmsg(&mmsg, u_p);
+		u_q = u_p;
+		ret = get_mmsg(&mmsg, &u_q);
 		if (ret)
 			break;
 		len = fd->ops->recvmsg_rt(fd, &mmsg.msg_hdr, flags);
@@ -734,15 +881,50 @@ out:
 }
 EXPORT_SYMBOL_GPL(rtdm_fd_sendmsg);
 
+static int sendmmsg_batch(struct rtdm_fd *fd, void __user *u_msgvec,
+			  unsigned int vlen, unsigned int flags,
+			  int (*get_mmsg)(struct mmsghdr *mmsg, void __user **u_mmsg_p),
+			  int (*put_mmsg)(void __user **u_mmsg_p, const struct mmsghdr *mmsg),
+			  int *datagrams_r)
+{
+	void __user *u_p = u_msgvec, *u_q = u_msgvec;
+	struct mmsghdr mmsgv[RTDM_MMSG_BATCH];
+	unsigned int n, count;
+	int ret, done;
+
+	while (vlen > 0) {
+		count = min_t(unsigned int, vlen, RTDM_MMSG_BATCH);
+		for (n = 0; n < count; n++) {
+			ret = get_mmsg(&mmsgv[n], &u_q);
+			if (ret)
+				return ret;
+		}
+		done = fd->ops->sendmmsg_rt(fd, mmsgv, count, flags);
+		if (done <= 0)
+			return done;
+		for (n = 0; n < done; n++) {
+			ret = put_mmsg(&u_p, &mmsgv[n]);
+			if (ret)
+				return ret;
+			(*datagrams_r)++;
+		}
+		if (done < count)
+			break;
+		vlen -= count;
+	}
+
+	return 0;
+}
+
 int __rtdm_fd_sendmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 		       unsigned int flags,
-		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user *u_mmsg),
+		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user **u_mmsg_p),
 		       int (*put_mmsg)(void __user **u_mmsg_p, const struct mmsghdr *mmsg))
 {
+	void __user *u_p, *u_q;
 	int ret, datagrams = 0;
 	struct mmsghdr mmsg;
 	struct rtdm_fd *fd;
-	void __user *u_p;
 	ssize_t len;
 	
 	if (vlen == 0)
@@ -761,8 +943,17 @@ int __rtdm_fd_sendmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 	if (fd->oflags & O_NONBLOCK)
 		flags |= MSG_DONTWAIT;
 
+	if (fd->ops->sendmmsg_rt) {
+		ret = sendmmsg_batch(fd, u_msgvec, vlen, flags,
+				     get_mmsg, put_mmsg, &datagrams);
+		/* -ENOSYS asks for the per-message handler. */
+		if (ret != -ENOSYS)
+			vlen = 0;
+	}
+
 	for (u_p = u_msgvec; vlen > 0; vlen--) {
-		ret = get_mmsg(&mmsg, u_p);
+		u_q = u_p;
+		ret = get_mmsg(&mmsg, &u_q);
 		if (ret)
 			break;
 		len = fd->ops->sendmsg_rt(fd, &mmsg.msg_hdr, flags);
@@ -791,17 +982,14 @@ out:
 }
 
 static void
-__fd_close(struct cobalt_ppd *p, struct rtdm_fd_index *idx, spl_t s)
+__fd_close(struct cobalt_ppd *p, int ufd, struct rtdm_fd *fd, spl_t s)
 {
-	xnid_remove(&p->fds, &idx->id);
-	__put_fd(idx->fd, s);
-
-	kfree(idx);
+	store_fd(p, ufd, NULL);
+	__put_fd(fd, s);
 }
 
 int rtdm_fd_close(int ufd, unsigned int magic)
 {
-	struct rtdm_fd_index *idx;
 	struct cobalt_ppd *ppd;
 	struct rtdm_fd *fd;
 	spl_t s;
@@ -810,15 +998,14 @@ int rtdm_fd_close(int ufd, unsigned int magic)
 
 	ppd = cobalt_ppd_get(0);
 
-	xnlock_get_irqsave(&fdtree_lock, s);
-	idx = fetch_fd_index(ppd, ufd);
-	if (idx == NULL)
+	xnlock_get_irqsave(&fdtable_lock, s);
+	fd = fetch_fd(ppd, ufd);
+	if (fd == NULL)
 		goto ebadf;
 
-	fd = idx->fd;
 	if (magic != 0 && fd->magic != magic) {
 ebadf:
-		xnlock_put_irqrestore(&fdtree_lock, s);
+		xnlock_put_irqrestore(&fdtable_lock, s);
 		return -EBADF;
 	}
 
@@ -833,7 +1020,7 @@ ebadf:
 	 * descriptor was removed from the fdtable if some refs on
 	 * rtdm_fd are still pending.
 	 */
-	__fd_close(ppd, idx, s);
+	__fd_close(ppd, ufd, fd, s);
 	__close_fd(current->files, ufd);
 
 	return 0;
@@ -879,9 +1066,9 @@ int rtdm_fd_valid_p(int ufd)
 	struct rtdm_fd *fd;
 	spl_t s;
 
-	xnlock_get_irqsave(&fdtree_lock, s);
+	xnlock_get_irqsave(&fdtable_lock, s);
 	fd = fetch_fd(cobalt_ppd_get(0), ufd);
-	xnlock_put_irqrestore(&fdtree_lock, s);
+	xnlock_put_irqrestore(&fdtable_lock, s);
 
 	return fd != NULL;
 }
@@ -927,25 +1114,36 @@ int rtdm_fd_select(int ufd, struct xnselector *selector,
 	return ret;
 }
 
-static void destroy_fd(void *cookie, struct xnid *id)
+void rtdm_fd_cleanup(struct cobalt_ppd *p)
 {
-	struct cobalt_ppd *p = cookie;
-	struct rtdm_fd_index *idx;
+	struct rtdm_fd_table *t = p->fds;
+	struct rtdm_fd *fd;
+	unsigned int ufd;
 	spl_t s;
 
-	idx = container_of(id, struct rtdm_fd_index, id);
-	xnlock_get_irqsave(&fdtree_lock, s);
-	__fd_close(p, idx, 0);
-}
-
-void rtdm_fd_cleanup(struct cobalt_ppd *p)
-{
 	/*
 	 * This is called on behalf of a (userland) task exit handler,
 	 * so we don't have to deal with the regular file descriptors,
 	 * we only have to empty our own index.
 	 */
-	xntree_cleanup(&p->fds, p, destroy_fd);
+	if (t == NULL)
+		return;
+
+	for (ufd = 0; ufd < t->size; ufd++) {
+		xnlock_get_irqsave(&fdtable_lock, s);
+		fd = t->fds[ufd];
+		if (fd == NULL) {
+			xnlock_put_irqrestore(&fdtable_lock, s);
+			continue;
+		}
+		__fd_close(p, ufd, fd, s);
+	}
+
+	xnlock_get_irqsave(&fdtable_lock, s);
+	p->fds = NULL;
+	xnlock_put_irqrestore(&fdtable_lock, s);
+
+	free_fd_table(t);
 }
 
 void rtdm_fd_init(void)
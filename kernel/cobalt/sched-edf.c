@@ -0,0 +1,624 @@
+/*
+ * Xenomai is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * Xenomai is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Xenomai; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <cobalt/kernel/sched.h>
+#include <cobalt/kernel/heap.h>
+#include <cobalt/kernel/arith.h>
+#include <cobalt/uapi/sched.h>
+
+/*
+ * SCHED_EDF threads are given a (runtime, deadline, period)
+ * reservation, and queued by increasing absolute deadline on the
+ * CPU they belong to. Each thread is served by a constant bandwidth
+ * server (CBS): the runtime it consumes is charged against its
+ * budget, and a thread which exhausts its budget is throttled until
+ * the next period begins. Since the reservations are admitted as
+ * long as their overall density does not exceed
+ * CONFIG_XENO_OPT_SCHED_EDF_MAXUTIL on any CPU, every thread which
+ * does not overrun its runtime is guaranteed to meet its deadlines,
+ * regardless of what the other threads do.
+ *
+ * CAUTION: PI boosts carry the weighted priority of the waiter, not
+ * its deadline ordering. EDF threads sharing resources should rather
+ * be given priorities which reflect their relative deadlines.
+ */
+
+#define EDF_MAX_BW	\
+	(XNSCHED_EDF_BW_ONE * CONFIG_XENO_OPT_SCHED_EDF_MAXUTIL / 100)
+
+/* Keep products of time values within 64bit. */
+#define EDF_MAX_PERIOD	(1ULL << 40)
+
+static void edf_replenish_handler(struct xntimer *timer);
+
+static inline bool edf_before(xnticks_t a, xnticks_t b)
+{
+	return (xnsticks_t)(a - b) < 0;
+}
+
+static inline unsigned long edf_bandwidth(const struct xnsched_edf_param *p)
+{
+	/* Density, which is the utilization for implicit deadlines. */
+	return xnarch_div64(p->runtime << XNSCHED_EDF_BW_SHIFT, p->deadline);
+}
+
+static void edf_set_deadline(struct xnthread *thread, xnticks_t deadline)
+{
+	thread->edf->deadline = deadline;
+	/*
+	 * The queuing deadline of a boosted thread is inherited, it
+	 * will be reset when the boost ends.
+	 */
+	if (!xnthread_test_state(thread, XNBOOST))
+		thread->edf_deadline = deadline;
+}
+
+static void edf_new_instance(struct xnthread *thread, xnticks_t now)
+{
+	struct xnsched_edf_data *edf = thread->edf;
+
+	edf->budget = edf->param.runtime;
+	edf_set_deadline(thread, now + edf->param.deadline);
+}
+
+static void edf_check_instance(struct xnthread *thread, xnticks_t now)
+{
+	struct xnsched_edf_data *edf = thread->edf;
+	xnsticks_t left = edf->deadline - now;
+
+	/*
+	 * CBS wakeup rule: keep going with the current budget and
+	 * deadline only if consuming the former by the latter would
+	 * not exceed the reserved bandwidth, otherwise start a new
+	 * instance.
+	 */
+	if (left <= 0 ||
+	    (edf->budget >> 10) * (edf->param.deadline >> 10) >
+	    ((xnticks_t)left >> 10) * (edf->param.runtime >> 10))
+		edf_new_instance(thread, now);
+}
+
+static void edf_insert(struct xnthread *thread, bool head)
+{
+	struct list_head *q = &thread->sched->edf.runnable;
+	struct xnthread *pos;
+
+	/*
+	 * Threads with equal deadlines are queued FIFO, except
+	 * preempted threads which go back to the head of their
+	 * group.
+	 */
+	list_for_each_entry(pos, q, rlink) {
+		if (edf_before(thread->edf_deadline, pos->edf_deadline))
+			break;
+		if (head && thread->edf_deadline == pos->edf_deadline)
+			break;
+	}
+
+	list_add_tail(&thread->rlink, &pos->rlink);
+}
+
+static void edf_suspend_activity(struct xnthread *thread)
+{
+	struct xnsched_edf_data *edf = thread->edf;
+	xnticks_t consumed;
+
+	if (!edf->active)
+		return;
+
+	edf->active = false;
+	xntimer_stop(&edf->budget_timer);
+	consumed = xnclock_read_monotonic(&nkclock) - edf->resume_date;
+	edf->budget = consumed < edf->budget ? edf->budget - consumed : 0;
+}
+
+static void edf_resume_activity(struct xnthread *thread)
+{
+	struct xnsched_edf_data *edf = thread->edf;
+
+	/*
+	 * Allow a kicked thread to run until it relaxes, even if it
+	 * lacks runtime budget.
+	 */
+	if (edf->active || xnthread_test_info(thread, XNKICKED))
+		return;
+
+	edf->active = true;
+	edf->resume_date = xnclock_read_monotonic(&nkclock);
+	xntimer_set_affinity(&edf->budget_timer, thread->sched);
+	xntimer_start(&edf->budget_timer, edf->budget,
+		      XN_INFINITE, XN_RELATIVE);
+}
+
+/*
+ * Lift the throttling of a thread from a class handler called by
+ * xnsched_set_policy(), which requeues the thread by itself if
+ * XNREADY is set on return.
+ */
+static void edf_unthrottle(struct xnthread *thread)
+{
+	struct xnsched_edf_data *edf = thread->edf;
+
+	xntimer_stop(&edf->repl_timer);
+	edf->throttled = false;
+
+	if (xnthread_test_state(thread, XNHELD)) {
+		xnthread_clear_state(thread, XNHELD);
+		if (!xnthread_test_state(thread, XNTHREAD_BLOCK_BITS))
+			xnthread_set_state(thread, XNREADY);
+	}
+}
+
+static void edf_budget_handler(struct xntimer *timer)
+{
+	struct xnsched_edf_data *edf;
+	struct xnthread *thread;
+	xnticks_t now;
+	int ret;
+
+	edf = container_of(timer, struct xnsched_edf_data, budget_timer);
+	thread = edf->thread;
+	edf->active = false;
+	edf->budget = 0;
+
+	now = xnclock_read_monotonic(&nkclock);
+	edf->release = edf->deadline - edf->param.deadline + edf->param.period;
+	if (!edf_before(now, edf->release)) {
+		/*
+		 * The current period is over already, start a new
+		 * instance right away. An earlier deadline may be
+		 * pending, so reschedule.
+		 */
+		edf_new_instance(thread, now);
+		edf_resume_activity(thread);
+		xnsched_set_resched(thread->sched);
+		return;
+	}
+
+	edf->throttled = true;
+	xnthread_suspend(thread, XNHELD, XN_INFINITE, XN_RELATIVE, NULL);
+	xntimer_set_affinity(&edf->repl_timer, thread->sched);
+	ret = xntimer_start(&edf->repl_timer, edf->release,
+			    XN_INFINITE, XN_ABSOLUTE);
+	if (ret == -ETIMEDOUT)
+		edf_replenish_handler(&edf->repl_timer);
+}
+
+static void edf_replenish_handler(struct xntimer *timer)
+{
+	struct xnsched_edf_data *edf;
+	struct xnthread *thread;
+
+	edf = container_of(timer, struct xnsched_edf_data, repl_timer);
+	thread = edf->thread;
+	edf->throttled = false;
+	edf->budget = edf->param.runtime;
+
+	/*
+	 * A throttled thread may have been forcibly unblocked in the
+	 * meantime, in which case it has to move to its new position
+	 * in the runqueue.
+	 */
+	if (xnthread_test_state(thread, XNHELD)) {
+		edf_set_deadline(thread, edf->release + edf->param.deadline);
+		xnthread_resume(thread, XNHELD);
+	} else if (xnthread_test_state(thread, XNREADY)) {
+		xnsched_dequeue(thread);
+		edf_set_deadline(thread, edf->release + edf->param.deadline);
+		xnsched_enqueue(thread);
+		xnsched_set_resched(thread->sched);
+	} else
+		edf_set_deadline(thread, edf->release + edf->param.deadline);
+}
+
+static int edf_check_param(const struct xnsched_edf_param *p)
+{
+	if (p->prio < XNSCHED_EDF_MIN_PRIO ||
+	    p->prio > XNSCHED_EDF_MAX_PRIO)
+		return -EINVAL;
+
+	if (p->runtime == 0 || p->runtime > p->deadline ||
+	    p->deadline > p->period || p->period > EDF_MAX_PERIOD)
+		return -EINVAL;
+
+	return 0;
+}
+
+/* nklock locked, interrupts off. */
+static int edf_reserve(struct xnsched_edf_data *edf,
+		       struct xnsched *sched, unsigned long bw)
+{
+	unsigned long avail = EDF_MAX_BW - sched->edf.bw;
+
+	if (edf->bw_sched == sched)
+		avail += edf->bw;
+
+	if (bw > avail)
+		return -EBUSY;
+
+	if (edf->bw_sched)
+		edf->bw_sched->edf.bw -= edf->bw;
+
+	sched->edf.bw += bw;
+	edf->bw_sched = sched;
+	edf->bw = bw;
+
+	return 0;
+}
+
+static void xnsched_edf_init(struct xnsched *sched)
+{
+	INIT_LIST_HEAD(&sched->edf.runnable);
+	sched->edf.bw = 0;
+}
+
+static bool xnsched_edf_setparam(struct xnthread *thread,
+				 const union xnsched_policy_param *p)
+{
+	struct xnsched_edf_data *edf = thread->edf;
+	bool effective;
+
+	xnthread_clear_state(thread, XNWEAK);
+	effective = xnsched_set_effective_priority(thread, p->edf.prio);
+
+	edf->param = p->edf;
+	if (edf->throttled)
+		edf_unthrottle(thread);
+
+	/* Start over with the new reservation. */
+	edf_new_instance(thread, xnclock_read_monotonic(&nkclock));
+	if (edf->active) {
+		edf->active = false;
+		xntimer_stop(&edf->budget_timer);
+		edf_resume_activity(thread);
+	}
+
+	return effective;
+}
+
+static void xnsched_edf_getparam(struct xnthread *thread,
+				 union xnsched_policy_param *p)
+{
+	struct xnsched_edf_data *edf = thread->edf;
+
+	/* We may be asked for the parameters of a boosted thread. */
+	if (edf)
+		p->edf = edf->param;
+	else {
+		p->edf.runtime = 0;
+		p->edf.deadline = 0;
+		p->edf.period = 0;
+	}
+
+	p->edf.prio = thread->cprio;
+	p->edf.abs_deadline = thread->edf_deadline;
+}
+
+static void xnsched_edf_trackprio(struct xnthread *thread,
+				  const union xnsched_policy_param *p)
+{
+	if (p) {
+		thread->cprio = p->edf.prio;
+		thread->edf_deadline = p->edf.abs_deadline;
+	} else {
+		thread->cprio = thread->bprio;
+		thread->edf_deadline = thread->edf->deadline;
+	}
+}
+
+static void xnsched_edf_protectprio(struct xnthread *thread, int prio)
+{
+	if (prio > XNSCHED_EDF_MAX_PRIO)
+		prio = XNSCHED_EDF_MAX_PRIO;
+
+	thread->cprio = prio;
+}
+
+static int xnsched_edf_declare(struct xnthread *thread,
+			       const union xnsched_policy_param *p)
+{
+	struct xnsched_edf_data *edf;
+	int ret;
+
+	ret = edf_check_param(&p->edf);
+	if (ret)
+		return ret;
+
+	edf = xnmalloc(sizeof(*edf));
+	if (edf == NULL)
+		return -ENOMEM;
+
+	edf->bw = 0;
+	edf->bw_sched = NULL;
+	ret = edf_reserve(edf, thread->sched, edf_bandwidth(&p->edf));
+	if (ret) {
+		xnfree(edf);
+		return ret;
+	}
+
+	xntimer_init(&edf->budget_timer, &nkclock, edf_budget_handler,
+		     thread->sched, XNTIMER_IGRAVITY);
+	xntimer_set_name(&edf->budget_timer, "edf-budget");
+	xntimer_init(&edf->repl_timer, &nkclock, edf_replenish_handler,
+		     thread->sched, XNTIMER_IGRAVITY);
+	xntimer_set_name(&edf->repl_timer, "edf-replenish");
+
+	edf->param = p->edf;
+	edf->deadline = 0;
+	edf->budget = 0;
+	edf->active = false;
+	edf->throttled = false;
+	edf->thread = thread;
+	thread->edf = edf;
+
+	return 0;
+}
+
+static int xnsched_edf_chkparam(struct xnthread *thread,
+				const union xnsched_policy_param *p)
+{
+	int ret;
+
+	ret = edf_check_param(&p->edf);
+	if (ret)
+		return ret;
+
+	/*
+	 * xnsched_set_policy() cannot fail past this point, so we
+	 * may commit the new reservation right away.
+	 */
+	return edf_reserve(thread->edf, thread->sched,
+			   edf_bandwidth(&p->edf));
+}
+
+static void xnsched_edf_forget(struct xnthread *thread)
+{
+	struct xnsched_edf_data *edf = thread->edf;
+
+	if (edf->throttled)
+		edf_unthrottle(thread);
+
+	edf->bw_sched->edf.bw -= edf->bw;
+	xntimer_destroy(&edf->budget_timer);
+	xntimer_destroy(&edf->repl_timer);
+	thread->edf = NULL;
+	xnfree(edf);
+}
+
+static void xnsched_edf_migrate(struct xnthread *thread, struct xnsched *sched)
+{
+	union xnsched_policy_param param;
+
+	if (thread->edf == NULL)
+		return;
+	/*
+	 * Bandwidth is reserved on a per-CPU basis, so it cannot
+	 * follow a thread to a CPU which did not admit it. Like
+	 * SCHED_TP, we move the thread to the RT class instead. A
+	 * subsequent call to __xnthread_set_schedparam() may bring it
+	 * back to EDF scheduling, pending admission on the new CPU.
+	 */
+	param.rt.prio = thread->cprio;
+	__xnthread_set_schedparam(thread, &xnsched_class_rt, &param);
+}
+
+static void xnsched_edf_enqueue(struct xnthread *thread)
+{
+	struct xnsched_edf_data *edf = thread->edf;
+
+	if (edf && !edf->throttled)
+		edf_check_instance(thread, xnclock_read_monotonic(&nkclock));
+
+	edf_insert(thread, false);
+}
+
+static void xnsched_edf_dequeue(struct xnthread *thread)
+{
+	list_del(&thread->rlink);
+}
+
+static void xnsched_edf_requeue(struct xnthread *thread)
+{
+	edf_insert(thread, true);
+}
+
+static struct xnthread *xnsched_edf_pick(struct xnsched *sched)
+{
+	struct list_head *q = &sched->edf.runnable;
+	struct xnthread *curr = sched->curr, *next = NULL;
+
+	if (!list_empty(q)) {
+		next = list_first_entry(q, struct xnthread, rlink);
+		list_del(&next->rlink);
+	}
+
+	/*
+	 * Being the highest class, we are called for every
+	 * rescheduling, which makes us the right place for
+	 * accounting the runtime of outgoing EDF threads, whichever
+	 * class picks the next one. Threads inheriting the EDF class
+	 * through a PI boost have no budget.
+	 */
+	if (curr->edf && curr != next)
+		edf_suspend_activity(curr);
+
+	if (next && next->edf)
+		edf_resume_activity(next);
+
+	return next;
+}
+
+#ifdef CONFIG_XENO_OPT_VFILE
+
+struct xnvfile_directory sched_edf_vfroot;
+
+struct vfile_sched_edf_priv {
+	struct xnthread *curr;
+};
+
+struct vfile_sched_edf_data {
+	int cpu;
+	pid_t pid;
+	char name[XNOBJECT_NAME_LEN];
+	int prio;
+	xnticks_t runtime;
+	xnticks_t deadline;
+	xnticks_t period;
+	unsigned long bw;
+	bool throttled;
+};
+
+static struct xnvfile_snapshot_ops vfile_sched_edf_ops;
+
+static struct xnvfile_snapshot vfile_sched_edf = {
+	.privsz = sizeof(struct vfile_sched_edf_priv),
+	.datasz = sizeof(struct vfile_sched_edf_data),
+	.tag = &nkthreadlist_tag,
+	.ops = &vfile_sched_edf_ops,
+};
+
+static int vfile_sched_edf_rewind(struct xnvfile_snapshot_iterator *it)
+{
+	struct vfile_sched_edf_priv *priv = xnvfile_iterator_priv(it);
+	int nrthreads = xnsched_class_edf.nthreads;
+
+	if (nrthreads == 0)
+		return -ESRCH;
+
+	priv->curr = list_first_entry(&nkthreadq, struct xnthread, glink);
+
+	return nrthreads;
+}
+
+static int vfile_sched_edf_next(struct xnvfile_snapshot_iterator *it,
+				void *data)
+{
+	struct vfile_sched_edf_priv *priv = xnvfile_iterator_priv(it);
+	struct vfile_sched_edf_data *p = data;
+	struct xnthread *thread;
+
+	if (priv->curr == NULL)
+		return 0;	/* All done. */
+
+	thread = priv->curr;
+	if (list_is_last(&thread->glink, &nkthreadq))
+		priv->curr = NULL;
+	else
+		priv->curr = list_next_entry(thread, glink);
+
+	if (thread->base_class != &xnsched_class_edf)
+		return VFILE_SEQ_SKIP;
+
+	p->cpu = xnsched_cpu(thread->sched);
+	p->pid = xnthread_host_pid(thread);
+	memcpy(p->name, thread->name, sizeof(p->name));
+	p->prio = thread->cprio;
+	p->runtime = thread->edf->param.runtime;
+	p->deadline = thread->edf->param.deadline;
+	p->period = thread->edf->param.period;
+	p->bw = thread->edf->bw;
+	p->throttled = thread->edf->throttled;
+
+	return 1;
+}
+
+static int vfile_sched_edf_show(struct xnvfile_snapshot_iterator *it,
+				void *data)
+{
+	char rtbuf[16], dlbuf[16], ptbuf[16];
+	struct vfile_sched_edf_data *p = data;
+	unsigned long pm;
+
+	if (p == NULL)
+		xnvfile_printf(it,
+			       "%-3s  %-6s %-4s %-10s %-10s %-10s %-6s  %s\n",
+			       "CPU", "PID", "PRI", "RUNTIME", "DEADLINE",
+			       "PERIOD", "BW%", "NAME");
+	else {
+		xntimer_format_time(p->runtime, rtbuf, sizeof(rtbuf));
+		xntimer_format_time(p->deadline, dlbuf, sizeof(dlbuf));
+		xntimer_format_time(p->period, ptbuf, sizeof(ptbuf));
+		pm = (p->bw * 1000) >> XNSCHED_EDF_BW_SHIFT;
+
+		xnvfile_printf(it,
+			       "%3u  %-6d %3d%c %-10s %-10s %-10s %3lu.%lu  %s\n",
+			       p->cpu,
+			       p->pid,
+			       p->prio,
+			       p->throttled ? '*' : ' ',
+			       rtbuf,
+			       dlbuf,
+			       ptbuf,
+			       pm / 10, pm % 10,
+			       p->name);
+	}
+
+	return 0;
+}
+
+static struct xnvfile_snapshot_ops vfile_sched_edf_ops = {
+	.rewind = vfile_sched_edf_rewind,
+	.next = vfile_sched_edf_next,
+	.show = vfile_sched_edf_show,
+};
+
+static int xnsched_edf_init_vfile(struct xnsched_class *schedclass,
+				  struct xnvfile_directory *vfroot)
+{
+	int ret;
+
+	ret = xnvfile_init_dir(schedclass->name, &sched_edf_vfroot, vfroot);
+	if (ret)
+		return ret;
+
+	return xnvfile_init_snapshot("threads", &vfile_sched_edf,
+				     &sched_edf_vfroot);
+}
+
+static void xnsched_edf_cleanup_vfile(struct xnsched_class *schedclass)
+{
+	xnvfile_destroy_snapshot(&vfile_sched_edf);
+	xnvfile_destroy_dir(&sched_edf_vfroot);
+}
+
+#endif /* CONFIG_XENO_OPT_VFILE */
+
+struct xnsched_class xnsched_class_edf = {
+	.sched_init		=	xnsched_edf_init,
+	.sched_enqueue		=	xnsched_edf_enqueue,
+	.sched_dequeue		=	xnsched_edf_dequeue,
+	.sched_requeue		=	xnsched_edf_requeue,
+	.sched_pick		=	xnsched_edf_pick,
+	.sched_tick		=	NULL,
+	.sched_rotate		=	NULL,
+	.sched_migrate		=	xnsched_edf_migrate,
+	.sched_setparam		=	xnsched_edf_setparam,
+	.sched_getparam		=	xnsched_edf_getparam,
+	.sched_trackprio	=	xnsched_edf_trackprio,
+	.sched_protectprio	=	xnsched_edf_protectprio,
+	.sched_declare		=	xnsched_edf_declare,
+	.sched_chkparam		=	xnsched_edf_chkparam,
+	.sched_forget		=	xnsched_edf_forget,
+	.sched_kick		=	NULL,
+#ifdef CONFIG_XENO_OPT_VFILE
+	.sched_init_vfile	=	xnsched_edf_init_vfile,
+	.sched_cleanup_vfile	=	xnsched_edf_cleanup_vfile,
+#endif
+	.weight			=	XNSCHED_CLASS_WEIGHT(5),
+	.policy			=	SCHED_EDF,
+	.name			=	"edf"
+};
+EXPORT_SYMBOL_GPL(xnsched_class_edf);
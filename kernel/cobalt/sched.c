@@ -26,6 +26,7 @@
 #include <cobalt/kernel/intr.h>
 #include <cobalt/kernel/heap.h>
 #include <cobalt/kernel/arith.h>
+#include <cobalt/kernel/evtrace.h>
 #include <cobalt/uapi/signal.h>
 #define CREATE_TRACE_POINTS
 #include <trace/events/cobalt-core.h>
@@ -86,6 +87,9 @@ void xnsched_register_classes(void)
 	xnsched_register_class(&xnsched_class_quota);
 #endif
 	xnsched_register_class(&xnsched_class_rt);
+#ifdef CONFIG_XENO_OPT_SCHED_EDF
+	xnsched_register_class(&xnsched_class_edf);
+#endif
 }
 
 #ifdef CONFIG_XENO_OPT_WATCHDOG
@@ -178,6 +182,10 @@ void xnsched_init(struct xnsched *sched, int cpu)
 	sched->lflags = XNIDLE;
 	sched->inesting = 0;
 	sched->curr = &sched->rootcb;
+#ifdef CONFIG_XENO_OPT_SCHED_CLUSTER
+	sched->nr_pushed = 0;
+	sched->nr_pulled = 0;
+#endif
 
 	attr.flags = XNROOT | XNFPU;
 	attr.name = root_name;
@@ -394,6 +402,10 @@ int xnsched_set_policy(struct xnthread *thread,
 		ret = xnsched_declare(sched_class, thread, p);
 		if (ret)
 			return ret;
+	} else {
+		ret = xnsched_chkparam(sched_class, thread, p);
+		if (ret)
+			return ret;
 	}
 
 	/*
@@ -596,6 +608,149 @@ void xnsched_migrate_passive(struct xnthread *thread, struct xnsched *sched)
 	}
 }
 
+#ifdef CONFIG_XENO_OPT_SCHED_CLUSTER
+
+/*
+ * Cluster scheduling. A thread bearing XNCLUSTER may be moved to any
+ * real-time CPU of its affinity set while it waits in a runqueue,
+ * i.e. neither running nor in the middle of a context switch. Only
+ * members of the RT class qualify, other policies maintain per-CPU
+ * state which we would have to carry along.
+ *
+ * The thread still runs in primary mode on its new CPU. As with
+ * xnsched_migrate(), XNMOVED tells xnthread_relax() that the host
+ * kernel lags behind, check_affinity() will reconcile both views
+ * when the thread switches back to primary mode later on.
+ */
+static bool cluster_movable(struct xnthread *thread)
+{
+	struct xnsched *sched = thread->sched;
+
+	if (thread == sched->curr || thread->lock_count > 0 ||
+	    thread->sched_class != &xnsched_class_rt ||
+	    !xnthread_test_state(thread, XNREADY))
+		return false;
+
+#ifdef CONFIG_IPIPE_WANT_PREEMPTIBLE_SWITCH
+	/* The last thread may still run on its stack. */
+	if ((sched->status & XNINSW) && thread == sched->last)
+		return false;
+#endif
+#ifdef CONFIG_XENO_ARCH_FPU
+	/* Its FPU context may still live in the registers. */
+	if (thread == sched->fpuholder)
+		return false;
+#endif
+
+	return true;
+}
+
+/*
+ * The highest priority level a CPU is committed to, including the
+ * RT threads which are already waiting for it.
+ */
+static int cluster_load(struct xnsched *sched)
+{
+	struct xnthread *head = xnsched_headq(&sched->rt.runnable);
+	int wprio = sched->curr->wprio;
+
+	if (head && head->wprio > wprio)
+		wprio = head->wprio;
+
+	return wprio;
+}
+
+static void cluster_move(struct xnthread *thread, struct xnsched *sched)
+{
+	trace_cobalt_sched_cluster_move(thread, xnsched_cpu(thread->sched),
+					xnsched_cpu(sched));
+	migrate_thread(thread, sched);
+	xnsched_putback(thread);
+	/*
+	 * The thread is not running, so it cannot race with us on its
+	 * local information bits.
+	 */
+	xnthread_set_localinfo(thread, XNMOVED);
+	xnstat_exectime_reset_stats(&thread->stat.lastperiod);
+}
+
+/*
+ * nklock locked, interrupts off. thread was just made ready, push it
+ * to the CPU of its cluster running the lowest priority activity, if
+ * it cannot preempt the current thread on its own CPU.
+ */
+void __xnsched_cluster_push(struct xnthread *thread)
+{
+	struct xnsched *sched = thread->sched, *target = NULL, *remote;
+	int cpu, load, min_load;
+
+	if (thread->wprio > sched->curr->wprio || !cluster_movable(thread))
+		return;
+
+	min_load = thread->wprio;
+
+	for_each_cpu(cpu, &thread->affinity) {
+		if (!xnsched_supported_cpu(cpu))
+			continue;
+		remote = xnsched_struct(cpu);
+		if (remote == sched || remote->curr->lock_count > 0)
+			continue;
+		load = cluster_load(remote);
+		if (load < min_load) {
+			min_load = load;
+			target = remote;
+		}
+	}
+
+	if (target) {
+		sched->nr_pushed++;
+		cluster_move(thread, target);
+	}
+}
+
+/*
+ * nklock locked, interrupts off. sched is about to idle, pull the
+ * highest priority cluster thread waiting for a CPU elsewhere, which
+ * may run on this one.
+ */
+static bool cluster_pull(struct xnsched *sched)
+{
+	struct xnthread *thread, *best = NULL;
+	struct xnsched *remote;
+	int cpu;
+
+	for_each_realtime_cpu(cpu) {
+		remote = xnsched_struct(cpu);
+		if (remote == sched)
+			continue;
+		thread = xnsched_headq(&remote->rt.runnable);
+		if (thread == NULL ||
+		    !xnthread_test_state(thread, XNCLUSTER) ||
+		    !cpumask_test_cpu(xnsched_cpu(sched), &thread->affinity) ||
+		    !cluster_movable(thread))
+			continue;
+		if (best == NULL || thread->wprio > best->wprio)
+			best = thread;
+	}
+
+	if (best == NULL)
+		return false;
+
+	sched->nr_pulled++;
+	cluster_move(best, sched);
+
+	return true;
+}
+
+#else /* !CONFIG_XENO_OPT_SCHED_CLUSTER */
+
+static inline bool cluster_pull(struct xnsched *sched)
+{
+	return false;
+}
+
+#endif /* !CONFIG_XENO_OPT_SCHED_CLUSTER */
+
 #ifdef CONFIG_XENO_OPT_SCALABLE_SCHED
 
 void xnsched_initq(struct xnsched_mlq *q)
@@ -924,7 +1079,12 @@ reschedule:
 		goto out;
 
 	next = xnsched_pick_next(sched);
+	if (xnthread_test_state(next, XNROOT) && cluster_pull(sched))
+		next = xnsched_pick_next(sched);
+
 	if (next == curr) {
+		/* Released before we could switch out, keeps running. */
+		xnstat_latency_account(&curr->stat.latency);
 		if (unlikely(xnthread_test_state(next, XNROOT))) {
 			if (sched->lflags & XNHTICK)
 				xnintr_host_tick(sched);
@@ -937,6 +1097,8 @@ reschedule:
 	prev = curr;
 
 	trace_cobalt_switch_context(prev, next);
+	xnevtrace_log(COBALT_EVTRACE_SWITCH, xnthread_host_pid(prev),
+		      xnthread_host_pid(next), next->cprio);
 
 	if (xnthread_test_state(next, XNROOT))
 		xnsched_reset_watchdog(sched);
@@ -957,6 +1119,16 @@ reschedule:
 
 	xnstat_exectime_switch(sched, &next->stat.account);
 	xnstat_counter_inc(&next->stat.csw);
+	xnstat_latency_account(&next->stat.latency);
+	xnstat_map_switch(sched, prev, next);
+
+	/*
+	 * Tell user-space which shadows are currently running in
+	 * primary mode, for adaptive spinning on mutexes. The root
+	 * thread has no window.
+	 */
+	xnthread_set_oncpu(prev, 0);
+	xnthread_set_oncpu(next, 1);
 
 	switch_context(sched, prev, next);
 
@@ -1377,6 +1549,179 @@ static struct xnvfile_snapshot_ops vfile_schedacct_ops = {
 	.show = vfile_schedacct_show,
 };
 
+#ifdef CONFIG_XENO_OPT_STATS_LATENCY
+
+struct vfile_schedlat_priv {
+	struct xnthread *curr;
+};
+
+struct vfile_schedlat_data {
+	int cpu;
+	pid_t pid;
+	int state;
+	char name[XNOBJECT_NAME_LEN];
+	xnstat_latency_t latency;
+};
+
+static struct xnvfile_snapshot_ops vfile_schedlat_ops;
+
+static struct xnvfile_snapshot schedlat_vfile = {
+	.privsz = sizeof(struct vfile_schedlat_priv),
+	.datasz = sizeof(struct vfile_schedlat_data),
+	.tag = &nkthreadlist_tag,
+	.ops = &vfile_schedlat_ops,
+};
+
+static int vfile_schedlat_rewind(struct xnvfile_snapshot_iterator *it)
+{
+	struct vfile_schedlat_priv *priv = xnvfile_iterator_priv(it);
+
+	priv->curr = list_first_entry(&nkthreadq, struct xnthread, glink);
+
+	return cobalt_nrthreads;
+}
+
+static int vfile_schedlat_next(struct xnvfile_snapshot_iterator *it,
+			       void *data)
+{
+	struct vfile_schedlat_priv *priv = xnvfile_iterator_priv(it);
+	struct vfile_schedlat_data *p = data;
+	struct xnthread *thread;
+
+	if (priv->curr == NULL)
+		return 0;	/* All done. */
+
+	thread = priv->curr;
+	if (list_is_last(&thread->glink, &nkthreadq))
+		priv->curr = NULL;
+	else
+		priv->curr = list_next_entry(thread, glink);
+
+	if (xnthread_test_state(thread, XNROOT))
+		return VFILE_SEQ_SKIP;
+
+	p->cpu = xnsched_cpu(thread->sched);
+	p->pid = xnthread_host_pid(thread);
+	p->state = xnthread_get_state(thread);
+	memcpy(p->name, thread->name, sizeof(p->name));
+	p->latency = thread->stat.latency;
+
+	return 1;
+}
+
+/*
+ * Upper bound of the given percentile (in 1/1000th) from the
+ * histogram, which cannot be more accurate than the bucket it falls
+ * in. Never report more than the observed maximum though.
+ */
+static xnticks_t schedlat_percentile(xnstat_latency_t *l, int permil)
+{
+	unsigned long long rank, seen = 0;
+	int n;
+
+	rank = xnarch_ulldiv((unsigned long long)l->count * permil + 999,
+			     1000, NULL);
+
+	for (n = 0; n < XNSTAT_LATENCY_BUCKETS - 1; n++) {
+		seen += l->buckets[n];
+		if (seen >= rank)
+			return min_t(xnticks_t, 1ULL << n, l->max);
+	}
+
+	return l->max;
+}
+
+static int vfile_schedlat_show(struct xnvfile_snapshot_iterator *it,
+			       void *data)
+{
+	struct vfile_schedlat_data *p = data;
+	xnstat_latency_t *l;
+	xnticks_t avg = 0;
+
+	if (p == NULL) {
+		xnvfile_printf(it,
+			       "%-3s  %-6s %-10s %-10s %-10s %-10s %-10s  %s\n",
+			       "CPU", "PID", "COUNT", "AVG(ns)", "P99(ns)",
+			       "P999(ns)", "MAX(ns)", "NAME");
+		return 0;
+	}
+
+	l = &p->latency;
+	if (l->count)
+		avg = xnarch_ulldiv(l->sum, l->count, NULL);
+
+	xnvfile_printf(it,
+		       "%3u  %-6d %-10lu %-10Lu %-10Lu %-10Lu %-10Lu  %s%s%s\n",
+		       p->cpu, p->pid, l->count,
+		       xnclock_ticks_to_ns(&nkclock, avg),
+		       xnclock_ticks_to_ns(&nkclock, schedlat_percentile(l, 990)),
+		       xnclock_ticks_to_ns(&nkclock, schedlat_percentile(l, 999)),
+		       xnclock_ticks_to_ns(&nkclock, l->max),
+		       (p->state & XNUSER) ? "" : "[",
+		       p->name,
+		       (p->state & XNUSER) ? "" : "]");
+
+	return 0;
+}
+
+static struct xnvfile_snapshot_ops vfile_schedlat_ops = {
+	.rewind = vfile_schedlat_rewind,
+	.next = vfile_schedlat_next,
+	.show = vfile_schedlat_show,
+};
+
+/*
+ * The binary flavour emits a struct xnstat_latency_header, followed
+ * by one struct xnstat_latency_record per thread.
+ */
+static struct xnvfile_snapshot_ops vfile_schedlatbin_ops;
+
+static struct xnvfile_snapshot schedlatbin_vfile = {
+	.privsz = sizeof(struct vfile_schedlat_priv),
+	.datasz = sizeof(struct vfile_schedlat_data),
+	.tag = &nkthreadlist_tag,
+	.ops = &vfile_schedlatbin_ops,
+};
+
+static int vfile_schedlatbin_show(struct xnvfile_snapshot_iterator *it,
+				  void *data)
+{
+	struct vfile_schedlat_data *p = data;
+	struct xnstat_latency_header h;
+	struct xnstat_latency_record r;
+	int n;
+
+	if (p == NULL) {
+		h.magic = XNSTAT_LATENCY_MAGIC;
+		h.nr_buckets = XNSTAT_LATENCY_BUCKETS;
+		for (n = 0; n < XNSTAT_LATENCY_BUCKETS; n++)
+			h.limits_ns[n] = xnclock_ticks_to_ns(&nkclock, 1ULL << n);
+		xnvfile_write(it, &h, sizeof(h));
+		return 0;
+	}
+
+	memset(&r, 0, sizeof(r));
+	r.cpu = p->cpu;
+	r.pid = p->pid;
+	r.count = p->latency.count;
+	r.sum_ns = xnclock_ticks_to_ns(&nkclock, p->latency.sum);
+	r.max_ns = xnclock_ticks_to_ns(&nkclock, p->latency.max);
+	for (n = 0; n < XNSTAT_LATENCY_BUCKETS; n++)
+		r.buckets[n] = p->latency.buckets[n];
+	memcpy(r.name, p->name, sizeof(r.name));
+	xnvfile_write(it, &r, sizeof(r));
+
+	return 0;
+}
+
+static struct xnvfile_snapshot_ops vfile_schedlatbin_ops = {
+	.rewind = vfile_schedlat_rewind,
+	.next = vfile_schedlat_next,
+	.show = vfile_schedlatbin_show,
+};
+
+#endif /* CONFIG_XENO_OPT_STATS_LATENCY */
+
 #endif /* CONFIG_XENO_OPT_STATS */
 
 #ifdef CONFIG_SMP
@@ -1448,6 +1793,35 @@ static struct xnvfile_regular affinity_vfile = {
 
 #endif /* CONFIG_SMP */
 
+#ifdef CONFIG_XENO_OPT_SCHED_CLUSTER
+
+static int migration_vfile_show(struct xnvfile_regular_iterator *it,
+				void *data)
+{
+	struct xnsched *sched;
+	int cpu;
+
+	xnvfile_printf(it, "%-3s  %-10s %-10s\n", "CPU", "PUSHED", "PULLED");
+
+	for_each_realtime_cpu(cpu) {
+		sched = xnsched_struct(cpu);
+		xnvfile_printf(it, "%3u  %-10lu %-10lu\n",
+			       cpu, sched->nr_pushed, sched->nr_pulled);
+	}
+
+	return 0;
+}
+
+static struct xnvfile_regular_ops migration_vfile_ops = {
+	.show = migration_vfile_show,
+};
+
+static struct xnvfile_regular migration_vfile = {
+	.ops = &migration_vfile_ops,
+};
+
+#endif /* CONFIG_XENO_OPT_SCHED_CLUSTER */
+
 int xnsched_init_proc(void)
 {
 	struct xnsched_class *p;
@@ -1476,8 +1850,23 @@ int xnsched_init_proc(void)
 	ret = xnvfile_init_snapshot("acct", &schedacct_vfile, &sched_vfroot);
 	if (ret)
 		return ret;
+#ifdef CONFIG_XENO_OPT_STATS_LATENCY
+	ret = xnvfile_init_snapshot("latency", &schedlat_vfile, &sched_vfroot);
+	if (ret)
+		return ret;
+	ret = xnvfile_init_snapshot("latency.bin", &schedlatbin_vfile,
+				    &sched_vfroot);
+	if (ret)
+		return ret;
+#endif /* CONFIG_XENO_OPT_STATS_LATENCY */
 #endif /* CONFIG_XENO_OPT_STATS */
 
+#ifdef CONFIG_XENO_OPT_SCHED_CLUSTER
+	ret = xnvfile_init_regular("migration", &migration_vfile, &sched_vfroot);
+	if (ret)
+		return ret;
+#endif /* CONFIG_XENO_OPT_SCHED_CLUSTER */
+
 #ifdef CONFIG_SMP
 	xnvfile_init_regular("affinity", &affinity_vfile, &cobalt_vfroot);
 #endif /* CONFIG_SMP */
@@ -1497,7 +1886,14 @@ void xnsched_cleanup_proc(void)
 #ifdef CONFIG_SMP
 	xnvfile_destroy_regular(&affinity_vfile);
 #endif /* CONFIG_SMP */
+#ifdef CONFIG_XENO_OPT_SCHED_CLUSTER
+	xnvfile_destroy_regular(&migration_vfile);
+#endif /* CONFIG_XENO_OPT_SCHED_CLUSTER */
 #ifdef CONFIG_XENO_OPT_STATS
+#ifdef CONFIG_XENO_OPT_STATS_LATENCY
+	xnvfile_destroy_snapshot(&schedlatbin_vfile);
+	xnvfile_destroy_snapshot(&schedlat_vfile);
+#endif /* CONFIG_XENO_OPT_STATS_LATENCY */
 	xnvfile_destroy_snapshot(&schedacct_vfile);
 	xnvfile_destroy_snapshot(&schedstat_vfile);
 #endif /* CONFIG_XENO_OPT_STATS */
@@ -45,6 +45,11 @@
  * - a @a struct @a xnselector structure, the selection structure,  passed by
  * the thread calling the xnselect service, where this service does all its
  * housekeeping.
+ *
+ * A selector may also be made persistent, in which case file
+ * descriptors are registered once as items of the selector, and
+ * those which are ready are linked into a list, so that
+ * xnselector_wait() only has to consider the ready ones.
  * @{
  */
 
@@ -72,6 +77,53 @@ static inline int xnselect_wakeup(struct xnselector *selector)
 	return xnsynch_flush(&selector->synchbase, 0) == XNSYNCH_RESCHED;
 }
 
+static void sync_item(struct xnselector *selector, struct xnselect_item *item)
+{
+	unsigned int type, pending = 0;
+
+	for (type = 0; type < XNSELECT_MAX_TYPES; type++)
+		if ((item->events & (1 << type)) &&
+		    __FD_ISSET__(item->index, &selector->fds[type].pending))
+			pending |= (1 << type);
+
+	if (pending && item->pending == 0)
+		list_add_tail(&item->link, &selector->ready);
+	else if (pending == 0 && item->pending)
+		list_del(&item->link);
+
+	item->pending = pending;
+}
+
+static inline void update_item(struct xnselector *selector, unsigned index)
+{
+	struct xnselect_item *item;
+
+	if (selector->items == NULL || index >= __FD_SETSIZE)
+		return;
+
+	item = selector->items[index];
+	if (item)
+		sync_item(selector, item);
+}
+
+static struct xnselect_item *
+detach_item(struct xnselector *selector, unsigned int index)
+{
+	struct xnselect_item *item;
+
+	if (selector->items == NULL || index >= __FD_SETSIZE)
+		return NULL;
+
+	item = selector->items[index];
+	if (item) {
+		selector->items[index] = NULL;
+		if (item->pending)
+			list_del(&item->link);
+	}
+
+	return item;
+}
+
 /**
  * Bind a file descriptor (represented by its @a xnselect structure) to a
  * selector block.
@@ -126,10 +178,13 @@ int xnselect_bind(struct xnselect *select_block,
 	__FD_SET__(index, &selector->fds[type].expected);
 	if (state) {
 		__FD_SET__(index, &selector->fds[type].pending);
+		update_item(selector, index);
 		if (xnselect_wakeup(selector))
 			xnsched_run();
-	} else
+	} else {
 		__FD_CLR__(index, &selector->fds[type].pending);
+		update_item(selector, index);
+	}
 
 	return 0;
 }
@@ -149,12 +204,15 @@ int __xnselect_signal(struct xnselect *select_block, unsigned state)
 					&selector->fds[binding->type].pending)) {
 				__FD_SET__(binding->bit_index,
 					 &selector->fds[binding->type].pending);
+				update_item(selector, binding->bit_index);
 				if (xnselect_wakeup(selector))
 					resched = 1;
 			}
-		} else
+		} else {
 			__FD_CLR__(binding->bit_index,
 				 &selector->fds[binding->type].pending);
+			update_item(selector, binding->bit_index);
+		}
 	}
 
 	return resched;
@@ -164,7 +222,9 @@ EXPORT_SYMBOL_GPL(__xnselect_signal);
 /**
  * Destroy the @a xnselect structure associated with a file descriptor.
  *
- * Any binding with a @a xnselector block is destroyed.
+ * Any binding with a @a xnselector block is destroyed. Persistent
+ * selectors also drop the item registered for the file descriptor,
+ * instead of reporting it ready.
  *
  * @param select_block pointer to the @a xnselect structure associated
  * with a file descriptor
@@ -174,6 +234,7 @@ EXPORT_SYMBOL_GPL(__xnselect_signal);
 void xnselect_destroy(struct xnselect *select_block)
 {
 	struct xnselect_binding *binding, *tmp;
+	struct xnselect_item *item;
 	struct xnselector *selector;
 	int resched = 0;
 	spl_t s;
@@ -188,7 +249,17 @@ void xnselect_destroy(struct xnselect *select_block)
 		selector = binding->selector;
 		__FD_CLR__(binding->bit_index,
 			 &selector->fds[binding->type].expected);
-		if (!__FD_ISSET__(binding->bit_index,
+		item = NULL;
+		if (selector->items) {
+			/*
+			 * Nobody is left to consume events from a
+			 * closed fd, and its index may be reused: forget
+			 * about it.
+			 */
+			__FD_CLR__(binding->bit_index,
+				 &selector->fds[binding->type].pending);
+			item = detach_item(selector, binding->bit_index);
+		} else if (!__FD_ISSET__(binding->bit_index,
 				&selector->fds[binding->type].pending)) {
 			__FD_SET__(binding->bit_index,
 				 &selector->fds[binding->type].pending);
@@ -198,6 +269,8 @@ void xnselect_destroy(struct xnselect *select_block)
 		list_del(&binding->slink);
 		xnlock_put_irqrestore(&nklock, s);
 		xnfree(binding);
+		if (item)
+			xnfree(item);
 		xnlock_get_irqsave(&nklock, s);
 	}
 	if (resched)
@@ -289,11 +362,170 @@ int xnselector_init(struct xnselector *selector)
 		__FD_ZERO__(&selector->fds[i].pending);
 	}
 	INIT_LIST_HEAD(&selector->bindings);
+	INIT_LIST_HEAD(&selector->ready);
+	selector->items = NULL;
 
 	return 0;
 }
 EXPORT_SYMBOL_GPL(xnselector_init);
 
+/**
+ * Initialize a persistent selector structure.
+ *
+ * A persistent selector keeps track of the file descriptors it has
+ * been told about with xnselector_add_item(), and maintains a list of
+ * those which are ready, for xnselector_wait() to pick from.
+ *
+ * @param selector The selector structure to be initialized.
+ *
+ * @retval 0 on success;
+ * @retval -ENOMEM if the item table could not be allocated.
+ *
+ * @coretags{task-unrestricted}
+ */
+int xnselector_init_persistent(struct xnselector *selector)
+{
+	size_t size = __FD_SETSIZE * sizeof(struct xnselect_item *);
+
+	xnselector_init(selector);
+	selector->items = xnmalloc(size);
+	if (selector->items == NULL)
+		return -ENOMEM;
+
+	memset(selector->items, 0, size);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xnselector_init_persistent);
+
+/**
+ * Register an item with a persistent selector.
+ *
+ * @param selector The selector the item should be added to.
+ *
+ * @param item An item allocated with xnmalloc(), with the index,
+ * events and cookie fields set. The selector owns the item once
+ * added, until it is removed by a call to xnselector_del_item(), or
+ * the file descriptor is closed.
+ *
+ * The file descriptor represented by @a item->index should have been
+ * bound to @a selector by xnselect_bind() for each event type in @a
+ * item->events beforehand.
+ *
+ * @retval 0 on success;
+ * @retval -EINVAL if the index is out of range;
+ * @retval -EEXIST if an item is already registered at this index.
+ *
+ * @coretags{task-unrestricted}
+ */
+int xnselector_add_item(struct xnselector *selector,
+			struct xnselect_item *item)
+{
+	int ret = 0;
+	spl_t s;
+
+	if (item->index >= __FD_SETSIZE)
+		return -EINVAL;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	if (selector->items[item->index]) {
+		ret = -EEXIST;
+		goto out;
+	}
+
+	selector->items[item->index] = item;
+	item->pending = 0;
+	sync_item(selector, item);
+	if (item->pending && xnselect_wakeup(selector))
+		xnsched_run();
+out:
+	xnlock_put_irqrestore(&nklock, s);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(xnselector_add_item);
+
+/**
+ * Change the events watched by an item of a persistent selector.
+ *
+ * @param selector The selector the item belongs to.
+ *
+ * @param index The index of the item.
+ *
+ * @param events The new mask of watched events.
+ *
+ * @param cookie The new cookie value.
+ *
+ * @retval 0 on success;
+ * @retval -ENOENT if no item is registered at this index.
+ *
+ * @coretags{task-unrestricted}
+ */
+int xnselector_mod_item(struct xnselector *selector, unsigned int index,
+			unsigned int events, __u64 cookie)
+{
+	struct xnselect_item *item;
+	int ret = 0;
+	spl_t s;
+
+	if (index >= __FD_SETSIZE)
+		return -ENOENT;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	item = selector->items[index];
+	if (item == NULL) {
+		ret = -ENOENT;
+		goto out;
+	}
+
+	item->events = events;
+	item->cookie = cookie;
+	sync_item(selector, item);
+	if (item->pending && xnselect_wakeup(selector))
+		xnsched_run();
+out:
+	xnlock_put_irqrestore(&nklock, s);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(xnselector_mod_item);
+
+/**
+ * Remove an item from a persistent selector.
+ *
+ * The bindings established for the corresponding file descriptor are
+ * left in place, they are dropped when either the file descriptor or
+ * the selector goes away. Closing the file descriptor removes the
+ * item as well.
+ *
+ * @param selector The selector the item belongs to.
+ *
+ * @param index The index of the item.
+ *
+ * @return The removed item, which the caller should release with
+ * xnfree(), or NULL if no item is registered at this index.
+ *
+ * @coretags{task-unrestricted}
+ */
+struct xnselect_item *
+xnselector_del_item(struct xnselector *selector, unsigned int index)
+{
+	struct xnselect_item *item;
+	spl_t s;
+
+	if (index >= __FD_SETSIZE)
+		return NULL;
+
+	xnlock_get_irqsave(&nklock, s);
+	item = detach_item(selector, index);
+	xnlock_put_irqrestore(&nklock, s);
+
+	return item;
+}
+EXPORT_SYMBOL_GPL(xnselector_del_item);
+
 /**
  * Check the state of a number of file descriptors, wait for a state change if
  * no descriptor is ready.
@@ -384,6 +616,81 @@ int xnselect(struct xnselector *selector,
 }
 EXPORT_SYMBOL_GPL(xnselect);
 
+/**
+ * Wait for items of a persistent selector to become ready.
+ *
+ * Ready items are reported in list order, then moved to the end of
+ * the ready list, so that all of them eventually get reported when
+ * more items are ready than @a maxevents. The cost of this call
+ * depends on the number of ready items, not on the number of items
+ * registered with the selector.
+ *
+ * @param selector The persistent selector to wait on.
+ *
+ * @param events An array receiving the ready items.
+ *
+ * @param maxevents The number of entries available in @a events.
+ *
+ * @param timeout the timeout, whose meaning depends on @a
+ * timeout_mode, passed unchanged to xnsynch_sleep_on(). XN_NONBLOCK
+ * with XN_RELATIVE causes the call to return immediately.
+ *
+ * @param timeout_mode the mode of @a timeout.
+ *
+ * @retval -EINTR if the wait was interrupted;
+ * @retval 0 in case of timeout;
+ * @retval the number of entries filled in @a events.
+ *
+ * @coretags{primary-only, might-switch}
+ */
+int xnselector_wait(struct xnselector *selector,
+		    struct xnselect_event *events, int maxevents,
+		    xnticks_t timeout, xntmode_t timeout_mode)
+{
+	struct xnselect_item *item;
+	int info = 0, n, i;
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	if (timeout_mode == XN_RELATIVE && timeout == XN_NONBLOCK)
+		goto collect;
+
+	while (list_empty(&selector->ready)) {
+		info = xnsynch_sleep_on(&selector->synchbase,
+					timeout, timeout_mode);
+		if (info & (XNBREAK | XNTIMEO | XNRMID))
+			break;
+	}
+collect:
+	n = 0;
+	list_for_each_entry(item, &selector->ready, link) {
+		if (n >= maxevents)
+			break;
+		events[n].index = item->index;
+		events[n].events = item->pending;
+		events[n].cookie = item->cookie;
+		n++;
+	}
+
+	for (i = 0; i < n; i++)
+		list_rotate_left(&selector->ready);
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	if (n > 0)
+		return n;
+
+	if (info & XNBREAK)
+		return -EINTR;
+
+	if (info & XNRMID)
+		return -EBADF;
+
+	return 0; /* Timeout */
+}
+EXPORT_SYMBOL_GPL(xnselector_wait);
+
 /**
  * Destroy a selector block.
  *
@@ -409,7 +716,7 @@ static void xnselector_destroy_loop(void *cookie)
 	struct xnselect_binding *binding, *tmpb;
 	struct xnselector *selector, *tmps;
 	struct xnselect *fd;
-	int resched;
+	int resched, i;
 	spl_t s;
 
 	xnlock_get_irqsave(&nklock, s);
@@ -433,6 +740,12 @@ static void xnselector_destroy_loop(void *cookie)
 		resched = xnsynch_destroy(&selector->synchbase) == XNSYNCH_RESCHED;
 		xnlock_put_irqrestore(&nklock, s);
 
+		if (selector->items) {
+			for (i = 0; i < __FD_SETSIZE; i++)
+				if (selector->items[i])
+					xnfree(selector->items[i]);
+			xnfree(selector->items);
+		}
 		xnfree(selector);
 		if (resched)
 			xnsched_run();
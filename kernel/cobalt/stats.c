@@ -0,0 +1,276 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/fcntl.h>
+#include <linux/bitmap.h>
+#include <cobalt/kernel/sched.h>
+#include <cobalt/kernel/thread.h>
+#include <cobalt/kernel/stat.h>
+#include <cobalt/uapi/kernel/stats.h>
+#include <rtdm/driver.h>
+#include <asm/xenomai/machine.h>
+
+/*
+ * Binary statistics map. A single vmalloc'ed area holds a header
+ * page, followed by one record per possible CPU, then by a fixed
+ * number of thread slots. Records are updated in place under
+ * nklock, mostly from the context switch code, and the area can be
+ * mapped read-only into user-space through the stats device, so
+ * that monitoring tools may poll the statistics of a live system
+ * without perturbing it.
+ */
+
+#define XNSTAT_MAP_SLOTS  CONFIG_XENO_OPT_STATS_MAP_SLOTS
+
+static void *stats_area;
+
+static struct cobalt_stats_header *stats_header;
+
+static struct cobalt_stats_cpu *stats_cpus;
+
+static struct cobalt_stats_thread *stats_threads;
+
+static DECLARE_BITMAP(stats_slotmap, XNSTAT_MAP_SLOTS);
+
+static inline void stats_write_begin(__u32 *seq)
+{
+	(*seq)++;
+	smp_wmb();
+}
+
+static inline void stats_write_end(__u32 *seq)
+{
+	smp_wmb();
+	(*seq)++;
+}
+
+static void publish_thread(struct cobalt_stats_thread *p,
+			   struct xnthread *thread)
+{
+	p->pid = xnthread_host_pid(thread);
+	p->cpu = xnsched_cpu(thread->sched);
+	p->cprio = thread->cprio;
+	p->state = thread->state;
+	p->exectime = xnstat_exectime_get_total(&thread->stat.account);
+	p->csw = xnstat_counter_get(&thread->stat.csw);
+	p->msw = xnstat_counter_get(&thread->stat.ssw);
+	p->xsc = xnstat_counter_get(&thread->stat.xsc);
+	p->pf = xnstat_counter_get(&thread->stat.pf);
+}
+
+void xnstat_map_attach(struct xnthread *thread) /* nklock held, irqs off */
+{
+	struct cobalt_stats_thread *p;
+	int n;
+
+	if (stats_threads == NULL)
+		return;
+
+	n = find_first_zero_bit(stats_slotmap, XNSTAT_MAP_SLOTS);
+	if (n >= XNSTAT_MAP_SLOTS) {
+		stats_header->overflows++;
+		return;
+	}
+
+	__set_bit(n, stats_slotmap);
+	p = stats_threads + n;
+	stats_write_begin(&p->seq);
+	p->flags = COBALT_STATS_SLOT_USED;
+	memcpy(p->name, thread->name, sizeof(p->name));
+	publish_thread(p, thread);
+	stats_write_end(&p->seq);
+	thread->stat.slot = p;
+}
+
+void xnstat_map_detach(struct xnthread *thread) /* nklock held, irqs off */
+{
+	struct cobalt_stats_thread *p = thread->stat.slot;
+
+	if (p == NULL)
+		return;
+
+	stats_write_begin(&p->seq);
+	p->flags = 0;
+	stats_write_end(&p->seq);
+	__clear_bit(p - stats_threads, stats_slotmap);
+	thread->stat.slot = NULL;
+}
+
+void xnstat_map_update(struct xnthread *thread) /* nklock held, irqs off */
+{
+	struct cobalt_stats_thread *p = thread->stat.slot;
+
+	if (p == NULL)
+		return;
+
+	stats_write_begin(&p->seq);
+	memcpy(p->name, thread->name, sizeof(p->name));
+	publish_thread(p, thread);
+	stats_write_end(&p->seq);
+}
+
+void xnstat_map_switch(struct xnsched *sched,
+		       struct xnthread *prev, struct xnthread *next)
+{				/* nklock held, irqs off */
+	struct cobalt_stats_thread *p = prev->stat.slot;
+	struct cobalt_stats_cpu *c;
+
+	if (stats_cpus == NULL)
+		return;
+
+	/* The exectime of @prev was just accounted for. */
+	if (p) {
+		stats_write_begin(&p->seq);
+		publish_thread(p, prev);
+		stats_write_end(&p->seq);
+	}
+
+	c = stats_cpus + xnsched_cpu(sched);
+	stats_write_begin(&c->seq);
+	c->curr = next->stat.slot ? next->stat.slot - stats_threads : -1;
+	c->csw++;
+	c->switch_date = xnstat_exectime_get_last_switch(sched);
+	stats_write_end(&c->seq);
+}
+
+static int stats_open(struct rtdm_fd *fd, int oflags)
+{
+	if ((oflags & O_ACCMODE) != O_RDONLY)
+		return -EACCES;
+
+	return 0;
+}
+
+static int stats_ioctl_nrt(struct rtdm_fd *fd,
+			   unsigned int request, void __user *arg)
+{
+	switch (request) {
+	case STATS_RTIOC_INFO:
+		return rtdm_safe_copy_to_user(fd, arg, stats_header,
+					      sizeof(*stats_header));
+	default:
+		return -EINVAL;
+	}
+}
+
+static int stats_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+	size_t len = vma->vm_end - vma->vm_start;
+
+	if (vma->vm_pgoff || len > stats_header->map_size)
+		return -EINVAL;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EACCES;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	return rtdm_mmap_vmem(vma, stats_area);
+}
+
+static struct rtdm_driver stats_driver = {
+	.profile_info	=	RTDM_PROFILE_INFO(stats,
+						  RTDM_CLASS_COBALT,
+						  RTDM_SUBCLASS_GENERIC,
+						  0),
+	.device_flags	=	RTDM_NAMED_DEVICE,
+	.device_count	=	1,
+	.ops = {
+		.open		=	stats_open,
+		.ioctl_nrt	=	stats_ioctl_nrt,
+		.mmap		=	stats_mmap,
+	},
+};
+
+static struct rtdm_device stats_device = {
+	.driver = &stats_driver,
+	.label = COBALT_STATS_DEV,
+};
+
+int __init xnstat_map_init(void)
+{
+	size_t cpu_area, thread_area, map_size;
+	struct cobalt_stats_header *h;
+	struct xnthread *thread;
+	int cpu, ret;
+	spl_t s;
+
+	cpu_area = PAGE_ALIGN(nr_cpu_ids * sizeof(struct cobalt_stats_cpu));
+	thread_area = PAGE_ALIGN(XNSTAT_MAP_SLOTS *
+				 sizeof(struct cobalt_stats_thread));
+	map_size = PAGE_SIZE + cpu_area + thread_area;
+
+	stats_area = vmalloc_user(map_size);
+	if (stats_area == NULL)
+		return -ENOMEM;
+
+	h = stats_area;
+	h->magic = COBALT_STATS_MAGIC;
+	h->version = COBALT_STATS_VERSION;
+	h->nr_cpus = nr_cpu_ids;
+	h->nr_slots = XNSTAT_MAP_SLOTS;
+	h->cpu_offset = PAGE_SIZE;
+	h->cpu_size = sizeof(struct cobalt_stats_cpu);
+	h->thread_offset = PAGE_SIZE + cpu_area;
+	h->thread_size = sizeof(struct cobalt_stats_thread);
+	h->clock_freq = cobalt_pipeline.clock_freq;
+	h->map_size = map_size;
+	stats_header = h;
+
+	ret = rtdm_dev_register(&stats_device);
+	if (ret) {
+		vfree(stats_area);
+		stats_area = NULL;
+		return ret;
+	}
+
+	xnlock_get_irqsave(&nklock, s);
+
+	stats_cpus = stats_area + h->cpu_offset;
+	for_each_possible_cpu(cpu)
+		stats_cpus[cpu].curr = -1;
+
+	/* Only the root threads may exist at this point. */
+	stats_threads = stats_area + h->thread_offset;
+	list_for_each_entry(thread, &nkthreadq, glink)
+		xnstat_map_attach(thread);
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	return 0;
+}
+
+void xnstat_map_cleanup(void)
+{
+	struct xnthread *thread;
+	spl_t s;
+
+	/* All writers hold nklock. */
+	xnlock_get_irqsave(&nklock, s);
+
+	list_for_each_entry(thread, &nkthreadq, glink)
+		xnstat_map_detach(thread);
+
+	stats_cpus = NULL;
+	stats_threads = NULL;
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	rtdm_dev_unregister(&stats_device);
+	vfree(stats_area);
+	stats_area = NULL;
+}
@@ -929,6 +929,18 @@ bool xnsynch_release(struct xnsynch *synch, struct xnthread *curr)
 
 	lockp = xnsynch_fastlock(synch);
 	currh = curr->handle;
+
+	/*
+	 * An uncontended release of an object which is not boosting
+	 * us does not need the superlock, like the fast unlock path
+	 * of libcobalt: only the owner may set XNSYNCH_CEILING, and
+	 * contenders raise FLCLAIM atomically, in which case the
+	 * cmpxchg below fails and we fall back to the locked path.
+	 */
+	if ((synch->status & XNSYNCH_CEILING) == 0 &&
+	    atomic_cmpxchg(lockp, currh, XN_NO_HANDLE) == currh)
+		return false;
+
 	/*
 	 * FLCEIL may only be raised by the owner, or when the owner
 	 * is blocked waiting for the synch (ownership transfer). In
@@ -34,6 +34,7 @@
 #include <cobalt/kernel/clock.h>
 #include <cobalt/kernel/stat.h>
 #include <cobalt/kernel/trace.h>
+#include <cobalt/kernel/evtrace.h>
 #include <cobalt/kernel/assert.h>
 #include <cobalt/kernel/select.h>
 #include <cobalt/kernel/lock.h>
@@ -75,11 +76,46 @@ static void periodic_handler(struct xntimer *timer)
 	xntimer_set_affinity(&thread->ptimer, thread->sched);
 }
 
+static void relgroup_handler(struct xntimer *timer)
+{
+	struct xnrelgroup *group = container_of(timer, struct xnrelgroup, timer);
+	struct xnthread *thread;
+
+	/*
+	 * Missed expiries are folded into periodic_ticks by the
+	 * clock code, so this counts every group period elapsed since
+	 * the first release, including overrun ones.
+	 */
+	group->ticks = timer->periodic_ticks + 1;
+
+	/*
+	 * Members are linked by decreasing priority, so that the
+	 * highest priority threads due for release are readied
+	 * first. Same rules as periodic_handler() otherwise.
+	 */
+	list_for_each_entry(thread, &group->members, relgroup_next) {
+		if ((xnsticks_t)(group->ticks - thread->relgroup_release) <= 0)
+			continue;
+		if (xnthread_test_state(thread, XNDELAY|XNPEND) == XNDELAY &&
+		    !xntimer_running_p(&thread->rtimer))
+			xnthread_resume(thread, XNDELAY);
+	}
+}
+
+static inline void leave_relgroup(struct xnthread *thread)
+{				/* nklock held, irqs off */
+	if (thread->relgroup) {
+		list_del(&thread->relgroup_next);
+		thread->relgroup = NULL;
+	}
+}
+
 static inline void enlist_new_thread(struct xnthread *thread)
 {				/* nklock held, irqs off */
 	list_add_tail(&thread->glink, &nkthreadq);
 	cobalt_nrthreads++;
 	xnvfile_touch_tag(&nkthreadlist_tag);
+	xnstat_map_attach(thread);
 }
 
 struct kthread_arg {
@@ -210,6 +246,8 @@ int __xnthread_init(struct xnthread *thread,
 		     sched, gravity);
 	xntimer_set_name(&thread->ptimer, thread->name);
 	xntimer_set_priority(&thread->ptimer, XNTIMER_HIPRIO);
+	thread->relgroup = NULL;
+	INIT_LIST_HEAD(&thread->relgroup_next);
 
 	thread->base_class = NULL; /* xnsched_set_policy() will set it. */
 	ret = xnsched_init_thread(thread);
@@ -475,6 +513,7 @@ static inline void cleanup_tcb(struct xnthread *curr) /* nklock held, irqs off *
 	list_del(&curr->glink);
 	cobalt_nrthreads--;
 	xnvfile_touch_tag(&nkthreadlist_tag);
+	xnstat_map_detach(curr);
 
 	if (xnthread_test_state(curr, XNREADY)) {
 		XENO_BUG_ON(COBALT, xnthread_test_state(curr, XNTHREAD_BLOCK_BITS));
@@ -485,6 +524,8 @@ static inline void cleanup_tcb(struct xnthread *curr) /* nklock held, irqs off *
 	if (xnthread_test_state(curr, XNPEND))
 		xnsynch_forget_sleeper(curr);
 
+	leave_relgroup(curr);
+
 	xnthread_set_state(curr, XNZOMBIE);
 	/*
 	 * NOTE: we must be running over the root thread, or @curr
@@ -550,7 +591,9 @@ void __xnthread_discard(struct xnthread *thread)
 		list_del(&thread->glink);
 		cobalt_nrthreads--;
 		xnvfile_touch_tag(&nkthreadlist_tag);
+		xnstat_map_detach(thread);
 	}
+	leave_relgroup(thread);
 	xnthread_deregister(thread);
 	xnlock_put_irqrestore(&nklock, s);
 }
@@ -776,6 +819,13 @@ EXPORT_SYMBOL_GPL(xnthread_start);
  * xnthread_suspend(). If XNWARN is set for the current thread,
  * SIGDEBUG is sent in addition to raising the break condition.
  *
+ * - XNCLUSTER lets the scheduler move the current thread to any CPU
+ * of its affinity set while it runs in primary mode, when it is
+ * ready to run but preempted on its own CPU, and some other CPU of
+ * the set runs a lower priority thread or idles. This is only
+ * available with CONFIG_XENO_OPT_SCHED_CLUSTER, and only affects
+ * threads from the SCHED_FIFO/SCHED_RR class.
+ *
  * @coretags{primary-only, might-switch}
  *
  * @note Setting @a clrmask and @a setmask to zero leads to a nop,
@@ -1176,6 +1226,8 @@ clear_wchan:
 		 */
 		xnsynch_forget_sleeper(thread);
 
+	xnstat_latency_release(&thread->stat.latency);
+
 	if (unlikely((oldstate & mask) & XNHELD)) {
 		xnsched_requeue(thread);
 		goto ready;
@@ -1185,6 +1237,12 @@ enqueue:
 ready:
 	xnthread_set_state(thread, XNREADY);
 	xnsched_set_resched(sched);
+	/*
+	 * A hardening thread may still be switching out from the
+	 * host kernel on its current CPU, leave it there.
+	 */
+	if ((mask & XNRELAX) == 0)
+		xnsched_cluster_push(thread);
 unlock_and_exit:
 	xnlock_put_irqrestore(&nklock, s);
 }
@@ -1319,6 +1377,8 @@ int xnthread_set_periodic(struct xnthread *thread, xnticks_t idate,
 		
 	xnlock_get_irqsave(&nklock, s);
 
+	leave_relgroup(thread);
+
 	if (period == XN_INFINITE) {
 		if (xntimer_running_p(&thread->ptimer))
 			xntimer_stop(&thread->ptimer);
@@ -1359,6 +1419,47 @@ unlock_and_exit:
 }
 EXPORT_SYMBOL_GPL(xnthread_set_periodic);
 
+static int wait_relgroup_period(struct xnthread *thread,
+				unsigned long *overruns_r)
+{				/* nklock held, irqs off */
+	struct xnrelgroup *group = thread->relgroup;
+	unsigned long overruns, rem;
+
+	if (unlikely(!xntimer_running_p(&group->timer)))
+		return -EWOULDBLOCK;
+
+	trace_cobalt_thread_wait_period(thread);
+
+	/*
+	 * relgroup_release is the index of the group timer expiry
+	 * which releases us next; we are due once group->ticks has
+	 * gone past it.
+	 */
+	while ((xnsticks_t)(group->ticks - thread->relgroup_release) <= 0) {
+		xnthread_suspend(thread, XNDELAY, XN_INFINITE, XN_RELATIVE, NULL);
+		if (unlikely(xnthread_test_info(thread, XNBREAK)))
+			return -EINTR;
+		group = thread->relgroup;
+		if (group == NULL)
+			return -EIDRM;
+	}
+
+	overruns = xnarch_ulldiv(group->ticks - 1 - thread->relgroup_release,
+				 thread->relgroup_mult, &rem);
+	thread->relgroup_release += (xnticks_t)(overruns + 1) *
+		thread->relgroup_mult;
+
+	if (likely(overruns_r != NULL))
+		*overruns_r = overruns;
+
+	if (overruns) {
+		trace_cobalt_thread_missed_period(thread);
+		return -ETIMEDOUT;
+	}
+
+	return 0;
+}
+
 /**
  * @fn int xnthread_wait_period(unsigned long *overruns_r)
  * @brief Wait for the next periodic release point.
@@ -1377,7 +1478,11 @@ EXPORT_SYMBOL_GPL(xnthread_set_periodic);
  * is copied to the pointed memory location. Otherwise:
  *
  * - -EWOULDBLOCK is returned if xnthread_set_periodic() has not
- * previously been called for the calling thread.
+ * previously been called for the calling thread, or if the release
+ * group the caller belongs to has not been started.
+ *
+ * - -EIDRM is returned if the release group the caller belongs to
+ * was deleted while waiting.
  *
  * - -EINTR is returned if xnthread_unblock() has been called for the
  * waiting thread before the next periodic release point has been
@@ -1403,6 +1508,11 @@ int xnthread_wait_period(unsigned long *overruns_r)
 
 	xnlock_get_irqsave(&nklock, s);
 
+	if (thread->relgroup) {
+		ret = wait_relgroup_period(thread, overruns_r);
+		goto out;
+	}
+
 	if (unlikely(!xntimer_running_p(&thread->ptimer))) {
 		ret = -EWOULDBLOCK;
 		goto out;
@@ -1437,6 +1547,204 @@ int xnthread_wait_period(unsigned long *overruns_r)
 }
 EXPORT_SYMBOL_GPL(xnthread_wait_period);
 
+/**
+ * @fn void xnrelgroup_init(struct xnrelgroup *group, struct xnclock *clock, struct xnsched *sched)
+ * @brief Initialize a periodic release group.
+ *
+ * A release group drives the periodic release points of threads
+ * with harmonic periods from a single timer, instead of one periodic
+ * timer per thread. Each member thread is released every N expiries
+ * of the group timer, N being its period multiplier (see
+ * xnthread_join_relgroup()). All members due at the same expiry are
+ * readied from a single timer shot, by decreasing priority order.
+ *
+ * @param group The group descriptor.
+ *
+ * @param clock The clock the group timer should be based on.
+ *
+ * @param sched The scheduler slot the group timer should be
+ * affine to.
+ *
+ * @coretags{task-unrestricted}
+ */
+void xnrelgroup_init(struct xnrelgroup *group,
+		     struct xnclock *clock, struct xnsched *sched)
+{
+	xntimer_init(&group->timer, clock, relgroup_handler,
+		     sched, XNTIMER_UGRAVITY);
+	xntimer_set_name(&group->timer, "[relgroup]");
+	xntimer_set_priority(&group->timer, XNTIMER_HIPRIO);
+	INIT_LIST_HEAD(&group->members);
+	group->ticks = 0;
+}
+EXPORT_SYMBOL_GPL(xnrelgroup_init);
+
+/**
+ * @fn int xnrelgroup_start(struct xnrelgroup *group, xnticks_t idate, xntmode_t timeout_mode, xnticks_t period)
+ * @brief Start the timer of a release group.
+ *
+ * Program the first release point and the base period of a release
+ * group. The release schedule of every member is reset, so that all
+ * of them are released at @a idate.
+ *
+ * @param group The group descriptor.
+ *
+ * @param idate The initial (absolute) date of the first release
+ * point, expressed in nanoseconds. If @a idate is equal to
+ * XN_INFINITE, the first release point is set to @a period
+ * nanoseconds after the current date.
+ *
+ * @param timeout_mode The mode of the @a idate parameter, either
+ * XN_ABSOLUTE or XN_REALTIME.
+ *
+ * @param period The base period of the group, expressed in
+ * nanoseconds. Passing XN_INFINITE stops the group timer.
+ *
+ * @return 0 is returned upon success. Otherwise, -ETIMEDOUT or
+ * -EINVAL are returned under the same conditions as
+ * xnthread_set_periodic().
+ *
+ * @coretags{task-unrestricted}
+ */
+int xnrelgroup_start(struct xnrelgroup *group, xnticks_t idate,
+		     xntmode_t timeout_mode, xnticks_t period)
+{
+	struct xnclock *clock = xntimer_clock(&group->timer);
+	struct xnthread *thread;
+	int ret = 0;
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	if (period == XN_INFINITE) {
+		if (xntimer_running_p(&group->timer))
+			xntimer_stop(&group->timer);
+		goto out;
+	}
+
+	if (period < xnclock_ticks_to_ns(clock,
+			 xnclock_get_gravity(clock, user))) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	group->ticks = 0;
+	list_for_each_entry(thread, &group->members, relgroup_next)
+		thread->relgroup_release = 0;
+
+	if (idate == XN_INFINITE)
+		xntimer_start(&group->timer, period, period, XN_RELATIVE);
+	else {
+		/*
+		 * Release points are counted in group periods, so
+		 * keep the timer on the monotonic time line even if
+		 * the wallclock is shifted later on.
+		 */
+		if (timeout_mode == XN_REALTIME)
+			idate -= xnclock_get_offset(clock);
+		else if (timeout_mode != XN_ABSOLUTE) {
+			ret = -EINVAL;
+			goto out;
+		}
+		ret = xntimer_start(&group->timer, idate, period,
+				    XN_ABSOLUTE);
+	}
+out:
+	xnlock_put_irqrestore(&nklock, s);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(xnrelgroup_start);
+
+/**
+ * @fn void xnrelgroup_destroy(struct xnrelgroup *group)
+ * @brief Destroy a release group.
+ *
+ * Stop the group timer and detach all members. Members waiting for
+ * their next release point are unblocked, xnthread_wait_period()
+ * returning -EIDRM to them.
+ *
+ * @param group The group descriptor.
+ *
+ * @coretags{task-unrestricted, might-switch}
+ */
+void xnrelgroup_destroy(struct xnrelgroup *group)
+{
+	struct xnthread *thread, *tmp;
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	xntimer_destroy(&group->timer);
+
+	list_for_each_entry_safe(thread, tmp, &group->members, relgroup_next) {
+		list_del(&thread->relgroup_next);
+		thread->relgroup = NULL;
+		if (xnthread_test_state(thread, XNDELAY|XNPEND) == XNDELAY &&
+		    !xntimer_running_p(&thread->rtimer))
+			xnthread_resume(thread, XNDELAY);
+	}
+
+	xnsched_run();
+
+	xnlock_put_irqrestore(&nklock, s);
+}
+EXPORT_SYMBOL_GPL(xnrelgroup_destroy);
+
+/**
+ * @fn int xnthread_join_relgroup(struct xnthread *thread, struct xnrelgroup *group, unsigned int mult)
+ * @brief Attach a thread to a release group.
+ *
+ * Make @a thread periodic with a period of @a mult times the base
+ * period of @a group. The thread is released at the next expiry of
+ * the group timer which is a multiple of @a mult, then every @a mult
+ * expiries. The thread's own periodic timer is stopped; calling
+ * xnthread_set_periodic() later on leaves the group.
+ *
+ * @param thread The thread to attach.
+ *
+ * @param group The group to join, or NULL to leave the current
+ * group, if any.
+ *
+ * @param mult The period multiplier, must be non-zero. Ignored when
+ * @a group is NULL.
+ *
+ * @return 0 is returned upon success, or -EINVAL if @a mult is zero.
+ *
+ * @coretags{task-unrestricted}
+ */
+int xnthread_join_relgroup(struct xnthread *thread,
+			   struct xnrelgroup *group, unsigned int mult)
+{
+	unsigned long rem;
+	spl_t s;
+
+	if (group && mult == 0)
+		return -EINVAL;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	leave_relgroup(thread);
+
+	if (group) {
+		if (xntimer_running_p(&thread->ptimer))
+			xntimer_stop(&thread->ptimer);
+		thread->relgroup = group;
+		thread->relgroup_mult = mult;
+		xnarch_ulldiv(group->ticks, mult, &rem);
+		thread->relgroup_release = group->ticks;
+		if (rem)
+			thread->relgroup_release += mult - rem;
+		list_add_priff(thread, &group->members,
+			       cprio, relgroup_next);
+	}
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xnthread_join_relgroup);
+
 /**
  * @fn int xnthread_set_slice(struct xnthread *thread, xnticks_t quantum)
  * @brief Set thread time-slicing information.
@@ -1940,6 +2248,7 @@ int xnthread_harden(void)
 		return -ERESTARTSYS;
 
 	trace_cobalt_shadow_gohard(thread);
+	xnevtrace_log(COBALT_EVTRACE_HARDEN, task_pid_nr(p), 0, 0);
 
 	xnthread_clear_sync_window(thread, XNRELAX);
 
@@ -2081,6 +2390,7 @@ void xnthread_relax(int notify, int reason)
 	 * to resume using the register state of the shadow thread.
 	 */
 	trace_cobalt_shadow_gorelax(reason);
+	xnevtrace_log(COBALT_EVTRACE_RELAX, task_pid_nr(p), reason, 0);
 
 	/*
 	 * If you intend to change the following interrupt-free
@@ -2155,8 +2465,14 @@ void xnthread_relax(int notify, int reason)
 #ifdef CONFIG_SMP
 	if (xnthread_test_localinfo(thread, XNMOVED)) {
 		xnthread_clear_localinfo(thread, XNMOVED);
-		cpu = xnsched_cpu(thread->sched);
-		set_cpus_allowed_ptr(p, cpumask_of(cpu));
+		/*
+		 * Cluster threads may run anywhere in their affinity
+		 * set, let the host kernel pick from it.
+		 */
+		if (!xnthread_test_state(thread, XNCLUSTER)) {
+			cpu = xnsched_cpu(thread->sched);
+			set_cpus_allowed_ptr(p, cpumask_of(cpu));
+		}
 	}
 #endif
 
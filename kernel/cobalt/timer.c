@@ -981,6 +981,216 @@ void xntimerq_insert(xntimerq_t *q, xntimerh_t *holder)
 	rb_link_node(&holder->link, parent, new);
 	rb_insert_color(&holder->link, &q->root);
 }
+#elif defined(CONFIG_XENO_OPT_TIMER_WHEEL)
+static inline bool xntimerh_is_lt(xntimerh_t *left, xntimerh_t *right)
+{
+	return left->date < right->date
+		|| (left->date == right->date && left->prio > right->prio);
+}
+
+static inline u64 wheel_ror(u64 map, unsigned int n)
+{
+	return n ? (map >> n) | (map << (XNTIMERQ_WHEEL_SLOTS - n)) : map;
+}
+
+static unsigned int wheel_hash(xntimerq_t *q, xnticks_t date)
+{
+	unsigned int level, shift = XNTIMERQ_WHEEL_SHIFT;
+
+	if (date < q->base)
+		return XNTIMERQ_WHEEL_EARLY;
+
+	for (level = 0; level < XNTIMERQ_WHEEL_LEVELS;
+	     level++, shift += XNTIMERQ_WHEEL_BITS) {
+		if ((date >> shift) - (q->base >> shift) < XNTIMERQ_WHEEL_SLOTS)
+			return level * XNTIMERQ_WHEEL_SLOTS +
+				((date >> shift) & XNTIMERQ_WHEEL_MASK);
+	}
+
+	return XNTIMERQ_WHEEL_FAR;
+}
+
+static void wheel_link(xntimerq_t *q, xntimerh_t *holder)
+{
+	unsigned int b = wheel_hash(q, holder->date);
+
+	holder->bucket = b;
+	list_add_tail(&holder->link, &q->buckets[b]);
+
+	if (b < XNTIMERQ_WHEEL_EARLY)
+		q->map[b / XNTIMERQ_WHEEL_SLOTS] |=
+			1ULL << (b & XNTIMERQ_WHEEL_MASK);
+	else if (b == XNTIMERQ_WHEEL_FAR && holder->date < q->farmin)
+		q->farmin = holder->date;
+}
+
+static void wheel_relink(xntimerq_t *q, unsigned int b)
+{
+	xntimerh_t *holder, *tmp;
+	struct list_head moved;
+
+	INIT_LIST_HEAD(&moved);
+	list_splice_init(&q->buckets[b], &moved);
+	if (b < XNTIMERQ_WHEEL_EARLY)
+		q->map[b / XNTIMERQ_WHEEL_SLOTS] &=
+			~(1ULL << (b & XNTIMERQ_WHEEL_MASK));
+	else if (b == XNTIMERQ_WHEEL_FAR)
+		q->farmin = (xnticks_t)-1;
+
+	list_for_each_entry_safe(holder, tmp, &moved, link)
+		wheel_link(q, holder);
+}
+
+static xntimerh_t *wheel_scan(xntimerq_t *q, unsigned int b,
+			      xntimerh_t *excl, xntimerh_t *best)
+{
+	xntimerh_t *holder;
+
+	list_for_each_entry(holder, &q->buckets[b], link) {
+		if (holder != excl &&
+		    (best == NULL || xntimerh_is_lt(holder, best)))
+			best = holder;
+	}
+
+	return best;
+}
+
+/* Find the earliest timer in the wheel, @excl aside. */
+static xntimerh_t *wheel_lookup(xntimerq_t *q, xntimerh_t *excl)
+{
+	unsigned int level, shift, idx, off;
+	xntimerh_t *best, *holder;
+	xnticks_t start;
+	u64 map;
+
+	/* Early timers precede anything else. */
+	best = wheel_scan(q, XNTIMERQ_WHEEL_EARLY, excl, NULL);
+	if (best)
+		return best;
+
+	for (level = 0, shift = XNTIMERQ_WHEEL_SHIFT;
+	     level < XNTIMERQ_WHEEL_LEVELS;
+	     level++, shift += XNTIMERQ_WHEEL_BITS) {
+		/*
+		 * Slots follow each other in time order, starting
+		 * from the one which covers the base date. The
+		 * earliest timer of a level is in the first slot
+		 * holding anything else than @excl.
+		 */
+		idx = (q->base >> shift) & XNTIMERQ_WHEEL_MASK;
+		map = wheel_ror(q->map[level], idx);
+		while (map) {
+			off = __ffs64(map);
+			start = ((q->base >> shift) + off) << shift;
+			if (best && start > best->date)
+				break;
+			holder = wheel_scan(q, level * XNTIMERQ_WHEEL_SLOTS +
+					    ((idx + off) & XNTIMERQ_WHEEL_MASK),
+					    excl, NULL);
+			if (holder) {
+				if (best == NULL || xntimerh_is_lt(holder, best))
+					best = holder;
+				break;
+			}
+			map &= map - 1;
+		}
+	}
+
+	if (best == NULL || q->farmin <= best->date)
+		best = wheel_scan(q, XNTIMERQ_WHEEL_FAR, excl, best);
+
+	return best;
+}
+
+void xntimerq_init(xntimerq_t *q)
+{
+	int n;
+
+	q->head = NULL;
+	q->second = NULL;
+	q->clock = NULL;
+	q->base = 0;
+	q->farmin = (xnticks_t)-1;
+	memset(q->map, 0, sizeof(q->map));
+
+	for (n = 0; n < XNTIMERQ_WHEEL_BUCKETS; n++)
+		INIT_LIST_HEAD(&q->buckets[n]);
+}
+
+void xntimerq_insert(xntimerq_t *q, xntimerh_t *holder)
+{
+	/*
+	 * Rebase an empty wheel on the current time, so that timers
+	 * queued next hash to the wheel levels regardless of whether
+	 * they are nearer than this one. A timer which is already
+	 * due goes to the early bucket, until the next tick moves the
+	 * base past it.
+	 */
+	if (q->head == NULL)
+		q->base = q->clock ? xnclock_read_raw(q->clock) : holder->date;
+
+	wheel_link(q, holder);
+
+	if (q->head == NULL || xntimerh_is_lt(holder, q->head)) {
+		q->second = q->head;
+		q->head = holder;
+	} else if (q->second == NULL || xntimerh_is_lt(holder, q->second))
+		q->second = holder;
+}
+
+void __xntimerq_refill(xntimerq_t *q, xntimerh_t *holder)
+{
+	/* @holder is already unlinked. */
+	if (holder == q->head)
+		q->head = q->second;
+
+	q->second = q->head ? wheel_lookup(q, q->head) : NULL;
+}
+
+/*
+ * Called from the tick handler once all timers due by @now have
+ * been fired, so that every outstanding timer is later than @now.
+ */
+void xntimerq_advance(xntimerq_t *q, xnticks_t now)
+{
+	unsigned int level, shift;
+
+	if (now <= q->base)
+		return;
+
+	q->base = now;
+
+	if (!list_empty(&q->buckets[XNTIMERQ_WHEEL_EARLY]))
+		wheel_relink(q, XNTIMERQ_WHEEL_EARLY);
+
+	shift = XNTIMERQ_WHEEL_SHIFT +
+		(XNTIMERQ_WHEEL_LEVELS - 1) * XNTIMERQ_WHEEL_BITS;
+	if ((q->farmin >> shift) - (now >> shift) < XNTIMERQ_WHEEL_SLOTS)
+		wheel_relink(q, XNTIMERQ_WHEEL_FAR);
+
+	/*
+	 * Moving the base forward keeps every timer within reach of
+	 * its level, but the slot covering the new base date in an
+	 * upper level may now overlap the span of the level below:
+	 * cascade those slots down, from the top level.
+	 */
+	for (level = XNTIMERQ_WHEEL_LEVELS - 1; level > 0; level--) {
+		shift = XNTIMERQ_WHEEL_SHIFT + level * XNTIMERQ_WHEEL_BITS;
+		wheel_relink(q, level * XNTIMERQ_WHEEL_SLOTS +
+			     ((now >> shift) & XNTIMERQ_WHEEL_MASK));
+	}
+}
+
+xntimerh_t *__xntimerq_it_scan(xntimerq_t *q, xntimerq_it_t *it)
+{
+	for (; it->bucket < XNTIMERQ_WHEEL_BUCKETS; it->bucket++) {
+		if (!list_empty(&q->buckets[it->bucket]))
+			return list_first_entry(&q->buckets[it->bucket],
+						xntimerh_t, link);
+	}
+
+	return NULL;
+}
 #endif
 
 /** @} */
@@ -384,6 +384,28 @@ TRACE_EVENT(cobalt_thread_migrate_passive,
 		  __entry->thread, __entry->pid, __entry->cpu)
 );
 
+TRACE_EVENT(cobalt_sched_cluster_move,
+	TP_PROTO(struct xnthread *thread, unsigned int from, unsigned int to),
+	TP_ARGS(thread, from, to),
+
+	TP_STRUCT__entry(
+		__field(struct xnthread *, thread)
+		__field(pid_t, pid)
+		__field(unsigned int, from)
+		__field(unsigned int, to)
+	),
+
+	TP_fast_assign(
+		__entry->thread = thread;
+		__entry->pid = xnthread_host_pid(thread);
+		__entry->from = from;
+		__entry->to = to;
+	),
+
+	TP_printk("thread=%p pid=%d from=%u to=%u",
+		  __entry->thread, __entry->pid, __entry->from, __entry->to)
+);
+
 DEFINE_EVENT(curr_thread_event, cobalt_shadow_gohard,
 	TP_PROTO(struct xnthread *thread),
 	TP_ARGS(thread)
@@ -161,7 +161,19 @@
 		__cobalt_symbolic_syscall(ftrace_puts),			\
 		__cobalt_symbolic_syscall(recvmmsg),			\
 		__cobalt_symbolic_syscall(sendmmsg),			\
-		__cobalt_symbolic_syscall(clock_adjtime))
+		__cobalt_symbolic_syscall(clock_adjtime),		\
+		__cobalt_symbolic_syscall(selector_create),		\
+		__cobalt_symbolic_syscall(selector_ctl),		\
+		__cobalt_symbolic_syscall(selector_wait),		\
+		__cobalt_symbolic_syscall(ioring_create),		\
+		__cobalt_symbolic_syscall(ioring_enter),		\
+		__cobalt_symbolic_syscall(relgroup_create),		\
+		__cobalt_symbolic_syscall(relgroup_join),		\
+		__cobalt_symbolic_syscall(relgroup_wait),		\
+		__cobalt_symbolic_syscall(mq_reserve),			\
+		__cobalt_symbolic_syscall(mq_commit),			\
+		__cobalt_symbolic_syscall(mq_consume),			\
+		__cobalt_symbolic_syscall(mq_release))
 
 DECLARE_EVENT_CLASS(syscall_entry,
 	TP_PROTO(unsigned int nr),
@@ -201,6 +213,7 @@ DECLARE_EVENT_CLASS(syscall_exit,
 			 {SCHED_TP, "tp"},			\
 			 {SCHED_QUOTA, "quota"},		\
 			 {SCHED_SPORADIC, "sporadic"},		\
+			 {SCHED_EDF, "edf"},			\
 			 {SCHED_COBALT, "cobalt"},		\
 			 {SCHED_WEAK, "weak"},			\
 			 {__SCHED_CURRENT, "<current>"})
@@ -316,7 +329,8 @@ DEFINE_EVENT(cobalt_posix_schedparam, cobalt_pthread_getschedparam,
 	__print_flags(__mode, "|",				\
 		      {PTHREAD_WARNSW, "warnsw"},		\
 		      {PTHREAD_LOCK_SCHED, "lock"},		\
-		      {PTHREAD_DISABLE_LOCKBREAK, "nolockbreak"})
+		      {PTHREAD_DISABLE_LOCKBREAK, "nolockbreak"},	\
+		      {PTHREAD_CLUSTER, "cluster"})
 
 TRACE_EVENT(cobalt_pthread_setmode,
 	TP_PROTO(int clrmask, int setmask),
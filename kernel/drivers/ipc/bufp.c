@@ -22,6 +22,8 @@
 #include <linux/kernel.h>
 #include <linux/slab.h>
 #include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
 #include <cobalt/kernel/heap.h>
 #include <cobalt/kernel/map.h>
 #include <cobalt/kernel/bufd.h>
@@ -48,6 +50,9 @@ struct bufp_socket {
 	u_long rdtoken;
 	rtdm_event_t i_event;
 	rtdm_event_t o_event;
+	size_t rdspan;
+	size_t wrspan;
+	struct rtdm_fd *spanfd;	/* Peer we hold a write span on. */
 
 	nanosecs_rel_t rx_timeout;
 	nanosecs_rel_t tx_timeout;
@@ -117,6 +122,9 @@ static int bufp_socket(struct rtdm_fd *fd)
 	sk->fillsz = 0;
 	sk->rdtoken = 0;
 	sk->wrtoken = 0;
+	sk->rdspan = 0;
+	sk->wrspan = 0;
+	sk->spanfd = NULL;
 	sk->status = 0;
 	sk->handle = 0;
 	sk->rx_timeout = RTDM_TIMEOUT_INFINITE;
@@ -129,12 +137,18 @@ static int bufp_socket(struct rtdm_fd *fd)
 	return 0;
 }
 
+static int __bufp_commit_wrspan(struct bufp_socket *sk, size_t len);
+
 static void bufp_close(struct rtdm_fd *fd)
 {
 	struct rtipc_private *priv = rtdm_fd_to_private(fd);
 	struct bufp_socket *sk = priv->state;
 	rtdm_lockctx_t s;
 
+	/* Drop any write span left uncommitted. */
+	if (sk->spanfd)
+		__bufp_commit_wrspan(sk, 0);
+
 	rtdm_event_destroy(&sk->i_event);
 	rtdm_event_destroy(&sk->o_event);
 
@@ -155,13 +169,61 @@ static void bufp_close(struct rtdm_fd *fd)
 	kfree(sk);
 }
 
+/*
+ * Wake up all threads pending on the input wait queue, if enough
+ * data is available for feeding the leading one.
+ */
+static void __bufp_wake_readers(struct bufp_socket *sk,
+				int resched) /* nklock held */
+{
+	struct bufp_wait_context *bufwc;
+	struct rtipc_wait_context *wc;
+	struct xnthread *waiter;
+
+	waiter = rtipc_peek_wait_head(&sk->i_event);
+	if (waiter == NULL)
+		return;
+
+	wc = rtipc_get_wait_context(waiter);
+	XENO_BUG_ON(COBALT, wc == NULL);
+	bufwc = container_of(wc, struct bufp_wait_context, wc);
+	if (bufwc->len <= sk->fillsz)
+		/* This call rescheds internally. */
+		rtdm_event_pulse(&sk->i_event);
+	else if (resched)
+		xnsched_run();
+}
+
+/*
+ * Wake up all threads pending on the output wait queue, if enough
+ * room is available for the leading one to post its message.
+ */
+static void __bufp_wake_writers(struct bufp_socket *sk,
+				int resched) /* nklock held */
+{
+	struct bufp_wait_context *bufwc;
+	struct rtipc_wait_context *wc;
+	struct xnthread *waiter;
+
+	waiter = rtipc_peek_wait_head(&sk->o_event);
+	if (waiter == NULL)
+		return;
+
+	wc = rtipc_get_wait_context(waiter);
+	XENO_BUG_ON(COBALT, wc == NULL);
+	bufwc = container_of(wc, struct bufp_wait_context, wc);
+	if (bufwc->len + sk->fillsz <= sk->bufsz)
+		/* This call rescheds internally. */
+		rtdm_event_pulse(&sk->o_event);
+	else if (resched)
+		xnsched_run();
+}
+
 static ssize_t __bufp_readbuf(struct bufp_socket *sk,
 			      struct xnbufd *bufd,
 			      int flags)
 {
-	struct bufp_wait_context wait, *bufwc;
-	struct rtipc_wait_context *wc;
-	struct xnthread *waiter;
+	struct bufp_wait_context wait;
 	rtdm_toseq_t toseq;
 	ssize_t len, ret;
 	size_t rbytes, n;
@@ -179,9 +241,10 @@ redo:
 	for (;;) {
 		/*
 		 * We should be able to read a complete message of the
-		 * requested length, or block.
+		 * requested length, or block. A reader consuming data
+		 * in place holds off any copy until it commits.
 		 */
-		if (sk->fillsz < len)
+		if (sk->rdspan || sk->fillsz < len)
 			goto wait;
 
 		/*
@@ -234,23 +297,7 @@ redo:
 		if (sk->fillsz == 0) /* -> non-readable */
 			resched |= xnselect_signal(&sk->priv->recv_block, 0);
 
-		/*
-		 * Wake up all threads pending on the output wait
-		 * queue, if we freed enough room for the leading one
-		 * to post its message.
-		 */
-		waiter = rtipc_peek_wait_head(&sk->o_event);
-		if (waiter == NULL)
-			goto out;
-
-		wc = rtipc_get_wait_context(waiter);
-		XENO_BUG_ON(COBALT, wc == NULL);
-		bufwc = container_of(wc, struct bufp_wait_context, wc);
-		if (bufwc->len + sk->fillsz <= sk->bufsz)
-			/* This call rescheds internally. */
-			rtdm_event_pulse(&sk->o_event);
-		else if (resched)
-			xnsched_run();
+		__bufp_wake_writers(sk, resched);
 		/*
 		 * We cannot fail anymore once some data has been
 		 * copied via the buffer descriptor, so no need to
@@ -271,7 +318,8 @@ redo:
 		 * pathological use of the buffer. We must allow for a
 		 * short read to prevent a deadlock.
 		 */
-		if (sk->fillsz > 0 && rtipc_peek_wait_head(&sk->o_event)) {
+		if (sk->rdspan == 0 && sk->fillsz > 0 &&
+		    rtipc_peek_wait_head(&sk->o_event)) {
 			len = sk->fillsz;
 			goto redo;
 		}
@@ -413,9 +461,7 @@ static ssize_t __bufp_writebuf(struct bufp_socket *rsk,
 			       struct xnbufd *bufd,
 			       int flags)
 {
-	struct bufp_wait_context wait, *bufwc;
-	struct rtipc_wait_context *wc;
-	struct xnthread *waiter;
+	struct bufp_wait_context wait;
 	rtdm_toseq_t toseq;
 	rtdm_lockctx_t s;
 	ssize_t len, ret;
@@ -433,9 +479,10 @@ redo:
 	for (;;) {
 		/*
 		 * We should be able to write the entire message at
-		 * once or block.
+		 * once or block. A writer filling the buffer in place
+		 * holds off any copy until it commits.
 		 */
-		if (rsk->fillsz + len > rsk->bufsz)
+		if (rsk->wrspan || rsk->fillsz + len > rsk->bufsz)
 			goto wait;
 
 		/*
@@ -486,22 +533,8 @@ redo:
 
 		if (rsk->fillsz == rsk->bufsz) /* non-writable */
 			resched |= xnselect_signal(&rsk->priv->send_block, 0);
-		/*
-		 * Wake up all threads pending on the input wait
-		 * queue, if we accumulated enough data to feed the
-		 * leading one.
-		 */
-		waiter = rtipc_peek_wait_head(&rsk->i_event);
-		if (waiter == NULL)
-			goto out;
-
-		wc = rtipc_get_wait_context(waiter);
-		XENO_BUG_ON(COBALT, wc == NULL);
-		bufwc = container_of(wc, struct bufp_wait_context, wc);
-		if (bufwc->len <= rsk->fillsz)
-			rtdm_event_pulse(&rsk->i_event);
-		else if (resched)
-			xnsched_run();
+
+		__bufp_wake_readers(rsk, resched);
 		/*
 		 * We cannot fail anymore once some data has been
 		 * copied via the buffer descriptor, so no need to
@@ -973,6 +1006,286 @@ static int __bufp_getsockopt(struct bufp_socket *sk,
 	return ret;
 }
 
+static int __bufp_acquire_wrspan(struct bufp_socket *sk,
+				 struct bufp_span *span)
+{
+	struct bufp_wait_context wait;
+	struct bufp_socket *rsk;
+	struct rtdm_fd *rfd;
+	rtdm_toseq_t toseq;
+	rtdm_lockctx_t s;
+	size_t len;
+	int ret;
+
+	if (sk->peer.sipc_port < 0)
+		return -EDESTADDRREQ;
+
+	cobalt_atomic_enter(s);
+	rfd = xnmap_fetch_nocheck(portmap, sk->peer.sipc_port);
+	if (rfd && rtdm_fd_lock(rfd) < 0)
+		rfd = NULL;
+	cobalt_atomic_leave(s);
+	if (rfd == NULL)
+		return -ECONNRESET;
+
+	rsk = rtipc_fd_to_state(rfd);
+	if (!test_bit(_BUFP_BOUND, &rsk->status)) {
+		ret = -ECONNREFUSED;
+		goto fail;
+	}
+
+	len = span->len;
+	if (len == 0 || len > rsk->bufsz) {
+		ret = -EINVAL;
+		goto fail;
+	}
+
+	rtdm_toseq_init(&toseq, sk->tx_timeout);
+
+	cobalt_atomic_enter(s);
+
+	for (;;) {
+		if (sk->spanfd || rsk->wrspan) {
+			ret = -EBUSY;
+			break;
+		}
+
+		if (rsk->fillsz + len <= rsk->bufsz) {
+			/*
+			 * Grant all the free room, and draw the next
+			 * write token so that a copy in progress
+			 * starts over, then waits for our commit.
+			 */
+			rsk->wrtoken++;
+			rsk->wrspan = rsk->bufsz - rsk->fillsz;
+			span->offset = rsk->wroff;
+			span->len = rsk->wrspan;
+			sk->spanfd = rfd;
+			ret = 0;
+			break;
+		}
+
+		if (span->flags & MSG_DONTWAIT) {
+			ret = -EWOULDBLOCK;
+			break;
+		}
+
+		wait.len = len;
+		wait.sk = rsk;
+		rtipc_prepare_wait(&wait.wc);
+		ret = rtdm_event_timedwait(&rsk->o_event,
+					   sk->tx_timeout, &toseq);
+		if (unlikely(ret))
+			break;
+	}
+
+	cobalt_atomic_leave(s);
+
+	/*
+	 * Keep the peer locked until we commit, unless we write to
+	 * ourselves: a socket may not pin its own descriptor, or it
+	 * could never be closed.
+	 */
+	if (ret == 0 && rsk != sk)
+		return 0;
+fail:
+	rtdm_fd_unlock(rfd);
+
+	return ret;
+}
+
+static int __bufp_commit_wrspan(struct bufp_socket *sk, size_t len)
+{
+	struct bufp_socket *rsk;
+	struct rtdm_fd *rfd;
+	rtdm_lockctx_t s;
+	int resched = 0;
+
+	cobalt_atomic_enter(s);
+
+	rfd = sk->spanfd;
+	if (rfd == NULL) {
+		cobalt_atomic_leave(s);
+		return -EINVAL;
+	}
+
+	rsk = rtipc_fd_to_state(rfd);
+	if (len > rsk->wrspan) {
+		cobalt_atomic_leave(s);
+		return -EINVAL;
+	}
+
+	sk->spanfd = NULL;
+	rsk->wrspan = 0;
+
+	if (len > 0) {
+		rsk->fillsz += len;
+		rsk->wroff = (rsk->wroff + len) % rsk->bufsz;
+
+		if (rsk->fillsz == len) /* -> readable */
+			resched |= xnselect_signal(&rsk->priv->recv_block, POLLIN);
+
+		if (rsk->fillsz == rsk->bufsz) /* non-writable */
+			resched |= xnselect_signal(&rsk->priv->send_block, 0);
+	}
+
+	/*
+	 * Feed the readers, then the copying writers which may have
+	 * queued up behind the span.
+	 */
+	__bufp_wake_readers(rsk, resched);
+	__bufp_wake_writers(rsk, 0);
+
+	cobalt_atomic_leave(s);
+
+	if (rsk != sk)
+		rtdm_fd_unlock(rfd);
+
+	return 0;
+}
+
+static int __bufp_acquire_rdspan(struct bufp_socket *sk,
+				 struct bufp_span *span)
+{
+	struct bufp_wait_context wait;
+	rtdm_toseq_t toseq;
+	rtdm_lockctx_t s;
+	size_t len;
+	int ret;
+
+	if (!test_bit(_BUFP_BOUND, &sk->status))
+		return -EAGAIN;
+
+	len = span->len;
+	if (len == 0 || len > sk->bufsz)
+		return -EINVAL;
+
+	rtdm_toseq_init(&toseq, sk->rx_timeout);
+
+	cobalt_atomic_enter(s);
+
+	for (;;) {
+		if (sk->rdspan) {
+			ret = -EBUSY;
+			break;
+		}
+
+		if (sk->fillsz >= len) {
+			/*
+			 * Grant all the pending data, and draw the
+			 * next read token so that a copy in progress
+			 * starts over, then waits for our commit.
+			 */
+			sk->rdtoken++;
+			sk->rdspan = sk->fillsz;
+			span->offset = sk->rdoff;
+			span->len = sk->rdspan;
+			ret = 0;
+			break;
+		}
+
+		if (span->flags & MSG_DONTWAIT) {
+			ret = -EWOULDBLOCK;
+			break;
+		}
+
+		/* Same deadlock avoidance as __bufp_readbuf(). */
+		if (sk->fillsz > 0 && rtipc_peek_wait_head(&sk->o_event)) {
+			len = sk->fillsz;
+			continue;
+		}
+
+		wait.len = len;
+		wait.sk = sk;
+		rtipc_prepare_wait(&wait.wc);
+		ret = rtdm_event_timedwait(&sk->i_event,
+					   sk->rx_timeout, &toseq);
+		if (unlikely(ret))
+			break;
+	}
+
+	cobalt_atomic_leave(s);
+
+	return ret;
+}
+
+static int __bufp_commit_rdspan(struct bufp_socket *sk, size_t len)
+{
+	rtdm_lockctx_t s;
+	int resched = 0;
+
+	cobalt_atomic_enter(s);
+
+	if (sk->rdspan == 0 || len > sk->rdspan) {
+		cobalt_atomic_leave(s);
+		return -EINVAL;
+	}
+
+	sk->rdspan = 0;
+
+	if (len > 0) {
+		sk->fillsz -= len;
+		sk->rdoff = (sk->rdoff + len) % sk->bufsz;
+
+		if (sk->fillsz + len == sk->bufsz) /* -> writable */
+			resched |= xnselect_signal(&sk->priv->send_block, POLLOUT);
+
+		if (sk->fillsz == 0) /* -> non-readable */
+			resched |= xnselect_signal(&sk->priv->recv_block, 0);
+	}
+
+	/*
+	 * Make room for the writers, then wake up the copying
+	 * readers which may have queued up behind the span.
+	 */
+	__bufp_wake_writers(sk, resched);
+	__bufp_wake_readers(sk, 0);
+
+	cobalt_atomic_leave(s);
+
+	return 0;
+}
+
+static int __bufp_span_ioctl(struct bufp_socket *sk,
+			     struct rtdm_fd *fd,
+			     unsigned int request, void *arg)
+{
+	struct bufp_span span;
+	int ret;
+
+	if (rtipc_get_arg(fd, &span, arg, sizeof(span)))
+		return -EFAULT;
+
+	switch (request) {
+	case BUFP_WRACQUIRE:
+		ret = __bufp_acquire_wrspan(sk, &span);
+		break;
+	case BUFP_WRCOMMIT:
+		return __bufp_commit_wrspan(sk, span.len);
+	case BUFP_RDACQUIRE:
+		ret = __bufp_acquire_rdspan(sk, &span);
+		break;
+	case BUFP_RDCOMMIT:
+		return __bufp_commit_rdspan(sk, span.len);
+	default:
+		return -EINVAL;
+	}
+
+	if (ret)
+		return ret;
+
+	if (rtipc_put_arg(fd, arg, &span, sizeof(span))) {
+		/* Don't leave a span nobody knows about. */
+		if (request == BUFP_WRACQUIRE)
+			__bufp_commit_wrspan(sk, 0);
+		else
+			__bufp_commit_rdspan(sk, 0);
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
 static int __bufp_ioctl(struct rtdm_fd *fd,
 			unsigned int request, void *arg)
 {
@@ -1024,6 +1337,13 @@ static int __bufp_ioctl(struct rtdm_fd *fd,
 		ret = -ENOTCONN;
 		break;
 
+	case BUFP_WRACQUIRE:
+	case BUFP_WRCOMMIT:
+	case BUFP_RDACQUIRE:
+	case BUFP_RDCOMMIT:
+		ret = __bufp_span_ioctl(sk, fd, request, arg);
+		break;
+
 	default:
 		ret = -EINVAL;
 	}
@@ -1076,6 +1396,85 @@ static unsigned int bufp_pollstate(struct rtdm_fd *fd) /* atomic */
 	return mask;
 }
 
+static void bufp_vmopen(struct vm_area_struct *vma)
+{
+	struct rtdm_fd *rfd = vma->vm_private_data;
+
+	/* Cannot fail, the mapping being duplicated holds a ref. */
+	rtdm_fd_lock(rfd);
+}
+
+static void bufp_vmclose(struct vm_area_struct *vma)
+{
+	struct rtdm_fd *rfd = vma->vm_private_data;
+
+	rtdm_fd_unlock(rfd);
+}
+
+static struct vm_operations_struct bufp_vmops = {
+	.open = bufp_vmopen,
+	.close = bufp_vmclose,
+};
+
+static int bufp_mmap(struct rtdm_fd *fd,
+		     struct vm_area_struct *vma) /* nklock free */
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct bufp_socket *sk = priv->state, *rsk;
+	unsigned long len, off;
+	struct rtdm_fd *rfd;
+	struct page *page;
+	rtdm_lockctx_t s;
+	int ret;
+
+	if (sk->peer.sipc_port < 0)
+		return -EDESTADDRREQ;
+
+	cobalt_atomic_enter(s);
+	rfd = xnmap_fetch_nocheck(portmap, sk->peer.sipc_port);
+	if (rfd && rtdm_fd_lock(rfd) < 0)
+		rfd = NULL;
+	cobalt_atomic_leave(s);
+	if (rfd == NULL)
+		return -ECONNRESET;
+
+	rsk = rtipc_fd_to_state(rfd);
+	if (!test_bit(_BUFP_BOUND, &rsk->status)) {
+		ret = -ECONNREFUSED;
+		goto fail;
+	}
+
+	len = vma->vm_end - vma->vm_start;
+	if (vma->vm_pgoff != 0 || (rsk->bufsz & ~PAGE_MASK) != 0 ||
+	    len != rsk->bufsz * 2) {
+		ret = -EINVAL;
+		goto fail;
+	}
+
+	/*
+	 * Map the buffer pages twice in a row, so that spans
+	 * wrapping at the end of the circular buffer are contiguous
+	 * in user space.
+	 */
+	for (off = 0; off < len; off += PAGE_SIZE) {
+		page = vmalloc_to_page(rsk->bufmem + off % rsk->bufsz);
+		if (vm_insert_page(vma, vma->vm_start + off, page)) {
+			ret = -EAGAIN;
+			goto fail;
+		}
+	}
+
+	/* The peer buffer lives until the last mapping goes away. */
+	vma->vm_ops = &bufp_vmops;
+	vma->vm_private_data = rfd;
+
+	return 0;
+fail:
+	rtdm_fd_unlock(rfd);
+
+	return ret;
+}
+
 static int bufp_init(void)
 {
 	portmap = xnmap_create(CONFIG_XENO_OPT_BUFP_NRPORT, 0, 0);
@@ -1104,5 +1503,6 @@ struct rtipc_protocol bufp_proto_driver = {
 		.write = bufp_write,
 		.ioctl = bufp_ioctl,
 		.pollstate = bufp_pollstate,
+		.mmap = bufp_mmap,
 	}
 };
@@ -30,14 +30,33 @@
 
 #define IDDP_SOCKET_MAGIC 0xa37a37a8
 
+#define IDDP_SUB_MAXDEPTH 65536
+
 struct iddp_message {
 	struct list_head next;
 	int from;
+	int refs;		/* Fan-out references */
 	size_t rdoff;
 	size_t len;
 	char data[];
 };
 
+struct iddp_socket;
+
+struct iddp_sub {
+	struct list_head next;		/* Link in topic->subscribers */
+	struct iddp_socket *sk;		/* Subscriber */
+	struct rtdm_fd *tfd;		/* Fan-out port, NULL if detached */
+	int port;
+	int policy;
+	unsigned int depth;
+	unsigned int head;
+	unsigned int count;
+	size_t rdoff;			/* Read offset into head message */
+	unsigned int drops;
+	struct iddp_message *ring[];
+};
+
 struct iddp_socket {
 	int magic;
 	struct sockaddr_ipc name;
@@ -56,6 +75,9 @@ struct iddp_socket {
 	nanosecs_rel_t tx_timeout;
 	unsigned long stalls;	/* Buffer stall counter. */
 	struct rtipc_private *priv;
+	struct list_head subscribers;	/* If fan-out port */
+	rtdm_waitqueue_t fanwaitq;	/* Publishers blocked on subscribers */
+	struct iddp_sub *sub;		/* Our subscription, if any */
 };
 
 static struct sockaddr_ipc nullsa = {
@@ -70,6 +92,7 @@ static rtdm_waitqueue_t poolwaitq;
 #define _IDDP_BINDING   0
 #define _IDDP_BOUND     1
 #define _IDDP_CONNECTED 2
+#define _IDDP_FANOUT    3
 
 #ifdef CONFIG_XENO_OPT_VFILE
 
@@ -103,6 +126,7 @@ static struct xnpnode_link __iddp_pnode = {
 
 static inline void __iddp_init_mbuf(struct iddp_message *mbuf, size_t len)
 {
+	mbuf->refs = 0;
 	mbuf->rdoff = 0;
 	mbuf->len = len;
 	INIT_LIST_HEAD(&mbuf->next);
@@ -158,6 +182,47 @@ static void __iddp_free_mbuf(struct iddp_socket *sk,
 	rtdm_waitqueue_broadcast(sk->poolwaitq);
 }
 
+/*
+ * Drop a reference on a message published by the fan-out port @tsk,
+ * releasing it to the pool of that port on last reference.
+ */
+static void __iddp_put_mbuf(struct iddp_socket *tsk,
+			    struct iddp_message *mbuf) /* nklock held */
+{
+	if (--mbuf->refs == 0)
+		__iddp_free_mbuf(tsk, mbuf);
+}
+
+static inline int __iddp_readable(struct iddp_socket *sk)
+{
+	return !list_empty(&sk->inq) || (sk->sub && sk->sub->count > 0);
+}
+
+/*
+ * Detach a subscription from its fan-out port, dropping the pending
+ * messages.
+ */
+static void __iddp_detach_sub(struct iddp_sub *sub) /* nklock held */
+{
+	struct iddp_socket *tsk;
+
+	if (sub->tfd == NULL)
+		return;
+
+	tsk = rtipc_fd_to_state(sub->tfd);
+	while (sub->count > 0) {
+		__iddp_put_mbuf(tsk, sub->ring[sub->head]);
+		sub->head = (sub->head + 1) % sub->depth;
+		sub->count--;
+	}
+
+	sub->rdoff = 0;
+	list_del(&sub->next);
+	sub->tfd = NULL;
+	/* Publishers may be waiting for this subscriber. */
+	rtdm_waitqueue_broadcast(&tsk->fanwaitq);
+}
+
 static int iddp_socket(struct rtdm_fd *fd)
 {
 	struct rtipc_private *priv = rtdm_fd_to_private(fd);
@@ -179,6 +244,9 @@ static int iddp_socket(struct rtdm_fd *fd)
 	rtdm_sem_init(&sk->insem, 0);
 	rtdm_waitqueue_init(&sk->privwaitq);
 	sk->priv = priv;
+	INIT_LIST_HEAD(&sk->subscribers);
+	rtdm_waitqueue_init(&sk->fanwaitq);
+	sk->sub = NULL;
 
 	return 0;
 }
@@ -188,6 +256,7 @@ static void iddp_close(struct rtdm_fd *fd)
 	struct rtipc_private *priv = rtdm_fd_to_private(fd);
 	struct iddp_socket *sk = priv->state;
 	struct iddp_message *mbuf;
+	struct iddp_sub *sub;
 	rtdm_lockctx_t s;
 	void *poolmem;
 	u32 poolsz;
@@ -195,6 +264,24 @@ static void iddp_close(struct rtdm_fd *fd)
 	rtdm_sem_destroy(&sk->insem);
 	rtdm_waitqueue_destroy(&sk->privwaitq);
 
+	cobalt_atomic_enter(s);
+	/*
+	 * Drop our subscription, then cancel all subscriptions to
+	 * our fan-out port, so that no message from our pool is left
+	 * pending anywhere.
+	 */
+	sub = sk->sub;
+	if (sub)
+		__iddp_detach_sub(sub);
+	while (!list_empty(&sk->subscribers))
+		__iddp_detach_sub(list_first_entry(&sk->subscribers,
+						   struct iddp_sub, next));
+	cobalt_atomic_leave(s);
+
+	rtdm_waitqueue_destroy(&sk->fanwaitq);
+	if (sub)
+		xnfree(sub);
+
 	if (test_bit(_IDDP_BOUND, &sk->status)) {
 		if (sk->handle)
 			xnregistry_remove(sk->handle);
@@ -224,21 +311,55 @@ static void iddp_close(struct rtdm_fd *fd)
 	return;
 }
 
+static int __iddp_copy_mbuf(struct rtdm_fd *fd, struct iddp_message *mbuf,
+			    int rdoff, ssize_t len,
+			    struct iovec *iov, int iovlen)
+{
+	ssize_t wrlen, vlen;
+	struct xnbufd bufd;
+	int nvec, ret;
+
+	/* Write "len" bytes from mbuf->data to the vector cells */
+	for (nvec = 0, wrlen = len; nvec < iovlen && wrlen > 0; nvec++) {
+		if (iov[nvec].iov_len == 0)
+			continue;
+		vlen = wrlen >= iov[nvec].iov_len ? iov[nvec].iov_len : wrlen;
+		if (rtdm_fd_is_user(fd)) {
+			xnbufd_map_uread(&bufd, iov[nvec].iov_base, vlen);
+			ret = xnbufd_copy_from_kmem(&bufd, mbuf->data + rdoff, vlen);
+			xnbufd_unmap_uread(&bufd);
+		} else {
+			xnbufd_map_kread(&bufd, iov[nvec].iov_base, vlen);
+			ret = xnbufd_copy_from_kmem(&bufd, mbuf->data + rdoff, vlen);
+			xnbufd_unmap_kread(&bufd);
+		}
+		if (ret < 0)
+			return ret;
+		iov[nvec].iov_base += vlen;
+		iov[nvec].iov_len -= vlen;
+		wrlen -= vlen;
+		rdoff += vlen;
+	}
+
+	return 0;
+}
+
 static ssize_t __iddp_recvmsg(struct rtdm_fd *fd,
 			      struct iovec *iov, int iovlen, int flags,
-			      struct sockaddr_ipc *saddr)
+			      struct sockaddr_ipc *saddr, int nowake)
 {
 	struct rtipc_private *priv = rtdm_fd_to_private(fd);
-	struct iddp_socket *sk = priv->state;
-	ssize_t maxlen, len, wrlen, vlen;
+	struct iddp_socket *sk = priv->state, *tsk = NULL;
 	rtdm_toseq_t timeout_seq, *toseq;
-	int nvec, rdoff, ret, dofree;
+	struct rtdm_fd *tfd = NULL;
 	struct iddp_message *mbuf;
+	int rdoff, ret, dofree;
 	nanosecs_rel_t timeout;
-	struct xnbufd bufd;
+	ssize_t maxlen, len;
+	struct iddp_sub *sub;
 	rtdm_lockctx_t s;
 
-	if (!test_bit(_IDDP_BOUND, &sk->status))
+	if (!test_bit(_IDDP_BOUND, &sk->status) && sk->sub == NULL)
 		return -EAGAIN;
 
 	maxlen = rtdm_get_iov_flatlen(iov, iovlen);
@@ -264,67 +385,180 @@ static ssize_t __iddp_recvmsg(struct rtdm_fd *fd,
 		}
 		/* We may have spurious wakeups. */
 		cobalt_atomic_enter(s);
-		if (!list_empty(&sk->inq))
+		if (__iddp_readable(sk))
 			break;
 		cobalt_atomic_leave(s);
 	}
 
-	/* Pull heading message from input queue. */
-	mbuf = list_entry(sk->inq.next, struct iddp_message, next);
-	rdoff = mbuf->rdoff;
-	len = mbuf->len - rdoff;
+	if (!list_empty(&sk->inq)) {
+		/* Pull heading message from input queue. */
+		mbuf = list_entry(sk->inq.next, struct iddp_message, next);
+		rdoff = mbuf->rdoff;
+		len = mbuf->len - rdoff;
+		if (maxlen >= len) {
+			list_del(&mbuf->next);
+			dofree = 1;
+		} else {
+			/* Buffer is only partially read: repost. */
+			mbuf->rdoff += maxlen;
+			len = maxlen;
+			dofree = 0;
+		}
+	} else {
+		/*
+		 * Pull heading message published to the fan-out port
+		 * we subscribed to. Holding the port prevents its
+		 * pool from vanishing while we copy the data out.
+		 */
+		sub = sk->sub;
+		tfd = sub->tfd;
+		if (rtdm_fd_lock(tfd) < 0) {
+			cobalt_atomic_leave(s);
+			return -ECONNRESET;
+		}
+		tsk = rtipc_fd_to_state(tfd);
+		mbuf = sub->ring[sub->head];
+		mbuf->refs++;
+		rdoff = sub->rdoff;
+		len = mbuf->len - rdoff;
+		if (maxlen >= len) {
+			sub->head = (sub->head + 1) % sub->depth;
+			sub->count--;
+			sub->rdoff = 0;
+			__iddp_put_mbuf(tsk, mbuf);
+			if (sub->policy == IDDP_SUB_BLOCK)
+				rtdm_waitqueue_broadcast(&tsk->fanwaitq);
+			dofree = 1;
+		} else {
+			sub->rdoff += maxlen;
+			len = maxlen;
+			dofree = 0;
+		}
+	}
+
 	if (saddr) {
 		saddr->sipc_family = AF_RTIPC;
 		saddr->sipc_port = mbuf->from;
 	}
-	if (maxlen >= len) {
-		list_del(&mbuf->next);
-		dofree = 1;
-		if (list_empty(&sk->inq)) /* -> non-readable */
-			xnselect_signal(&priv->recv_block, 0);
-
-	} else {
-		/* Buffer is only partially read: repost. */
-		mbuf->rdoff += maxlen;
-		len = maxlen;
-		dofree = 0;
-	}
 
 	if (!dofree)
 		rtdm_sem_up(&sk->insem);
+	else if (!__iddp_readable(sk)) /* -> non-readable */
+		xnselect_signal(&priv->recv_block, 0);
 
 	cobalt_atomic_leave(s);
 
-	/* Now, write "len" bytes from mbuf->data to the vector cells */
-	for (nvec = 0, wrlen = len; nvec < iovlen && wrlen > 0; nvec++) {
-		if (iov[nvec].iov_len == 0)
-			continue;
-		vlen = wrlen >= iov[nvec].iov_len ? iov[nvec].iov_len : wrlen;
-		if (rtdm_fd_is_user(fd)) {
-			xnbufd_map_uread(&bufd, iov[nvec].iov_base, vlen);
-			ret = xnbufd_copy_from_kmem(&bufd, mbuf->data + rdoff, vlen);
-			xnbufd_unmap_uread(&bufd);
-		} else {
-			xnbufd_map_kread(&bufd, iov[nvec].iov_base, vlen);
-			ret = xnbufd_copy_from_kmem(&bufd, mbuf->data + rdoff, vlen);
-			xnbufd_unmap_kread(&bufd);
-		}
-		if (ret < 0)
+	ret = __iddp_copy_mbuf(fd, mbuf, rdoff, len, iov, iovlen);
+
+	if (tfd) {
+		cobalt_atomic_enter(s);
+		__iddp_put_mbuf(tsk, mbuf);
+		cobalt_atomic_leave(s);
+		rtdm_fd_unlock(tfd);
+	} else if (dofree) {
+		if (nowake)
+			xnheap_free(sk->bufpool, mbuf);
+		else
+			__iddp_free_mbuf(sk, mbuf);
+	}
+
+	return ret ?: len;
+}
+
+/*
+ * Pull up to @max messages from the input queue at once, consuming
+ * the matching count from the input semaphore. Messages published to
+ * a fan-out subscription are left to __iddp_recvmsg().
+ */
+static int __iddp_pull_batch(struct iddp_socket *sk,
+			     struct iddp_message **mbufv, int max)
+{
+	rtdm_lockctx_t s;
+	int n;
+
+	cobalt_atomic_enter(s);
+
+	for (n = 0; n < max && !list_empty(&sk->inq); n++) {
+		if (rtdm_sem_timeddown(&sk->insem, RTDM_TIMEOUT_NONE, NULL))
 			break;
-		iov[nvec].iov_base += vlen;
-		iov[nvec].iov_len -= vlen;
-		wrlen -= vlen;
-		rdoff += vlen;
+		mbufv[n] = list_entry(sk->inq.next, struct iddp_message, next);
+		list_del(&mbufv[n]->next);
 	}
 
-	if (dofree)
-		__iddp_free_mbuf(sk, mbuf);
+	if (n > 0 && !__iddp_readable(sk)) /* -> non-readable */
+		xnselect_signal(&sk->priv->recv_block, 0);
 
-	return ret ?: len;
+	cobalt_atomic_leave(s);
+
+	return n;
 }
 
-static ssize_t iddp_recvmsg(struct rtdm_fd *fd,
-			    struct user_msghdr *msg, int flags)
+/*
+ * Put back the messages from a batch we could not receive, at the
+ * head of the input queue and in their original order.
+ */
+static void __iddp_unpull_batch(struct iddp_socket *sk,
+				struct iddp_message **mbufv, int nr)
+{
+	rtdm_lockctx_t s;
+	int n;
+
+	if (nr <= 0)
+		return;
+
+	cobalt_atomic_enter(s);
+
+	if (!__iddp_readable(sk)) /* -> readable */
+		xnselect_signal(&sk->priv->recv_block, POLLIN);
+
+	for (n = nr - 1; n >= 0; n--)
+		list_add(&mbufv[n]->next, &sk->inq);
+
+	/*
+	 * Requeue all messages before posting the semaphore, which
+	 * may switch to another reader.
+	 */
+	for (n = 0; n < nr; n++)
+		rtdm_sem_up(&sk->insem);
+
+	cobalt_atomic_leave(s);
+}
+
+/*
+ * Receive a message pulled by __iddp_pull_batch(), only if it fits
+ * entirely into the I/O vector, in which case *mbufp is cleared.
+ */
+static ssize_t __iddp_recvmsg_mbuf(struct rtdm_fd *fd,
+				   struct iovec *iov, int iovlen,
+				   struct sockaddr_ipc *saddr,
+				   struct iddp_message **mbufp)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iddp_message *mbuf = *mbufp;
+	struct iddp_socket *sk = priv->state;
+	ssize_t len;
+	int ret;
+
+	len = mbuf->len - mbuf->rdoff;
+	if (rtdm_get_iov_flatlen(iov, iovlen) < len)
+		return -EMSGSIZE;
+
+	ret = __iddp_copy_mbuf(fd, mbuf, mbuf->rdoff, len, iov, iovlen);
+	if (ret)
+		return ret;
+
+	saddr->sipc_family = AF_RTIPC;
+	saddr->sipc_port = mbuf->from;
+	/* Pool waiters are kicked once per batch. */
+	xnheap_free(sk->bufpool, mbuf);
+	*mbufp = NULL;
+
+	return len;
+}
+
+static ssize_t __iddp_recvmsg_hdr(struct rtdm_fd *fd,
+				  struct user_msghdr *msg, int flags,
+				  struct iddp_message **mbufp, int nowake)
 {
 	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
 	struct sockaddr_ipc saddr;
@@ -347,7 +581,12 @@ static ssize_t iddp_recvmsg(struct rtdm_fd *fd,
 	if (ret)
 		return ret;
 
-	ret = __iddp_recvmsg(fd, iov, msg->msg_iovlen, flags, &saddr);
+	if (mbufp)
+		ret = __iddp_recvmsg_mbuf(fd, iov, msg->msg_iovlen,
+					  &saddr, mbufp);
+	else
+		ret = __iddp_recvmsg(fd, iov, msg->msg_iovlen, flags,
+				     &saddr, nowake);
 	if (ret <= 0) {
 		rtdm_drop_iovec(iov, iov_fast);
 		return ret;
@@ -367,11 +606,225 @@ static ssize_t iddp_recvmsg(struct rtdm_fd *fd,
 	return ret;
 }
 
+static ssize_t iddp_recvmsg(struct rtdm_fd *fd,
+			    struct user_msghdr *msg, int flags)
+{
+	return __iddp_recvmsg_hdr(fd, msg, flags, NULL, 0);
+}
+
+static int iddp_recvmmsg(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			 unsigned int vlen, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iddp_message *mbufv[RTDM_MMSG_BATCH];
+	struct iddp_socket *sk = priv->state;
+	int waitforone = flags & MSG_WAITFORONE;
+	unsigned int n = 0;
+	ssize_t ret = 0;
+	int nr, i;
+
+	flags &= ~MSG_WAITFORONE;
+
+	/*
+	 * Threads waiting for pool memory are kicked once for the
+	 * whole batch, not once per message received.
+	 */
+	while (n < vlen) {
+		/* Dequeue all pending messages at once. */
+		nr = __iddp_pull_batch(sk, mbufv,
+				       min_t(unsigned int, vlen - n, RTDM_MMSG_BATCH));
+		for (i = 0; i < nr; i++) {
+			ret = __iddp_recvmsg_hdr(fd, &msgvec[n].msg_hdr,
+						 flags, &mbufv[i], 0);
+			if (mbufv[i]) {
+				__iddp_unpull_batch(sk, mbufv + i, nr - i);
+				break;
+			}
+			if (ret < 0) {
+				__iddp_unpull_batch(sk, mbufv + i + 1, nr - i - 1);
+				goto out;
+			}
+			msgvec[n++].msg_len = (unsigned int)ret;
+		}
+
+		if (i == nr && nr > 0)
+			goto next;
+
+		if (i < nr && ret != -EMSGSIZE)
+			break;
+		/*
+		 * Nothing was pending, or the leading message exceeds
+		 * the buffer: the regular path waits for input or
+		 * reads the message partially.
+		 */
+		ret = __iddp_recvmsg_hdr(fd, &msgvec[n].msg_hdr,
+					 flags, NULL, 1);
+		if (ret < 0)
+			break;
+		msgvec[n++].msg_len = (unsigned int)ret;
+	next:
+		if (waitforone)
+			flags |= MSG_DONTWAIT;
+	}
+out:
+	rtdm_waitqueue_broadcast(sk->poolwaitq);
+
+	return n ?: ret;
+}
+
 static ssize_t iddp_read(struct rtdm_fd *fd, void *buf, size_t len)
 {
 	struct iovec iov = { .iov_base = buf, .iov_len = len };
 
-	return __iddp_recvmsg(fd, &iov, 1, 0, NULL);
+	return __iddp_recvmsg(fd, &iov, 1, 0, NULL, 0);
+}
+
+static int __iddp_fill_mbuf(struct rtdm_fd *fd, struct iddp_message *mbuf,
+			    struct iovec *iov, int iovlen)
+{
+	ssize_t rdlen, vlen;
+	struct xnbufd bufd;
+	int nvec, wroff;
+	int ret = 0;
+
+	/* Move "len" bytes to mbuf->data from the vector cells */
+	for (nvec = 0, rdlen = mbuf->len, wroff = 0;
+	     nvec < iovlen && rdlen > 0; nvec++) {
+		if (iov[nvec].iov_len == 0)
+			continue;
+		vlen = rdlen >= iov[nvec].iov_len ? iov[nvec].iov_len : rdlen;
+		if (rtdm_fd_is_user(fd)) {
+			xnbufd_map_uread(&bufd, iov[nvec].iov_base, vlen);
+			ret = xnbufd_copy_to_kmem(mbuf->data + wroff, &bufd, vlen);
+			xnbufd_unmap_uread(&bufd);
+		} else {
+			xnbufd_map_kread(&bufd, iov[nvec].iov_base, vlen);
+			ret = xnbufd_copy_to_kmem(mbuf->data + wroff, &bufd, vlen);
+			xnbufd_unmap_kread(&bufd);
+		}
+		if (ret < 0)
+			return ret;
+		iov[nvec].iov_base += vlen;
+		iov[nvec].iov_len -= vlen;
+		rdlen -= vlen;
+		wroff += vlen;
+	}
+
+	return 0;
+}
+
+/*
+ * Queue a published message to a subscriber, applying its overflow
+ * policy if the queue is full. Subscribers with the blocking policy
+ * always have room at this point.
+ */
+static void __iddp_queue_pub(struct iddp_socket *tsk, struct iddp_sub *sub,
+			     struct iddp_message *mbuf) /* nklock held */
+{
+	struct iddp_socket *sk = sub->sk;
+	int wakeup = 1;
+
+	if (sub->count == sub->depth) {
+		sub->drops++;
+		if (sub->policy != IDDP_SUB_DROP_OLDEST)
+			return;
+		__iddp_put_mbuf(tsk, sub->ring[sub->head]);
+		sub->head = (sub->head + 1) % sub->depth;
+		sub->count--;
+		sub->rdoff = 0;
+		/* The reader was already told about this slot. */
+		wakeup = 0;
+	}
+
+	if (wakeup && !__iddp_readable(sk)) /* -> readable */
+		xnselect_signal(&sk->priv->recv_block, POLLIN);
+
+	sub->ring[(sub->head + sub->count) % sub->depth] = mbuf;
+	sub->count++;
+	mbuf->refs++;
+
+	if (wakeup)
+		rtdm_sem_up(&sk->insem);
+}
+
+static int __iddp_pub_blocked(struct iddp_socket *tsk) /* nklock held */
+{
+	struct iddp_sub *sub;
+
+	list_for_each_entry(sub, &tsk->subscribers, next) {
+		if (sub->policy == IDDP_SUB_BLOCK && sub->count == sub->depth)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Publish a message to all subscribers of the fan-out port @tsk.
+ * The payload is copied once, into a buffer shared by all
+ * subscribers.
+ */
+static ssize_t __iddp_publish(struct rtdm_fd *fd, struct iddp_socket *tsk,
+			      struct iovec *iov, int iovlen,
+			      ssize_t len, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iddp_socket *sk = priv->state;
+	rtdm_toseq_t timeout_seq;
+	struct iddp_message *mbuf;
+	struct iddp_sub *sub;
+	rtdm_lockctx_t s;
+	int ret;
+
+	if (flags & MSG_OOB)
+		return -EOPNOTSUPP;
+
+	mbuf = __iddp_alloc_mbuf(tsk, len, sk->tx_timeout, flags, &ret);
+	if (unlikely(ret))
+		return ret;
+
+	ret = __iddp_fill_mbuf(fd, mbuf, iov, iovlen);
+	if (ret) {
+		__iddp_free_mbuf(tsk, mbuf);
+		return ret;
+	}
+
+	mbuf->from = sk->name.sipc_port;
+	/* Hold the buffer until all subscribers got it. */
+	mbuf->refs = 1;
+
+	rtdm_toseq_init(&timeout_seq, sk->tx_timeout);
+
+	rtdm_waitqueue_lock(&tsk->fanwaitq, s);
+
+	/*
+	 * Wait for all blocking subscribers to have room, so that
+	 * the message is delivered to all of them at once, or to
+	 * none if we fail.
+	 */
+	while (__iddp_pub_blocked(tsk)) {
+		if (flags & MSG_DONTWAIT) {
+			ret = -EAGAIN;
+			break;
+		}
+		ret = rtdm_timedwait_locked(&tsk->fanwaitq,
+					    sk->tx_timeout, &timeout_seq);
+		if (unlikely(ret == -EIDRM))
+			ret = -ECONNRESET;
+		if (ret)
+			break;
+	}
+
+	if (ret == 0) {
+		list_for_each_entry(sub, &tsk->subscribers, next)
+			__iddp_queue_pub(tsk, sub, mbuf);
+	}
+
+	__iddp_put_mbuf(tsk, mbuf);
+
+	rtdm_waitqueue_unlock(&tsk->fanwaitq, s);
+
+	return ret ?: len;
 }
 
 static ssize_t __iddp_sendmsg(struct rtdm_fd *fd,
@@ -381,11 +834,10 @@ static ssize_t __iddp_sendmsg(struct rtdm_fd *fd,
 	struct rtipc_private *priv = rtdm_fd_to_private(fd);
 	struct iddp_socket *sk = priv->state, *rsk;
 	struct iddp_message *mbuf;
-	ssize_t len, rdlen, vlen;
-	int nvec, wroff, ret;
 	struct rtdm_fd *rfd;
-	struct xnbufd bufd;
 	rtdm_lockctx_t s;
+	ssize_t len;
+	int ret;
 
 	len = rtdm_get_iov_flatlen(iov, iovlen);
 	if (len == 0)
@@ -405,34 +857,21 @@ static ssize_t __iddp_sendmsg(struct rtdm_fd *fd,
 		return -ECONNREFUSED;
 	}
 
+	if (test_bit(_IDDP_FANOUT, &rsk->status)) {
+		ret = __iddp_publish(fd, rsk, iov, iovlen, len, flags);
+		rtdm_fd_unlock(rfd);
+		return ret;
+	}
+
 	mbuf = __iddp_alloc_mbuf(rsk, len, sk->tx_timeout, flags, &ret);
 	if (unlikely(ret)) {
 		rtdm_fd_unlock(rfd);
 		return ret;
 	}
 
-	/* Now, move "len" bytes to mbuf->data from the vector cells */
-	for (nvec = 0, rdlen = len, wroff = 0;
-	     nvec < iovlen && rdlen > 0; nvec++) {
-		if (iov[nvec].iov_len == 0)
-			continue;
-		vlen = rdlen >= iov[nvec].iov_len ? iov[nvec].iov_len : rdlen;
-		if (rtdm_fd_is_user(fd)) {
-			xnbufd_map_uread(&bufd, iov[nvec].iov_base, vlen);
-			ret = xnbufd_copy_to_kmem(mbuf->data + wroff, &bufd, vlen);
-			xnbufd_unmap_uread(&bufd);
-		} else {
-			xnbufd_map_kread(&bufd, iov[nvec].iov_base, vlen);
-			ret = xnbufd_copy_to_kmem(mbuf->data + wroff, &bufd, vlen);
-			xnbufd_unmap_kread(&bufd);
-		}
-		if (ret < 0)
-			goto fail;
-		iov[nvec].iov_base += vlen;
-		iov[nvec].iov_len -= vlen;
-		rdlen -= vlen;
-		wroff += vlen;
-	}
+	ret = __iddp_fill_mbuf(fd, mbuf, iov, iovlen);
+	if (ret)
+		goto fail;
 
 	cobalt_atomic_enter(s);
 
@@ -440,7 +879,7 @@ static ssize_t __iddp_sendmsg(struct rtdm_fd *fd,
 	 * CAUTION: we must remain atomic from the moment we signal
 	 * POLLIN, until sem_up has happened.
 	 */
-	if (list_empty(&rsk->inq)) /* -> readable */
+	if (!__iddp_readable(rsk)) /* -> readable */
 		xnselect_signal(&rsk->priv->recv_block, POLLIN);
 
 	mbuf->from = sk->name.sipc_port;
@@ -466,40 +905,52 @@ fail:
 	return ret;
 }
 
-static ssize_t iddp_sendmsg(struct rtdm_fd *fd,
-			    const struct user_msghdr *msg, int flags)
+static int __iddp_get_daddr(struct rtdm_fd *fd,
+			    const struct user_msghdr *msg,
+			    struct sockaddr_ipc *daddr)
 {
 	struct rtipc_private *priv = rtdm_fd_to_private(fd);
-	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
 	struct iddp_socket *sk = priv->state;
-	struct sockaddr_ipc daddr;
-	ssize_t ret;
-
-	if (flags & ~(MSG_OOB | MSG_DONTWAIT))
-		return -EINVAL;
 
 	if (msg->msg_name) {
 		if (msg->msg_namelen != sizeof(struct sockaddr_ipc))
 			return -EINVAL;
 
 		/* Fetch the destination address to send to. */
-		if (rtipc_get_arg(fd, &daddr, msg->msg_name, sizeof(daddr)))
+		if (rtipc_get_arg(fd, daddr, msg->msg_name, sizeof(*daddr)))
 			return -EFAULT;
 
-		if (daddr.sipc_port < 0 ||
-		    daddr.sipc_port >= CONFIG_XENO_OPT_IDDP_NRPORT)
+		if (daddr->sipc_port < 0 ||
+		    daddr->sipc_port >= CONFIG_XENO_OPT_IDDP_NRPORT)
 			return -EINVAL;
 	} else {
 		if (msg->msg_namelen != 0)
 			return -EINVAL;
-		daddr = sk->peer;
-		if (daddr.sipc_port < 0)
+		*daddr = sk->peer;
+		if (daddr->sipc_port < 0)
 			return -EDESTADDRREQ;
 	}
 
 	if (msg->msg_iovlen >= UIO_MAXIOV)
 		return -EINVAL;
 
+	return 0;
+}
+
+static ssize_t iddp_sendmsg(struct rtdm_fd *fd,
+			    const struct user_msghdr *msg, int flags)
+{
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	struct sockaddr_ipc daddr;
+	ssize_t ret;
+
+	if (flags & ~(MSG_OOB | MSG_DONTWAIT))
+		return -EINVAL;
+
+	ret = __iddp_get_daddr(fd, msg, &daddr);
+	if (ret)
+		return ret;
+
 	/* Copy I/O vector in */
 	ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
 	if (ret)
@@ -515,6 +966,172 @@ static ssize_t iddp_sendmsg(struct rtdm_fd *fd,
 	return rtdm_put_iovec(fd, iov, msg, iov_fast) ?: ret;
 }
 
+/*
+ * Queue a batch of messages to the same destination at once, see
+ * __iddp_sendmsg().
+ */
+static void __iddp_queue_batch(struct iddp_socket *sk,
+			       struct iddp_socket *rsk,
+			       struct iddp_message **mbufv, int nr,
+			       int flags)
+{
+	rtdm_lockctx_t s;
+	int n;
+
+	if (nr == 0)
+		return;
+
+	cobalt_atomic_enter(s);
+
+	if (!__iddp_readable(rsk)) /* -> readable */
+		xnselect_signal(&rsk->priv->recv_block, POLLIN);
+
+	for (n = 0; n < nr; n++) {
+		mbufv[n]->from = sk->name.sipc_port;
+		if (flags & MSG_OOB)
+			list_add(&mbufv[n]->next, &rsk->inq);
+		else
+			list_add_tail(&mbufv[n]->next, &rsk->inq);
+	}
+
+	/*
+	 * Queue all messages before posting the semaphore, which may
+	 * switch to the reader.
+	 */
+	for (n = 0; n < nr; n++)
+		rtdm_sem_up(&rsk->insem);
+
+	cobalt_atomic_leave(s);
+}
+
+/*
+ * Send a vector of messages, looking up the destination port once
+ * for consecutive messages sent to the same peer, and queuing them
+ * with a single atomic section.
+ */
+static int iddp_sendmmsg(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			 unsigned int vlen, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	struct iddp_message *mbufv[RTDM_MMSG_BATCH];
+	struct iddp_socket *sk = priv->state, *rsk = NULL;
+	struct rtdm_fd *rfd = NULL;
+	struct sockaddr_ipc daddr;
+	struct iddp_message *mbuf;
+	struct user_msghdr *msg;
+	int nr = 0, port = -1;
+	rtdm_lockctx_t s;
+	unsigned int n;
+	ssize_t len;
+	int ret = 0;
+
+	if (flags & ~(MSG_OOB | MSG_DONTWAIT))
+		return -EINVAL;
+
+	vlen = min_t(unsigned int, vlen, RTDM_MMSG_BATCH);
+
+	for (n = 0; n < vlen; n++) {
+		msg = &msgvec[n].msg_hdr;
+		ret = __iddp_get_daddr(fd, msg, &daddr);
+		if (ret)
+			break;
+
+		if (rfd == NULL || daddr.sipc_port != port) {
+			if (rfd) {
+				__iddp_queue_batch(sk, rsk, mbufv, nr, flags);
+				nr = 0;
+				rtdm_fd_unlock(rfd);
+			}
+			cobalt_atomic_enter(s);
+			rfd = xnmap_fetch_nocheck(portmap, daddr.sipc_port);
+			if (rfd && rtdm_fd_lock(rfd) < 0)
+				rfd = NULL;
+			cobalt_atomic_leave(s);
+			if (rfd == NULL) {
+				ret = -ECONNRESET;
+				break;
+			}
+			rsk = rtipc_fd_to_state(rfd);
+			port = daddr.sipc_port;
+		}
+
+		if (!test_bit(_IDDP_BOUND, &rsk->status)) {
+			ret = -ECONNREFUSED;
+			break;
+		}
+
+		/* Copy I/O vector in */
+		ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+		if (ret)
+			break;
+
+		len = rtdm_get_iov_flatlen(iov, msg->msg_iovlen);
+		if (len <= 0) {
+			rtdm_drop_iovec(iov, iov_fast);
+			if (len < 0) {
+				ret = len;
+				break;
+			}
+			msgvec[n].msg_len = 0;
+			continue;
+		}
+
+		if (test_bit(_IDDP_FANOUT, &rsk->status)) {
+			len = __iddp_publish(fd, rsk, iov, msg->msg_iovlen,
+					     len, flags);
+			if (len < 0) {
+				rtdm_drop_iovec(iov, iov_fast);
+				ret = len;
+				break;
+			}
+			goto done;
+		}
+
+		/*
+		 * Never wait for pool memory while holding buffers
+		 * the reader cannot see yet, flush them first.
+		 */
+		mbuf = __iddp_alloc_mbuf(rsk, len, sk->tx_timeout,
+					 nr > 0 ? flags | MSG_DONTWAIT : flags,
+					 &ret);
+		if (ret == -EAGAIN && nr > 0 && !(flags & MSG_DONTWAIT)) {
+			__iddp_queue_batch(sk, rsk, mbufv, nr, flags);
+			nr = 0;
+			mbuf = __iddp_alloc_mbuf(rsk, len, sk->tx_timeout,
+						 flags, &ret);
+		}
+		if (unlikely(ret)) {
+			rtdm_drop_iovec(iov, iov_fast);
+			break;
+		}
+
+		ret = __iddp_fill_mbuf(fd, mbuf, iov, msg->msg_iovlen);
+		if (ret) {
+			__iddp_free_mbuf(rsk, mbuf);
+			rtdm_drop_iovec(iov, iov_fast);
+			break;
+		}
+
+		mbufv[nr++] = mbuf;
+	done:
+		msgvec[n].msg_len = (unsigned int)len;
+		/* Copy updated I/O vector back */
+		ret = rtdm_put_iovec(fd, iov, msg, iov_fast);
+		if (ret) {
+			n++;	/* Sent anyway. */
+			break;
+		}
+	}
+
+	if (rfd) {
+		__iddp_queue_batch(sk, rsk, mbufv, nr, flags);
+		rtdm_fd_unlock(rfd);
+	}
+
+	return n ?: ret;
+}
+
 static ssize_t iddp_write(struct rtdm_fd *fd,
 			  const void *buf, size_t len)
 {
@@ -694,16 +1311,101 @@ set_assoc:
 	return 0;
 }
 
+static int __iddp_subscribe(struct iddp_socket *sk,
+			    const struct iddp_subscription *req)
+{
+	struct iddp_sub *sub, *osub;
+	struct iddp_socket *tsk;
+	struct rtdm_fd *tfd;
+	rtdm_lockctx_t s;
+	int ret = 0;
+
+	if (req->port < 0) {
+		cobalt_atomic_enter(s);
+		osub = sk->sub;
+		if (osub) {
+			__iddp_detach_sub(osub);
+			sk->sub = NULL;
+		}
+		cobalt_atomic_leave(s);
+		if (osub)
+			xnfree(osub);
+		return 0;
+	}
+
+	if (req->port >= CONFIG_XENO_OPT_IDDP_NRPORT)
+		return -ECONNREFUSED;
+
+	if (req->depth == 0 || req->depth > IDDP_SUB_MAXDEPTH)
+		return -EINVAL;
+
+	switch (req->policy) {
+	case IDDP_SUB_DROP_OLDEST:
+	case IDDP_SUB_DROP_NEWEST:
+	case IDDP_SUB_BLOCK:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	sub = xnmalloc(sizeof(*sub) + req->depth * sizeof(sub->ring[0]));
+	if (sub == NULL)
+		return -ENOMEM;
+
+	sub->sk = sk;
+	sub->port = req->port;
+	sub->policy = req->policy;
+	sub->depth = req->depth;
+	sub->head = 0;
+	sub->count = 0;
+	sub->rdoff = 0;
+	sub->drops = 0;
+
+	cobalt_atomic_enter(s);
+
+	/*
+	 * A subscription which lost its fan-out port may be replaced
+	 * silently.
+	 */
+	osub = sk->sub;
+	tfd = xnmap_fetch_nocheck(portmap, req->port);
+	if (osub && osub->tfd)
+		ret = -EBUSY;
+	else if (tfd == NULL)
+		ret = -ECONNREFUSED;
+	else {
+		tsk = rtipc_fd_to_state(tfd);
+		if (!test_bit(_IDDP_BOUND, &tsk->status) ||
+		    !test_bit(_IDDP_FANOUT, &tsk->status))
+			ret = -ECONNREFUSED;
+		else {
+			sub->tfd = tfd;
+			list_add_tail(&sub->next, &tsk->subscribers);
+			sk->sub = sub;
+		}
+	}
+
+	cobalt_atomic_leave(s);
+
+	if (ret)
+		xnfree(sub);
+	else if (osub)
+		xnfree(osub);
+
+	return ret;
+}
+
 static int __iddp_setsockopt(struct iddp_socket *sk,
 			     struct rtdm_fd *fd,
 			     void *arg)
 {
 	struct _rtdm_setsockopt_args sopt;
+	struct iddp_subscription subreq;
 	struct rtipc_port_label plabel;
 	struct timeval tv;
 	rtdm_lockctx_t s;
 	size_t len;
-	int ret;
+	int ret, val;
 
 	ret = rtipc_get_sockoptin(fd, &sopt, arg);
 	if (ret)
@@ -776,6 +1478,30 @@ static int __iddp_setsockopt(struct iddp_socket *sk,
 		cobalt_atomic_leave(s);
 		break;
 
+	case IDDP_FANOUT:
+		if (sopt.optlen != sizeof(val))
+			return -EINVAL;
+		if (rtipc_get_arg(fd, &val, sopt.optval, sizeof(val)))
+			return -EFAULT;
+		cobalt_atomic_enter(s);
+		if (test_bit(_IDDP_BOUND, &sk->status) ||
+		    test_bit(_IDDP_BINDING, &sk->status))
+			ret = -EALREADY;
+		else if (val)
+			__set_bit(_IDDP_FANOUT, &sk->status);
+		else
+			__clear_bit(_IDDP_FANOUT, &sk->status);
+		cobalt_atomic_leave(s);
+		break;
+
+	case IDDP_SUBSCRIBE:
+		if (sopt.optlen != sizeof(subreq))
+			return -EINVAL;
+		if (rtipc_get_arg(fd, &subreq, sopt.optval, sizeof(subreq)))
+			return -EFAULT;
+		ret = __iddp_subscribe(sk, &subreq);
+		break;
+
 	default:
 		ret = -EINVAL;
 	}
@@ -788,6 +1514,7 @@ static int __iddp_getsockopt(struct iddp_socket *sk,
 			     void *arg)
 {
 	struct _rtdm_getsockopt_args sopt;
+	struct iddp_subscription subreq;
 	struct rtipc_port_label plabel;
 	struct timeval tv;
 	rtdm_lockctx_t s;
@@ -841,6 +1568,24 @@ static int __iddp_getsockopt(struct iddp_socket *sk,
 			return -EFAULT;
 		break;
 
+	case IDDP_SUBSCRIBE:
+		if (len < sizeof(subreq))
+			return -EINVAL;
+		memset(&subreq, 0, sizeof(subreq));
+		subreq.port = -1;
+		cobalt_atomic_enter(s);
+		if (sk->sub && sk->sub->tfd) {
+			subreq.port = sk->sub->port;
+			subreq.policy = sk->sub->policy;
+			subreq.depth = sk->sub->depth;
+		}
+		if (sk->sub)
+			subreq.drops = sk->sub->drops;
+		cobalt_atomic_leave(s);
+		if (rtipc_put_arg(fd, sopt.optval, &subreq, sizeof(subreq)))
+			return -EFAULT;
+		break;
+
 	default:
 		ret = -EINVAL;
 	}
@@ -946,7 +1691,8 @@ static unsigned int iddp_pollstate(struct rtdm_fd *fd) /* atomic */
 	unsigned int mask = 0;
 	struct rtdm_fd *rfd;
 
-	if (test_bit(_IDDP_BOUND, &sk->status) && !list_empty(&sk->inq))
+	if ((test_bit(_IDDP_BOUND, &sk->status) || sk->sub) &&
+	    __iddp_readable(sk))
 		mask |= POLLIN;
 
 	/*
@@ -979,7 +1725,9 @@ struct rtipc_protocol iddp_proto_driver = {
 		.socket = iddp_socket,
 		.close = iddp_close,
 		.recvmsg = iddp_recvmsg,
+		.recvmmsg = iddp_recvmmsg,
 		.sendmsg = iddp_sendmsg,
+		.sendmmsg = iddp_sendmmsg,
 		.read = iddp_read,
 		.write = iddp_write,
 		.ioctl = iddp_ioctl,
@@ -49,6 +49,10 @@ struct rtipc_protocol {
 				   struct user_msghdr *msg, int flags);
 		ssize_t (*sendmsg)(struct rtdm_fd *fd,
 				   const struct user_msghdr *msg, int flags);
+		int (*recvmmsg)(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+				unsigned int vlen, int flags);
+		int (*sendmmsg)(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+				unsigned int vlen, int flags);
 		ssize_t (*read)(struct rtdm_fd *fd,
 				void *buf, size_t len);
 		ssize_t (*write)(struct rtdm_fd *fd,
@@ -56,6 +60,8 @@ struct rtipc_protocol {
 		int (*ioctl)(struct rtdm_fd *fd,
 			     unsigned int request, void *arg);
 		unsigned int (*pollstate)(struct rtdm_fd *fd);
+		int (*mmap)(struct rtdm_fd *fd,
+			    struct vm_area_struct *vma);
 	} proto_ops;
 };
 
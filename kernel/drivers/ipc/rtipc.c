@@ -397,6 +397,28 @@ static ssize_t rtipc_sendmsg(struct rtdm_fd *fd,
 	return priv->proto->proto_ops.sendmsg(fd, msg, flags);
 }
 
+static int rtipc_recvmmsg(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			  unsigned int vlen, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+
+	if (priv->proto->proto_ops.recvmmsg == NULL)
+		return -ENOSYS;	/* Use the per-message handler. */
+
+	return priv->proto->proto_ops.recvmmsg(fd, msgvec, vlen, flags);
+}
+
+static int rtipc_sendmmsg(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			  unsigned int vlen, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+
+	if (priv->proto->proto_ops.sendmmsg == NULL)
+		return -ENOSYS;	/* Use the per-message handler. */
+
+	return priv->proto->proto_ops.sendmmsg(fd, msgvec, vlen, flags);
+}
+
 static ssize_t rtipc_read(struct rtdm_fd *fd,
 			  void *buf, size_t len)
 {
@@ -418,6 +440,16 @@ static int rtipc_ioctl(struct rtdm_fd *fd,
 	return priv->proto->proto_ops.ioctl(fd, request, arg);
 }
 
+static int rtipc_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+
+	if (priv->proto->proto_ops.mmap == NULL)
+		return -ENODEV;
+
+	return priv->proto->proto_ops.mmap(fd, vma);
+}
+
 static int rtipc_select(struct rtdm_fd *fd, struct xnselector *selector,
 			unsigned int type, unsigned int index)
 {
@@ -472,8 +504,10 @@ static struct rtdm_driver rtipc_driver = {
 		.close		=	rtipc_close,
 		.recvmsg_rt	=	rtipc_recvmsg,
 		.recvmsg_nrt	=	NULL,
+		.recvmmsg_rt	=	rtipc_recvmmsg,
 		.sendmsg_rt	=	rtipc_sendmsg,
 		.sendmsg_nrt	=	NULL,
+		.sendmmsg_rt	=	rtipc_sendmmsg,
 		.ioctl_rt	=	rtipc_ioctl,
 		.ioctl_nrt	=	rtipc_ioctl,
 		.read_rt	=	rtipc_read,
@@ -481,6 +515,7 @@ static struct rtdm_driver rtipc_driver = {
 		.write_rt	=	rtipc_write,
 		.write_nrt	=	NULL,
 		.select		=	rtipc_select,
+		.mmap		=	rtipc_mmap,
 	},
 };
 
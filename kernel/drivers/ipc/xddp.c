@@ -20,6 +20,8 @@
 #include <linux/module.h>
 #include <linux/string.h>
 #include <linux/poll.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
 #include <linux/slab.h>
 #include <cobalt/kernel/heap.h>
 #include <cobalt/kernel/bufd.h>
@@ -29,6 +31,9 @@
 
 #define XDDP_SOCKET_MAGIC 0xa21a21a2
 
+#define XDDP_RING_MAXSZ  (1U << 26)
+#define XDDP_RING_BUSY   0x80000000	/* Record being filled. */
+
 struct xddp_message {
 	struct xnpipe_mh mh;
 	char data[];
@@ -59,6 +64,15 @@ struct xddp_socket {
 
 	int (*monitor)(struct rtdm_fd *fd, int event, long arg);
 	struct rtipc_private *priv;
+
+	struct xddp_ring_setup ringreq;	/* Requested ring setup */
+	struct xddp_ring_ctl *ring;	/* Shared ring, if any */
+	char *ring_data;
+	u32 ring_size;		/* Private copy of ring->size */
+	u32 ring_resv;		/* End of reserved records */
+	u32 ring_tail;		/* End of committed records */
+	unsigned int ring_pending; /* Messages since last wakeup */
+	rtdm_timer_t ring_timer;
 };
 
 static struct sockaddr_ipc nullsa = {
@@ -200,12 +214,83 @@ static int __xddp_input_handler(struct xnpipe_mh *mh, int retval, void *skarg) /
 	return retval;
 }
 
+static int __xddp_mmap_handler(struct vm_area_struct *vma,
+			       void *skarg) /* nklock free */
+{
+	struct xddp_socket *sk = skarg;
+	size_t len = vma->vm_end - vma->vm_start;
+
+	if (vma->vm_pgoff != 0 || len != PAGE_SIZE + sk->ring_size)
+		return -EINVAL;
+
+	return rtdm_mmap_vmem(vma, sk->ring);
+}
+
+static int __xddp_pending_handler(void *skarg) /* nklock held */
+{
+	struct xddp_socket *sk = skarg;
+
+	return ACCESS_ONCE(sk->ring->head) != sk->ring_tail;
+}
+
+static void __xddp_ring_timeout(rtdm_timer_t *timer) /* nklock held */
+{
+	struct xddp_socket *sk = container_of(timer, struct xddp_socket,
+					      ring_timer);
+	sk->ring_pending = 0;
+	xnpipe_kick(sk->minor);
+}
+
+static int __xddp_alloc_ring(struct xddp_socket *sk)
+{
+	struct xddp_ring_ctl *ring;
+	u32 size;
+	int ret;
+
+	size = roundup_pow_of_two(sk->ringreq.size);
+	if (size < PAGE_SIZE)
+		size = PAGE_SIZE;
+
+	ring = xnheap_vmalloc(PAGE_SIZE + size);
+	if (ring == NULL)
+		return -ENOMEM;
+
+	ret = rtdm_timer_init(&sk->ring_timer, __xddp_ring_timeout,
+			      "xddp-ring");
+	if (ret) {
+		xnheap_vfree(ring);
+		return ret;
+	}
+
+	memset(ring, 0, PAGE_SIZE + size);
+	ring->size = size;
+	sk->ring = ring;
+	sk->ring_data = (char *)ring + PAGE_SIZE;
+	sk->ring_size = size;
+	sk->ring_resv = 0;
+	sk->ring_tail = 0;
+	sk->ring_pending = 0;
+
+	return 0;
+}
+
+static void __xddp_free_ring(struct xddp_socket *sk)
+{
+	if (sk->ring) {
+		xnheap_vfree(sk->ring);
+		sk->ring = NULL;
+	}
+}
+
 static void __xddp_release_handler(void *skarg) /* nklock free */
 {
 	struct xddp_socket *sk = skarg;
 	void *poolmem;
 	u32 poolsz;
 
+	/* No more mapping may refer to the ring at this point. */
+	__xddp_free_ring(sk);
+
 	if (sk->bufpool == &sk->privpool) {
 		poolmem = xnheap_get_membase(&sk->privpool);
 		poolsz = xnheap_get_size(&sk->privpool);
@@ -240,6 +325,8 @@ static int xddp_socket(struct rtdm_fd *fd)
 	sk->monitor = NULL;
 	rtdm_lock_init(&sk->lock);
 	sk->priv = priv;
+	memset(&sk->ringreq, 0, sizeof(sk->ringreq));
+	sk->ring = NULL;
 
 	return 0;
 }
@@ -262,6 +349,9 @@ static void xddp_close(struct rtdm_fd *fd)
 	if (sk->handle)
 		xnregistry_remove(sk->handle);
 
+	if (sk->ring)
+		rtdm_timer_destroy(&sk->ring_timer);
+
 	xnpipe_disconnect(sk->minor);
 }
 
@@ -459,6 +549,140 @@ out:
 	return outbytes;
 }
 
+static void __xddp_ring_commit(struct xddp_socket *sk) /* nklock held */
+{
+	u32 tail, recsz, batch;
+	struct xddp_ring_rec *rec;
+	unsigned int count = 0;
+
+	/*
+	 * Publish the records completed in sequence, stopping at the
+	 * first one still being filled by some sender. Record
+	 * lengths are read back from the shared area, which the
+	 * reader might have trashed: never walk past the reserved
+	 * space.
+	 */
+	for (tail = sk->ring_tail; tail != sk->ring_resv; tail += recsz) {
+		rec = (struct xddp_ring_rec *)
+			(sk->ring_data + (tail & (sk->ring_size - 1)));
+		if (rec->flags & XDDP_RING_BUSY)
+			break;
+		recsz = XDDP_RING_RECSZ(rec->len);
+		if (recsz == 0 || recsz > sk->ring_resv - tail) {
+			tail = sk->ring_resv;
+			break;
+		}
+		if ((rec->flags & XDDP_RING_PAD) == 0)
+			count++;
+	}
+
+	if (tail == sk->ring_tail)
+		return;
+
+	sk->ring_tail = tail;
+	smp_wmb();
+	sk->ring->tail = tail;
+
+	if (count == 0)
+		return;
+
+	/*
+	 * Wake up the reader once enough messages are pending, or
+	 * when the latency timer fires, whichever comes first.
+	 */
+	batch = sk->ringreq.batch ?: 1;
+	sk->ring_pending += count;
+	if (sk->ring_pending >= batch) {
+		if (sk->ringreq.latency)
+			rtdm_timer_stop(&sk->ring_timer);
+		sk->ring_pending = 0;
+		xnpipe_kick(sk->minor);
+	} else if (sk->ring_pending == count && sk->ringreq.latency)
+		rtdm_timer_start(&sk->ring_timer,
+				 (nanosecs_abs_t)sk->ringreq.latency * 1000,
+				 0, RTDM_TIMERMODE_RELATIVE);
+}
+
+static ssize_t __xddp_ring_send(struct rtdm_fd *fd, struct xddp_socket *rsk,
+				struct iovec *iov, int iovlen, ssize_t len)
+{
+	ssize_t rdlen, wrlen, vlen, ret = 0;
+	struct xddp_ring_rec *rec;
+	u32 recsz, off, room, head;
+	struct xnbufd bufd;
+	rtdm_lockctx_t s;
+	int nvec;
+
+	recsz = XDDP_RING_RECSZ(len);
+	if (len > rsk->ring_size / 2 || recsz > rsk->ring_size / 2)
+		return -EMSGSIZE;
+
+	/*
+	 * Reserve the record, padding the end of the data area if
+	 * the record would not fit contiguously. The payload is
+	 * copied with no lock held, other senders may reserve the
+	 * next records meanwhile.
+	 */
+	cobalt_atomic_enter(s);
+	head = ACCESS_ONCE(rsk->ring->head);
+	smp_mb();
+	off = rsk->ring_resv & (rsk->ring_size - 1);
+	room = rsk->ring_size - off;
+	if (rsk->ring_resv - head + (room < recsz ? room : 0) + recsz >
+	    rsk->ring_size) {
+		rsk->ring->dropped++;
+		cobalt_atomic_leave(s);
+		return -ENOMEM;
+	}
+	if (room < recsz) {
+		rec = (struct xddp_ring_rec *)(rsk->ring_data + off);
+		rec->len = room - sizeof(*rec);
+		rec->flags = XDDP_RING_PAD;
+		rsk->ring_resv += room;
+		off = 0;
+	}
+	rec = (struct xddp_ring_rec *)(rsk->ring_data + off);
+	rec->len = len;
+	rec->flags = XDDP_RING_BUSY;
+	rsk->ring_resv += recsz;
+	cobalt_atomic_leave(s);
+
+	for (nvec = 0, rdlen = len, wrlen = 0;
+	     nvec < iovlen && rdlen > 0; nvec++) {
+		if (iov[nvec].iov_len == 0)
+			continue;
+		vlen = rdlen >= iov[nvec].iov_len ? iov[nvec].iov_len : rdlen;
+		if (rtdm_fd_is_user(fd)) {
+			xnbufd_map_uread(&bufd, iov[nvec].iov_base, vlen);
+			ret = xnbufd_copy_to_kmem((char *)(rec + 1) + wrlen,
+						  &bufd, vlen);
+			xnbufd_unmap_uread(&bufd);
+		} else {
+			xnbufd_map_kread(&bufd, iov[nvec].iov_base, vlen);
+			ret = xnbufd_copy_to_kmem((char *)(rec + 1) + wrlen,
+						  &bufd, vlen);
+			xnbufd_unmap_kread(&bufd);
+		}
+		if (ret < 0)
+			break;
+		iov[nvec].iov_base += vlen;
+		iov[nvec].iov_len -= vlen;
+		rdlen -= vlen;
+		wrlen += vlen;
+	}
+
+	/*
+	 * The record cannot be given back once reserved, turn it to
+	 * padding if the payload could not be fetched.
+	 */
+	cobalt_atomic_enter(s);
+	rec->flags = ret < 0 ? XDDP_RING_PAD : 0;
+	__xddp_ring_commit(rsk);
+	cobalt_atomic_leave(s);
+
+	return ret < 0 ? ret : len;
+}
+
 static ssize_t __xddp_sendmsg(struct rtdm_fd *fd,
 			      struct iovec *iov, int iovlen, int flags,
 			      const struct sockaddr_ipc *daddr)
@@ -495,6 +719,15 @@ static ssize_t __xddp_sendmsg(struct rtdm_fd *fd,
 		return -ECONNREFUSED;
 	}
 
+	if (rsk->ring) {
+		if (flags & (MSG_MORE | MSG_OOB))
+			ret = -EOPNOTSUPP;
+		else
+			ret = __xddp_ring_send(fd, rsk, iov, iovlen, len);
+		rtdm_fd_unlock(rfd);
+		return ret;
+	}
+
 	sublen = len;
 	nvec = 0;
 
@@ -718,6 +951,12 @@ static int __xddp_bind_socket(struct rtipc_private *priv,
 		sk->curbufsz = sk->reqbufsz;
 	}
 
+	if (sk->ringreq.size > 0) {
+		ret = __xddp_alloc_ring(sk);
+		if (ret)
+			goto fail_freeheap;
+	}
+
 	sk->fd = rtdm_private_to_fd(priv);
 
 	ops.output = &__xddp_output_handler;
@@ -726,11 +965,17 @@ static int __xddp_bind_socket(struct rtipc_private *priv,
 	ops.free_ibuf = &__xddp_free_handler;
 	ops.free_obuf = &__xddp_free_handler;
 	ops.release = &__xddp_release_handler;
+	ops.mmap = sk->ring ? &__xddp_mmap_handler : NULL;
+	ops.pending = sk->ring ? &__xddp_pending_handler : NULL;
 
 	ret = xnpipe_connect(sa->sipc_port, &ops, sk);
 	if (ret < 0) {
 		if (ret == -EBUSY)
 			ret = -EADDRINUSE;
+		if (sk->ring) {
+			rtdm_timer_destroy(&sk->ring_timer);
+			__xddp_free_ring(sk);
+		}
 	fail_freeheap:
 		if (poolsz > 0) {
 			xnheap_destroy(&sk->privpool);
@@ -755,7 +1000,12 @@ static int __xddp_bind_socket(struct rtipc_private *priv,
 		ret = xnregistry_enter(sk->label, sk, &sk->handle,
 				       &__xddp_pnode.node);
 		if (ret) {
-			/* The release handler will cleanup the pool for us. */
+			/*
+			 * The release handler will cleanup the pool
+			 * and the ring for us.
+			 */
+			if (sk->ring)
+				rtdm_timer_destroy(&sk->ring_timer);
 			xnpipe_disconnect(sk->minor);
 			return ret;
 		}
@@ -854,6 +1104,7 @@ static int __xddp_setsockopt(struct xddp_socket *sk,
 {
 	int (*monitor)(struct rtdm_fd *fd, int event, long arg);
 	struct _rtdm_setsockopt_args sopt;
+	struct xddp_ring_setup ringreq;
 	struct rtipc_port_label plabel;
 	struct timeval tv;
 	rtdm_lockctx_t s;
@@ -948,6 +1199,22 @@ static int __xddp_setsockopt(struct xddp_socket *sk,
 		cobalt_atomic_leave(s);
 		break;
 
+	case XDDP_RING:
+		if (sopt.optlen != sizeof(ringreq))
+			return -EINVAL;
+		if (rtipc_get_arg(fd, &ringreq, sopt.optval, sizeof(ringreq)))
+			return -EFAULT;
+		if (ringreq.size == 0 || ringreq.size > XDDP_RING_MAXSZ)
+			return -EINVAL;
+		cobalt_atomic_enter(s);
+		if (test_bit(_XDDP_BOUND, &sk->status) ||
+		    test_bit(_XDDP_BINDING, &sk->status))
+			ret = -EALREADY;
+		else
+			sk->ringreq = ringreq;
+		cobalt_atomic_leave(s);
+		break;
+
 	default:
 		ret = -EINVAL;
 	}
@@ -79,7 +79,7 @@ static int rt_loopback_xmit(struct rtskb *rtskb, struct rtnet_device *rtdev)
     /* parse the Ethernet header as usual */
     rtskb->protocol = rt_eth_type_trans(rtskb, rtdev);
 
-    rt_stack_deliver(rtskb);
+    rt_stack_loopback(rtskb);
 
     return 0;
 }
@@ -37,6 +37,19 @@ struct dest_route {
     struct rtnet_device *rtdev;
 };
 
+/* output route of a connected socket, see rt_ip_route_output_cached() */
+struct dest_route_cache {
+    struct dest_route   dest;       /* dest.rtdev == NULL: invalid */
+    u32                 daddr;
+    u32                 saddr;
+    unsigned int        gen;
+};
+
+static inline void rt_ip_route_cache_reset(struct dest_route_cache *cache)
+{
+    cache->dest.rtdev = NULL;
+}
+
 
 int rt_ip_route_add_host(u32 addr, unsigned char *dev_addr,
                          struct rtnet_device *rtdev);
@@ -55,6 +68,8 @@ int rt_ip_route_del_host(u32 addr, struct rtnet_device *rtdev);
 int rt_ip_route_get_host(u32 addr, char* if_name, unsigned char *dev_addr,
                          struct rtnet_device *rtdev);
 int rt_ip_route_output(struct dest_route *rt_buf, u32 daddr, u32 saddr);
+int rt_ip_route_output_cached(struct dest_route_cache *cache,
+                              struct dest_route *rt_buf, u32 daddr, u32 saddr);
 
 int __init rt_ip_routing_init(void);
 void rt_ip_routing_release(void);
@@ -78,6 +78,72 @@ typedef int64_t                 nanosecs_rel_t;
 #define RTNET_RTIOC_EXTPOOL     _IOW(RTIOC_TYPE_NETWORK, 0x14, unsigned int)
 #define RTNET_RTIOC_SHRPOOL     _IOW(RTIOC_TYPE_NETWORK, 0x15, unsigned int)
 
+/*
+ * Memory-mapped frame rings of packet sockets
+ *
+ * RTNET_RTIOC_RING sets up a RX and/or a TX ring of frame_size bytes
+ * slots, once per socket. mmap() at offset 0 then exposes the RX ring,
+ * followed by the TX ring at the next page boundary. Each slot starts
+ * with a struct rtnet_frame_hdr, frame data follow at
+ * RTNET_FRAME_HDRLEN.
+ *
+ * RX: the kernel fills slots in order and flips their status to
+ * RTNET_FRAME_USER, the application hands them back by resetting the
+ * status to RTNET_FRAME_KERNEL. Frames always include the link layer
+ * header, see mac/net offsets. RTNET_RTIOC_RXWAIT blocks until the
+ * given slot is ready, honouring RTNET_RTIOC_TIMEOUT.
+ *
+ * TX: the application fills a slot at RTNET_FRAME_HDRLEN, sets len,
+ * then flips the status to RTNET_FRAME_SEND_REQUEST. Sending a message
+ * without any iovec transmits all pending slots in order, using the
+ * message address or the bound one, and returns the number of bytes
+ * sent. Sent slots become RTNET_FRAME_AVAILABLE again.
+ */
+struct rtnet_ring_req {
+    unsigned int        frame_size;     /* multiple of RTNET_FRAME_ALIGNMENT */
+    unsigned int        rx_frames;
+    unsigned int        tx_frames;
+};
+
+struct rtnet_frame_hdr {
+    uint32_t            status;
+    uint32_t            len;            /* frame length */
+    uint32_t            snaplen;        /* RX: bytes stored in the slot */
+    uint16_t            mac;            /* RX: offset of link layer header */
+    uint16_t            net;            /* RX: offset of network header */
+    uint64_t            tstamp;         /* RX: arrival time (ns) */
+    int32_t             ifindex;        /* RX: receiving interface */
+    uint16_t            protocol;       /* RX: network byte order */
+    uint8_t             pkttype;        /* RX: PACKET_HOST, etc. */
+    uint8_t             __pad;
+};
+
+#define RTNET_FRAME_ALIGNMENT   16
+#define RTNET_FRAME_HDRLEN      \
+    ((sizeof(struct rtnet_frame_hdr) + RTNET_FRAME_ALIGNMENT - 1) & \
+     ~(RTNET_FRAME_ALIGNMENT - 1))
+
+/* RX slot status */
+#define RTNET_FRAME_KERNEL      0x0
+#define RTNET_FRAME_USER        0x1
+#define RTNET_FRAME_TRUNC       0x2     /* frame did not fit the slot */
+#define RTNET_FRAME_LOSING      0x4     /* frames were dropped before */
+
+/* TX slot status */
+#define RTNET_FRAME_AVAILABLE       0x0
+#define RTNET_FRAME_SEND_REQUEST    0x1
+#define RTNET_FRAME_SENDING         0x2
+#define RTNET_FRAME_WRONG_FORMAT    0x4 /* invalid len, slot skipped */
+
+#define RTNET_RTIOC_RING        _IOW(RTIOC_TYPE_NETWORK, 0x16, \
+				     struct rtnet_ring_req)
+#define RTNET_RTIOC_RXWAIT      _IOW(RTIOC_TYPE_NETWORK, 0x17, unsigned int)
+
+/* adds a RTNET_RX_ACTION_DELIVER rule for the packet socket, see
+   rtnet_chrdev.h */
+#define RTNET_RTIOC_RXRULE      _IOW(RTIOC_TYPE_NETWORK, 0x18, \
+				     struct rtnet_rx_rule)
+
 /* socket transmission priorities */
 #define SOCK_MAX_PRIO           0
 #define SOCK_DEF_PRIO           SOCK_MAX_PRIO + \
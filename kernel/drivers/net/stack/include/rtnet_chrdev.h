@@ -66,6 +66,44 @@ extern void rtnet_chrdev_release(void);
 #endif  /* __KERNEL__ */
 
 
+/*
+ * Early RX classifier rules
+ *
+ * Rules are matched in order against every received frame before it is
+ * queued to the stack manager, the first matching rule wins. A rule
+ * matches if all fields selected in match do. For VLAN-tagged frames,
+ * ethertype refers to the encapsulated protocol. Port ranges apply to
+ * unfragmented UDP and TCP datagrams only.
+ *
+ * Global rules are managed via IOC_RT_RXRULE_*. Packet sockets add
+ * RTNET_RX_ACTION_DELIVER rules for themselves with RTNET_RTIOC_RXRULE,
+ * those are removed when the socket is closed or bound to ETH_P_ALL.
+ * ETH_P_ALL listeners cannot add such rules.
+ */
+struct rtnet_rx_rule {
+    __u32       match;          /* RTNET_RX_MATCH_* */
+    __s32       ifindex;
+    __u16       ethertype;      /* host byte order */
+    __u16       vlan_id;
+    __u8        ip_proto;
+    __u8        action;         /* RTNET_RX_ACTION_* */
+    __u16       queue;          /* RTNET_RX_ACTION_QUEUE */
+    __u16       sport_min, sport_max;
+    __u16       dport_min, dport_max;
+};
+
+#define RTNET_RX_MATCH_IFINDEX  0x01
+#define RTNET_RX_MATCH_ETHTYPE  0x02
+#define RTNET_RX_MATCH_VLAN     0x04
+#define RTNET_RX_MATCH_IPPROTO  0x08
+#define RTNET_RX_MATCH_SPORT    0x10
+#define RTNET_RX_MATCH_DPORT    0x20
+
+#define RTNET_RX_ACTION_QUEUE   0       /* steer to a stack manager queue */
+#define RTNET_RX_ACTION_DROP    1
+#define RTNET_RX_ACTION_DELIVER 2       /* hand over to the packet socket */
+
+
 #define RTNET_MINOR             240 /* user interface for /dev/rtnet */
 #define DEV_ADDR_LEN            32  /* avoids inconsistent MAX_ADDR_LEN */
 
@@ -99,6 +137,14 @@ struct rtnet_core_cmd {
             __u8        dev_addr[DEV_ADDR_LEN];
         } info;
 
+        /*** early RX classifier **/
+        struct {
+            __s32       index;      /* -1: append (ADD) */
+            __u32       __padding;
+            __u64       hits;       /* GET only */
+            struct rtnet_rx_rule rule;
+        } rxrule;
+
         __u64 __padding[8];
     } args;
 };
@@ -119,5 +165,14 @@ struct rtnet_core_cmd {
 #define IOC_RT_IFINFO                   _IOWR(RTNET_IOC_TYPE_CORE, 2 |  \
                                               RTNET_IOC_NODEV_PARAM,    \
                                               struct rtnet_core_cmd)
+#define IOC_RT_RXRULE_ADD               _IOW(RTNET_IOC_TYPE_CORE, 3 |   \
+                                             RTNET_IOC_NODEV_PARAM,     \
+                                             struct rtnet_core_cmd)
+#define IOC_RT_RXRULE_DEL               _IOW(RTNET_IOC_TYPE_CORE, 4 |   \
+                                             RTNET_IOC_NODEV_PARAM,     \
+                                             struct rtnet_core_cmd)
+#define IOC_RT_RXRULE_GET               _IOWR(RTNET_IOC_TYPE_CORE, 5 |  \
+                                              RTNET_IOC_NODEV_PARAM,    \
+                                              struct rtnet_core_cmd)
 
 #endif  /* __RTNET_CHRDEV_H_ */
@@ -34,10 +34,13 @@
 #include <rtnet.h>
 #include <rtdm/driver.h>
 #include <stack_mgr.h>
+#include <ipv4/route.h>
 
 #include <rtdm/driver.h>
 
 
+struct rt_packet_ring;
+
 struct rtsocket {
     unsigned short          protocol;
 
@@ -70,12 +73,15 @@ struct rtsocket {
 	    int             reg_index;  /* index in port registry */
 	    u8              tos;
 	    u8              state;
+
+	    struct dest_route_cache rt_cache;   /* route to daddr */
 	} inet;
 
 	/* packet socket specific */
 	struct {
 	    struct rtpacket_type packet_type;
 	    int                  ifindex;
+	    struct rt_packet_ring *ring;    /* mapped frame rings */
 	} packet;
     } prot;
 
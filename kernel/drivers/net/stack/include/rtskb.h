@@ -239,10 +239,32 @@ struct rtskb_pool_lock_ops {
     void (*unlock)(void *cookie);
 };
 
+#ifdef CONFIG_XENO_DRIVERS_NET_RTSKB_CACHE
+#define RTSKB_CACHE_SIZE        16      /* max. rtskbs held per CPU and pool */
+
+struct rtskb_pool_cache {
+    unsigned int        count;
+    struct rtskb        *skbs[RTSKB_CACHE_SIZE];
+};
+
+/* A miss is a batch transfer from or to the pool queue. */
+struct rtskb_cache_stats {
+    unsigned long       alloc_hits;
+    unsigned long       alloc_misses;
+    unsigned long       free_hits;
+    unsigned long       free_misses;
+};
+#endif
+
 struct rtskb_pool {
     struct rtskb_queue queue;
     const struct rtskb_pool_lock_ops *lock_ops;
     void *lock_cookie;
+#ifdef CONFIG_XENO_DRIVERS_NET_RTSKB_CACHE
+    struct rtskb_pool_cache __percpu *cache;
+    unsigned int cache_limit;   /* current per-CPU cache capacity */
+    unsigned int size;          /* number of rtskbs owned by the pool */
+#endif
 };
 
 #define QUEUE_MAX_PRIO          0
@@ -748,6 +770,10 @@ extern struct rtskb* rtskb_clone(struct rtskb *rtskb,
 extern int rtskb_pools_init(void);
 extern void rtskb_pools_release(void);
 
+#ifdef CONFIG_XENO_DRIVERS_NET_RTSKB_CACHE
+extern void rtskb_cache_read_stats(struct rtskb_cache_stats *total);
+#endif
+
 extern unsigned int rtskb_copy_and_csum_bits(const struct rtskb *skb,
 					     int offset, u8 *to, int len,
 					     unsigned int csum);
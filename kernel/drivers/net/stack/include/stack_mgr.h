@@ -30,6 +30,7 @@
 #include <linux/list.h>
 
 #include <rtnet_internal.h>
+#include <rtnet_chrdev.h>
 #include <rtdev.h>
 
 
@@ -40,6 +41,10 @@
 #define RTPACKET_HASH_TBL_SIZE  64
 #define RTPACKET_HASH_KEY_MASK  (RTPACKET_HASH_TBL_SIZE-1)
 
+/* stack manager queues and early RX classifier rules, see stack_mgr.c */
+#define RTNET_STACK_MAX_QUEUES  8
+#define RTNET_STACK_MAX_RULES   16
+
 struct rtpacket_type {
     struct list_head    list_entry;
 
@@ -77,6 +82,7 @@ void rt_stack_disconnect(struct rtnet_device *rtdev);
 
 #if IS_ENABLED(CONFIG_XENO_DRIVERS_NET_DRV_LOOPBACK)
 void rt_stack_deliver(struct rtskb *rtskb);
+void rt_stack_loopback(struct rtskb *rtskb);
 #endif /* CONFIG_XENO_DRIVERS_NET_DRV_LOOPBACK */
 
 int rt_stack_mgr_init(struct rtnet_mgr *mgr);
@@ -88,10 +94,14 @@ static inline void rtnetif_tx(struct rtnet_device *rtdev)
 {
 }
 
-static inline void rt_mark_stack_mgr(struct rtnet_device *rtdev)
-{
-    rtdm_event_signal(rtdev->stack_event);
-}
+void rt_mark_stack_mgr(struct rtnet_device *rtdev);
+
+int rt_stack_add_rx_rule(const struct rtnet_rx_rule *rule,
+			 struct rtpacket_type *pt, int index);
+int rt_stack_del_rx_rule(unsigned int index);
+int rt_stack_get_rx_rule(unsigned int index, struct rtnet_rx_rule *rule,
+			 u64 *hits);
+void rt_stack_remove_rx_rules(struct rtpacket_type *pt);
 
 #endif /* __KERNEL__ */
 
@@ -22,7 +22,6 @@
  *
  */
 
-#include <linux/moduleparam.h>
 #include <net/ip.h>
 
 #include <rtnet_internal.h>
@@ -47,11 +46,22 @@ struct host_route {
 /* Second-level routing: routes to other networks */
 struct net_route {
     struct net_route        *next;
+    struct net_route_node   *node;      /* NULL while not in the trie */
     u32                     dest_net_ip;
     u32                     dest_net_mask;
     u32                     gw_ip;
 };
 
+/* Path-compressed binary trie over the network prefixes, keyed in host
+   byte order. Nodes without a route are glue nodes and always have two
+   children, so n routes never need more than 2n-1 nodes. */
+struct net_route_node {
+    struct net_route_node   *child[2];
+    u32                     prefix;
+    unsigned int            prefix_len;
+    struct net_route        *route;
+};
+
 #if (CONFIG_XENO_DRIVERS_NET_RTIPV4_HOST_ROUTES & (CONFIG_XENO_DRIVERS_NET_RTIPV4_HOST_ROUTES - 1))
 # error CONFIG_XENO_DRIVERS_NET_RTIPV4_HOST_ROUTES must be power of 2
 #endif
@@ -72,26 +82,22 @@ static DEFINE_RTDM_LOCK(host_table_lock);
 #if (CONFIG_XENO_DRIVERS_NET_RTIPV4_NET_ROUTES & (CONFIG_XENO_DRIVERS_NET_RTIPV4_NET_ROUTES - 1))
 # error CONFIG_XENO_DRIVERS_NET_RTIPV4_NET_ROUTES must be power of 2
 #endif
-#if CONFIG_XENO_DRIVERS_NET_RTIPV4_NET_ROUTES < 256
-# define NET_HASH_TBL_SIZE  64
-#else
-# define NET_HASH_TBL_SIZE  ((CONFIG_XENO_DRIVERS_NET_RTIPV4_NET_ROUTES / 256) * 64)
-#endif
-#define NET_HASH_KEY_MASK   (NET_HASH_TBL_SIZE-1)
-#define NET_HASH_KEY_SHIFT  8
+#define NET_TRIE_NODES      (2 * CONFIG_XENO_DRIVERS_NET_RTIPV4_NET_ROUTES)
 
 static struct net_route     net_routes[CONFIG_XENO_DRIVERS_NET_RTIPV4_NET_ROUTES];
 static struct net_route     *free_net_route;
 static int                  allocated_net_routes;
-static struct net_route     *net_hash_tbl[NET_HASH_TBL_SIZE + 1];
-static unsigned int         net_hash_key_shift = NET_HASH_KEY_SHIFT;
+static struct net_route_node net_trie_nodes[NET_TRIE_NODES];
+static struct net_route_node *free_net_trie_node;
+static int                  allocated_net_trie_nodes;
+static struct net_route_node *net_trie_root;
 static DEFINE_RTDM_LOCK(net_table_lock);
-
-module_param(net_hash_key_shift, uint, 0444);
-MODULE_PARM_DESC(net_hash_key_shift, "destination right shift for "
-		 "network hash key (default: 8)");
 #endif /* CONFIG_XENO_DRIVERS_NET_RTIPV4_NETROUTING */
 
+/* bumped on every change of the host or network routes, invalidates
+   the output routes cached by connected sockets */
+static atomic_t             route_gen = ATOMIC_INIT(0);
+
 
 
 /***
@@ -100,10 +106,6 @@ MODULE_PARM_DESC(net_hash_key_shift, "destination right shift for "
 #ifdef CONFIG_XENO_OPT_VFILE
 static int rtnet_ipv4_route_show(struct xnvfile_regular_iterator *it, void *d)
 {
-#ifdef CONFIG_XENO_DRIVERS_NET_RTIPV4_NETROUTING
-    u32 mask;
-#endif /* CONFIG_XENO_DRIVERS_NET_RTIPV4_NETROUTING */
-
     xnvfile_printf(it, "Host routes allocated/total:\t%d/%d\n"
 	    "Host hash table size:\t\t%d\n",
 	    allocated_host_routes,
@@ -111,15 +113,16 @@ static int rtnet_ipv4_route_show(struct xnvfile_regular_iterator *it, void *d)
 	    HOST_HASH_TBL_SIZE);
 
 #ifdef CONFIG_XENO_DRIVERS_NET_RTIPV4_NETROUTING
-    mask = NET_HASH_KEY_MASK << net_hash_key_shift;
     xnvfile_printf(it, "Network routes allocated/total:\t%d/%d\n"
-	    "Network hash table size:\t%d\n"
-	    "Network hash key shift/mask:\t%d/%08X\n",
+	    "Network trie nodes used/total:\t%d/%d\n",
 	    allocated_net_routes,
-	    CONFIG_XENO_DRIVERS_NET_RTIPV4_NET_ROUTES, NET_HASH_TBL_SIZE,
-	    net_hash_key_shift, mask);
+	    CONFIG_XENO_DRIVERS_NET_RTIPV4_NET_ROUTES,
+	    allocated_net_trie_nodes, NET_TRIE_NODES);
 #endif /* CONFIG_XENO_DRIVERS_NET_RTIPV4_NETROUTING */
 
+    xnvfile_printf(it, "Route generation:\t\t%u\n",
+	    (unsigned int)atomic_read(&route_gen));
+
 #ifdef CONFIG_XENO_DRIVERS_NET_RTIPV4_ROUTER
     xnvfile_printf(it, "IP Router:\t\t\tyes\n");
 #else
@@ -316,12 +319,11 @@ static struct xnvfile_lock_ops rtnet_ipv4_net_route_lock_ops = {
 };
 
 struct rtnet_ipv4_net_route_priv {
-    unsigned key;
-    struct net_route *entry_ptr;
+    int key;
 };
 
 struct rtnet_ipv4_net_route_data {
-    int key;
+    unsigned int prefix_len;
     u32 dest_net_ip;
     u32 dest_net_mask;
     u32 gw_ip;
@@ -351,7 +353,6 @@ static void *rtnet_ipv4_net_route_begin(struct xnvfile_snapshot_iterator *it)
     }
 
     priv->key = -1;
-    priv->entry_ptr = NULL;
     return data;
 }
 
@@ -367,22 +368,19 @@ static int rtnet_ipv4_net_route_next(struct xnvfile_snapshot_iterator *it,
 {
     struct rtnet_ipv4_net_route_priv *priv = xnvfile_iterator_priv(it);
     struct rtnet_ipv4_net_route_data *p = data;
+    struct net_route *rt;
 
-    if (priv->entry_ptr == NULL) {
-	if (++priv->key >= NET_HASH_TBL_SIZE + 1)
-	    return 0;
+    if (++priv->key >= CONFIG_XENO_DRIVERS_NET_RTIPV4_NET_ROUTES)
+	return 0;
 
-	priv->entry_ptr = net_hash_tbl[priv->key];
-	if (priv->entry_ptr == NULL)
-	    return VFILE_SEQ_SKIP;
-    }
+    rt = &net_routes[priv->key];
+    if (rt->node == NULL)
+	return VFILE_SEQ_SKIP;
 
-    p->key = priv->key;
-    p->dest_net_ip = priv->entry_ptr->dest_net_ip;
-    p->dest_net_mask = priv->entry_ptr->dest_net_mask;
-    p->gw_ip = priv->entry_ptr->gw_ip;
-
-    priv->entry_ptr = priv->entry_ptr->next;
+    p->prefix_len = rt->node->prefix_len;
+    p->dest_net_ip = rt->dest_net_ip;
+    p->dest_net_mask = rt->dest_net_mask;
+    p->gw_ip = rt->gw_ip;
 
     return 1;
 }
@@ -393,22 +391,15 @@ static int rtnet_ipv4_net_route_show(struct xnvfile_snapshot_iterator *it,
     struct rtnet_ipv4_net_route_data *p = data;
 
     if (p == NULL) {
-	xnvfile_printf(it, "Hash\tDestination\tMask\t\t\tGateway\n");
+	xnvfile_printf(it, "Prefix\tDestination\tMask\t\t\tGateway\n");
 	return 0;
     }
 
-    if (p->key < NET_HASH_TBL_SIZE)
-	xnvfile_printf(it, "%02X\t%u.%u.%u.%-3u\t%u.%u.%u.%-3u"
-		    "\t\t%u.%u.%u.%-3u\n",
-		    p->key, NIPQUAD(p->dest_net_ip),
-		    NIPQUAD(p->dest_net_mask),
-		    NIPQUAD(p->gw_ip));
-    else
-	xnvfile_printf(it, "*\t%u.%u.%u.%-3u\t%u.%u.%u.%-3u\t\t"
-		    "%u.%u.%u.%-3u\n",
-		    NIPQUAD(p->dest_net_ip),
-		    NIPQUAD(p->dest_net_mask),
-		    NIPQUAD(p->gw_ip));
+    xnvfile_printf(it, "/%u\t%u.%u.%u.%-3u\t%u.%u.%u.%-3u"
+		"\t\t%u.%u.%u.%-3u\n",
+		p->prefix_len, NIPQUAD(p->dest_net_ip),
+		NIPQUAD(p->dest_net_mask),
+		NIPQUAD(p->gw_ip));
 
     return 0;
 }
@@ -569,8 +560,14 @@ int rt_ip_route_add_host(u32 addr, unsigned char *dev_addr,
     while (rt != NULL) {
 	if ((rt->dest_host.ip == addr) &&
 	    (rt->dest_host.rtdev->local_ip == rtdev->local_ip)) {
-	    rt->dest_host.rtdev = rtdev;
-	    memcpy(rt->dest_host.dev_addr, dev_addr, rtdev->addr_len);
+	    /* ARP refreshes usually leave the route unchanged */
+	    if ((rt->dest_host.rtdev != rtdev) ||
+		(memcmp(rt->dest_host.dev_addr, dev_addr,
+			rtdev->addr_len) != 0)) {
+		rt->dest_host.rtdev = rtdev;
+		memcpy(rt->dest_host.dev_addr, dev_addr, rtdev->addr_len);
+		atomic_inc(&route_gen);
+	    }
 
 	    if (new_route)
 		rt_free_host_route(new_route);
@@ -586,6 +583,7 @@ int rt_ip_route_add_host(u32 addr, unsigned char *dev_addr,
     if (new_route) {
 	new_route->next    = host_hash_tbl[key];
 	host_hash_tbl[key] = new_route;
+	atomic_inc(&route_gen);
 
 	rtdm_lock_put_irqrestore(&host_table_lock, context);
     } else {
@@ -626,6 +624,7 @@ int rt_ip_route_del_host(u32 addr, struct rtnet_device *rtdev)
 	    *last_ptr = rt->next;
 
 	    rt_free_host_route(rt);
+	    atomic_inc(&route_gen);
 
 	    xnvfile_touch_tag(&host_route_tag);
 
@@ -669,6 +668,9 @@ void rt_ip_route_del_all(struct rtnet_device *rtdev)
 		*last_host_ptr = host_rt->next;
 
 		rt_free_host_route(host_rt);
+		atomic_inc(&route_gen);
+
+		xnvfile_touch_tag(&host_route_tag);
 
 		rtdm_lock_put_irqrestore(&host_table_lock, context);
 
@@ -754,9 +756,101 @@ static inline struct net_route *rt_alloc_net_route(void)
  */
 static inline void rt_free_net_route(struct net_route *rt)
 {
+    rt->node       = NULL;
     rt->next       = free_net_route;
     free_net_route = rt;
-    allocated_host_routes--;
+    allocated_net_routes--;
+}
+
+
+
+/***
+ *  rt_alloc_net_trie_node - allocates trie node
+ *
+ *  Note: must be called with net_table_lock held
+ */
+static inline struct net_route_node *rt_alloc_net_trie_node(u32 prefix,
+							    unsigned int len)
+{
+    struct net_route_node   *node;
+
+
+    if ((node = free_net_trie_node) != NULL) {
+	free_net_trie_node = node->child[0];
+	allocated_net_trie_nodes++;
+
+	node->child[0]   = NULL;
+	node->child[1]   = NULL;
+	node->prefix     = prefix;
+	node->prefix_len = len;
+	node->route      = NULL;
+    }
+
+    return node;
+}
+
+
+
+/***
+ *  rt_free_net_trie_node - releases trie node
+ *
+ *  Note: must be called with net_table_lock held
+ */
+static inline void rt_free_net_trie_node(struct net_route_node *node)
+{
+    node->child[0]     = free_net_trie_node;
+    free_net_trie_node = node;
+    allocated_net_trie_nodes--;
+}
+
+
+
+static inline u32 rt_net_prefix_mask(unsigned int len)
+{
+    return len ? ~0U << (32 - len) : 0;
+}
+
+/* bit of key following a prefix of length len (len < 32) */
+static inline unsigned int rt_net_prefix_bit(u32 key, unsigned int len)
+{
+    return (key >> (31 - len)) & 1;
+}
+
+/* length of the common prefix of a and b, limited to len */
+static inline unsigned int rt_net_common_len(u32 a, u32 b, unsigned int len)
+{
+    unsigned int common = 32 - fls(a ^ b);
+
+    return min(common, len);
+}
+
+
+
+/***
+ *  rt_net_trie_lookup - finds the longest matching network route
+ *
+ *  Note: must be called with net_table_lock held
+ */
+static struct net_route *rt_net_trie_lookup(u32 key)
+{
+    struct net_route_node   *node = net_trie_root;
+    struct net_route        *best = NULL;
+
+
+    while (node != NULL) {
+	if ((key ^ node->prefix) & rt_net_prefix_mask(node->prefix_len))
+	    break;
+
+	if (node->route != NULL)
+	    best = node->route;
+
+	if (node->prefix_len == 32)
+	    break;
+
+	node = node->child[rt_net_prefix_bit(key, node->prefix_len)];
+    }
+
+    return best;
 }
 
 
@@ -766,15 +860,24 @@ static inline void rt_free_net_route(struct net_route *rt)
  */
 int rt_ip_route_add_net(u32 addr, u32 mask, u32 gw_addr)
 {
-    rtdm_lockctx_t      context;
-    struct net_route    *new_route;
-    struct net_route    *rt;
-    struct net_route    **last_ptr;
-    unsigned int        key;
-    u32                 shifted_mask;
+    rtdm_lockctx_t          context;
+    struct net_route        *new_route;
+    struct net_route_node   **link;
+    struct net_route_node   *node;
+    struct net_route_node   *leaf;
+    struct net_route_node   *glue;
+    unsigned int            len;
+    unsigned int            common = 0;
+    u32                     key;
+
 
+    /* longest-prefix matching requires contiguous masks */
+    if (~ntohl(mask) & (~ntohl(mask) + 1))
+	return -EINVAL;
 
     addr &= mask;
+    key   = ntohl(addr);
+    len   = hweight32(mask);
 
     if ((new_route = rt_alloc_net_route()) != NULL) {
 	new_route->dest_net_ip   = addr;
@@ -782,21 +885,26 @@ int rt_ip_route_add_net(u32 addr, u32 mask, u32 gw_addr)
 	new_route->gw_ip         = gw_addr;
     }
 
-    shifted_mask = NET_HASH_KEY_MASK << net_hash_key_shift;
-    if ((mask & shifted_mask) == shifted_mask)
-	key = (ntohl(addr) >> net_hash_key_shift) & NET_HASH_KEY_MASK;
-    else
-	key = NET_HASH_TBL_SIZE;
-    last_ptr = &net_hash_tbl[key];
-
     rtdm_lock_get_irqsave(&net_table_lock, context);
 
     xnvfile_touch_tag(&net_route_tag);
 
-    rt = net_hash_tbl[key];
-    while (rt != NULL) {
-	if ((rt->dest_net_ip == addr) && (rt->dest_net_mask == mask)) {
-	    rt->gw_ip = gw_addr;
+    link = &net_trie_root;
+    while ((node = *link) != NULL) {
+	common = rt_net_common_len(key, node->prefix,
+				   min(len, node->prefix_len));
+	if ((common < node->prefix_len) || (node->prefix_len == len))
+	    break;
+
+	link = &node->child[rt_net_prefix_bit(key, node->prefix_len)];
+    }
+
+    if ((node != NULL) && (node->prefix_len == len) && (common == len)) {
+	if (node->route != NULL) {
+	    if (node->route->gw_ip != gw_addr) {
+		node->route->gw_ip = gw_addr;
+		atomic_inc(&route_gen);
+	    }
 
 	    if (new_route)
 		rt_free_net_route(new_route);
@@ -806,23 +914,56 @@ int rt_ip_route_add_net(u32 addr, u32 mask, u32 gw_addr)
 	    return 0;
 	}
 
-	last_ptr = &rt->next;
-	rt = rt->next;
+	/* turn the glue node into a route node */
+	leaf = new_route ? node : NULL;
+	glue = NULL;
+    } else {
+	leaf = NULL;
+	glue = NULL;
+	if (new_route) {
+	    leaf = rt_alloc_net_trie_node(key, len);
+	    if ((node != NULL) && (common < len)) {
+		glue = rt_alloc_net_trie_node(key & rt_net_prefix_mask(common),
+					      common);
+		if (glue == NULL && leaf != NULL) {
+		    rt_free_net_trie_node(leaf);
+		    leaf = NULL;
+		}
+	    }
+	}
     }
 
-    if (new_route) {
-	new_route->next = *last_ptr;
-	*last_ptr       = new_route;
-
-	rtdm_lock_put_irqrestore(&net_table_lock, context);
+    if (leaf == NULL) {
+	if (new_route)
+	    rt_free_net_route(new_route);
 
-	return 0;
-    } else {
 	rtdm_lock_put_irqrestore(&net_table_lock, context);
 
 	/*ERRMSG*/rtdm_printk("RTnet: no more network routes available\n");
 	return -ENOBUFS;
     }
+
+    if (leaf != node) {
+	if (glue != NULL) {
+	    /* split: node and the new route diverge after common bits */
+	    glue->child[rt_net_prefix_bit(key, common)]          = leaf;
+	    glue->child[rt_net_prefix_bit(node->prefix, common)] = node;
+	    *link = glue;
+	} else {
+	    /* the new route is a prefix of node, or a new leaf */
+	    if (node != NULL)
+		leaf->child[rt_net_prefix_bit(node->prefix, len)] = node;
+	    *link = leaf;
+	}
+    }
+
+    leaf->route     = new_route;
+    new_route->node = leaf;
+    atomic_inc(&route_gen);
+
+    rtdm_lock_put_irqrestore(&net_table_lock, context);
+
+    return 0;
 }
 
 
@@ -832,45 +973,66 @@ int rt_ip_route_add_net(u32 addr, u32 mask, u32 gw_addr)
  */
 int rt_ip_route_del_net(u32 addr, u32 mask)
 {
-    rtdm_lockctx_t      context;
-    struct net_route    *rt;
-    struct net_route    **last_ptr;
-    unsigned int        key;
-    u32                 shifted_mask;
+    rtdm_lockctx_t          context;
+    struct net_route_node   **link;
+    struct net_route_node   **parent_link = NULL;
+    struct net_route_node   *node;
+    struct net_route_node   *parent;
+    unsigned int            len;
+    u32                     key;
 
 
-    addr &= mask;
+    if (~ntohl(mask) & (~ntohl(mask) + 1))
+	return -ENOENT;
 
-    shifted_mask = NET_HASH_KEY_MASK << net_hash_key_shift;
-    if ((mask & shifted_mask) == shifted_mask)
-	key = (ntohl(addr) >> net_hash_key_shift) & NET_HASH_KEY_MASK;
-    else
-	key = NET_HASH_TBL_SIZE;
-    last_ptr = &net_hash_tbl[key];
+    addr &= mask;
+    key   = ntohl(addr);
+    len   = hweight32(mask);
 
     rtdm_lock_get_irqsave(&net_table_lock, context);
 
-    rt = net_hash_tbl[key];
-    while (rt != NULL) {
-	if ((rt->dest_net_ip == addr) && (rt->dest_net_mask == mask)) {
-	    *last_ptr = rt->next;
+    link = &net_trie_root;
+    while (((node = *link) != NULL) && (node->prefix_len < len)) {
+	if ((key ^ node->prefix) & rt_net_prefix_mask(node->prefix_len))
+	    break;
 
-	    rt_free_net_route(rt);
+	parent_link = link;
+	link = &node->child[rt_net_prefix_bit(key, node->prefix_len)];
+    }
 
-	    xnvfile_touch_tag(&net_route_tag);
+    if ((node == NULL) || (node->prefix_len != len) ||
+	(node->prefix != key) || (node->route == NULL)) {
+	rtdm_lock_put_irqrestore(&net_table_lock, context);
 
-	    rtdm_lock_put_irqrestore(&net_table_lock, context);
+	return -ENOENT;
+    }
 
-	    return 0;
+    rt_free_net_route(node->route);
+    node->route = NULL;
+
+    /* drop nodes which are no longer needed, keeping glue nodes binary */
+    if ((node->child[0] == NULL) || (node->child[1] == NULL)) {
+	*link = node->child[0] ? node->child[0] : node->child[1];
+
+	if ((*link == NULL) && (parent_link != NULL)) {
+	    parent = *parent_link;
+	    if (parent->route == NULL) {
+		*parent_link = parent->child[0] ?
+		    parent->child[0] : parent->child[1];
+		rt_free_net_trie_node(parent);
+	    }
 	}
 
-	last_ptr = &rt->next;
-	rt = rt->next;
+	rt_free_net_trie_node(node);
     }
 
+    atomic_inc(&route_gen);
+
+    xnvfile_touch_tag(&net_route_tag);
+
     rtdm_lock_put_irqrestore(&net_table_lock, context);
 
-    return -ENOENT;
+    return 0;
 }
 #endif /* CONFIG_XENO_DRIVERS_NET_RTIPV4_NETROUTING */
 
@@ -940,49 +1102,81 @@ int rt_ip_route_output(struct dest_route *rt_buf, u32 daddr, u32 saddr)
 #ifdef CONFIG_XENO_DRIVERS_NET_RTIPV4_NETROUTING
     if (lookup_gw) {
 	lookup_gw = 0;
-	key = (ntohl(daddr) >> net_hash_key_shift) & NET_HASH_KEY_MASK;
 
 	rtdm_lock_get_irqsave(&net_table_lock, context);
 
-	net_rt = net_hash_tbl[key];
-	while (net_rt != NULL) {
-	    if (net_rt->dest_net_ip == (daddr & net_rt->dest_net_mask)) {
-		daddr = net_rt->gw_ip;
+	net_rt = rt_net_trie_lookup(ntohl(daddr));
+	if (net_rt != NULL) {
+	    daddr = net_rt->gw_ip;
 
-		rtdm_lock_put_irqrestore(&net_table_lock, context);
-
-		/* start over, now using the gateway ip as destination */
-		goto restart;
-	    }
+	    rtdm_lock_put_irqrestore(&net_table_lock, context);
 
-	    net_rt = net_rt->next;
+	    /* start over, now using the gateway ip as destination */
+	    goto restart;
 	}
 
 	rtdm_lock_put_irqrestore(&net_table_lock, context);
+    }
+#endif /* CONFIG_XENO_DRIVERS_NET_RTIPV4_NETROUTING */
 
-	/* last try: no hash key */
-	rtdm_lock_get_irqsave(&net_table_lock, context);
+    /*ERRMSG*/rtdm_printk("RTnet: host %u.%u.%u.%u unreachable\n", NIPQUAD(daddr));
+    return -EHOSTUNREACH;
+}
 
-	net_rt = net_hash_tbl[NET_HASH_TBL_SIZE];
-	while (net_rt != NULL) {
-	    if (net_rt->dest_net_ip == (daddr & net_rt->dest_net_mask)) {
-		daddr = net_rt->gw_ip;
 
-		rtdm_lock_put_irqrestore(&net_table_lock, context);
 
-		/* start over, now using the gateway ip as destination */
-		goto restart;
-	    }
+/***
+ *  rt_ip_route_output_cached - looks up output route via a socket cache
+ *
+ *  Reuses the route stored in cache as long as no host or network route
+ *  has changed since it was looked up, skipping the table walks. The
+ *  cache is protected by host_table_lock, which also keeps the cached
+ *  device from being unbound while it is referenced.
+ *
+ *  Note: increments refcount on returned rtdev in rt_buf
+ */
+int rt_ip_route_output_cached(struct dest_route_cache *cache,
+			      struct dest_route *rt_buf, u32 daddr, u32 saddr)
+{
+    rtdm_lockctx_t      context;
+    unsigned int        gen;
+    int                 err;
 
-	    net_rt = net_rt->next;
-	}
 
-	rtdm_lock_put_irqrestore(&net_table_lock, context);
+    rtdm_lock_get_irqsave(&host_table_lock, context);
+
+    if ((cache->dest.rtdev != NULL) && (cache->daddr == daddr) &&
+	(cache->saddr == saddr) &&
+	(cache->gen == (unsigned int)atomic_read(&route_gen)) &&
+	rtdev_reference(cache->dest.rtdev)) {
+	memcpy(rt_buf, &cache->dest, sizeof(*rt_buf));
+
+	rtdm_lock_put_irqrestore(&host_table_lock, context);
+
+	return 0;
     }
-#endif /* CONFIG_XENO_DRIVERS_NET_RTIPV4_NETROUTING */
 
-    /*ERRMSG*/rtdm_printk("RTnet: host %u.%u.%u.%u unreachable\n", NIPQUAD(daddr));
-    return -EHOSTUNREACH;
+    rtdm_lock_put_irqrestore(&host_table_lock, context);
+
+    gen = atomic_read(&route_gen);
+    smp_rmb();
+
+    err = rt_ip_route_output(rt_buf, daddr, saddr);
+
+    rtdm_lock_get_irqsave(&host_table_lock, context);
+
+    /* only cache what is still valid, a concurrent change wins */
+    if ((err == 0) && (gen == (unsigned int)atomic_read(&route_gen))) {
+	memcpy(&cache->dest, rt_buf, sizeof(cache->dest));
+	cache->daddr = daddr;
+	cache->saddr = saddr;
+	cache->gen   = gen;
+    } else
+	cache->dest.rtdev = NULL;
+
+    rtdm_lock_put_irqrestore(&host_table_lock, context);
+
+    return err;
 }
 
 
@@ -1045,6 +1239,10 @@ int __init rt_ip_routing_init(void)
     for (i = 0; i < CONFIG_XENO_DRIVERS_NET_RTIPV4_NET_ROUTES-2; i++)
 	net_routes[i].next = &net_routes[i+1];
     free_net_route = &net_routes[0];
+
+    for (i = 0; i < NET_TRIE_NODES-1; i++)
+	net_trie_nodes[i].child[0] = &net_trie_nodes[i+1];
+    free_net_trie_node = &net_trie_nodes[0];
 #endif /* CONFIG_XENO_DRIVERS_NET_RTIPV4_NETROUTING */
 
 #ifdef CONFIG_XENO_OPT_VFILE
@@ -1071,3 +1269,4 @@ EXPORT_SYMBOL_GPL(rt_ip_route_add_host);
 EXPORT_SYMBOL_GPL(rt_ip_route_del_host);
 EXPORT_SYMBOL_GPL(rt_ip_route_del_all);
 EXPORT_SYMBOL_GPL(rt_ip_route_output);
+EXPORT_SYMBOL_GPL(rt_ip_route_output_cached);
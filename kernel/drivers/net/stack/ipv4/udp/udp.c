@@ -243,6 +243,7 @@ int rt_udp_connect(struct rtdm_fd *fd, struct rtsocket *sock,
 		sock->prot.inet.daddr = INADDR_ANY;
 		sock->prot.inet.dport = 0;
 		sock->prot.inet.state = TCP_CLOSE;
+		rt_ip_route_cache_reset(&sock->prot.inet.rt_cache);
 
 		rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
 	} else {
@@ -266,6 +267,7 @@ int rt_udp_connect(struct rtdm_fd *fd, struct rtsocket *sock,
 		sock->prot.inet.state = TCP_ESTABLISHED;
 		sock->prot.inet.daddr = sin->sin_addr.s_addr;
 		sock->prot.inet.dport = sin->sin_port;
+		rt_ip_route_cache_reset(&sock->prot.inet.rt_cache);
 
 		rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
 	}
@@ -294,6 +296,7 @@ int rt_udp_socket(struct rtdm_fd *fd)
     sock->prot.inet.saddr = INADDR_ANY;
     sock->prot.inet.state = TCP_CLOSE;
     sock->prot.inet.tos   = 0;
+    rt_ip_route_cache_reset(&sock->prot.inet.rt_cache);
 
     rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
 
@@ -599,6 +602,7 @@ ssize_t rt_udp_sendmsg(struct rtdm_fd *fd, const struct user_msghdr *msg, int ms
     u32                 saddr;
     u32                 daddr;
     u16                 dport;
+    int                 connected = 0;
     int                 err;
     rtdm_lockctx_t      context;
     struct user_msghdr _msg;
@@ -658,6 +662,7 @@ ssize_t rt_udp_sendmsg(struct rtdm_fd *fd, const struct user_msghdr *msg, int ms
 
 	    daddr = sock->prot.inet.daddr;
 	    dport = sock->prot.inet.dport;
+	    connected = 1;
     }
     
     saddr         = sock->prot.inet.saddr;
@@ -670,8 +675,13 @@ ssize_t rt_udp_sendmsg(struct rtdm_fd *fd, const struct user_msghdr *msg, int ms
 	    goto out;
     }
 
-    /* get output route */
-    err = rt_ip_route_output(&rt, daddr, saddr);
+    /* get output route, connected sockets skip the lookup while the
+       routes remain unchanged */
+    if (connected)
+	    err = rt_ip_route_output_cached(&sock->prot.inet.rt_cache,
+					    &rt, daddr, saddr);
+    else
+	    err = rt_ip_route_output(&rt, daddr, saddr);
     if (err)
 	    goto out;
 
@@ -688,7 +698,7 @@ ssize_t rt_udp_sendmsg(struct rtdm_fd *fd, const struct user_msghdr *msg, int ms
 
     err = rt_ip_build_xmit(sock, rt_udp_getfrag, &ufh, ulen, &rt, msg_flags);
 
-    /* Drop the reference obtained in rt_ip_route_output() */
+    /* Drop the reference obtained in rt_ip_route_output[_cached]() */
     rtdev_dereference(rt.rtdev);
 out:
     rtdm_drop_iovec(iov, iov_fast);
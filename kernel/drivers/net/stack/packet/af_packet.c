@@ -25,6 +25,9 @@
 #include <linux/module.h>
 #include <linux/sched.h>
 #include <linux/err.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
 
 #include <rtnet_iovec.h>
 #include <rtnet_socket.h>
@@ -33,6 +36,88 @@
 MODULE_LICENSE("GPL");
 
 
+#define RT_PACKET_RING_MAX_FRAMES   4096
+#define RT_PACKET_RING_MAX_FSIZE    65536
+
+struct rt_packet_ring {
+    void                *area;
+    size_t              area_size;
+    unsigned int        frame_size;
+
+    void                *rx_base;
+    unsigned int        rx_frames;
+    unsigned int        rx_head;    /* next slot to fill */
+    int                 rx_losing;
+    rtdm_lock_t         rx_lock;
+
+    void                *tx_base;
+    unsigned int        tx_frames;
+    unsigned int        tx_head;    /* next slot to send */
+    rtdm_mutex_t        tx_mutex;
+};
+
+static inline struct rtnet_frame_hdr *
+rt_packet_frame(void *base, struct rt_packet_ring *ring, unsigned int slot)
+{
+    return base + (size_t)slot * ring->frame_size;
+}
+
+
+/***
+ *  rt_packet_ring_rcv - copy a frame into the next RX slot
+ */
+static void rt_packet_ring_rcv(struct rt_packet_ring *ring, struct rtskb *skb)
+{
+    struct rtnet_frame_hdr  *hdr;
+    unsigned int            len, snaplen, status;
+    rtdm_lockctx_t          context;
+
+
+    rtdm_lock_get_irqsave(&ring->rx_lock, context);
+
+    hdr = rt_packet_frame(ring->rx_base, ring, ring->rx_head);
+    if (ACCESS_ONCE(hdr->status) != RTNET_FRAME_KERNEL) {
+	ring->rx_losing = 1;
+	rtdm_lock_put_irqrestore(&ring->rx_lock, context);
+	return;
+    }
+
+    /* The slot is ours once the head moved past it. */
+    if (++ring->rx_head == ring->rx_frames)
+	ring->rx_head = 0;
+
+    status = RTNET_FRAME_USER;
+    if (ring->rx_losing) {
+	status |= RTNET_FRAME_LOSING;
+	ring->rx_losing = 0;
+    }
+
+    rtdm_lock_put_irqrestore(&ring->rx_lock, context);
+
+    len     = skb->len + (skb->data - skb->mac.raw);
+    snaplen = ring->frame_size - RTNET_FRAME_HDRLEN;
+    if (len > snaplen)
+	status |= RTNET_FRAME_TRUNC;
+    else
+	snaplen = len;
+
+    memcpy((void *)hdr + RTNET_FRAME_HDRLEN, skb->mac.raw, snaplen);
+
+    hdr->len      = len;
+    hdr->snaplen  = snaplen;
+    hdr->mac      = RTNET_FRAME_HDRLEN;
+    hdr->net      = RTNET_FRAME_HDRLEN + (skb->data - skb->mac.raw);
+    hdr->tstamp   = skb->time_stamp;
+    hdr->ifindex  = skb->rtdev->ifindex;
+    hdr->protocol = skb->protocol;
+    hdr->pkttype  = skb->pkt_type;
+
+    /* frame contents must be visible before the status */
+    smp_wmb();
+    hdr->status = status;
+}
+
+
 /***
  *  rt_packet_rcv
  */
@@ -44,11 +129,21 @@ static int rt_packet_rcv(struct rtskb *skb, struct rtpacket_type *pt)
     void            (*callback_func)(struct rtdm_fd *, void *);
     void            *callback_arg;
     rtdm_lockctx_t  context;
+    struct rt_packet_ring *ring;
 
 
     if (unlikely((ifindex != 0) && (ifindex != skb->rtdev->ifindex)))
 	return -EUNATCH;
 
+    ring = ACCESS_ONCE(sock->prot.packet.ring);
+    if (ring != NULL && ring->rx_frames > 0) {
+	rt_packet_ring_rcv(ring, skb);
+	/* ETH_P_ALL listeners only get a look at the packet */
+	if (pt->type != htons(ETH_P_ALL))
+	    kfree_rtskb(skb);
+	goto wakeup;
+    }
+
 #ifdef CONFIG_XENO_DRIVERS_NET_ETH_P_ALL
     if (pt->type == htons(ETH_P_ALL)) {
 	struct rtskb *clone_skb = rtskb_clone(skb, &sock->skb_pool);
@@ -63,6 +158,8 @@ static int rt_packet_rcv(struct rtskb *skb, struct rtpacket_type *pt)
 	}
 
     rtskb_queue_tail(&sock->incoming, skb);
+
+  wakeup:
     rtdm_sem_up(&sock->pending_sem);
 
     rtdm_lock_get_irqsave(&sock->param_lock, context);
@@ -128,6 +225,10 @@ static int rt_packet_bind(struct rtdm_fd *fd, struct rtsocket *sock,
 	if (pt->type != 0)
 		rtdev_remove_pack(pt);
 
+	/* see rt_packet_add_rx_rule() */
+	if (new_type == htons(ETH_P_ALL))
+		rt_stack_remove_rx_rules(pt);
+
 	pt->type = new_type;
 	sock->prot.packet.ifindex = sll->sll_ifindex;
 
@@ -202,6 +303,200 @@ static int rt_packet_getsockname(struct rtdm_fd *fd, struct rtsocket *sock,
 
 
 
+/***
+ *  rt_packet_add_rx_rule - let the early RX classifier deliver to us
+ */
+static int rt_packet_add_rx_rule(struct rtsocket *sock,
+				 const struct rtnet_rx_rule *req)
+{
+    struct rtpacket_type    *pt = &sock->prot.packet.packet_type;
+    struct rtnet_rx_rule    rule = *req;
+    rtdm_lockctx_t          context;
+    int                     ifindex;
+    int                     ret;
+
+
+    rtdm_lock_get_irqsave(&sock->param_lock, context);
+
+    /* ETH_P_ALL listeners only get a look at the packets they receive,
+       while the classifier hands matching packets over for good */
+    if (pt->type == htons(ETH_P_ALL)) {
+	ret = -EINVAL;
+	goto out;
+    }
+
+    /* matching frames are ours alone, so do not take them from devices
+       we are not bound to */
+    ifindex = sock->prot.packet.ifindex;
+    if (ifindex != 0) {
+	if ((rule.match & RTNET_RX_MATCH_IFINDEX) && rule.ifindex != ifindex) {
+	    ret = -EINVAL;
+	    goto out;
+	}
+	rule.match   |= RTNET_RX_MATCH_IFINDEX;
+	rule.ifindex  = ifindex;
+    }
+
+    rule.action = RTNET_RX_ACTION_DELIVER;
+    pt->handler = rt_packet_rcv;
+
+    ret = rt_stack_add_rx_rule(&rule, pt, -1);
+
+  out:
+    rtdm_lock_put_irqrestore(&sock->param_lock, context);
+
+    return (ret < 0) ? ret : 0;
+}
+
+
+
+/***
+ *  rt_packet_setup_ring
+ */
+static int rt_packet_setup_ring(struct rtsocket *sock,
+				const struct rtnet_ring_req *req)
+{
+    struct rt_packet_ring   *ring;
+    size_t                  rx_size, tx_size;
+    rtdm_lockctx_t          context;
+    int                     ret = 0;
+
+
+    if (req->frame_size % RTNET_FRAME_ALIGNMENT != 0 ||
+	req->frame_size < RTNET_FRAME_HDRLEN + ETH_HLEN ||
+	req->frame_size > RT_PACKET_RING_MAX_FSIZE ||
+	req->rx_frames > RT_PACKET_RING_MAX_FRAMES ||
+	req->tx_frames > RT_PACKET_RING_MAX_FRAMES ||
+	req->rx_frames + req->tx_frames == 0)
+	return -EINVAL;
+
+    ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+    if (ring == NULL)
+	return -ENOMEM;
+
+    rx_size = PAGE_ALIGN((size_t)req->rx_frames * req->frame_size);
+    tx_size = PAGE_ALIGN((size_t)req->tx_frames * req->frame_size);
+
+    /* zeroed: all RX slots belong to the kernel, all TX slots are free */
+    ring->area = vmalloc_user(rx_size + tx_size);
+    if (ring->area == NULL) {
+	kfree(ring);
+	return -ENOMEM;
+    }
+
+    ring->area_size  = rx_size + tx_size;
+    ring->frame_size = req->frame_size;
+    ring->rx_base    = ring->area;
+    ring->rx_frames  = req->rx_frames;
+    ring->tx_base    = ring->area + rx_size;
+    ring->tx_frames  = req->tx_frames;
+    rtdm_lock_init(&ring->rx_lock);
+    rtdm_mutex_init(&ring->tx_mutex);
+
+    rtdm_lock_get_irqsave(&sock->param_lock, context);
+    if (sock->prot.packet.ring == NULL)
+	sock->prot.packet.ring = ring;
+    else
+	ret = -EBUSY;
+    rtdm_lock_put_irqrestore(&sock->param_lock, context);
+
+    if (ret) {
+	rtdm_mutex_destroy(&ring->tx_mutex);
+	vfree(ring->area);
+	kfree(ring);
+    }
+
+    return ret;
+}
+
+
+
+/***
+ *  rt_packet_rx_wait - wait for a RX slot to be filled
+ */
+static int rt_packet_rx_wait(struct rtsocket *sock, unsigned int slot)
+{
+    struct rt_packet_ring   *ring = sock->prot.packet.ring;
+    struct rtnet_frame_hdr  *hdr;
+    int                     ret;
+
+
+    if (ring == NULL || slot >= ring->rx_frames)
+	return -EINVAL;
+
+    hdr = rt_packet_frame(ring->rx_base, ring, slot);
+
+    /* pending_sem also counts frames consumed without waiting, so we
+       may have to go through a few stale units */
+    while ((ACCESS_ONCE(hdr->status) & RTNET_FRAME_USER) == 0) {
+	ret = rtdm_sem_timeddown(&sock->pending_sem, sock->timeout, NULL);
+	if (unlikely(ret < 0))
+	    switch (ret) {
+		case -EWOULDBLOCK:
+		case -ETIMEDOUT:
+		case -EINTR:
+		    return ret;
+		default:
+		    return -EBADF;  /* socket has been closed */
+	    }
+    }
+
+    return 0;
+}
+
+
+
+static void rt_packet_vmopen(struct vm_area_struct *vma)
+{
+    /* Cannot fail, the mapping being duplicated holds a ref. */
+    rtdm_fd_lock(vma->vm_private_data);
+}
+
+static void rt_packet_vmclose(struct vm_area_struct *vma)
+{
+    rtdm_fd_unlock(vma->vm_private_data);
+}
+
+static struct vm_operations_struct rt_packet_vmops = {
+    .open = rt_packet_vmopen,
+    .close = rt_packet_vmclose,
+};
+
+/***
+ *  rt_packet_mmap
+ */
+static int rt_packet_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+    struct rtsocket         *sock = rtdm_fd_to_private(fd);
+    struct rt_packet_ring   *ring = sock->prot.packet.ring;
+    int                     ret;
+
+
+    if (ring == NULL)
+	return -ENXIO;
+
+    if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start > ring->area_size)
+	return -EINVAL;
+
+    ret = rtdm_fd_lock(fd);
+    if (ret < 0)
+	return ret;
+
+    ret = rtdm_mmap_vmem(vma, ring->area);
+    if (ret) {
+	rtdm_fd_unlock(fd);
+	return ret;
+    }
+
+    /* The rings live until the last mapping goes away. */
+    vma->vm_ops = &rt_packet_vmops;
+    vma->vm_private_data = fd;
+
+    return 0;
+}
+
+
+
 /***
  * rt_packet_socket - initialize a packet socket
  */
@@ -216,6 +511,7 @@ static int rt_packet_socket(struct rtdm_fd *fd, int protocol)
 
     sock->prot.packet.packet_type.type		= protocol;
     sock->prot.packet.ifindex			= 0;
+    sock->prot.packet.ring			= NULL;
     sock->prot.packet.packet_type.trylock	= rt_packet_trylock;
     sock->prot.packet.packet_type.unlock        = rt_packet_unlock;
 
@@ -242,10 +538,13 @@ static void rt_packet_close(struct rtdm_fd *fd)
 {
     struct rtsocket         *sock = rtdm_fd_to_private(fd);
     struct rtpacket_type    *pt = &sock->prot.packet.packet_type;
+    struct rt_packet_ring   *ring = sock->prot.packet.ring;
     struct rtskb            *del;
     rtdm_lockctx_t          context;
 
 
+    rt_stack_remove_rx_rules(pt);
+
     rtdm_lock_get_irqsave(&sock->param_lock, context);
 
     if (pt->type != 0) {
@@ -260,6 +559,12 @@ static void rt_packet_close(struct rtdm_fd *fd)
 	kfree_rtskb(del);
     }
 
+    if (ring != NULL) {
+	rtdm_mutex_destroy(&ring->tx_mutex);
+	vfree(ring->area);
+	kfree(ring);
+    }
+
     rt_socket_cleanup(fd);
 }
 
@@ -275,6 +580,34 @@ static int rt_packet_ioctl(struct rtdm_fd *fd, unsigned int request, void __user
 	struct _rtdm_setsockaddr_args _setaddr;
 	const struct _rtdm_getsockaddr_args *getaddr;
 	struct _rtdm_getsockaddr_args _getaddr;
+	const struct rtnet_ring_req *req;
+	struct rtnet_ring_req _req;
+	const unsigned int *slot;
+	unsigned int _slot;
+	const struct rtnet_rx_rule *rule;
+	struct rtnet_rx_rule _rule;
+
+	switch (request) {
+	case RTNET_RTIOC_RING:
+		if (rtdm_in_rt_context())
+			return -ENOSYS;
+		req = rtnet_get_arg(fd, &_req, arg, sizeof(_req));
+		if (IS_ERR(req))
+			return PTR_ERR(req);
+		return rt_packet_setup_ring(sock, req);
+
+	case RTNET_RTIOC_RXWAIT:
+		slot = rtnet_get_arg(fd, &_slot, arg, sizeof(_slot));
+		if (IS_ERR(slot))
+			return PTR_ERR(slot);
+		return rt_packet_rx_wait(sock, *slot);
+
+	case RTNET_RTIOC_RXRULE:
+		rule = rtnet_get_arg(fd, &_rule, arg, sizeof(_rule));
+		if (IS_ERR(rule))
+			return PTR_ERR(rule);
+		return rt_packet_add_rx_rule(sock, rule);
+	}
 
 	/* fast path for common socket IOCTLs */
 	if (_IOC_TYPE(request) == RTIOC_TYPE_NETWORK)
@@ -328,6 +661,11 @@ rt_packet_recvmsg(struct rtdm_fd *fd, struct user_msghdr *u_msg, int msg_flags)
     if (msg->msg_iovlen == 0)
 	    return 0;
 
+    /* frames go to the RX ring only */
+    if (sock->prot.packet.ring != NULL &&
+	sock->prot.packet.ring->rx_frames > 0)
+	    return -EINVAL;
+
     ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
     if (ret)
 	    return ret;
@@ -413,6 +751,130 @@ fail:
 
 
 
+/***
+ *  rt_packet_prepare - allocate and set up an outgoing rtskb
+ */
+static struct rtskb *rt_packet_prepare(struct rtdm_fd *fd,
+				       struct rtsocket *sock,
+				       struct rtnet_device *rtdev,
+				       const struct sockaddr_ll *sll,
+				       unsigned short proto, size_t len)
+{
+    int             socket_type;
+    struct rtskb    *rtskb;
+
+
+    socket_type = rtdm_fd_to_context(fd)->device->driver->socket_type;
+
+    /* If an RTmac discipline is active, this becomes a pure sanity check to
+       avoid writing beyond rtskb boundaries. The hard check is then performed
+       upon rtdev_xmit() by the discipline's xmit handler. */
+    if (len > rtdev->mtu +
+	((socket_type == SOCK_RAW) ? rtdev->hard_header_len : 0))
+	return ERR_PTR(-EMSGSIZE);
+
+    if ((sll != NULL) && (sll->sll_halen != rtdev->addr_len))
+	return ERR_PTR(-EINVAL);
+
+    rtskb = alloc_rtskb(rtdev->hard_header_len + len, &sock->skb_pool);
+    if (rtskb == NULL)
+	return ERR_PTR(-ENOBUFS);
+
+    rtskb_reserve(rtskb, rtdev->hard_header_len);
+
+    rtskb->rtdev    = rtdev;
+    rtskb->priority = sock->priority;
+
+    if (rtdev->hard_header) {
+	int hdr_len;
+
+	hdr_len = rtdev->hard_header(rtskb, rtdev, ntohs(proto),
+				     (sll != NULL) ? (void *)sll->sll_addr :
+						     NULL, NULL, len);
+	if (socket_type != SOCK_DGRAM) {
+	    rtskb->tail = rtskb->data;
+	    rtskb->len = 0;
+	} else if (hdr_len < 0) {
+	    kfree_rtskb(rtskb);
+	    return ERR_PTR(-EINVAL);
+	}
+    }
+
+    return rtskb;
+}
+
+
+
+/***
+ *  rt_packet_tx_kick - send all frames queued in the TX ring
+ */
+static ssize_t rt_packet_tx_kick(struct rtdm_fd *fd, struct rtsocket *sock,
+				 struct rtnet_device *rtdev,
+				 const struct sockaddr_ll *sll,
+				 unsigned short proto)
+{
+    struct rt_packet_ring   *ring = sock->prot.packet.ring;
+    struct rtnet_frame_hdr  *hdr;
+    struct rtskb            *rtskb;
+    size_t                  len, total = 0;
+    unsigned int            n;
+    int                     ret = 0;
+
+
+    ret = rtdm_mutex_lock(&ring->tx_mutex);
+    if (ret)
+	return ret;
+
+    for (n = 0; n < ring->tx_frames; n++) {
+	hdr = rt_packet_frame(ring->tx_base, ring, ring->tx_head);
+	if (ACCESS_ONCE(hdr->status) != RTNET_FRAME_SEND_REQUEST)
+	    break;
+	smp_rmb();  /* read the frame after its status */
+
+	hdr->status = RTNET_FRAME_SENDING;
+
+	len = hdr->len;
+	if (len == 0 || len > ring->frame_size - RTNET_FRAME_HDRLEN) {
+	    hdr->status = RTNET_FRAME_WRONG_FORMAT;
+	    goto next;
+	}
+
+	rtskb = rt_packet_prepare(fd, sock, rtdev, sll, proto, len);
+	if (IS_ERR(rtskb)) {
+	    ret = PTR_ERR(rtskb);
+	    if (ret == -ENOBUFS) {
+		/* leave the frame queued for the next kick */
+		hdr->status = RTNET_FRAME_SEND_REQUEST;
+		break;
+	    }
+	    hdr->status = RTNET_FRAME_WRONG_FORMAT;
+	    ret = 0;
+	    goto next;
+	}
+
+	memcpy(rtskb_put(rtskb, len), (void *)hdr + RTNET_FRAME_HDRLEN, len);
+
+	ret = rtdev_xmit(rtskb);
+	if (ret) {
+	    hdr->status = RTNET_FRAME_SEND_REQUEST;
+	    break;
+	}
+
+	total += len;
+	smp_wmb();
+	hdr->status = RTNET_FRAME_AVAILABLE;
+    next:
+	if (++ring->tx_head == ring->tx_frames)
+	    ring->tx_head = 0;
+    }
+
+    rtdm_mutex_unlock(&ring->tx_mutex);
+
+    return (total > 0 || ret == 0) ? total : ret;
+}
+
+
+
 /***
  *  rt_packet_sendmsg
  */
@@ -420,16 +882,16 @@ static ssize_t
 rt_packet_sendmsg(struct rtdm_fd *fd, const struct user_msghdr *msg, int msg_flags)
 {
     struct rtsocket     *sock = rtdm_fd_to_private(fd);
+    struct rt_packet_ring *ring = sock->prot.packet.ring;
     size_t              len;
     struct sockaddr_ll  _sll, *sll;
     struct rtnet_device *rtdev;
     struct rtskb        *rtskb;
     unsigned short      proto;
-    unsigned char       *addr;
     int                 ifindex;
     ssize_t             ret;
     struct user_msghdr _msg;
-    struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+    struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov = NULL;
 
     if (msg_flags & MSG_OOB)    /* Mirror BSD error message compatibility */
 	return -EOPNOTSUPP;
@@ -443,19 +905,21 @@ rt_packet_sendmsg(struct rtdm_fd *fd, const struct user_msghdr *msg, int msg_fla
     if (msg->msg_iovlen < 0)
 	    return -EINVAL;
 
-    if (msg->msg_iovlen == 0)
+    /* An empty message kicks the TX ring, if any. */
+    if (msg->msg_iovlen == 0 && (ring == NULL || ring->tx_frames == 0))
 	    return 0;
-    
-    ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
-    if (ret)
-	    return ret;
+
+    if (msg->msg_iovlen > 0) {
+	    ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+	    if (ret)
+		    return ret;
+    }
 
     if (msg->msg_name == NULL) {
 	/* Note: We do not care about races with rt_packet_bind here -
 	   the user has to do so. */
 	ifindex = sock->prot.packet.ifindex;
 	proto   = sock->prot.packet.packet_type.type;
-	addr    = NULL;
 	sll = NULL;
     } else {
 	    sll = rtnet_get_arg(fd, &_sll, msg->msg_name, sizeof(_sll));
@@ -475,7 +939,6 @@ rt_packet_sendmsg(struct rtdm_fd *fd, const struct user_msghdr *msg, int msg_fla
 
 	    ifindex = sll->sll_ifindex;
 	    proto   = sll->sll_protocol;
-	    addr    = sll->sll_addr;
     }
 
     if ((rtdev = rtdev_get_by_index(ifindex)) == NULL) {
@@ -483,65 +946,39 @@ rt_packet_sendmsg(struct rtdm_fd *fd, const struct user_msghdr *msg, int msg_fla
 	    goto abort;
     }
 
-    len = rtdm_get_iov_flatlen(iov, msg->msg_iovlen);
-    rtskb = alloc_rtskb(rtdev->hard_header_len + len, &sock->skb_pool);
-    if (rtskb == NULL) {
-	ret = -ENOBUFS;
+    if ((rtdev->flags & IFF_UP) == 0) {
+	ret = -ENETDOWN;
 	goto out;
     }
 
-    /* If an RTmac discipline is active, this becomes a pure sanity check to
-       avoid writing beyond rtskb boundaries. The hard check is then performed
-       upon rtdev_xmit() by the discipline's xmit handler. */
-    if (len > rtdev->mtu +
-	((rtdm_fd_to_context(fd)->device->driver->socket_type == SOCK_RAW) ?
-	    rtdev->hard_header_len : 0)) {
-	ret = -EMSGSIZE;
-	goto err;
-    }
-
-    if ((sll != NULL) && (sll->sll_halen != rtdev->addr_len)) {
-	ret = -EINVAL;
-	goto err;
+    if (msg->msg_iovlen == 0) {
+	ret = rt_packet_tx_kick(fd, sock, rtdev, sll, proto);
+	goto out;
     }
 
-    rtskb_reserve(rtskb, rtdev->hard_header_len);
-
-    rtskb->rtdev    = rtdev;
-    rtskb->priority = sock->priority;
-
-    if (rtdev->hard_header) {
-	int hdr_len;
-
-	ret = -EINVAL;
-	hdr_len = rtdev->hard_header(rtskb, rtdev, ntohs(proto),
-				     addr, NULL, len);
-	if (rtdm_fd_to_context(fd)->device->driver->socket_type != SOCK_DGRAM) {
-	    rtskb->tail = rtskb->data;
-	    rtskb->len = 0;
-	} else if (hdr_len < 0)
-	    goto err;
+    len = rtdm_get_iov_flatlen(iov, msg->msg_iovlen);
+    rtskb = rt_packet_prepare(fd, sock, rtdev, sll, proto, len);
+    if (IS_ERR(rtskb)) {
+	ret = PTR_ERR(rtskb);
+	goto out;
     }
 
     ret = rtnet_read_from_iov(fd, iov, msg->msg_iovlen, rtskb_put(rtskb, len), len);
-
-    if ((rtdev->flags & IFF_UP) != 0) {
-	if ((ret = rtdev_xmit(rtskb)) == 0)
-	    ret = len;
-    } else {
-	ret = -ENETDOWN;
-	goto err;
+    if (ret < 0) {
+	kfree_rtskb(rtskb);
+	goto out;
     }
 
+    if ((ret = rtdev_xmit(rtskb)) == 0)
+	ret = len;
+
  out:
     rtdev_dereference(rtdev);
  abort:
-    rtdm_drop_iovec(iov, iov_fast);
+    if (iov)
+	rtdm_drop_iovec(iov, iov_fast);
 
     return ret;
- err:
-    kfree_rtskb(rtskb);
-    goto out;
 }
 
 
@@ -567,6 +1004,7 @@ static struct rtdm_driver packet_proto_drv = {
 	.recvmsg_rt =   rt_packet_recvmsg,
 	.sendmsg_rt =   rt_packet_sendmsg,
 	.select =       rt_socket_select_bind,
+	.mmap =         rt_packet_mmap,
     },
 };
 
@@ -596,6 +1034,7 @@ static struct rtdm_driver raw_packet_proto_drv = {
 	.recvmsg_rt =   rt_packet_recvmsg,
 	.sendmsg_rt =   rt_packet_sendmsg,
 	.select =       rt_socket_select_bind,
+	.mmap =         rt_packet_mmap,
     },
 };
 
@@ -33,6 +33,7 @@
 #include <rtnet_chrdev.h>
 #include <rtnet_internal.h>
 #include <ipv4/route.h>
+#include <stack_mgr.h>
 
 
 static DEFINE_SPINLOCK(ioctl_handler_lock);
@@ -226,6 +227,23 @@ static int rtnet_core_ioctl(struct rtnet_device *rtdev, unsigned int request,
 		return -EFAULT;
 	    break;
 
+	case IOC_RT_RXRULE_ADD:
+	    ret = rt_stack_add_rx_rule(&cmd.args.rxrule.rule, NULL,
+				       cmd.args.rxrule.index);
+	    break;
+
+	case IOC_RT_RXRULE_DEL:
+	    ret = rt_stack_del_rx_rule(cmd.args.rxrule.index);
+	    break;
+
+	case IOC_RT_RXRULE_GET:
+	    ret = rt_stack_get_rx_rule(cmd.args.rxrule.index,
+				       &cmd.args.rxrule.rule,
+				       &cmd.args.rxrule.hits);
+	    if (ret == 0 && copy_to_user((void *)arg, &cmd, sizeof(cmd)) != 0)
+		return -EFAULT;
+	    break;
+
 	default:
 	    ret = -ENOTTY;
     }
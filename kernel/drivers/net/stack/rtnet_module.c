@@ -130,6 +130,9 @@ static struct xnvfile_regular rtnet_devices_vfile = {
 static int rtnet_rtskb_show(struct xnvfile_regular_iterator *it, void *data)
 {
     unsigned int rtskb_len;
+#ifdef CONFIG_XENO_DRIVERS_NET_RTSKB_CACHE
+    struct rtskb_cache_stats cache_stats;
+#endif
 
     rtskb_len = ALIGN_RTSKB_STRUCT_LEN + SKB_DATA_ALIGN(RTSKB_SIZE);
 
@@ -140,6 +143,16 @@ static int rtnet_rtskb_show(struct xnvfile_regular_iterator *it, void *data)
 		     rtskb_pools, rtskb_pools_max,
 		     rtskb_amount, rtskb_amount_max,
 		     rtskb_amount * rtskb_len, rtskb_amount_max * rtskb_len);
+
+#ifdef CONFIG_XENO_DRIVERS_NET_RTSKB_CACHE
+    rtskb_cache_read_stats(&cache_stats);
+    xnvfile_printf(it, "rtskb cache alloc hits\t%lu\n"
+		     "rtskb cache alloc misses\t%lu\n"
+		     "rtskb cache free hits\t%lu\n"
+		     "rtskb cache free misses\t%lu\n",
+		     cache_stats.alloc_hits, cache_stats.alloc_misses,
+		     cache_stats.free_hits, cache_stats.free_misses);
+#endif
 	return 0;
 }
 
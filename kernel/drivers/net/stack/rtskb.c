@@ -22,6 +22,7 @@
  */
 
 #include <linux/moduleparam.h>
+#include <linux/percpu.h>
 #include <linux/slab.h>
 #include <net/checksum.h>
 
@@ -165,12 +166,198 @@ static struct rtskb *__rtskb_pool_dequeue(struct rtskb_pool *pool)
     return skb;
 }
 
+static void __rtskb_pool_queue_tail(struct rtskb_pool *pool, struct rtskb *skb)
+{
+    struct rtskb_queue *queue = &pool->queue;
+
+    __rtskb_queue_tail(queue,skb);
+    pool->lock_ops->unlock(pool->lock_cookie);
+}
+
+#ifdef CONFIG_XENO_DRIVERS_NET_RTSKB_CACHE
+
+/*
+ * Per-CPU rtskb caches
+ *
+ * Pools whose lifetime is guarded by their lock_ops get a small cache
+ * of free rtskbs per CPU. Caches are only touched by their owner CPU
+ * with interrupts off, so allocating or releasing a buffer usually
+ * does not involve the pool queue lock. Buffers move between a cache
+ * and the pool queue by batches of half the cache capacity.
+ *
+ * The capacity is scaled down for small pools, so that at most half
+ * of the buffers of a pool can sit in the caches of CPUs which do not
+ * need them. The lock_ops are still invoked for each buffer: a cached
+ * rtskb is a free buffer of its pool, just like a queued one.
+ */
+
+static DEFINE_PER_CPU(struct rtskb_cache_stats, rtskb_cache_stats);
+
+static void rtskb_cache_resize(struct rtskb_pool *pool)
+{
+    unsigned int limit;
+
+    limit = pool->size / (2 * num_online_cpus());
+    if (limit > RTSKB_CACHE_SIZE)
+	limit = RTSKB_CACHE_SIZE;
+
+    pool->cache_limit = limit;
+}
+
+static void rtskb_cache_init(struct rtskb_pool *pool)
+{
+    /* no cache is not fatal, the pool queue is used directly then */
+    pool->cache = alloc_percpu(struct rtskb_pool_cache);
+}
+
+static void rtskb_cache_flush(struct rtskb_pool *pool)
+{
+    struct rtskb_pool_cache *cache;
+    rtdm_lockctx_t context;
+    int cpu;
+
+    if (pool->cache == NULL)
+	return;
+
+    /* The pool is not in use anymore, remote caches can be accessed. */
+    rtdm_lock_get_irqsave(&pool->queue.lock, context);
+
+    for_each_possible_cpu(cpu) {
+	cache = per_cpu_ptr(pool->cache, cpu);
+	while (cache->count > 0)
+	    __rtskb_queue_tail(&pool->queue, cache->skbs[--cache->count]);
+    }
+
+    rtdm_lock_put_irqrestore(&pool->queue.lock, context);
+}
+
+/* Give the rtskbs cached by the current CPU back to the pool queue. */
+static void rtskb_cache_flush_local(struct rtskb_pool *pool)
+{
+    struct rtskb_pool_cache *cache;
+    rtdm_lockctx_t context;
+
+    rtdm_lock_get_irqsave(&pool->queue.lock, context);
+
+    cache = raw_cpu_ptr(pool->cache);
+    while (cache->count > 0)
+	__rtskb_queue_tail(&pool->queue, cache->skbs[--cache->count]);
+
+    rtdm_lock_put_irqrestore(&pool->queue.lock, context);
+}
+
+static void rtskb_cache_destroy(struct rtskb_pool *pool)
+{
+    rtskb_cache_flush(pool);
+    free_percpu(pool->cache);
+    pool->cache = NULL;
+    pool->cache_limit = 0;
+}
+
+/* Called with interrupts off. */
+static struct rtskb *rtskb_cache_dequeue(struct rtskb_pool *pool)
+{
+    struct rtskb_cache_stats *stats = raw_cpu_ptr(&rtskb_cache_stats);
+    struct rtskb_pool_cache *cache = raw_cpu_ptr(pool->cache);
+    unsigned int batch;
+    struct rtskb *skb;
+
+    if (!pool->lock_ops->trylock(pool->lock_cookie))
+	return NULL;
+
+    if (likely(cache->count > 0)) {
+	stats->alloc_hits++;
+	return cache->skbs[--cache->count];
+    }
+
+    stats->alloc_misses++;
+    batch = pool->cache_limit / 2 ?: 1;
+
+    rtdm_lock_get(&pool->queue.lock);
+    while (cache->count < batch &&
+	   (skb = __rtskb_dequeue(&pool->queue)) != NULL)
+	cache->skbs[cache->count++] = skb;
+    rtdm_lock_put(&pool->queue.lock);
+
+    if (cache->count == 0) {
+	pool->lock_ops->unlock(pool->lock_cookie);
+	return NULL;
+    }
+
+    return cache->skbs[--cache->count];
+}
+
+/* Called with interrupts off, for single rtskbs only. */
+static void rtskb_cache_queue_tail(struct rtskb_pool *pool, struct rtskb *skb)
+{
+    struct rtskb_cache_stats *stats = raw_cpu_ptr(&rtskb_cache_stats);
+    struct rtskb_pool_cache *cache = raw_cpu_ptr(pool->cache);
+    unsigned int limit = pool->cache_limit;
+
+    if (likely(cache->count < limit)) {
+	stats->free_hits++;
+	cache->skbs[cache->count++] = skb;
+    } else {
+	stats->free_misses++;
+	rtdm_lock_get(&pool->queue.lock);
+	while (cache->count > limit / 2)
+	    __rtskb_queue_tail(&pool->queue, cache->skbs[--cache->count]);
+	__rtskb_queue_tail(&pool->queue, skb);
+	rtdm_lock_put(&pool->queue.lock);
+    }
+
+    pool->lock_ops->unlock(pool->lock_cookie);
+}
+
+void rtskb_cache_read_stats(struct rtskb_cache_stats *total)
+{
+    struct rtskb_cache_stats *stats;
+    int cpu;
+
+    memset(total, 0, sizeof(*total));
+
+    for_each_possible_cpu(cpu) {
+	stats = per_cpu_ptr(&rtskb_cache_stats, cpu);
+	total->alloc_hits += stats->alloc_hits;
+	total->alloc_misses += stats->alloc_misses;
+	total->free_hits += stats->free_hits;
+	total->free_misses += stats->free_misses;
+    }
+}
+
+#define rtskb_pool_cached(pool) ((pool)->cache != NULL)
+
+#else /* !CONFIG_XENO_DRIVERS_NET_RTSKB_CACHE */
+
+static inline void rtskb_cache_destroy(struct rtskb_pool *pool) { }
+
+static inline struct rtskb *rtskb_cache_dequeue(struct rtskb_pool *pool)
+{
+    return NULL;
+}
+
+static inline void rtskb_cache_queue_tail(struct rtskb_pool *pool,
+					  struct rtskb *skb)
+{
+}
+
+#define rtskb_pool_cached(pool) 0
+
+#endif /* !CONFIG_XENO_DRIVERS_NET_RTSKB_CACHE */
+
 struct rtskb *rtskb_pool_dequeue(struct rtskb_pool *pool)
 {
     struct rtskb_queue *queue = &pool->queue;
     rtdm_lockctx_t context;
     struct rtskb *skb;
 
+    if (rtskb_pool_cached(pool)) {
+	rtdm_lock_irqsave(context);
+	skb = rtskb_cache_dequeue(pool);
+	rtdm_lock_irqrestore(context);
+	return skb;
+    }
+
     rtdm_lock_get_irqsave(&queue->lock, context);
     skb = __rtskb_pool_dequeue(pool);
     rtdm_lock_put_irqrestore(&queue->lock, context);
@@ -179,19 +366,19 @@ struct rtskb *rtskb_pool_dequeue(struct rtskb_pool *pool)
 }
 EXPORT_SYMBOL_GPL(rtskb_pool_dequeue);
 
-static void __rtskb_pool_queue_tail(struct rtskb_pool *pool, struct rtskb *skb)
-{
-    struct rtskb_queue *queue = &pool->queue;
-
-    __rtskb_queue_tail(queue,skb);
-    pool->lock_ops->unlock(pool->lock_cookie);
-}
-
 void rtskb_pool_queue_tail(struct rtskb_pool *pool, struct rtskb *skb)
 {
     struct rtskb_queue *queue = &pool->queue;
     rtdm_lockctx_t context;
 
+    /* chains bypass the caches */
+    if (rtskb_pool_cached(pool) && skb->chain_end == skb) {
+	rtdm_lock_irqsave(context);
+	rtskb_cache_queue_tail(pool, skb);
+	rtdm_lock_irqrestore(context);
+	return;
+    }
+
     rtdm_lock_get_irqsave(&queue->lock, context);
     __rtskb_pool_queue_tail(pool, skb);
     rtdm_lock_put_irqrestore(&queue->lock, context);
@@ -321,6 +508,16 @@ unsigned int rtskb_pool_init(struct rtskb_pool *pool,
 
     rtskb_queue_init(&pool->queue);
 
+#ifdef CONFIG_XENO_DRIVERS_NET_RTSKB_CACHE
+    pool->cache = NULL;
+    pool->cache_limit = 0;
+    pool->size = 0;
+
+    /* Only pools which cannot vanish under cached buffers get a cache. */
+    if (lock_ops)
+	rtskb_cache_init(pool);
+#endif
+
     i = rtskb_pool_extend(pool, initial_size);
 
     rtskb_pools++;
@@ -371,6 +568,8 @@ void rtskb_pool_release(struct rtskb_pool *pool)
 {
     struct rtskb *skb;
 
+    rtskb_cache_destroy(pool);
+
     while ((skb = rtskb_dequeue(&pool->queue)) != NULL) {
 	rtdev_unmap_rtskb(skb);
 	kmem_cache_free(rtskb_slab_pool, skb);
@@ -419,6 +618,12 @@ unsigned int rtskb_pool_extend(struct rtskb_pool *pool,
 	    rtskb_amount_max = rtskb_amount;
     }
 
+#ifdef CONFIG_XENO_DRIVERS_NET_RTSKB_CACHE
+    pool->size += i;
+    if (pool->cache)
+	rtskb_cache_resize(pool);
+#endif
+
     return i;
 }
 
@@ -430,6 +635,15 @@ unsigned int rtskb_pool_shrink(struct rtskb_pool *pool,
     struct rtskb    *skb;
 
 
+#ifdef CONFIG_XENO_DRIVERS_NET_RTSKB_CACHE
+    /*
+     * The local cache can be drained safely, rtskbs cached by other
+     * CPUs are not reclaimed here and remain part of the pool.
+     */
+    if (pool->cache)
+	rtskb_cache_flush_local(pool);
+#endif
+
     for (i = 0; i < rem_rtskbs; i++) {
 	if ((skb = rtskb_dequeue(&pool->queue)) == NULL)
 	    break;
@@ -439,6 +653,12 @@ unsigned int rtskb_pool_shrink(struct rtskb_pool *pool,
 	rtskb_amount--;
     }
 
+#ifdef CONFIG_XENO_DRIVERS_NET_RTSKB_CACHE
+    pool->size -= i;
+    if (pool->cache)
+	rtskb_cache_resize(pool);
+#endif
+
     return i;
 }
 
@@ -451,24 +671,21 @@ int rtskb_acquire(struct rtskb *rtskb, struct rtskb_pool *comp_pool)
     rtdm_lockctx_t context;
 
 
-    rtdm_lock_get_irqsave(&comp_pool->queue.lock, context);
+    /* local interrupts stay off across the exchange */
+    rtdm_lock_irqsave(context);
 
-    comp_rtskb = __rtskb_pool_dequeue(comp_pool);
+    comp_rtskb = rtskb_pool_dequeue(comp_pool);
     if (!comp_rtskb) {
-	rtdm_lock_put_irqrestore(&comp_pool->queue.lock, context);
+	rtdm_lock_irqrestore(context);
 	return -ENOMEM;
     }
 
-    rtdm_lock_put(&comp_pool->queue.lock);
-
     comp_rtskb->chain_end = comp_rtskb;
     comp_rtskb->pool = release_pool = rtskb->pool;
 
-    rtdm_lock_get(&release_pool->queue.lock);
-
-    __rtskb_pool_queue_tail(release_pool, comp_rtskb);
+    rtskb_pool_queue_tail(release_pool, comp_rtskb);
 
-    rtdm_lock_put_irqrestore(&release_pool->queue.lock, context);
+    rtdm_lock_irqrestore(context);
 
     rtskb->pool = comp_pool;
 
@@ -23,6 +23,9 @@
  */
 
 #include <linux/moduleparam.h>
+#include <linux/jhash.h>
+#include <linux/ip.h>
+#include <linux/if_vlan.h>
 
 #include <rtdev.h>
 #include <rtnet_internal.h>
@@ -34,11 +37,82 @@ static unsigned int stack_mgr_prio = RTNET_DEF_STACK_PRIORITY;
 module_param(stack_mgr_prio, uint, 0444);
 MODULE_PARM_DESC(stack_mgr_prio, "Priority of the stack manager task");
 
+static unsigned int stack_mgr_queues = 1;
+module_param(stack_mgr_queues, uint, 0444);
+MODULE_PARM_DESC(stack_mgr_queues, "Number of stack manager queues (1-"
+		 __stringify(RTNET_STACK_MAX_QUEUES) ")");
+
+static int stack_mgr_qprio[RTNET_STACK_MAX_QUEUES];
+static int stack_mgr_nr_qprio;
+module_param_array(stack_mgr_qprio, int, &stack_mgr_nr_qprio, 0444);
+MODULE_PARM_DESC(stack_mgr_qprio, "Priority of each queue task "
+		 "(default: stack_mgr_prio)");
+
+static int stack_mgr_qcpu[RTNET_STACK_MAX_QUEUES];
+static int stack_mgr_nr_qcpu;
+module_param_array(stack_mgr_qcpu, int, &stack_mgr_nr_qcpu, 0444);
+MODULE_PARM_DESC(stack_mgr_qcpu, "CPU of each queue task, -1 for any "
+		 "(default: any)");
+
+static char *stack_mgr_steer = "hash";
+module_param(stack_mgr_steer, charp, 0444);
+MODULE_PARM_DESC(stack_mgr_steer, "Early RX classifier rules, first match "
+		 "wins, and default steering policy, e.g. \"if:2=0,eth:0x88f7=1,"
+		 "udp:319=1,vlan:5+tcp:80-89=drop,hash\"");
+
 
 #if (CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE & (CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE-1)) != 0
 #error CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE must be power of 2!
 #endif
-static DECLARE_RTSKB_FIFO(rx, CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE);
+
+struct rt_stack_queue {
+    rtdm_task_t         *task;
+    rtdm_event_t        *event;
+    rtdm_task_t         __task;
+    rtdm_event_t        __event;
+    int                 prio;
+    int                 cpu;
+    unsigned long       rx_packets;
+    atomic_t            rx_dropped;
+    DECLARE_RTSKB_FIFO(rx, CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE);
+};
+
+static struct rt_stack_queue stack_queues[RTNET_STACK_MAX_QUEUES];
+static unsigned int nr_stack_queues;
+static unsigned long stack_pending;
+
+#define RT_STACK_POLICY_HASH    0
+#define RT_STACK_POLICY_IFINDEX 1
+#define RT_STACK_POLICY_QUEUE   2
+
+static unsigned int steer_policy = RT_STACK_POLICY_HASH;
+static unsigned int steer_queue;
+
+#define RT_STACK_RX_MATCH_ALL   (RTNET_RX_MATCH_IFINDEX | \
+				 RTNET_RX_MATCH_ETHTYPE | \
+				 RTNET_RX_MATCH_VLAN    | \
+				 RTNET_RX_MATCH_IPPROTO | \
+				 RTNET_RX_MATCH_SPORT   | \
+				 RTNET_RX_MATCH_DPORT)
+
+struct rt_stack_rx_rule {
+    struct rtnet_rx_rule    rule;
+    struct rtpacket_type    *pt;        /* RTNET_RX_ACTION_DELIVER */
+    u64                     hits;
+};
+
+/* what the classifier needs to know about a packet */
+struct rt_stack_flow {
+    unsigned short      proto;          /* past any VLAN tag */
+    int                 vlan_id;
+    int                 ip_proto;
+    int                 sport;
+    int                 dport;
+};
+
+static struct rt_stack_rx_rule rx_rules[RTNET_STACK_MAX_RULES];
+static unsigned int nr_rx_rules;
+static DEFINE_RTDM_LOCK(rx_rules_lock);
 
 struct list_head    rt_packets[RTPACKET_HASH_TBL_SIZE];
 #ifdef CONFIG_XENO_DRIVERS_NET_ETH_P_ALL
@@ -103,6 +177,175 @@ void rtdev_remove_pack(struct rtpacket_type *pt)
 EXPORT_SYMBOL_GPL(rtdev_remove_pack);
 
 
+static void rt_stack_parse_flow(struct rtskb *skb, struct rt_stack_flow *flow)
+{
+    unsigned char   *nh = skb->data;
+    unsigned int    len = skb->len;
+    struct iphdr    *iph;
+    __be16          *ports;
+
+
+    flow->proto    = skb->protocol;
+    flow->vlan_id  = -1;
+    flow->ip_proto = -1;
+    flow->sport    = -1;
+    flow->dport    = -1;
+
+    if (flow->proto == htons(ETH_P_8021Q)) {
+	if (len < VLAN_HLEN)
+	    return;
+	flow->vlan_id = ntohs(*(__be16 *)nh) & VLAN_VID_MASK;
+	flow->proto   = *(__be16 *)(nh + 2);
+	nh  += VLAN_HLEN;
+	len -= VLAN_HLEN;
+    }
+
+    if (flow->proto != htons(ETH_P_IP) || len < sizeof(*iph))
+	return;
+
+    iph = (struct iphdr *)nh;
+    flow->ip_proto = iph->protocol;
+
+    /* only the first fragment carries the ports, keep them all together */
+    if ((iph->protocol != IPPROTO_UDP && iph->protocol != IPPROTO_TCP) ||
+	(iph->frag_off & htons(IP_MF | IP_OFFSET)) != 0 ||
+	len < iph->ihl * 4 + 2 * sizeof(*ports))
+	return;
+
+    ports = (__be16 *)(nh + iph->ihl * 4);
+    flow->sport = ntohs(ports[0]);
+    flow->dport = ntohs(ports[1]);
+}
+
+
+static bool rt_stack_match(const struct rtnet_rx_rule *rule,
+			   struct rtskb *skb, const struct rt_stack_flow *flow)
+{
+    if ((rule->match & RTNET_RX_MATCH_IFINDEX) &&
+	rule->ifindex != skb->rtdev->ifindex)
+	return false;
+
+    if ((rule->match & RTNET_RX_MATCH_ETHTYPE) &&
+	flow->proto != htons(rule->ethertype))
+	return false;
+
+    if ((rule->match & RTNET_RX_MATCH_VLAN) &&
+	flow->vlan_id != rule->vlan_id)
+	return false;
+
+    if ((rule->match & RTNET_RX_MATCH_IPPROTO) &&
+	flow->ip_proto != rule->ip_proto)
+	return false;
+
+    if ((rule->match & RTNET_RX_MATCH_SPORT) &&
+	(flow->sport < rule->sport_min || flow->sport > rule->sport_max))
+	return false;
+
+    if ((rule->match & RTNET_RX_MATCH_DPORT) &&
+	(flow->dport < rule->dport_min || flow->dport > rule->dport_max))
+	return false;
+
+    return true;
+}
+
+
+static unsigned int rt_stack_hash(struct rtskb *skb)
+{
+    struct iphdr    *iph = (struct iphdr *)skb->data;
+
+
+    /* ports are left out so that all fragments of a datagram and the
+       flows between two hosts are processed in order */
+    if (skb->protocol == htons(ETH_P_IP) && skb->len >= sizeof(*iph))
+	return jhash_3words(iph->saddr, iph->daddr, iph->protocol, 0);
+
+    return jhash_2words(skb->protocol, skb->rtdev->ifindex, 0);
+}
+
+
+/***
+ *  rt_stack_classify: run the early RX classifier on an incoming packet
+ *  @skb - the packet, with data pointing to the layer 3 header
+ *
+ *  Returns the stack manager queue of the packet, or -1 if the packet has
+ *  been consumed, i.e. dropped or delivered to a packet socket.
+ */
+static int rt_stack_classify(struct rtskb *skb)
+{
+    struct rt_stack_rx_rule *r;
+    struct rtpacket_type    *pt;
+    struct rt_stack_flow    flow;
+    rtdm_lockctx_t          context;
+    unsigned int            i;
+    int                     qnum;
+
+
+    if (ACCESS_ONCE(nr_rx_rules) == 0)
+	goto steer;
+
+    rt_stack_parse_flow(skb, &flow);
+
+    rtdm_lock_get_irqsave(&rx_rules_lock, context);
+
+    for (i = 0; i < nr_rx_rules; i++) {
+	r = &rx_rules[i];
+	if (!rt_stack_match(&r->rule, skb, &flow))
+	    continue;
+
+	r->hits++;
+
+	switch (r->rule.action) {
+	    case RTNET_RX_ACTION_DROP:
+		rtdm_lock_put_irqrestore(&rx_rules_lock, context);
+		kfree_rtskb(skb);
+		return -1;
+
+	    case RTNET_RX_ACTION_DELIVER:
+		/* The socket removes its rules before going away, but it may
+		   be closing already. Matching packets are its own, even if
+		   it cannot or does not take them. */
+		pt = r->pt;
+		if (!pt->trylock(pt)) {
+		    rtdm_lock_put_irqrestore(&rx_rules_lock, context);
+		    kfree_rtskb(skb);
+		    return -1;
+		}
+		rtdm_lock_put_irqrestore(&rx_rules_lock, context);
+
+		rtcap_report_incoming(skb);
+		skb->nh.raw = skb->data;
+
+		if (pt->handler(skb, pt) != 0)
+		    kfree_rtskb(skb);
+		pt->unlock(pt);
+		return -1;
+
+	    default:
+		qnum = r->rule.queue;
+		rtdm_lock_put_irqrestore(&rx_rules_lock, context);
+		return qnum;
+	}
+    }
+
+    rtdm_lock_put_irqrestore(&rx_rules_lock, context);
+
+  steer:
+    if (nr_stack_queues <= 1)
+	return 0;
+
+    switch (steer_policy) {
+	case RT_STACK_POLICY_IFINDEX:
+	    return skb->rtdev->ifindex % nr_stack_queues;
+
+	case RT_STACK_POLICY_QUEUE:
+	    return steer_queue;
+
+	default:
+	    return rt_stack_hash(skb) % nr_stack_queues;
+    }
+}
+
+
 /***
  *  rtnetif_rx: will be called from the driver interrupt handler
  *  (IRQs disabled!) and send a message to rtdev-owned stack-manager
@@ -111,18 +354,65 @@ EXPORT_SYMBOL_GPL(rtdev_remove_pack);
  */
 void rtnetif_rx(struct rtskb *skb)
 {
+    struct rt_stack_queue   *queue = &stack_queues[0];
+    int                     qnum = 0;
+
+
     RTNET_ASSERT(skb != NULL, return;);
     RTNET_ASSERT(skb->rtdev != NULL, return;);
 
-    if (unlikely(rtskb_fifo_insert_inirq(&rx.fifo, skb) < 0)) {
+    if (nr_stack_queues > 1 || ACCESS_ONCE(nr_rx_rules) > 0) {
+	qnum = rt_stack_classify(skb);
+	if (qnum < 0)
+	    return;
+	queue = &stack_queues[qnum];
+    }
+
+    if (unlikely(rtskb_fifo_insert_inirq(&queue->rx.fifo, skb) < 0)) {
 	rtdm_printk("RTnet: dropping packet in %s()\n", __FUNCTION__);
+	atomic_inc(&queue->rx_dropped);
 	kfree_rtskb(skb);
+	return;
+    }
+
+    /* the packet must be queued before rt_mark_stack_mgr() sees the bit */
+    if (nr_stack_queues > 1) {
+	smp_mb__before_atomic();
+	set_bit(qnum, &stack_pending);
     }
 }
 
 EXPORT_SYMBOL_GPL(rtnetif_rx);
 
 
+/***
+ *  rt_mark_stack_mgr: wake up the stack manager queues which received
+ *  packets via rtnetif_rx() since the last call
+ *
+ *  @rtdev - the receiving device
+ */
+void rt_mark_stack_mgr(struct rtnet_device *rtdev)
+{
+    unsigned long   pending;
+    unsigned int    qnum;
+
+
+    if (nr_stack_queues <= 1) {
+	rtdm_event_signal(rtdev->stack_event);
+	return;
+    }
+
+    pending = xchg(&stack_pending, 0);
+    while (pending) {
+	qnum = __ffs(pending);
+	pending &= ~(1UL << qnum);
+	rtdm_event_signal(stack_queues[qnum].event);
+    }
+}
+
+EXPORT_SYMBOL_GPL(rt_mark_stack_mgr);
+
+
 #if IS_ENABLED(CONFIG_XENO_DRIVERS_NET_DRV_LOOPBACK)
 #define __DELIVER_PREFIX
 #else /* !CONFIG_XENO_DRIVERS_NET_DRV_LOOPBACK */
@@ -192,21 +482,40 @@ __DELIVER_PREFIX void rt_stack_deliver(struct rtskb *rtskb)
 
 #if IS_ENABLED(CONFIG_XENO_DRIVERS_NET_DRV_LOOPBACK)
 EXPORT_SYMBOL_GPL(rt_stack_deliver);
+
+/***
+ *  rt_stack_loopback: deliver a looped back packet right away, once the
+ *  early RX classifier had a look at it
+ *  @rtskb - the packet, with data pointing to the layer 3 header
+ *
+ *  Queue steering does not apply, the packet is processed by the caller.
+ */
+void rt_stack_loopback(struct rtskb *rtskb)
+{
+    if (ACCESS_ONCE(nr_rx_rules) > 0 && rt_stack_classify(rtskb) < 0)
+	return;
+
+    rt_stack_deliver(rtskb);
+}
+
+EXPORT_SYMBOL_GPL(rt_stack_loopback);
 #endif /* CONFIG_XENO_DRIVERS_NET_DRV_LOOPBACK */
 
 
 static void rt_stack_mgr_task(void *arg)
 {
-    rtdm_event_t            *mgr_event = &((struct rtnet_mgr *)arg)->event;
+    struct rt_stack_queue   *queue = arg;
     struct rtskb            *rtskb;
 
     while (!rtdm_task_should_stop()) {
-	if (rtdm_event_wait(mgr_event) < 0)
+	if (rtdm_event_wait(queue->event) < 0)
 	    break;
 
 	/* we are the only reader => no locking required */
-	while ((rtskb = __rtskb_fifo_remove(&rx.fifo)))
+	while ((rtskb = __rtskb_fifo_remove(&queue->rx.fifo))) {
+	    queue->rx_packets++;
 	    rt_stack_deliver(rtskb);
+	}
     }
 }
 
@@ -233,15 +542,392 @@ void rt_stack_disconnect (struct rtnet_device *rtdev)
 EXPORT_SYMBOL_GPL(rt_stack_disconnect);
 
 
+/***
+ *  rt_stack_add_rx_rule: insert a rule into the early RX classifier
+ *  @rule - the rule
+ *  @pt - target of RTNET_RX_ACTION_DELIVER rules, NULL otherwise
+ *  @index - position of the rule, a negative value appends it
+ *
+ *  Returns the position of the rule, or a negative error code.
+ */
+int rt_stack_add_rx_rule(const struct rtnet_rx_rule *rule,
+			 struct rtpacket_type *pt, int index)
+{
+    rtdm_lockctx_t  context;
+
+
+    if ((rule->match & ~RT_STACK_RX_MATCH_ALL) != 0 ||
+	((rule->match & RTNET_RX_MATCH_SPORT) &&
+	 rule->sport_min > rule->sport_max) ||
+	((rule->match & RTNET_RX_MATCH_DPORT) &&
+	 rule->dport_min > rule->dport_max))
+	return -EINVAL;
+
+    switch (rule->action) {
+	case RTNET_RX_ACTION_QUEUE:
+	    if (rule->queue >= nr_stack_queues)
+		return -EINVAL;
+	    /* fall through */
+	case RTNET_RX_ACTION_DROP:
+	    if (pt != NULL)
+		return -EINVAL;
+	    break;
+
+	case RTNET_RX_ACTION_DELIVER:
+	    if (pt == NULL)
+		return -EINVAL;
+	    break;
+
+	default:
+	    return -EINVAL;
+    }
+
+    rtdm_lock_get_irqsave(&rx_rules_lock, context);
+
+    if (nr_rx_rules == RTNET_STACK_MAX_RULES) {
+	rtdm_lock_put_irqrestore(&rx_rules_lock, context);
+	return -ENOSPC;
+    }
+
+    if (index < 0 || index > nr_rx_rules)
+	index = nr_rx_rules;
+
+    memmove(&rx_rules[index + 1], &rx_rules[index],
+	    (nr_rx_rules - index) * sizeof(rx_rules[0]));
+    rx_rules[index].rule = *rule;
+    rx_rules[index].pt   = pt;
+    rx_rules[index].hits = 0;
+    nr_rx_rules++;
+
+    rtdm_lock_put_irqrestore(&rx_rules_lock, context);
+
+    return index;
+}
+
+EXPORT_SYMBOL_GPL(rt_stack_add_rx_rule);
+
+
+static void __rt_stack_del_rx_rule(unsigned int index)
+{
+    nr_rx_rules--;
+    memmove(&rx_rules[index], &rx_rules[index + 1],
+	    (nr_rx_rules - index) * sizeof(rx_rules[0]));
+}
+
+
+/***
+ *  rt_stack_del_rx_rule: remove a rule from the early RX classifier
+ *  @index - position of the rule
+ */
+int rt_stack_del_rx_rule(unsigned int index)
+{
+    rtdm_lockctx_t  context;
+    int             ret = 0;
+
+
+    rtdm_lock_get_irqsave(&rx_rules_lock, context);
+    if (index < nr_rx_rules)
+	__rt_stack_del_rx_rule(index);
+    else
+	ret = -ENOENT;
+    rtdm_lock_put_irqrestore(&rx_rules_lock, context);
+
+    return ret;
+}
+
+EXPORT_SYMBOL_GPL(rt_stack_del_rx_rule);
+
+
+/***
+ *  rt_stack_get_rx_rule: read back a rule of the early RX classifier
+ *  @index - position of the rule
+ *  @rule - buffer for the rule
+ *  @hits - buffer for the number of matching packets
+ */
+int rt_stack_get_rx_rule(unsigned int index, struct rtnet_rx_rule *rule,
+			 u64 *hits)
+{
+    rtdm_lockctx_t  context;
+    int             ret = 0;
+
+
+    rtdm_lock_get_irqsave(&rx_rules_lock, context);
+    if (index < nr_rx_rules) {
+	*rule = rx_rules[index].rule;
+	*hits = rx_rules[index].hits;
+    } else
+	ret = -ENOENT;
+    rtdm_lock_put_irqrestore(&rx_rules_lock, context);
+
+    return ret;
+}
+
+EXPORT_SYMBOL_GPL(rt_stack_get_rx_rule);
+
+
+/***
+ *  rt_stack_remove_rx_rules: remove all rules delivering to a packet type
+ *  @pt - the packet type, usually of a closing socket
+ *
+ *  Once this returns, the classifier no longer refers to @pt.
+ */
+void rt_stack_remove_rx_rules(struct rtpacket_type *pt)
+{
+    rtdm_lockctx_t  context;
+    unsigned int    i;
+
+
+    rtdm_lock_get_irqsave(&rx_rules_lock, context);
+    for (i = 0; i < nr_rx_rules; )
+	if (rx_rules[i].pt == pt)
+	    __rt_stack_del_rx_rule(i);
+	else
+	    i++;
+    rtdm_lock_put_irqrestore(&rx_rules_lock, context);
+}
+
+EXPORT_SYMBOL_GPL(rt_stack_remove_rx_rules);
+
+
+static int rt_stack_parse_range(char *str, u16 *min, u16 *max)
+{
+    char    *sep = strchr(str, '-');
+
+
+    if (sep != NULL)
+	*sep++ = '\0';
+
+    if (kstrtou16(str, 0, min) != 0)
+	return -EINVAL;
+
+    if (sep == NULL) {
+	*max = *min;
+	return 0;
+    }
+
+    return kstrtou16(sep, 0, max);
+}
+
+
+static int rt_stack_parse_match(char *str, struct rtnet_rx_rule *rule)
+{
+    char            *tok, *key;
+    unsigned int    k;
+
+
+    while ((tok = strsep(&str, "+")) != NULL) {
+	key = strchr(tok, ':');
+	if (key == NULL)
+	    return -EINVAL;
+	*key++ = '\0';
+
+	if (strcmp(tok, "udp") == 0 || strcmp(tok, "tcp") == 0) {
+	    rule->match |= RTNET_RX_MATCH_IPPROTO | RTNET_RX_MATCH_DPORT;
+	    rule->ip_proto = (*tok == 'u') ? IPPROTO_UDP : IPPROTO_TCP;
+	    if (rt_stack_parse_range(key, &rule->dport_min,
+				     &rule->dport_max) != 0)
+		return -EINVAL;
+	    continue;
+	}
+
+	if (kstrtouint(key, 0, &k) != 0)
+	    return -EINVAL;
+
+	if (strcmp(tok, "if") == 0) {
+	    rule->match |= RTNET_RX_MATCH_IFINDEX;
+	    rule->ifindex = k;
+	} else if (strcmp(tok, "eth") == 0 && k <= 0xffff) {
+	    rule->match |= RTNET_RX_MATCH_ETHTYPE;
+	    rule->ethertype = k;
+	} else if (strcmp(tok, "vlan") == 0 && k <= VLAN_VID_MASK) {
+	    rule->match |= RTNET_RX_MATCH_VLAN;
+	    rule->vlan_id = k;
+	} else if (strcmp(tok, "ip") == 0 && k <= 0xff) {
+	    rule->match |= RTNET_RX_MATCH_IPPROTO;
+	    rule->ip_proto = k;
+	} else
+	    return -EINVAL;
+    }
+
+    return 0;
+}
+
+
+static int rt_stack_parse_steer(void)
+{
+    struct rtnet_rx_rule    rule;
+    char                    *buf, *pos, *tok, *val;
+    unsigned int            q;
+    int                     err = 0;
+
+
+    nr_rx_rules = 0;
+    steer_policy = RT_STACK_POLICY_HASH;
+
+    if (stack_mgr_steer == NULL)
+	return 0;
+
+    buf = kstrdup(stack_mgr_steer, GFP_KERNEL);
+    if (buf == NULL)
+	return -ENOMEM;
+
+    pos = buf;
+    while ((tok = strsep(&pos, ",")) != NULL) {
+	if (*tok == '\0')
+	    continue;
+
+	if (strcmp(tok, "hash") == 0) {
+	    steer_policy = RT_STACK_POLICY_HASH;
+	    continue;
+	}
+	if (strcmp(tok, "ifindex") == 0) {
+	    steer_policy = RT_STACK_POLICY_IFINDEX;
+	    continue;
+	}
+
+	val = strchr(tok, '=');
+	if (val == NULL) {
+	    /* a bare queue number is the default queue */
+	    if (kstrtouint(tok, 0, &q) != 0 || q >= nr_stack_queues)
+		goto invalid;
+	    steer_policy = RT_STACK_POLICY_QUEUE;
+	    steer_queue = q;
+	    continue;
+	}
+	*val++ = '\0';
+
+	memset(&rule, 0, sizeof(rule));
+	if (rt_stack_parse_match(tok, &rule) != 0)
+	    goto invalid;
+
+	if (strcmp(val, "drop") == 0)
+	    rule.action = RTNET_RX_ACTION_DROP;
+	else if (kstrtou16(val, 0, &rule.queue) == 0)
+	    rule.action = RTNET_RX_ACTION_QUEUE;
+	else
+	    goto invalid;
+
+	if (rt_stack_add_rx_rule(&rule, NULL, -1) < 0)
+	    goto invalid;
+    }
+
+  out:
+    kfree(buf);
+    return err;
+
+  invalid:
+    printk("RTnet: invalid stack_mgr_steer entry \"%s\"\n", tok);
+    err = -EINVAL;
+    goto out;
+}
+
+
+#ifdef CONFIG_XENO_OPT_VFILE
+static int rt_stack_queues_show(struct xnvfile_regular_iterator *it, void *d)
+{
+    struct rt_stack_queue   *queue;
+    struct rtnet_rx_rule    rule;
+    unsigned int            i;
+    u64                     hits;
+
+
+    xnvfile_printf(it, "Queue\tCPU\tPrio\tPackets\t\tDropped\n");
+
+    for (i = 0; i < nr_stack_queues; i++) {
+	queue = &stack_queues[i];
+	if (queue->cpu < 0)
+	    xnvfile_printf(it, "%u\tany", i);
+	else
+	    xnvfile_printf(it, "%u\t%d", i, queue->cpu);
+	xnvfile_printf(it, "\t%d\t%-10lu\t%d\n", queue->prio,
+		       queue->rx_packets, atomic_read(&queue->rx_dropped));
+    }
+
+    if (nr_stack_queues > 1) {
+	if (steer_policy == RT_STACK_POLICY_QUEUE)
+	    xnvfile_printf(it, "\nDefault steering: queue %u\n", steer_queue);
+	else
+	    xnvfile_printf(it, "\nDefault steering: %s\n",
+			   steer_policy == RT_STACK_POLICY_HASH ?
+			   "hash" : "ifindex");
+    }
+
+    for (i = 0; rt_stack_get_rx_rule(i, &rule, &hits) == 0; i++) {
+	if (i == 0)
+	    xnvfile_printf(it, "\nRule\tHits\t\tAction\t\tMatch\n");
+
+	xnvfile_printf(it, "%u\t%-10llu\t", i, (unsigned long long)hits);
+	if (rule.action == RTNET_RX_ACTION_DROP)
+	    xnvfile_printf(it, "drop\t\t");
+	else if (rule.action == RTNET_RX_ACTION_DELIVER)
+	    xnvfile_printf(it, "deliver\t\t");
+	else
+	    xnvfile_printf(it, "queue %u\t\t", rule.queue);
+
+	if (rule.match == 0)
+	    xnvfile_printf(it, "any");
+	if (rule.match & RTNET_RX_MATCH_IFINDEX)
+	    xnvfile_printf(it, "if:%d ", rule.ifindex);
+	if (rule.match & RTNET_RX_MATCH_ETHTYPE)
+	    xnvfile_printf(it, "eth:0x%04x ", rule.ethertype);
+	if (rule.match & RTNET_RX_MATCH_VLAN)
+	    xnvfile_printf(it, "vlan:%u ", rule.vlan_id);
+	if (rule.match & RTNET_RX_MATCH_IPPROTO)
+	    xnvfile_printf(it, "ip:%u ", rule.ip_proto);
+	if (rule.match & RTNET_RX_MATCH_SPORT)
+	    xnvfile_printf(it, "sport:%u-%u ", rule.sport_min, rule.sport_max);
+	if (rule.match & RTNET_RX_MATCH_DPORT)
+	    xnvfile_printf(it, "dport:%u-%u ", rule.dport_min, rule.dport_max);
+	xnvfile_printf(it, "\n");
+    }
+
+    return 0;
+}
+
+static struct xnvfile_regular_ops rt_stack_queues_vfile_ops = {
+    .show = rt_stack_queues_show,
+};
+
+static struct xnvfile_regular rt_stack_queues_vfile = {
+    .ops = &rt_stack_queues_vfile_ops,
+};
+#endif /* CONFIG_XENO_OPT_VFILE */
+
+
+static void rt_stack_queues_destroy(unsigned int nr)
+{
+    struct rt_stack_queue   *queue;
+
+
+    while (nr-- > 0) {
+	queue = &stack_queues[nr];
+	rtdm_event_destroy(queue->event);
+	rtdm_task_destroy(queue->task);
+    }
+}
+
+
 /***
  *  rt_stack_mgr_init
  */
 int rt_stack_mgr_init (struct rtnet_mgr *mgr)
 {
-    int i;
+    struct rt_stack_queue   *queue;
+    char                    name[XNOBJECT_NAME_LEN];
+    unsigned int            i;
+    int                     err;
 
 
-    rtskb_fifo_init(&rx.fifo, CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE);
+    if (stack_mgr_queues < 1 || stack_mgr_queues > RTNET_STACK_MAX_QUEUES) {
+	printk("RTnet: stack_mgr_queues must be between 1 and %d\n",
+	       RTNET_STACK_MAX_QUEUES);
+	return -EINVAL;
+    }
+    nr_stack_queues = stack_mgr_queues;
+
+    err = rt_stack_parse_steer();
+    if (err)
+	return err;
 
     for (i = 0; i < RTPACKET_HASH_TBL_SIZE; i++)
 	INIT_LIST_HEAD(&rt_packets[i]);
@@ -249,10 +935,51 @@ int rt_stack_mgr_init (struct rtnet_mgr *mgr)
     INIT_LIST_HEAD(&rt_packets_all);
 #endif /* CONFIG_XENO_DRIVERS_NET_ETH_P_ALL */
 
-    rtdm_event_init(&mgr->event, 0);
+    stack_pending = 0;
+
+    for (i = 0; i < nr_stack_queues; i++) {
+	queue = &stack_queues[i];
 
-    return rtdm_task_init(&mgr->task, "rtnet-stack", rt_stack_mgr_task, mgr,
-			  stack_mgr_prio, 0);
+	/* queue 0 is driven by the manager drivers connect to */
+	if (i == 0) {
+	    queue->task  = &mgr->task;
+	    queue->event = &mgr->event;
+	    strcpy(name, "rtnet-stack");
+	} else {
+	    queue->task  = &queue->__task;
+	    queue->event = &queue->__event;
+	    snprintf(name, sizeof(name), "rtnet-stack%u", i);
+	}
+	queue->prio = i < stack_mgr_nr_qprio ?
+	    stack_mgr_qprio[i] : stack_mgr_prio;
+	queue->cpu = i < stack_mgr_nr_qcpu ? stack_mgr_qcpu[i] : -1;
+	queue->rx_packets = 0;
+	atomic_set(&queue->rx_dropped, 0);
+
+	rtskb_fifo_init(&queue->rx.fifo, CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE);
+	rtdm_event_init(queue->event, 0);
+
+	err = rtdm_task_init_on_cpu(queue->task, name, rt_stack_mgr_task,
+				    queue, queue->prio, 0, queue->cpu);
+	if (err) {
+	    printk("RTnet: cannot start stack manager queue %u (%d)\n",
+		   i, err);
+	    rtdm_event_destroy(queue->event);
+	    rt_stack_queues_destroy(i);
+	    return err;
+	}
+    }
+
+#ifdef CONFIG_XENO_OPT_VFILE
+    err = xnvfile_init_regular("stack_queues", &rt_stack_queues_vfile,
+			       &rtnet_proc_root);
+    if (err) {
+	rt_stack_queues_destroy(nr_stack_queues);
+	return err;
+    }
+#endif /* CONFIG_XENO_OPT_VFILE */
+
+    return 0;
 }
 
 
@@ -261,6 +988,9 @@ int rt_stack_mgr_init (struct rtnet_mgr *mgr)
  */
 void rt_stack_mgr_delete (struct rtnet_mgr *mgr)
 {
-    rtdm_event_destroy(&mgr->event);
-    rtdm_task_destroy(&mgr->task);
+#ifdef CONFIG_XENO_OPT_VFILE
+    xnvfile_destroy_regular(&rt_stack_queues_vfile);
+#endif /* CONFIG_XENO_OPT_VFILE */
+
+    rt_stack_queues_destroy(nr_stack_queues);
 }
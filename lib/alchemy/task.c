@@ -29,6 +29,9 @@
 #include "queue.h"
 #include "timer.h"
 #include "heap.h"
+#ifdef CONFIG_XENO_COBALT
+#include <sys/cobalt.h>
+#endif
 
 /**
  * @ingroup alchemy
@@ -280,6 +283,7 @@ static int create_tcb(struct alchemy_task **tcbp, RT_TASK *task,
 
 	tcb->suspends = 0;
 	tcb->flowgen = 0;
+	tcb->relgroup = 0;
 
 	idata.magic = task_magic;
 	idata.finalizer = task_finalizer;
@@ -812,6 +816,9 @@ undo:
  * - -ETIMEDOUT is returned if @a idate is different from TM_INFINITE
  * and represents a date in the past.
  *
+ * - -EBUSY is returned if @a task has joined a release group (see
+ * rt_task_join_relgroup()).
+ *
  * @apitags{mode-unrestricted, switch-primary}
  *
  * @note The caller must be an Alchemy task if @a task is NULL.
@@ -871,7 +878,10 @@ int rt_task_set_periodic(RT_TASK *task, RTIME idate, RTIME period)
 		goto out;
 	}
 
-	ret = threadobj_set_periodic(&tcb->thobj, &its, &pts);
+	if (tcb->relgroup)
+		ret = -EBUSY;
+	else
+		ret = threadobj_set_periodic(&tcb->thobj, &its, &pts);
 	put_alchemy_task(tcb);
 out:
 	CANCEL_RESTORE(svc);
@@ -885,7 +895,8 @@ out:
  *
  * Delay the current task until the next periodic release point is
  * reached. The periodic timer should have been previously started for
- * @a task by a call to rt_task_set_periodic().
+ * @a task by a call to rt_task_set_periodic(), or the task should have
+ * joined a release group by a call to rt_task_join_relgroup().
  *
  * @param overruns_r If non-NULL, @a overruns_r shall be a pointer to
  * a memory location which will be written with the count of pending
@@ -900,6 +911,9 @@ out:
  * - -EWOULDBLOCK is returned if rt_task_set_periodic() was not called
  * for the current task.
  *
+ * - -EIDRM is returned if the release group the current task joined
+ * was deleted while waiting. The task is detached from the group.
+ *
  * - -EINTR is returned if rt_task_unblock() was called for the
  * waiting task before the next periodic release point was reached. In
  * this case, the overrun counter is also cleared.
@@ -923,9 +937,195 @@ int rt_task_wait_period(unsigned long *overruns_r)
 	if (!threadobj_current_p())
 		return -EPERM;
 
+#ifdef CONFIG_XENO_COBALT
+	{
+		struct alchemy_task *tcb = alchemy_task_current();
+
+		if (tcb && tcb->relgroup) {
+			if (cobalt_relgroup_wait(overruns_r) == 0)
+				return 0;
+			if (errno == EIDRM)
+				tcb->relgroup = 0;
+			return -errno;
+		}
+	}
+#endif
+
 	return threadobj_wait_period(overruns_r);
 }
 
+/**
+ * @fn int rt_relgroup_create(RT_RELGROUP *group, RTIME idate, RTIME period)
+ * @brief Create a release group.
+ *
+ * Create a group driving the periodic release points of tasks with
+ * harmonic periods from a single timer. Tasks join the group by a
+ * call to rt_task_join_relgroup(), specifying their period as a
+ * multiple of the group period, then wait for their release points
+ * by calling rt_task_wait_period() as usual. All tasks due at the
+ * same release point are readied at once, by decreasing priority
+ * order.
+ *
+ * @param group The address of a group descriptor which can be later
+ * used to identify uniquely the created object.
+ *
+ * @param idate The initial (absolute) date of the first release
+ * point of the group, expressed in clock ticks (see note). If @a
+ * idate is equal to TM_NOW, the first release point is set one @a
+ * period from the current date.
+ *
+ * @param period The base period of the group, expressed in clock
+ * ticks (see note).
+ *
+ * @return Zero is returned upon success. Otherwise:
+ *
+ * - -EINVAL is returned if @a period is zero or TM_INFINITE, or
+ * shorter than the user scheduling latency value for the target
+ * system, as displayed by /proc/xenomai/latency.
+ *
+ * - -ETIMEDOUT is returned if @a idate represents a date in the
+ * past.
+ *
+ * - -ENOSYS is returned over Mercury.
+ *
+ * @apitags{mode-unrestricted, switch-secondary}
+ *
+ * @note Release groups are process-local.
+ *
+ * @note The @a idate and @a period values are interpreted as a
+ * multiple of the Alchemy clock resolution (see
+ * --alchemy-clock-resolution option, defaults to 1 nanosecond).
+ */
+int rt_relgroup_create(RT_RELGROUP *group, RTIME idate, RTIME period)
+{
+#ifdef CONFIG_XENO_COBALT
+	struct timespec its, pts;
+	struct service svc;
+	int fd, ret = 0;
+
+	if (period == 0 || period == TM_INFINITE)
+		return -EINVAL;
+
+	CANCEL_DEFER(svc);
+
+	clockobj_ticks_to_timespec(&alchemy_clock, period, &pts);
+	if (idate != TM_NOW)
+		clockobj_ticks_to_timespec(&alchemy_clock, idate, &its);
+
+	fd = cobalt_relgroup_create(CLOCK_COPPERPLATE,
+				    idate == TM_NOW ? NULL : &its, &pts);
+	if (fd < 0)
+		ret = -errno;
+	else
+		group->fd = fd;
+
+	CANCEL_RESTORE(svc);
+
+	return ret;
+#else
+	return -ENOSYS;
+#endif
+}
+
+/**
+ * @fn int rt_relgroup_delete(RT_RELGROUP *group)
+ * @brief Delete a release group.
+ *
+ * Tasks waiting for their next release point from this group are
+ * unblocked, rt_task_wait_period() returning -EIDRM to them. All
+ * members are detached from the group.
+ *
+ * @param group The group descriptor.
+ *
+ * @return Zero is returned upon success. Otherwise:
+ *
+ * - -EBADF is returned if @a group is not a valid group descriptor.
+ *
+ * - -ENOSYS is returned over Mercury.
+ *
+ * @apitags{mode-unrestricted, switch-secondary}
+ */
+int rt_relgroup_delete(RT_RELGROUP *group)
+{
+#ifdef CONFIG_XENO_COBALT
+	struct service svc;
+	int ret = 0;
+
+	CANCEL_DEFER(svc);
+
+	if (cobalt_relgroup_destroy(group->fd))
+		ret = -errno;
+	else
+		group->fd = -1;
+
+	CANCEL_RESTORE(svc);
+
+	return ret;
+#else
+	return -ENOSYS;
+#endif
+}
+
+/**
+ * @fn int rt_task_join_relgroup(RT_RELGROUP *group, unsigned int multiplier)
+ * @brief Make the current task periodic within a release group.
+ *
+ * Attach the current task to a release group, with a period of @a
+ * multiplier times the base period of @a group. The task is first
+ * released at the next release point of the group which is a
+ * multiple of @a multiplier, counting from the first release of the
+ * group. The periodic timer of the task is stopped if enabled.
+ *
+ * @param group The group descriptor, or NULL to detach the current
+ * task from the group it joined.
+ *
+ * @param multiplier The period of the task, as a multiple of the
+ * group period. Ignored when @a group is NULL.
+ *
+ * @return Zero is returned upon success. Otherwise:
+ *
+ * - -EINVAL is returned if @a multiplier is zero.
+ *
+ * - -EBADF is returned if @a group is not a valid group descriptor.
+ *
+ * - -EPERM is returned if the caller is not an Alchemy task.
+ *
+ * - -ENOSYS is returned over Mercury.
+ *
+ * @apitags{xthread-only, switch-primary}
+ */
+int rt_task_join_relgroup(RT_RELGROUP *group, unsigned int multiplier)
+{
+#ifdef CONFIG_XENO_COBALT
+	static const struct timespec zero;
+	struct alchemy_task *tcb;
+	int ret;
+
+	tcb = get_alchemy_task_or_self(NULL, &ret);
+	if (tcb == NULL)
+		return ret;
+
+	if (group == NULL) {
+		ret = cobalt_relgroup_leave() ? -errno : 0;
+		if (ret == 0)
+			tcb->relgroup = 0;
+		goto out;
+	}
+
+	ret = cobalt_relgroup_join(group->fd, multiplier) ? -errno : 0;
+	if (ret == 0) {
+		threadobj_set_periodic(&tcb->thobj, &zero, &zero);
+		tcb->relgroup = 1;
+	}
+out:
+	put_alchemy_task(tcb);
+
+	return ret;
+#else
+	return -ENOSYS;
+#endif
+}
+
 /**
  * @fn int rt_task_sleep_until(RTIME date)
  * @brief Delay the current real-time task (with absolute wakeup date).
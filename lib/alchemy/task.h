@@ -36,6 +36,7 @@ struct alchemy_task {
 	int suspends;
 	struct syncobj sobj_msg;
 	int flowgen;
+	int relgroup;
 	struct threadobj thobj;
 	struct clusterobj cobj;
 	void (*entry)(void *arg);
@@ -123,6 +123,16 @@ static const struct option cobalt_options[] = {
 		.name = "print-sync-delay",
 		.has_arg = required_argument,
 	},
+	{
+#define mutex_spin_opt	4
+		.name = "mutex-spin",
+		.has_arg = required_argument,
+	},
+	{
+#define print_deferred_opt	5
+		.name = "print-deferred",
+		.has_arg = no_argument,
+	},
 	{ /* Sentinel */ }
 };
 
@@ -336,6 +346,15 @@ static int cobalt_parse_option(int optnum, const char *optarg)
 			return ret;
 		__cobalt_print_syncdelay = value;
 		break;
+	case mutex_spin_opt:
+		ret = get_int_arg("--mutex-spin", optarg, &value, 0);
+		if (ret)
+			return ret;
+		__cobalt_mutex_spin = value;
+		break;
+	case print_deferred_opt:
+		__cobalt_print_deferred = 1;
+		break;
 	default:
 		/* Paranoid, can't happen. */
 		return -EINVAL;
@@ -350,6 +369,8 @@ static void cobalt_help(void)
         fprintf(stderr, "--print-buffer-size=<bytes>	size of a print relay buffer (16k)\n");
         fprintf(stderr, "--print-buffer-count=<num>	number of print relay buffers (4)\n");
         fprintf(stderr, "--print-buffer-syncdelay=<ms>	max delay of output synchronization (100 ms)\n");
+        fprintf(stderr, "--mutex-spin=<count>		max rounds of adaptive spinning on contended mutexes (0, disabled)\n");
+        fprintf(stderr, "--print-deferred		format rt_printf() output from the printer thread\n");
 }
 
 static struct setup_descriptor cobalt_interface = {
@@ -0,0 +1,125 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#include <errno.h>
+#include <unistd.h>
+#include <boilerplate/atomic.h>
+#include <asm/xenomai/syscall.h>
+#include "internal.h"
+
+/*
+ * Batched RTDM I/O. Submissions are queued into the shared ring with
+ * cobalt_ioring_get_sqe(), then handed over to the kernel in one go
+ * by cobalt_ioring_submit(), which runs them from primary mode.
+ * Requests the driver only serves from secondary mode are run from
+ * that mode, one at a time, like the regular I/O calls would.
+ * Completions are reaped directly from the ring, there is no need to
+ * enter the kernel for this.
+ *
+ * A ring must not be operated concurrently by multiple threads
+ * without serialization.
+ */
+
+int cobalt_ioring_init(struct cobalt_ioring *ring,
+		       unsigned int entries, int flags)
+{
+	struct cobalt_ioring_state *state;
+	__u32 offset;
+	int fd;
+
+	fd = XENOMAI_SYSCALL3(sc_cobalt_ioring_create, entries, flags, &offset);
+	if (fd < 0) {
+		errno = -fd;
+		return -1;
+	}
+
+	state = cobalt_umm_private + offset;
+	ring->fd = fd;
+	ring->state = state;
+	ring->sq = (void *)state + state->sq_offset;
+	ring->cq = (void *)state + state->cq_offset;
+	ring->sq_mask = state->sq_entries - 1;
+	ring->cq_mask = state->cq_entries - 1;
+	ring->sq_tail = state->sq_tail;
+	__cobalt_commit_memory(state, state->cq_offset +
+			       state->cq_entries * sizeof(*ring->cq));
+
+	return 0;
+}
+
+void cobalt_ioring_destroy(struct cobalt_ioring *ring)
+{
+	XENOMAI_SYSCALL1(sc_cobalt_close, ring->fd);
+	ring->fd = -1;
+}
+
+struct cobalt_ioring_sqe *cobalt_ioring_get_sqe(struct cobalt_ioring *ring)
+{
+	struct cobalt_ioring_sqe *sqe;
+
+	if (ring->sq_tail - ACCESS_ONCE(ring->state->sq_head) > ring->sq_mask)
+		return NULL;
+
+	sqe = ring->sq + (ring->sq_tail & ring->sq_mask);
+	ring->sq_tail++;
+
+	return sqe;
+}
+
+int cobalt_ioring_submit(struct cobalt_ioring *ring)
+{
+	struct cobalt_ioring_state *state = ring->state;
+	int ret, count = 0;
+
+	smp_wmb();
+	state->sq_tail = ring->sq_tail;
+
+	/*
+	 * The kernel stops after running a request from secondary
+	 * mode, resubmit the remaining ones until the completion
+	 * queue is full.
+	 */
+	do {
+		ret = XENOMAI_SYSCALL2(sc_cobalt_ioring_enter, ring->fd,
+				       ring->sq_tail - state->sq_head);
+		if (ret < 0) {
+			if (count > 0)
+				break;
+			errno = -ret;
+			return -1;
+		}
+		count += ret;
+	} while (ret > 0 && state->sq_head != ring->sq_tail);
+
+	return count;
+}
+
+struct cobalt_ioring_cqe *cobalt_ioring_peek_cqe(struct cobalt_ioring *ring)
+{
+	struct cobalt_ioring_state *state = ring->state;
+
+	if (state->cq_head == ACCESS_ONCE(state->cq_tail))
+		return NULL;
+
+	smp_rmb();
+
+	return ring->cq + (state->cq_head & ring->cq_mask);
+}
+
+void cobalt_ioring_cqe_seen(struct cobalt_ioring *ring)
+{
+	smp_mb();
+	ring->state->cq_head++;
+}
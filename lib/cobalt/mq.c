@@ -22,6 +22,8 @@
 #include <fcntl.h>
 #include <pthread.h>
 #include <mqueue.h>
+#include <sys/mman.h>
+#include <cobalt/uapi/mqueue.h>
 #include <asm/xenomai/syscall.h>
 #include "internal.h"
 
@@ -576,4 +578,268 @@ COBALT_IMPL(int, mq_notify, (mqd_t mqd, const struct sigevent *evp))
 	return 0;
 }
 
+static size_t mq_pool_size(const struct mq_attr *attr)
+{
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+
+	return (cobalt_mq_slot_size(attr->mq_msgsize) * attr->mq_maxmsg
+		+ pagesz - 1) & ~(pagesz - 1);
+}
+
+/**
+ * @brief Map the payload pool of a zero-copy message queue
+ *
+ * Message queues created with the COBALT_MQ_ZEROCOPY bit set in the
+ * @a mq_flags attribute pass slot indices between senders and
+ * receivers instead of copying payloads. This service maps the
+ * pool of payload slots into the address space of the caller. The
+ * pool is mapped read-only for descriptors open with O_RDONLY.
+ *
+ * The payload of slot @a n starts @a n * @a *slotsz_r bytes from the
+ * address returned.
+ *
+ * @param mqd message queue descriptor;
+ *
+ * @param slotsz_r if not @a NULL, address where the size of a
+ * payload slot will be stored on success.
+ *
+ * @return the address of the payload pool on success;
+ * @return NULL with @a errno set if:
+ * - EBADF, @a mqd is not a valid message queue descriptor;
+ * - EINVAL, the queue was not created in zero-copy mode;
+ * - ENOMEM, the address space of the caller is exhausted.
+ *
+ * @apitags{thread-unrestricted, switch-secondary}
+ */
+void *cobalt_mq_map(mqd_t mqd, size_t *slotsz_r)
+{
+	struct mq_attr attr;
+	int prot;
+	void *p;
+
+	if (__COBALT(mq_getattr(mqd, &attr)))
+		return NULL;
+
+	if ((attr.mq_flags & COBALT_MQ_ZEROCOPY) == 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	prot = PROT_READ;
+	if ((attr.mq_flags & O_ACCMODE) != O_RDONLY)
+		prot |= PROT_WRITE;
+
+	p = __COBALT(mmap(NULL, mq_pool_size(&attr), prot, MAP_SHARED, mqd, 0));
+	if (p == MAP_FAILED)
+		return NULL;
+
+	if (slotsz_r)
+		*slotsz_r = cobalt_mq_slot_size(attr.mq_msgsize);
+
+	return p;
+}
+
+/**
+ * @brief Unmap the payload pool of a zero-copy message queue
+ *
+ * @param mqd message queue descriptor the pool was mapped from;
+ *
+ * @param pool address returned by cobalt_mq_map().
+ *
+ * @retval 0 on success;
+ * @retval -1 with @a errno set if:
+ * - EBADF, @a mqd is not a valid message queue descriptor;
+ * - EINVAL, the queue was not created in zero-copy mode.
+ *
+ * @apitags{thread-unrestricted, switch-secondary}
+ */
+int cobalt_mq_unmap(mqd_t mqd, void *pool)
+{
+	struct mq_attr attr;
+
+	if (__COBALT(mq_getattr(mqd, &attr)))
+		return -1;
+
+	if ((attr.mq_flags & COBALT_MQ_ZEROCOPY) == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return munmap(pool, mq_pool_size(&attr));
+}
+
+/**
+ * @brief Reserve a payload slot in a zero-copy message queue
+ *
+ * This service grabs a free slot from the payload pool, which the
+ * caller may fill in place before passing it to
+ * cobalt_mq_commit(). If no slot is available, the caller blocks
+ * until one is released, unless O_NONBLOCK is set for @a mqd, or
+ * the @a abs_timeout date is reached. Waiting senders are served by
+ * priority order.
+ *
+ * @param mqd message queue descriptor;
+ *
+ * @param slot_r address where the index of the reserved slot will
+ * be stored on success;
+ *
+ * @param abs_timeout if not @a NULL, the timeout, expressed as an
+ * absolute value of the CLOCK_REALTIME clock.
+ *
+ * @retval 0 on success;
+ * @retval -1 with @a errno set if:
+ * - EBADF, @a mqd is not a valid descriptor open for writing;
+ * - EINVAL, the queue was not created in zero-copy mode;
+ * - EAGAIN, no slot is available, and the flag @a O_NONBLOCK is set
+ *   for @a mqd;
+ * - EPERM, the caller context is invalid;
+ * - EINTR, the service was interrupted by a signal;
+ * - ETIMEDOUT, the specified timeout expired.
+ *
+ * @apitags{xthread-only, switch-primary}
+ */
+int cobalt_mq_reserve(mqd_t mqd, unsigned int *slot_r,
+		      const struct timespec *abs_timeout)
+{
+	int ret, oldtype;
+	__u32 slot;
+
+	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
+
+	ret = XENOMAI_SYSCALL3(sc_cobalt_mq_reserve, mqd, &slot, abs_timeout);
+
+	pthread_setcanceltype(oldtype, NULL);
+
+	if (ret) {
+		errno = -ret;
+		return -1;
+	}
+
+	*slot_r = slot;
+
+	return 0;
+}
+
+/**
+ * @brief Send a message from a reserved slot
+ *
+ * This service queues the message of length @a len which the caller
+ * built in the slot @a slot, obtained from cobalt_mq_reserve(), with
+ * priority @a prio. Ordering and receiver wakeup are the same as
+ * with mq_send(). The slot is owned by the receiving side
+ * afterwards.
+ *
+ * @retval 0 on success;
+ * @retval -1 with @a errno set if:
+ * - EBADF, @a mqd is not a valid descriptor;
+ * - EINVAL, @a slot was not reserved via @a mqd, or @a prio is
+ *   invalid;
+ * - EMSGSIZE, @a len is greater than the @a mq_msgsize attribute.
+ *
+ * @apitags{xthread-only, switch-primary}
+ */
+int cobalt_mq_commit(mqd_t mqd, unsigned int slot, size_t len,
+		     unsigned int prio)
+{
+	int ret;
+
+	if (len > (__u32)-1) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	ret = XENOMAI_SYSCALL4(sc_cobalt_mq_commit, mqd, slot, len, prio);
+	if (ret) {
+		errno = -ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Receive a message in place from a zero-copy message queue
+ *
+ * This service dequeues the message with the highest priority,
+ * blocking like mq_timedreceive() if the queue is empty. The
+ * payload is left in the slot which index is stored at @a slot_r,
+ * and remains valid until the caller gives the slot back with
+ * cobalt_mq_release().
+ *
+ * @param mqd message queue descriptor;
+ *
+ * @param slot_r address where the index of the message slot will be
+ * stored on success;
+ *
+ * @param prio_r if not @a NULL, address where the priority of the
+ * message will be stored on success;
+ *
+ * @param abs_timeout if not @a NULL, the timeout, expressed as an
+ * absolute value of the CLOCK_REALTIME clock.
+ *
+ * @return the message length on success;
+ * @return -1 with @a errno set if:
+ * - EBADF, @a mqd is not a valid descriptor open for reading;
+ * - EINVAL, the queue was not created in zero-copy mode;
+ * - EAGAIN, the queue is empty, and the flag @a O_NONBLOCK is set for
+ *   @a mqd;
+ * - EPERM, the caller context is invalid;
+ * - EINTR, the service was interrupted by a signal;
+ * - ETIMEDOUT, the specified timeout expired.
+ *
+ * @apitags{xthread-only, switch-primary}
+ */
+ssize_t cobalt_mq_consume(mqd_t mqd, unsigned int *slot_r,
+			  unsigned int *prio_r,
+			  const struct timespec *abs_timeout)
+{
+	int ret, oldtype;
+	__u32 slot, len;
+
+	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
+
+	ret = XENOMAI_SYSCALL5(sc_cobalt_mq_consume,
+			       mqd, &slot, &len, prio_r, abs_timeout);
+
+	pthread_setcanceltype(oldtype, NULL);
+
+	if (ret) {
+		errno = -ret;
+		return -1;
+	}
+
+	*slot_r = slot;
+
+	return len;
+}
+
+/**
+ * @brief Give back a message slot
+ *
+ * This service returns the slot @a slot obtained from
+ * cobalt_mq_consume() to the pool, possibly unblocking a sender
+ * waiting for a free slot. It may also be used to cancel a
+ * reservation obtained from cobalt_mq_reserve(). Slots still held
+ * when @a mqd is closed are released automatically.
+ *
+ * @retval 0 on success;
+ * @retval -1 with @a errno set if:
+ * - EBADF, @a mqd is not a valid descriptor;
+ * - EINVAL, @a slot is not held via @a mqd.
+ *
+ * @apitags{xthread-only, switch-primary}
+ */
+int cobalt_mq_release(mqd_t mqd, unsigned int slot)
+{
+	int ret;
+
+	ret = XENOMAI_SYSCALL2(sc_cobalt_mq_release, mqd, slot);
+	if (ret) {
+		errno = -ret;
+		return -1;
+	}
+
+	return 0;
+}
+
 /** @}*/
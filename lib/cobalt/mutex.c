@@ -19,6 +19,7 @@
 #include <string.h>
 #include <limits.h>
 #include <pthread.h>
+#include <boilerplate/atomic.h>
 #include <asm/xenomai/syscall.h>
 #include "current.h"
 #include "internal.h"
@@ -52,6 +53,13 @@
  * Note that only pthread_mutex_init() may be used to initialize a mutex, using
  * the static initializer @a PTHREAD_MUTEX_INITIALIZER is not supported.
  *
+ * When the --mutex-spin=<count> option is given, a thread running in
+ * primary mode which finds a mutex locked busy waits for at most
+ * <count> rounds before sleeping, as long as the owner is running in
+ * primary mode on another CPU and nobody sleeps on the mutex
+ * already. This may save two context switches when critical sections
+ * are short. Spinning is disabled by default.
+ *
  *@{
  */
 
@@ -60,6 +68,8 @@ static union cobalt_mutex_union cobalt_autoinit_mutex_union;
 static pthread_mutex_t *const cobalt_autoinit_mutex =
 	&cobalt_autoinit_mutex_union.native_mutex;
 
+int __cobalt_mutex_spin = 0;
+
 void cobalt_mutex_init(void)
 {
 	struct cobalt_mutex_shadow *_mutex =
@@ -199,6 +209,59 @@ COBALT_IMPL(int, pthread_mutex_destroy, (pthread_mutex_t *mutex))
 	return -err;
 }
 
+/*
+ * Publish the window of the new owner, so that contenders may tell
+ * whether it is running in primary mode.
+ */
+static inline void mutex_set_owner(struct cobalt_mutex_shadow *_mutex)
+{
+	struct xnthread_user_window *u_window = cobalt_get_current_window();
+
+	_mutex->lockcnt = 1;
+	mutex_get_state(_mutex)->owner_winoff =
+		(void *)u_window - cobalt_umm_shared;
+}
+
+/*
+ * Adaptive spinning: busy wait for the mutex to be released for at
+ * most __cobalt_mutex_spin rounds, as long as its owner is observed
+ * running in primary mode on another CPU. This is cheaper than
+ * sleeping and waking up through the kernel for short critical
+ * sections. Give up as soon as the owner is scheduled out, or when
+ * the mutex is claimed, since it would be handed over to the
+ * sleepers on release.
+ */
+static int mutex_spin_acquire(struct cobalt_mutex_shadow *_mutex,
+			      xnhandle_t cur)
+{
+	struct cobalt_mutex_state *state = mutex_get_state(_mutex);
+	struct xnthread_user_window *owner_window;
+	__u32 winoff;
+	xnhandle_t h;
+	int n;
+
+	for (n = 0; n < __cobalt_mutex_spin; n++) {
+		h = atomic_read(&state->owner);
+		if (h == XN_NO_HANDLE) {
+			if (xnsynch_fast_acquire(&state->owner, cur) == 0)
+				return 0;
+			continue;
+		}
+		if (xnsynch_fast_is_claimed(h))
+			break;
+		/* Offset zero is the vdso, never a thread window. */
+		winoff = ACCESS_ONCE(state->owner_winoff);
+		if (winoff == 0)
+			break;
+		owner_window = cobalt_umm_shared + winoff;
+		if (!ACCESS_ONCE(owner_window->oncpu))
+			break;
+		cpu_relax();
+	}
+
+	return -EAGAIN;
+}
+
 static int __attribute__((cold)) cobalt_mutex_autoinit(pthread_mutex_t *mutex)
 {
 	static pthread_mutex_t uninit_normal_mutex =
@@ -311,8 +374,10 @@ start:
 			goto protect;
 fast_path:
 		ret = xnsynch_fast_acquire(mutex_get_ownerp(_mutex), cur);
+		if (ret == -EAGAIN && __cobalt_mutex_spin > 0)
+			ret = mutex_spin_acquire(_mutex, cur);
 		if (ret == 0) {
-			_mutex->lockcnt = 1;
+			mutex_set_owner(_mutex);
 			return 0;
 		}
 	} else {
@@ -346,7 +411,7 @@ slow_path:
 	while (ret == -EINTR);
 
 	if (ret == 0)
-		_mutex->lockcnt = 1;
+		mutex_set_owner(_mutex);
 
 	return -ret;
 protect:	
@@ -422,8 +487,10 @@ start:
 			goto protect;
 fast_path:
 		ret = xnsynch_fast_acquire(mutex_get_ownerp(_mutex), cur);
+		if (ret == -EAGAIN && __cobalt_mutex_spin > 0)
+			ret = mutex_spin_acquire(_mutex, cur);
 		if (ret == 0) {
-			_mutex->lockcnt = 1;
+			mutex_set_owner(_mutex);
 			return 0;
 		}
 	} else {
@@ -458,7 +525,7 @@ slow_path:
 	} while (ret == -EINTR);
 
 	if (ret == 0)
-		_mutex->lockcnt = 1;
+		mutex_set_owner(_mutex);
 	return -ret;
 protect:	
 	u_window = cobalt_get_current_window();
@@ -525,7 +592,7 @@ start:
 fast_path:
 		ret = xnsynch_fast_acquire(mutex_get_ownerp(_mutex), cur);
 		if (ret == 0) {
-			_mutex->lockcnt = 1;
+			mutex_set_owner(_mutex);
 			return 0;
 		}
 	} else {
@@ -555,7 +622,7 @@ slow_path:
 	} while (ret == -EINTR);
 
 	if (ret == 0)
-		_mutex->lockcnt = 1;
+		mutex_set_owner(_mutex);
 
 	return -ret;
 autoinit:
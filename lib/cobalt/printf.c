@@ -42,11 +42,15 @@
 
 #define RT_PRINT_MODE_FORMAT		0
 #define RT_PRINT_MODE_FWRITE		1
+#define RT_PRINT_MODE_DEFER		2
+
+#define RT_PRINT_MAX_SPEC		32
 
 struct entry_head {
 	FILE *dest;
 	uint32_t seq_no;
 	int priority;
+	int mode;
 	size_t len;
 	char data[0];
 } __attribute__((packed));
@@ -74,6 +78,8 @@ int __cobalt_print_bufcount = RT_PRINT_DEFAULT_BUFFERS_COUNT;
 
 int __cobalt_print_syncdelay = RT_PRINT_DEFAULT_SYNCDELAY;
 
+int __cobalt_print_deferred = 0;
+
 static struct print_buffer *first_buffer;
 static int buffers;
 static uint32_t seq_no;
@@ -83,6 +89,8 @@ static pthread_cond_t printer_wakeup;
 static pthread_key_t buffer_key;
 static pthread_key_t cleanup_key;
 static pthread_t printer_thread;
+static char *print_scratch;
+static size_t print_scratch_size;
 static atomic_long_t *pool_bitmap;
 static unsigned pool_bitmap_len;
 static unsigned pool_buf_size;
@@ -91,6 +99,457 @@ static unsigned long pool_start, pool_len;
 static void release_buffer(struct print_buffer *buffer);
 static void print_buffers(void);
 
+/* *** Deferred formatting *** */
+
+/*
+ * In deferred mode, the caller only parses the format string in
+ * order to fetch the arguments, which are stored in the entry along
+ * with the format pointer, so that the printer thread does the
+ * actual formatting. Strings are copied, other arguments are stored
+ * as raw values. Formats this scheme cannot deal with (%n, %m,
+ * positional or wide character arguments) are formatted in place as
+ * usual.
+ *
+ * Since only the pointer is stored, the format string must remain
+ * valid until the entry is printed, which string literals do.
+ */
+
+enum print_arg_type {
+	PRINT_ARG_INT,
+	PRINT_ARG_LONG,
+	PRINT_ARG_LLONG,
+	PRINT_ARG_INTMAX,
+	PRINT_ARG_SIZE,
+	PRINT_ARG_PTRDIFF,
+	PRINT_ARG_DOUBLE,
+	PRINT_ARG_LDOUBLE,
+	PRINT_ARG_PTR,
+	PRINT_ARG_STR,
+};
+
+struct print_spec {
+	const char *start;
+	const char *end;
+	int star_width;
+	int star_prec;
+	int prec;
+	enum print_arg_type type;
+};
+
+/*
+ * Parse the conversion specification starting at @p, which points
+ * at a '%' sign. Return the address of the following character,
+ * NULL if the conversion is not supported in deferred mode.
+ */
+static const char *parse_spec(const char *p, struct print_spec *spec)
+{
+	enum { LEN_NONE, LEN_H, LEN_L, LEN_LL, LEN_J, LEN_Z, LEN_T, LEN_LD } lm;
+
+	spec->start = p++;
+	spec->star_width = 0;
+	spec->star_prec = 0;
+	spec->prec = -1;
+
+	while (*p && strchr("#0- +'", *p))
+		p++;
+
+	if (*p == '*') {
+		spec->star_width = 1;
+		p++;
+	} else
+		while (*p >= '0' && *p <= '9')
+			p++;
+
+	if (*p == '$')
+		return NULL;	/* Positional arguments. */
+
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			spec->star_prec = 1;
+			p++;
+		} else {
+			spec->prec = 0;
+			while (*p >= '0' && *p <= '9')
+				spec->prec = spec->prec * 10 + *p++ - '0';
+		}
+	}
+
+	lm = LEN_NONE;
+	switch (*p) {
+	case 'h':
+		lm = LEN_H;
+		if (*++p == 'h')
+			p++;
+		break;
+	case 'l':
+		lm = LEN_L;
+		if (*++p == 'l') {
+			lm = LEN_LL;
+			p++;
+		}
+		break;
+	case 'q':
+		lm = LEN_LL;
+		p++;
+		break;
+	case 'L':
+		lm = LEN_LD;
+		p++;
+		break;
+	case 'j':
+		lm = LEN_J;
+		p++;
+		break;
+	case 'z':
+		lm = LEN_Z;
+		p++;
+		break;
+	case 't':
+		lm = LEN_T;
+		p++;
+		break;
+	}
+
+	switch (*p) {
+	case 'd':
+	case 'i':
+	case 'o':
+	case 'u':
+	case 'x':
+	case 'X':
+		switch (lm) {
+		case LEN_L:
+			spec->type = PRINT_ARG_LONG;
+			break;
+		case LEN_LL:
+		case LEN_LD:
+			spec->type = PRINT_ARG_LLONG;
+			break;
+		case LEN_J:
+			spec->type = PRINT_ARG_INTMAX;
+			break;
+		case LEN_Z:
+			spec->type = PRINT_ARG_SIZE;
+			break;
+		case LEN_T:
+			spec->type = PRINT_ARG_PTRDIFF;
+			break;
+		default:
+			spec->type = PRINT_ARG_INT;
+		}
+		break;
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		spec->type = lm == LEN_LD ? PRINT_ARG_LDOUBLE : PRINT_ARG_DOUBLE;
+		break;
+	case 'c':
+		if (lm != LEN_NONE)
+			return NULL;
+		spec->type = PRINT_ARG_INT;
+		break;
+	case 's':
+		if (lm != LEN_NONE)
+			return NULL;
+		spec->type = PRINT_ARG_STR;
+		break;
+	case 'p':
+		spec->type = PRINT_ARG_PTR;
+		break;
+	default:
+		return NULL;
+	}
+
+	spec->end = ++p;
+	if (spec->end - spec->start >= RT_PRINT_MAX_SPEC)
+		return NULL;
+
+	return p;
+}
+
+#define defer_arg(__p, __end, __args, __type)			\
+	({							\
+		__type __v = va_arg(__args, __type);		\
+		int __ret = 0;					\
+		if ((__end) - (__p) < (int)sizeof(__v))		\
+			__ret = -ENOSPC;			\
+		else {						\
+			memcpy(__p, &__v, sizeof(__v));		\
+			(__p) += sizeof(__v);			\
+		}						\
+		__ret;						\
+	})
+
+/*
+ * Store the format pointer then the arguments into @data. Return
+ * the number of bytes used, -EINVAL if the format cannot be
+ * deferred, or -ENOSPC if the arguments do not fit.
+ */
+static int __defer_format(char *data, int len, const char *format,
+			  va_list args)
+{
+	char *p = data, *end = data + len;
+	struct print_spec spec;
+	const char *fmt, *s;
+	int ret, prec, n;
+
+	if (len < (int)sizeof(format))
+		return -ENOSPC;
+
+	memcpy(p, &format, sizeof(format));
+	p += sizeof(format);
+
+	for (fmt = format; *fmt; ) {
+		if (*fmt != '%') {
+			fmt++;
+			continue;
+		}
+		if (fmt[1] == '%') {
+			fmt += 2;
+			continue;
+		}
+
+		fmt = parse_spec(fmt, &spec);
+		if (fmt == NULL)
+			return -EINVAL;
+
+		if (spec.star_width) {
+			ret = defer_arg(p, end, args, int);
+			if (ret)
+				return ret;
+		}
+
+		prec = spec.prec;
+		if (spec.star_prec) {
+			prec = va_arg(args, int);
+			if (end - p < (int)sizeof(prec))
+				return -ENOSPC;
+			memcpy(p, &prec, sizeof(prec));
+			p += sizeof(prec);
+		}
+
+		switch (spec.type) {
+		case PRINT_ARG_INT:
+			ret = defer_arg(p, end, args, int);
+			break;
+		case PRINT_ARG_LONG:
+			ret = defer_arg(p, end, args, long);
+			break;
+		case PRINT_ARG_LLONG:
+			ret = defer_arg(p, end, args, long long);
+			break;
+		case PRINT_ARG_INTMAX:
+			ret = defer_arg(p, end, args, intmax_t);
+			break;
+		case PRINT_ARG_SIZE:
+			ret = defer_arg(p, end, args, size_t);
+			break;
+		case PRINT_ARG_PTRDIFF:
+			ret = defer_arg(p, end, args, ptrdiff_t);
+			break;
+		case PRINT_ARG_DOUBLE:
+			ret = defer_arg(p, end, args, double);
+			break;
+		case PRINT_ARG_LDOUBLE:
+			ret = defer_arg(p, end, args, long double);
+			break;
+		case PRINT_ARG_PTR:
+			ret = defer_arg(p, end, args, void *);
+			break;
+		case PRINT_ARG_STR:
+			/* Copy up to the precision, truncate if short of room. */
+			s = va_arg(args, const char *);
+			if (s == NULL)
+				s = "(null)";
+			if (p >= end)
+				return -ENOSPC;
+			n = end - p - 1;
+			if (prec >= 0 && prec < n)
+				n = prec;
+			n = strnlen(s, n);
+			memcpy(p, s, n);
+			p[n] = '\0';
+			p += n + 1;
+			ret = 0;
+			break;
+		}
+		if (ret)
+			return ret;
+	}
+
+	return p - data;
+}
+
+/* Leaves @args untouched, for formatting in place if need be. */
+static int defer_format(char *data, int len, const char *format,
+			va_list args)
+{
+	va_list aq;
+	int ret;
+
+	va_copy(aq, args);
+	ret = __defer_format(data, len, format, aq);
+	va_end(aq);
+
+	return ret;
+}
+
+#define format_arg(__buf, __room, __fmt, __p, __type)		\
+	({							\
+		__type __v;					\
+		memcpy(&__v, __p, sizeof(__v));			\
+		snprintf(__buf, __room, __fmt, __v);		\
+	})
+
+static int format_one(char *buf, size_t room, const char *subfmt,
+		      enum print_arg_type type, const char *p)
+{
+	switch (type) {
+	case PRINT_ARG_INT:
+		return format_arg(buf, room, subfmt, p, int);
+	case PRINT_ARG_LONG:
+		return format_arg(buf, room, subfmt, p, long);
+	case PRINT_ARG_LLONG:
+		return format_arg(buf, room, subfmt, p, long long);
+	case PRINT_ARG_INTMAX:
+		return format_arg(buf, room, subfmt, p, intmax_t);
+	case PRINT_ARG_SIZE:
+		return format_arg(buf, room, subfmt, p, size_t);
+	case PRINT_ARG_PTRDIFF:
+		return format_arg(buf, room, subfmt, p, ptrdiff_t);
+	case PRINT_ARG_DOUBLE:
+		return format_arg(buf, room, subfmt, p, double);
+	case PRINT_ARG_LDOUBLE:
+		return format_arg(buf, room, subfmt, p, long double);
+	case PRINT_ARG_PTR:
+		return format_arg(buf, room, subfmt, p, void *);
+	default:
+		return snprintf(buf, room, subfmt, p);
+	}
+}
+
+static size_t arg_size(enum print_arg_type type, const char *p)
+{
+	switch (type) {
+	case PRINT_ARG_INT:
+		return sizeof(int);
+	case PRINT_ARG_LONG:
+		return sizeof(long);
+	case PRINT_ARG_LLONG:
+		return sizeof(long long);
+	case PRINT_ARG_INTMAX:
+		return sizeof(intmax_t);
+	case PRINT_ARG_SIZE:
+		return sizeof(size_t);
+	case PRINT_ARG_PTRDIFF:
+		return sizeof(ptrdiff_t);
+	case PRINT_ARG_DOUBLE:
+		return sizeof(double);
+	case PRINT_ARG_LDOUBLE:
+		return sizeof(long double);
+	case PRINT_ARG_PTR:
+		return sizeof(void *);
+	default:
+		return strlen(p) + 1;
+	}
+}
+
+static int grow_scratch(size_t size)
+{
+	char *p;
+
+	if (size <= print_scratch_size)
+		return 0;
+
+	p = realloc(print_scratch, size);
+	if (p == NULL)
+		return -ENOMEM;
+
+	print_scratch = p;
+	print_scratch_size = size;
+
+	return 0;
+}
+
+/*
+ * Format a deferred entry into the scratch buffer, which belongs to
+ * whoever holds buffer_lock. Return the length of the text, or -1
+ * on error.
+ */
+static int format_deferred(const char *data)
+{
+	char subfmt[RT_PRINT_MAX_SPEC + 2 * 11], *q;
+	const char *p = data, *fmt, *lit, *s;
+	int n, width = 0, prec = 0;
+	struct print_spec spec;
+	size_t pos = 0;
+
+	memcpy(&fmt, p, sizeof(fmt));
+	p += sizeof(fmt);
+
+	for (;;) {
+		/* Copy the literal text up to the next conversion. */
+		for (lit = fmt; *fmt && (*fmt != '%' || fmt[1] == '%'); )
+			fmt += *fmt == '%' ? 2 : 1;
+
+		if (grow_scratch(pos + (fmt - lit) + 1))
+			return -1;
+
+		for (; lit < fmt; lit++) {
+			print_scratch[pos++] = *lit;
+			if (*lit == '%')
+				lit++;
+		}
+
+		if (*fmt == '\0')
+			break;
+
+		/* The caller checked the format already. */
+		fmt = parse_spec(fmt, &spec);
+
+		/* Rebuild the specification with the '*' values. */
+		if (spec.star_width) {
+			memcpy(&width, p, sizeof(width));
+			p += sizeof(width);
+		}
+		if (spec.star_prec) {
+			memcpy(&prec, p, sizeof(prec));
+			p += sizeof(prec);
+		}
+		for (q = subfmt, s = spec.start; s < spec.end; s++) {
+			if (*s == '*')
+				q += sprintf(q, "%d", s[-1] == '.' ? prec : width);
+			else
+				*q++ = *s;
+		}
+		*q = '\0';
+
+		n = format_one(print_scratch + pos, print_scratch_size - pos,
+			       subfmt, spec.type, p);
+		if (n < 0)
+			return -1;
+		if (pos + n >= print_scratch_size) {
+			if (grow_scratch(pos + n + 1))
+				return -1;
+			format_one(print_scratch + pos,
+				   print_scratch_size - pos,
+				   subfmt, spec.type, p);
+		}
+		pos += n;
+		p += arg_size(spec.type, p);
+	}
+
+	print_scratch[pos] = '\0';
+
+	return pos;
+}
+
 /* *** rt_print API *** */
 
 static int 
@@ -149,7 +608,13 @@ vprint_to_buffer(FILE *stream, int fortify_level, int priority,
 
 	head = buffer->ring + write_pos;
 
-	if (mode == RT_PRINT_MODE_FORMAT) {
+	if (mode == RT_PRINT_MODE_FORMAT && __cobalt_print_deferred &&
+	    (res = defer_format(head->data, len, format, args)) != -EINVAL) {
+		/* Dropped if short of room, like truncated text. */
+		mode = RT_PRINT_MODE_DEFER;
+		len = res > 0 ? res : 0;
+		res = 0;
+	} else if (mode == RT_PRINT_MODE_FORMAT) {
 		if (stream != RT_PRINT_SYSLOG_STREAM) {
 			/* We do not need the terminating \0 */
 #ifdef CONFIG_XENO_FORTIFY
@@ -204,6 +669,7 @@ vprint_to_buffer(FILE *stream, int fortify_level, int priority,
 	if (len > 0) {
 		head->seq_no = ++seq_no;
 		head->priority = priority;
+		head->mode = mode;
 		head->dest = stream;
 		head->len = len;
 
@@ -591,7 +1057,20 @@ static void print_buffers(void)
 		head = buffer->ring + read_pos;
 		len = head->len;
 
-		if (len) {
+		if (len && head->mode == RT_PRINT_MODE_DEFER) {
+			/* Format the entry on behalf of its writer */
+			ret = format_deferred(head->data);
+			if (ret > 0) {
+				if (head->dest == RT_PRINT_SYSLOG_STREAM)
+					syslog(head->priority,
+					       "%s", print_scratch);
+				else
+					ret = fwrite(print_scratch,
+						     ret, 1, head->dest);
+			}
+
+			read_pos += sizeof(*head) + len;
+		} else if (len) {
 			/* Print out non-empty entry and proceed */
 			/* Check if output goes to syslog */
 			if (head->dest == RT_PRINT_SYSLOG_STREAM) {
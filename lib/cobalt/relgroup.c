@@ -0,0 +1,148 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <asm/xenomai/syscall.h>
+#include "internal.h"
+
+/*
+ * Periodic release groups. Threads running at harmonic rates share
+ * the timer of a group, so that a single timer shot releases all
+ * members due at the same point, by decreasing priority order.
+ *
+ * A group is created with a base period and an absolute date for
+ * its first release, measured against @a clock_id. Each member then
+ * joins with a period multiplier, and calls cobalt_relgroup_wait()
+ * at the end of every cycle. The first release of a member is the
+ * next group release which is a multiple of its period multiplier,
+ * counting from the first release of the group.
+ */
+
+/**
+ * Create a release group.
+ *
+ * @param clock_id The clock the group timer is based on.
+ *
+ * @param idate The absolute date of the first release. If NULL or
+ * zero, the first release happens one period from now.
+ *
+ * @param period The base period of the group, must not be zero.
+ *
+ * @return A file descriptor referring to the group upon success,
+ * -1 otherwise, with errno set.
+ */
+int cobalt_relgroup_create(clockid_t clock_id,
+			   const struct timespec *idate,
+			   const struct timespec *period)
+{
+	struct itimerspec its;
+	int fd;
+
+	memset(&its, 0, sizeof(its));
+	if (idate)
+		its.it_value = *idate;
+	its.it_interval = *period;
+
+	fd = XENOMAI_SYSCALL2(sc_cobalt_relgroup_create, clock_id, &its);
+	if (fd < 0) {
+		errno = -fd;
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * Delete a release group. Members waiting for their next release
+ * are unblocked with EIDRM, and are detached from the group.
+ */
+int cobalt_relgroup_destroy(int gfd)
+{
+	int ret;
+
+	ret = XENOMAI_SYSCALL1(sc_cobalt_close, gfd);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Attach the calling thread to a release group, with a period of
+ * @a multiplier times the base period of the group. This is a
+ * primary mode service.
+ */
+int cobalt_relgroup_join(int gfd, unsigned int multiplier)
+{
+	int ret;
+
+	if (gfd < 0) {
+		errno = EBADF;
+		return -1;
+	}
+
+	ret = XENOMAI_SYSCALL2(sc_cobalt_relgroup_join, gfd, multiplier);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Detach the calling thread from its release group, if any.
+ */
+int cobalt_relgroup_leave(void)
+{
+	int ret;
+
+	ret = XENOMAI_SYSCALL2(sc_cobalt_relgroup_join, -1, 0);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Wait for the next release point of the calling thread. If @a
+ * overruns_r is non-NULL, the count of missed release points is
+ * copied back to this location on success or ETIMEDOUT.
+ *
+ * @return 0 on success, -1 otherwise with errno set to:
+ *
+ * - EWOULDBLOCK if the caller did not join any release group.
+ * - EINTR if the caller was unblocked before its release point.
+ * - EIDRM if the group was deleted while the caller was waiting.
+ * - ETIMEDOUT if one or more release points were missed.
+ */
+int cobalt_relgroup_wait(unsigned long *overruns_r)
+{
+	int ret;
+
+	ret = XENOMAI_SYSCALL1(sc_cobalt_relgroup_wait, overruns_r);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return 0;
+}
@@ -258,8 +258,8 @@ COBALT_IMPL(int, sched_setscheduler, (pid_t pid, int policy,
  * assumed.
  *
  * @param policy scheduling policy, one of SCHED_WEAK, SCHED_FIFO,
- * SCHED_COBALT, SCHED_RR, SCHED_SPORADIC, SCHED_TP, SCHED_QUOTA or
- * SCHED_NORMAL;
+ * SCHED_COBALT, SCHED_RR, SCHED_SPORADIC, SCHED_TP, SCHED_QUOTA,
+ * SCHED_EDF or SCHED_NORMAL;
  *
  * @param param_ex address of scheduling parameters. As a special
  * exception, a negative sched_priority value is interpreted as if
@@ -270,6 +270,13 @@ COBALT_IMPL(int, sched_setscheduler, (pid_t pid, int policy,
  * priority levels in the [0..99] range (inclusive). Otherwise,
  * sched_priority must be zero for the SCHED_WEAK policy.
  *
+ * SCHED_EDF threads are scheduled by earliest absolute deadline,
+ * ahead of all fixed priority policies. The runtime, relative
+ * deadline and period of the thread are given by the
+ * sched_edf_runtime, sched_edf_deadline and sched_edf_period fields
+ * of @a param_ex, such that 0 < runtime <= deadline <= period.
+ * sched_priority is only used to order waiters on resources.
+ *
  * @return 0 on success;
  * @return an error number if:
  * - ESRCH, @a pid is not found;
@@ -278,6 +285,9 @@ COBALT_IMPL(int, sched_setscheduler, (pid_t pid, int policy,
  * - EAGAIN, insufficient memory available from the system heap,
  *   increase CONFIG_XENO_OPT_SYS_HEAPSZ;
  * - EFAULT, @a param_ex is an invalid address;
+ * - EBUSY, with @a policy equal to SCHED_EDF, if admitting the
+ *   requested bandwidth would exceed CONFIG_XENO_OPT_SCHED_EDF_MAXUTIL
+ *   on the CPU the target thread runs on;
  *
  * @note
  *
@@ -46,3 +46,50 @@ COBALT_IMPL(int, select, (int __nfds, fd_set *__restrict __readfds,
 	errno = -err;
 	return -1;
 }
+
+int cobalt_selector_create(int flags)
+{
+	int fd;
+
+	fd = XENOMAI_SYSCALL1(sc_cobalt_selector_create, flags);
+	if (fd < 0) {
+		errno = -fd;
+		return -1;
+	}
+
+	return fd;
+}
+
+int cobalt_selector_ctl(int sfd, int op, int fd,
+			struct cobalt_selector_event *ev)
+{
+	int ret;
+
+	ret = XENOMAI_SYSCALL4(sc_cobalt_selector_ctl, sfd, op, fd, ev);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+int cobalt_selector_wait(int sfd, struct cobalt_selector_event *events,
+			 int maxevents, const struct timespec *timeout)
+{
+	int ret, oldtype;
+
+	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
+
+	ret = XENOMAI_SYSCALL4(sc_cobalt_selector_wait,
+			       sfd, events, maxevents, timeout);
+
+	pthread_setcanceltype(oldtype, NULL);
+
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return ret;
+}
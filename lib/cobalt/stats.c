@@ -0,0 +1,211 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <rtdm/rtdm.h>
+#include <boilerplate/atomic.h>
+#include <cobalt/sys/cobalt.h>
+#include "internal.h"
+
+/*
+ * Reader side of the binary statistics map. Once mapped, the
+ * records are sampled directly from memory, no syscall is involved
+ * and the kernel is not perturbed by the readers, which may poll
+ * the statistics as often as they see fit.
+ */
+
+#define STATS_DEVICE  "/dev/rtdm/" COBALT_STATS_DEV
+
+static inline const struct cobalt_stats_thread *
+thread_record(const struct cobalt_stats_header *h, unsigned int slot)
+{
+	return (const void *)h + h->thread_offset + slot * h->thread_size;
+}
+
+static inline const struct cobalt_stats_cpu *
+cpu_record(const struct cobalt_stats_header *h, unsigned int cpu)
+{
+	return (const void *)h + h->cpu_offset + cpu * h->cpu_size;
+}
+
+/*
+ * The kernel may update the records we are reading from any CPU,
+ * including ours when the reader is preempted, so we need the
+ * compiler barrier on UP as well.
+ */
+static inline __u32 read_begin(const __u32 *seq)
+{
+	__u32 s;
+
+	while ((s = ACCESS_ONCE(*seq)) & 1)
+		cpu_relax();
+
+	smp_rmb();
+	compiler_barrier();
+
+	return s;
+}
+
+static inline int read_retry(const __u32 *seq, __u32 s)
+{
+	smp_rmb();
+	compiler_barrier();
+
+	return ACCESS_ONCE(*seq) != s;
+}
+
+int cobalt_stats_open(struct cobalt_stats *st)
+{
+	struct cobalt_stats_header h;
+	int fd, ret;
+	void *map;
+
+	fd = __RT(open(STATS_DEVICE, O_RDONLY));
+	if (fd < 0)
+		return -1;
+
+	ret = __RT(ioctl(fd, STATS_RTIOC_INFO, &h));
+	if (ret)
+		goto fail;
+
+	/* Records may only grow in later versions. */
+	if (h.magic != COBALT_STATS_MAGIC ||
+	    h.thread_size < sizeof(struct cobalt_stats_thread) ||
+	    h.cpu_size < sizeof(struct cobalt_stats_cpu)) {
+		errno = EPROTO;
+		goto fail;
+	}
+
+	map = __RT(mmap(NULL, h.map_size, PROT_READ, MAP_SHARED, fd, 0));
+	if (map == MAP_FAILED)
+		goto fail;
+
+	__RT(close(fd));
+	st->header = map;
+
+	return 0;
+fail:
+	ret = errno;
+	__RT(close(fd));
+	errno = ret;
+
+	return -1;
+}
+
+void cobalt_stats_close(struct cobalt_stats *st)
+{
+	munmap((void *)st->header, st->header->map_size);
+	st->header = NULL;
+}
+
+int cobalt_stats_read_thread(struct cobalt_stats *st, unsigned int slot,
+			     struct cobalt_stats_threadinfo *ti)
+{
+	const struct cobalt_stats_header *h = st->header;
+	const struct cobalt_stats_thread *p;
+	const struct cobalt_stats_cpu *c;
+	struct cobalt_stats_thread rec;
+	__u32 seq, cseq, cpu;
+	xnticks_t date = 0;
+	xnsticks_t delta;
+	int curr, running;
+
+	if (slot >= h->nr_slots) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/*
+	 * The slot does not tell which CPU a thread migrated to
+	 * until it is switched out there, so look for it on all of
+	 * them. If it was switched out meanwhile, start over.
+	 */
+	p = thread_record(h, slot);
+	do {
+		seq = read_begin(&p->seq);
+		memcpy(&rec, p, sizeof(rec));
+		running = -1;
+		for (cpu = 0; cpu < h->nr_cpus && running < 0; cpu++) {
+			c = cpu_record(h, cpu);
+			do {
+				cseq = read_begin(&c->seq);
+				curr = c->curr;
+				date = c->switch_date;
+			} while (read_retry(&c->seq, cseq));
+			if (curr == (int)slot)
+				running = cpu;
+		}
+	} while (read_retry(&p->seq, seq));
+
+	if ((rec.flags & COBALT_STATS_SLOT_USED) == 0) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	/* Count the time spent running since the last switch in. */
+	if (running >= 0) {
+		rec.cpu = running;
+		delta = cobalt_read_hrclock() - date;
+		if (delta > 0)
+			rec.exectime += delta;
+	}
+
+	ti->pid = rec.pid;
+	ti->cpu = rec.cpu;
+	ti->cprio = rec.cprio;
+	ti->status = rec.state;
+	ti->xtime = cobalt_ticks_to_ns(rec.exectime);
+	ti->msw = rec.msw;
+	ti->csw = rec.csw;
+	ti->xsc = rec.xsc;
+	ti->pf = rec.pf;
+	memcpy(ti->name, rec.name, sizeof(ti->name));
+	ti->name[sizeof(ti->name) - 1] = '\0';
+
+	return 0;
+}
+
+int cobalt_stats_read_cpu(struct cobalt_stats *st, unsigned int cpu,
+			  struct cobalt_stats_cpuinfo *ci)
+{
+	const struct cobalt_stats_header *h = st->header;
+	const struct cobalt_stats_cpu *c;
+	xnsticks_t delta;
+	xnticks_t date;
+	__u32 seq;
+
+	if (cpu >= h->nr_cpus) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	c = cpu_record(h, cpu);
+	do {
+		seq = read_begin(&c->seq);
+		ci->curr = c->curr;
+		ci->csw = c->csw;
+		date = c->switch_date;
+	} while (read_retry(&c->seq, seq));
+
+	delta = cobalt_read_hrclock() - date;
+	ci->runtime = delta > 0 ? cobalt_ticks_to_ns(delta) : 0;
+
+	return 0;
+}
@@ -349,6 +349,15 @@ COBALT_IMPL(int, pthread_create, (pthread_t *ptid_r,
  *   scheduler lock owner would return with EINTR immediately from any
  *   blocking call instead (see PTHREAD_WARNSW notifications).
  *
+ * - PTHREAD_CLUSTER allows the Cobalt scheduler to move the current
+ *   thread to another CPU of its affinity set while it runs in
+ *   primary mode, whenever it is ready to run but preempted on its
+ *   own CPU, and another CPU from the set idles or runs a lower
+ *   priority thread. The affinity set of the thread defines its
+ *   cluster. This mode bit is only available if the Cobalt core was
+ *   built with CONFIG_XENO_OPT_SCHED_CLUSTER enabled, and only
+ *   affects SCHED_FIFO and SCHED_RR threads.
+ *
  * - PTHREAD_CONFORMING can be passed in @a setmask to switch the
  *   current Cobalt thread to its preferred runtime mode. The only
  *   meaningful use of this switch is to force a real-time thread back
@@ -367,7 +376,9 @@ COBALT_IMPL(int, pthread_create, (pthread_t *ptid_r,
  *
  * @return 0 on success, otherwise:
  *
- * - EINVAL, some bit in @a clrmask or @a setmask is invalid.
+ * - EINVAL, some bit in @a clrmask or @a setmask is invalid, or
+ * PTHREAD_CLUSTER was passed although cluster scheduling is not
+ * enabled in the Cobalt core.
  *
  * @note Setting @a clrmask and @a setmask to zero leads to a nop,
  * only returning the previous mode if @a mode_r is a valid address.
@@ -570,8 +581,8 @@ COBALT_IMPL(int, pthread_setschedparam, (pthread_t thread,
  * @param thread target Cobalt thread;
  *
  * @param policy scheduling policy, one of SCHED_WEAK, SCHED_FIFO,
- * SCHED_COBALT, SCHED_RR, SCHED_SPORADIC, SCHED_TP, SCHED_QUOTA or
- * SCHED_NORMAL;
+ * SCHED_COBALT, SCHED_RR, SCHED_SPORADIC, SCHED_TP, SCHED_QUOTA,
+ * SCHED_EDF or SCHED_NORMAL;
  *
  * @param param_ex scheduling parameters address. As a special
  * exception, a negative sched_priority value is interpreted as if
@@ -582,6 +593,13 @@ COBALT_IMPL(int, pthread_setschedparam, (pthread_t thread,
  * priority levels in the [0..99] range (inclusive). Otherwise,
  * sched_priority must be zero for the SCHED_WEAK policy.
  *
+ * SCHED_EDF threads are scheduled by earliest absolute deadline,
+ * ahead of all fixed priority policies. The runtime, relative
+ * deadline and period of the thread are given by the
+ * sched_edf_runtime, sched_edf_deadline and sched_edf_period fields
+ * of @a param_ex, such that 0 < runtime <= deadline <= period.
+ * sched_priority is only used to order waiters on resources.
+ *
  * @return 0 on success;
  * @return an error number if:
  * - ESRCH, @a thread is invalid;
@@ -589,6 +607,9 @@ COBALT_IMPL(int, pthread_setschedparam, (pthread_t thread,
  * - EAGAIN, insufficient memory available from the system heap,
  *   increase CONFIG_XENO_OPT_SYS_HEAPSZ;
  * - EFAULT, @a param_ex is an invalid address;
+ * - EBUSY, with @a policy equal to SCHED_EDF, if admitting the
+ *   requested bandwidth would exceed CONFIG_XENO_OPT_SCHED_EDF_MAXUTIL
+ *   on the CPU the target thread runs on;
  * - EPERM, the calling process does not have superuser
  *   permissions.
  *
@@ -175,6 +175,11 @@ int open_threads(struct fsobj *fsobj, void *priv)
 			sched_class = "quota";
 			break;
 #endif
+#ifdef SCHED_EDF
+		case SCHED_EDF:
+			sched_class = "edf";
+			break;
+#endif
 #ifdef SCHED_QUOTA
 		case SCHED_WEAK:
 			sched_class = "weak";
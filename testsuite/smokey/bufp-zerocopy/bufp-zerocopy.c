@@ -0,0 +1,463 @@
+/*
+ * RTIPC/BUFP zero-copy test.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <error.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <smokey/smokey.h>
+#include <rtdm/ipc.h>
+
+smokey_test_plugin(bufp_zerocopy,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(bufsz),
+			   SMOKEY_INT(chunk),
+			   SMOKEY_INT(total),
+		   ),
+   "Check the zero-copy mode of BUFP sockets. The buffer of a BUFP\n"
+   "\tsocket is mapped by both ends, which exchange data in place\n"
+   "\tthrough acquired spans, keeping the blocking semantics of\n"
+   "\tregular send and receive operations. The same stream is then\n"
+   "\tpassed with send()/recv() and through spans, and the throughput\n"
+   "\tof both runs is reported.\n\n"
+   "\tbufsz=<kbytes>\tbuffer size (default 1024)\n"
+   "\tchunk=<bytes>\ttransfer unit (default 65536)\n"
+   "\ttotal=<mbytes>\tstream length per run (default 256)"
+);
+
+static size_t bufsz = 1024 * 1024;
+
+static size_t chunk = 65536;
+
+static unsigned long long total = 256 * 1024 * 1024ULL;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int open_pair(size_t len, int *rs_r, int *ws_r)
+{
+	struct sockaddr_ipc saddr;
+	socklen_t addrlen;
+	int rs, ws;
+
+	rs = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_BUFP);
+	if (rs < 0)
+		return -errno;
+
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sipc_family = AF_RTIPC;
+	saddr.sipc_port = -1;
+	addrlen = sizeof(saddr);
+	if (setsockopt(rs, SOL_BUFP, BUFP_BUFSZ, &len, sizeof(len)) ||
+	    bind(rs, (struct sockaddr *)&saddr, sizeof(saddr)) ||
+	    getsockname(rs, (struct sockaddr *)&saddr, &addrlen))
+		goto fail;
+
+	ws = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_BUFP);
+	if (ws < 0)
+		goto fail;
+
+	if (connect(ws, (struct sockaddr *)&saddr, sizeof(saddr))) {
+		close(ws);
+		goto fail;
+	}
+
+	*rs_r = rs;
+	*ws_r = ws;
+
+	return 0;
+fail:
+	close(rs);
+
+	return -errno;
+}
+
+static char *map_buffer(int s, size_t len)
+{
+	void *p;
+
+	/* The buffer is mapped twice in a row. */
+	p = mmap(NULL, len * 2, PROT_READ|PROT_WRITE, MAP_SHARED, s, 0);
+
+	return p == MAP_FAILED ? NULL : p;
+}
+
+static int check_semantics(void)
+{
+	struct sockaddr_ipc saddr;
+	struct bufp_span span;
+	char *rmap, *wmap;
+	socklen_t addrlen;
+	size_t len, off;
+	char buf[256];
+	int rs, ws, n;
+
+	len = getpagesize() * 4;
+	n = open_pair(len, &rs, &ws);
+	if (n) {
+		if (n == -EAFNOSUPPORT)
+			return -ENOSYS;
+		error(1, -n, "open_pair");
+	}
+
+	wmap = map_buffer(ws, len);
+	if (wmap == NULL) {
+		if (errno == ENODEV) {
+			smokey_note("bufp_zerocopy skipped (no kernel support)");
+			return -ENOSYS;
+		}
+		error(1, errno, "mmap(writer)");
+	}
+	rmap = map_buffer(rs, len);
+	if (rmap == NULL)
+		error(1, errno, "mmap(reader)");
+
+	/* Only double mappings are allowed. */
+	if (!smokey_assert(mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED,
+				ws, 0) == MAP_FAILED && errno == EINVAL))
+		return -EPROTO;
+
+	memset(&span, 0, sizeof(span));
+	span.len = len + 1;
+	if (!smokey_assert(ioctl(ws, BUFP_WRACQUIRE, &span) == -1 &&
+			   errno == EINVAL))
+		return -EPROTO;
+	if (!smokey_assert(ioctl(rs, BUFP_RDCOMMIT, &span) == -1 &&
+			   errno == EINVAL))
+		return -EPROTO;
+
+	/* A write span covers all the free room. */
+	span.len = 100;
+	if (smokey_check_errno(ioctl(ws, BUFP_WRACQUIRE, &span)) < 0)
+		return -EPROTO;
+	if (!smokey_assert(span.offset == 0 && span.len == len))
+		return -EPROTO;
+	if (!smokey_assert(ioctl(ws, BUFP_WRACQUIRE, &span) == -1 &&
+			   errno == EBUSY))
+		return -EPROTO;
+	/* Copying writers are held off until the span is committed. */
+	if (!smokey_assert(send(ws, buf, 1, MSG_DONTWAIT) == -1 &&
+			   errno == EWOULDBLOCK))
+		return -EPROTO;
+	memset(wmap + span.offset, 'a', 100);
+	span.len = 100;
+	if (smokey_check_errno(ioctl(ws, BUFP_WRCOMMIT, &span)) < 0)
+		return -EPROTO;
+
+	span.len = 200;
+	span.flags = MSG_DONTWAIT;
+	if (!smokey_assert(ioctl(rs, BUFP_RDACQUIRE, &span) == -1 &&
+			   errno == EWOULDBLOCK))
+		return -EPROTO;
+
+	/* A read span covers all the pending data. */
+	span.len = 1;
+	if (smokey_check_errno(ioctl(rs, BUFP_RDACQUIRE, &span)) < 0)
+		return -EPROTO;
+	if (!smokey_assert(span.offset == 0 && span.len == 100 &&
+			   rmap[0] == 'a' && rmap[99] == 'a'))
+		return -EPROTO;
+	/* Copying readers are held off until the span is committed. */
+	if (!smokey_assert(recv(rs, buf, 1, MSG_DONTWAIT) == -1 &&
+			   errno == EWOULDBLOCK))
+		return -EPROTO;
+	if (smokey_check_errno(ioctl(rs, BUFP_RDCOMMIT, &span)) < 0)
+		return -EPROTO;
+
+	/* Move close to the end of the buffer. */
+	for (off = 100; off < len - 50; off += n) {
+		n = len - 50 - off;
+		if (n > sizeof(buf))
+			n = sizeof(buf);
+		if (!smokey_assert(send(ws, buf, n, 0) == n) ||
+		    !smokey_assert(recv(rs, buf, n, 0) == n))
+			return -EPROTO;
+	}
+
+	/* Spans wrapping at the end are contiguous. */
+	span.len = sizeof(buf);
+	span.flags = 0;
+	if (smokey_check_errno(ioctl(ws, BUFP_WRACQUIRE, &span)) < 0)
+		return -EPROTO;
+	if (!smokey_assert(span.offset + sizeof(buf) > len))
+		return -EPROTO;
+	for (n = 0; n < sizeof(buf); n++)
+		wmap[span.offset + n] = n;
+	span.len = sizeof(buf);
+	if (smokey_check_errno(ioctl(ws, BUFP_WRCOMMIT, &span)) < 0)
+		return -EPROTO;
+	if (!smokey_assert(recv(rs, buf, sizeof(buf), 0) == sizeof(buf)))
+		return -EPROTO;
+	for (n = 0; n < sizeof(buf); n++)
+		if (!smokey_assert(buf[n] == (char)n))
+			return -EPROTO;
+
+	/* Spans held by a closed socket are dropped. */
+	addrlen = sizeof(saddr);
+	if (smokey_check_errno(getpeername(ws, (struct sockaddr *)&saddr,
+					   &addrlen)) < 0)
+		return -EPROTO;
+	span.len = 1;
+	if (smokey_check_errno(ioctl(ws, BUFP_WRACQUIRE, &span)) < 0)
+		return -EPROTO;
+	munmap(wmap, len * 2);
+	close(ws);
+	ws = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_BUFP);
+	if (ws < 0)
+		error(1, errno, "socket");
+	if (smokey_check_errno(connect(ws, (struct sockaddr *)&saddr,
+				       sizeof(saddr))) < 0)
+		return -EPROTO;
+	if (smokey_check_errno(send(ws, buf, 1, MSG_DONTWAIT)) < 0)
+		return -EPROTO;
+
+	munmap(rmap, len * 2);
+	close(ws);
+	close(rs);
+
+	return 0;
+}
+
+struct run {
+	int rs;
+	char *rmap;
+	unsigned long sum;
+	int err;
+};
+
+static void *copy_reader(void *arg)
+{
+	unsigned long long n;
+	struct run *r = arg;
+	char *buf;
+
+	buf = malloc(chunk);
+	if (buf == NULL) {
+		r->err = ENOMEM;
+		return NULL;
+	}
+
+	for (n = 0; n < total; n += chunk) {
+		if (recv(r->rs, buf, chunk, 0) != chunk) {
+			r->err = errno ?: EPROTO;
+			break;
+		}
+		r->sum += buf[0] + buf[chunk - 1];
+	}
+
+	free(buf);
+
+	return NULL;
+}
+
+static void *zc_reader(void *arg)
+{
+	struct bufp_span span;
+	unsigned long long n;
+	struct run *r = arg;
+	size_t off;
+	char *p;
+
+	memset(&span, 0, sizeof(span));
+
+	for (n = 0; n < total; n += span.len) {
+		span.len = chunk;
+		if (ioctl(r->rs, BUFP_RDACQUIRE, &span)) {
+			r->err = errno;
+			break;
+		}
+		/* Consume all the complete chunks available. */
+		p = r->rmap + span.offset;
+		for (off = 0; off + chunk <= span.len; off += chunk)
+			r->sum += p[off] + p[off + chunk - 1];
+		span.len = off;
+		if (ioctl(r->rs, BUFP_RDCOMMIT, &span)) {
+			r->err = errno;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static int write_stream(int ws, char *wmap, unsigned long *sum_r)
+{
+	unsigned long long n = 0;
+	struct bufp_span span;
+	unsigned int seq = 0;
+	char *buf = NULL;
+	size_t off;
+
+	memset(&span, 0, sizeof(span));
+
+	if (wmap == NULL) {
+		buf = malloc(chunk);
+		if (buf == NULL)
+			return ENOMEM;
+	}
+
+	while (n < total) {
+		if (buf) {
+			memset(buf, seq, chunk);
+			if (send(ws, buf, chunk, 0) != chunk)
+				goto fail;
+			*sum_r += (char)seq * 2;
+			seq++;
+			n += chunk;
+			continue;
+		}
+		span.len = chunk;
+		if (ioctl(ws, BUFP_WRACQUIRE, &span))
+			goto fail;
+		/* Fill all the complete chunks which fit. */
+		for (off = 0; off + chunk <= span.len && n < total;
+		     off += chunk, n += chunk, seq++) {
+			memset(wmap + span.offset + off, seq, chunk);
+			*sum_r += (char)seq * 2;
+		}
+		span.len = off;
+		if (ioctl(ws, BUFP_WRCOMMIT, &span))
+			goto fail;
+	}
+
+	free(buf);
+
+	return 0;
+fail:
+	free(buf);
+
+	return errno ?: EPROTO;
+}
+
+static int run_stream(int zerocopy)
+{
+	struct sched_param param;
+	char *wmap = NULL;
+	unsigned long sum = 0;
+	pthread_attr_t attr;
+	long long start, ns;
+	struct run r;
+	pthread_t tid;
+	int ws, ret;
+
+	memset(&r, 0, sizeof(r));
+	ret = open_pair(bufsz, &r.rs, &ws);
+	if (ret)
+		return -ret;
+
+	if (zerocopy) {
+		wmap = map_buffer(ws, bufsz);
+		r.rmap = map_buffer(r.rs, bufsz);
+		if (wmap == NULL || r.rmap == NULL) {
+			ret = errno;
+			goto out;
+		}
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = 50;
+	pthread_attr_setschedparam(&attr, &param);
+	ret = pthread_create(&tid, &attr,
+			     zerocopy ? zc_reader : copy_reader, &r);
+	pthread_attr_destroy(&attr);
+	if (ret)
+		goto out;
+
+	start = now_ns();
+	ret = write_stream(ws, wmap, &sum);
+	if (ret)
+		pthread_cancel(tid);
+	pthread_join(tid, NULL);
+	ns = now_ns() - start;
+
+	if (ret == 0)
+		ret = r.err;
+	if (ret == 0) {
+		smokey_trace("%s: %llu MB in %zu byte chunks in %.3f ms, "
+			     "%.1f MB/s",
+			     zerocopy ? "zero-copy" : "copy", total >> 20, chunk,
+			     ns / 1000000.0, total * 1000.0 / ns);
+		if (!smokey_assert(r.sum == sum))
+			ret = EPROTO;
+	}
+out:
+	if (wmap)
+		munmap(wmap, bufsz * 2);
+	if (r.rmap)
+		munmap(r.rmap, bufsz * 2);
+	close(ws);
+	close(r.rs);
+
+	return ret;
+}
+
+static int run_bufp_zerocopy(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct sched_param param;
+	int ret, kb;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(bufp_zerocopy, bufsz)) {
+		kb = SMOKEY_ARG_INT(bufp_zerocopy, bufsz);
+		if (kb <= 0 || (kb * 1024) % getpagesize())
+			error(1, EINVAL, "bufsz=%d", kb);
+		bufsz = kb * 1024UL;
+	}
+
+	if (SMOKEY_ARG_ISSET(bufp_zerocopy, chunk)) {
+		if (SMOKEY_ARG_INT(bufp_zerocopy, chunk) <= 0)
+			error(1, EINVAL, "chunk=%d",
+			      SMOKEY_ARG_INT(bufp_zerocopy, chunk));
+		chunk = SMOKEY_ARG_INT(bufp_zerocopy, chunk);
+	}
+	if (chunk > bufsz)
+		error(1, EINVAL, "chunk=%zu", chunk);
+
+	if (SMOKEY_ARG_ISSET(bufp_zerocopy, total)) {
+		if (SMOKEY_ARG_INT(bufp_zerocopy, total) <= 0)
+			error(1, EINVAL, "total=%d",
+			      SMOKEY_ARG_INT(bufp_zerocopy, total));
+		total = SMOKEY_ARG_INT(bufp_zerocopy, total) * 1024 * 1024ULL;
+	}
+	/* Both ends move complete chunks. */
+	total -= total % chunk;
+
+	param.sched_priority = 10;
+	ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (ret) {
+		warning("pthread_setschedparam(SCHED_FIFO, 10) failed");
+		return -ret;
+	}
+
+	ret = check_semantics();
+	if (ret)
+		return ret;
+
+	ret = run_stream(0);
+	if (ret)
+		error(1, ret, "copy run");
+
+	ret = run_stream(1);
+	if (ret)
+		error(1, ret, "zero-copy run");
+
+	return 0;
+}
@@ -0,0 +1,412 @@
+/*
+ * RTIPC/IDDP fan-out test.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <error.h>
+#include <smokey/smokey.h>
+#include <rtdm/ipc.h>
+
+smokey_test_plugin(iddp_fanout,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(msgsize),
+			   SMOKEY_INT(rounds),
+		   ),
+   "Check the fan-out mode of IDDP ports. The overflow policies of\n"
+   "\tsubscribers are checked first, then a sample stream is sent to\n"
+   "\tan increasing number of subscribers, once by unicasting a copy\n"
+   "\tto each of them, once by publishing to a fan-out port. The\n"
+   "\tsending cost per sample is reported for both modes.\n\n"
+   "\tmsgsize=<bytes>\tsample size (default 4096)\n"
+   "\trounds=<n>\tbursts of samples per run (default 100)"
+);
+
+#define MAX_SUBS  8
+#define BURST     32
+
+struct subscriber {
+	int s;
+	int port;
+	pthread_t tid;
+	unsigned long received;
+	int err;
+};
+
+static struct subscriber subs[MAX_SUBS];
+
+static size_t msgsize = 4096;
+
+static int rounds = 100;
+
+static sem_t drained;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int open_port(int fanout, size_t poolsz, int *port)
+{
+	struct sockaddr_ipc saddr;
+	socklen_t addrlen;
+	int s, ret;
+
+	s = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_IDDP);
+	if (s < 0)
+		return -errno;
+
+	if (fanout) {
+		ret = setsockopt(s, SOL_IDDP, IDDP_FANOUT,
+				 &fanout, sizeof(fanout));
+		if (ret)
+			goto fail;
+	}
+
+	if (poolsz) {
+		ret = setsockopt(s, SOL_IDDP, IDDP_POOLSZ,
+				 &poolsz, sizeof(poolsz));
+		if (ret)
+			goto fail;
+	}
+
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sipc_family = AF_RTIPC;
+	saddr.sipc_port = -1;
+	ret = bind(s, (struct sockaddr *)&saddr, sizeof(saddr));
+	if (ret)
+		goto fail;
+
+	addrlen = sizeof(saddr);
+	ret = getsockname(s, (struct sockaddr *)&saddr, &addrlen);
+	if (ret)
+		goto fail;
+
+	*port = saddr.sipc_port;
+
+	return s;
+fail:
+	ret = -errno;
+	close(s);
+
+	return ret;
+}
+
+static int subscribe(int s, int port, int policy, unsigned int depth)
+{
+	struct iddp_subscription sub;
+
+	memset(&sub, 0, sizeof(sub));
+	sub.port = port;
+	sub.policy = policy;
+	sub.depth = depth;
+
+	return setsockopt(s, SOL_IDDP, IDDP_SUBSCRIBE, &sub, sizeof(sub));
+}
+
+static int send_to(int s, int port, const void *buf, size_t len, int flags)
+{
+	struct sockaddr_ipc saddr;
+
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sipc_family = AF_RTIPC;
+	saddr.sipc_port = port;
+
+	return sendto(s, buf, len, flags, (struct sockaddr *)&saddr,
+		      sizeof(saddr));
+}
+
+static int check_policy(int tport, int ts, int policy,
+			int first, int last, int drops)
+{
+	struct iddp_subscription sub;
+	socklen_t len;
+	int s, n, val;
+
+	s = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_IDDP);
+	if (s < 0)
+		error(1, errno, "socket");
+
+	if (smokey_check_errno(subscribe(s, tport, policy, 2)) < 0)
+		return -EPROTO;
+
+	for (n = 0; n < 3; n++) {
+		if (send_to(ts, tport, &n, sizeof(n), MSG_DONTWAIT) < 0) {
+			if (!smokey_assert(policy == IDDP_SUB_BLOCK &&
+					   errno == EAGAIN && n == 2))
+				return -EPROTO;
+		}
+	}
+
+	for (n = first; n <= last; n++) {
+		if (!smokey_assert(recv(s, &val, sizeof(val),
+					MSG_DONTWAIT) == sizeof(val) &&
+				   val == n))
+			return -EPROTO;
+	}
+
+	if (!smokey_assert(recv(s, &val, sizeof(val), MSG_DONTWAIT) == -1 &&
+			   errno == EWOULDBLOCK))
+		return -EPROTO;
+
+	len = sizeof(sub);
+	if (smokey_check_errno(getsockopt(s, SOL_IDDP, IDDP_SUBSCRIBE,
+					  &sub, &len)) < 0)
+		return -EPROTO;
+	if (!smokey_assert(sub.port == tport && sub.drops == drops))
+		return -EPROTO;
+
+	close(s);
+
+	return 0;
+}
+
+static int check_semantics(void)
+{
+	int ts, tport, s, val = 1, ret;
+
+	ts = open_port(1, 0, &tport);
+	if (ts == -EINVAL) {
+		smokey_note("iddp_fanout skipped (no kernel support)");
+		return -ENOSYS;
+	}
+	if (ts < 0)
+		error(1, -ts, "fan-out port");
+
+	/* The fan-out mode is set once for all. */
+	if (!smokey_assert(setsockopt(ts, SOL_IDDP, IDDP_FANOUT,
+				      &val, sizeof(val)) == -1 &&
+			   errno == EALREADY))
+		return -EPROTO;
+
+	/* Urgent messages cannot be published. */
+	if (!smokey_assert(send_to(ts, tport, &val, sizeof(val),
+				   MSG_OOB) == -1 && errno == EOPNOTSUPP))
+		return -EPROTO;
+
+	/* Only fan-out ports may be subscribed to. */
+	s = open_port(0, 0, &val);
+	if (s < 0)
+		error(1, -s, "port");
+	if (!smokey_assert(subscribe(s, val, IDDP_SUB_BLOCK, 1) == -1 &&
+			   errno == ECONNREFUSED))
+		return -EPROTO;
+	close(s);
+
+	ret = check_policy(tport, ts, IDDP_SUB_DROP_NEWEST, 0, 1, 1);
+	if (ret == 0)
+		ret = check_policy(tport, ts, IDDP_SUB_DROP_OLDEST, 1, 2, 1);
+	if (ret == 0)
+		ret = check_policy(tport, ts, IDDP_SUB_BLOCK, 0, 1, 0);
+
+	close(ts);
+
+	return ret;
+}
+
+static void *subscriber_body(void *arg)
+{
+	struct subscriber *sub = arg;
+	unsigned long seq;
+	char *buf;
+	int n;
+
+	buf = malloc(msgsize);
+	if (buf == NULL) {
+		sub->err = ENOMEM;
+		return NULL;
+	}
+
+	for (;;) {
+		for (n = 0; n < BURST; n++) {
+			if (recv(sub->s, buf, msgsize, 0) != msgsize) {
+				sub->err = errno;
+				goto out;
+			}
+			memcpy(&seq, buf, sizeof(seq));
+			if (seq != sub->received) {
+				sub->err = EPROTO;
+				goto out;
+			}
+			sub->received++;
+		}
+		sem_post(&drained);
+		if (sub->received == rounds * BURST)
+			break;
+	}
+out:
+	if (sub->err)
+		sem_post(&drained);
+	free(buf);
+
+	return NULL;
+}
+
+static int run_fanout(int nsubs, int fanout, long long *ns_r)
+{
+	size_t poolsz = 2 * BURST * (msgsize + 256);
+	int ts, tport, n, k, r, ret = 0, nr = 0;
+	struct sched_param param;
+	unsigned long seq = 0;
+	long long start, ns = 0;
+	pthread_attr_t attr;
+	char *buf;
+
+	ts = open_port(fanout, poolsz, &tport);
+	if (ts < 0)
+		return -ts;
+
+	for (n = 0; n < nsubs; n++, nr++) {
+		memset(subs + n, 0, sizeof(subs[n]));
+		subs[n].s = open_port(0, fanout ? 0 : poolsz, &subs[n].port);
+		if (subs[n].s < 0) {
+			ret = -subs[n].s;
+			break;
+		}
+		if (fanout && subscribe(subs[n].s, tport,
+					IDDP_SUB_BLOCK, BURST)) {
+			ret = errno;
+			close(subs[n].s);
+			break;
+		}
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		param.sched_priority = 40;
+		pthread_attr_setschedparam(&attr, &param);
+		ret = pthread_create(&subs[n].tid, &attr,
+				     subscriber_body, subs + n);
+		pthread_attr_destroy(&attr);
+		if (ret) {
+			close(subs[n].s);
+			break;
+		}
+	}
+
+	buf = calloc(1, msgsize);
+	if (buf == NULL && ret == 0)
+		ret = ENOMEM;
+
+	/*
+	 * Subscribers have a lower priority and run on the same CPU,
+	 * so that only the sending cost is measured for each burst.
+	 */
+	for (r = 0; r < rounds && ret == 0; r++) {
+		start = now_ns();
+		for (n = 0; n < BURST; n++, seq++) {
+			memcpy(buf, &seq, sizeof(seq));
+			if (fanout) {
+				if (send_to(ts, tport, buf, msgsize, 0) < 0) {
+					ret = errno;
+					break;
+				}
+				continue;
+			}
+			for (k = 0; k < nsubs; k++) {
+				if (send_to(ts, subs[k].port,
+					    buf, msgsize, 0) < 0) {
+					ret = errno;
+					break;
+				}
+			}
+			if (ret)
+				break;
+		}
+		ns += now_ns() - start;
+		for (n = 0; n < nsubs && ret == 0; n++)
+			sem_wait(&drained);
+		for (n = 0; n < nsubs && ret == 0; n++)
+			ret = subs[n].err;
+	}
+
+	for (n = 0; n < nr; n++) {
+		if (ret)
+			pthread_cancel(subs[n].tid);
+		pthread_join(subs[n].tid, NULL);
+		if (ret == 0 && subs[n].err)
+			ret = subs[n].err;
+		close(subs[n].s);
+	}
+
+	free(buf);
+	close(ts);
+	*ns_r = ns / (rounds * BURST);
+
+	return ret;
+}
+
+static int run_iddp_fanout(struct smokey_test *t, int argc, char *const argv[])
+{
+	long long ns_unicast, ns_fanout;
+	struct sched_param param;
+	cpu_set_t affinity;
+	int ret, nsubs;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(iddp_fanout, msgsize))
+		msgsize = SMOKEY_ARG_INT(iddp_fanout, msgsize);
+	if (msgsize < sizeof(unsigned long) || msgsize > 65536)
+		error(1, EINVAL, "msgsize=%zu", msgsize);
+
+	if (SMOKEY_ARG_ISSET(iddp_fanout, rounds))
+		rounds = SMOKEY_ARG_INT(iddp_fanout, rounds);
+	if (rounds <= 0)
+		error(1, EINVAL, "rounds=%d", rounds);
+
+	ret = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_IDDP);
+	if (ret < 0) {
+		if (errno == EAFNOSUPPORT)
+			return -ENOSYS;
+		error(1, errno, "socket");
+	}
+	close(ret);
+
+	sem_init(&drained, 0, 0);
+
+	CPU_ZERO(&affinity);
+	CPU_SET(0, &affinity);
+	ret = pthread_setaffinity_np(pthread_self(), sizeof(affinity),
+				     &affinity);
+	if (ret)
+		error(1, ret, "pthread_setaffinity_np");
+
+	param.sched_priority = 50;
+	ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (ret) {
+		warning("pthread_setschedparam(SCHED_FIFO, 50) failed");
+		return -ret;
+	}
+
+	ret = check_semantics();
+	if (ret)
+		return ret;
+
+	for (nsubs = 1; nsubs <= MAX_SUBS; nsubs *= 2) {
+		ret = run_fanout(nsubs, 0, &ns_unicast);
+		if (ret)
+			error(1, ret, "unicast run");
+		ret = run_fanout(nsubs, 1, &ns_fanout);
+		if (ret)
+			error(1, ret, "fan-out run");
+		smokey_trace("%d subscriber(s), %zu bytes: unicast %.3f us, "
+			     "fan-out %.3f us per sample",
+			     nsubs, msgsize, ns_unicast / 1000.0,
+			     ns_fanout / 1000.0);
+	}
+
+	return 0;
+}
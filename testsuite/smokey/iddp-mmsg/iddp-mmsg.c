@@ -0,0 +1,345 @@
+/*
+ * RTIPC batched sendmmsg/recvmmsg test.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <smokey/smokey.h>
+#include <rtdm/ipc.h>
+
+smokey_test_plugin(iddp_mmsg,
+		   SMOKEY_NOARGS,
+		   "Check batched sendmmsg/recvmmsg on RTIPC sockets."
+);
+
+/* Larger than the batches passed to drivers. */
+#define NR_MSGS   12
+
+#define MSG_SIZE  64
+
+struct msgvec {
+	struct mmsghdr hdr[NR_MSGS];
+	struct iovec iov[NR_MSGS];
+	struct sockaddr_ipc addr[NR_MSGS];
+	char buf[NR_MSGS][MSG_SIZE];
+};
+
+static struct msgvec tx, rx;
+
+static int open_port(int proto, int level, int opt, size_t size, int *port)
+{
+	struct sockaddr_ipc saddr;
+	socklen_t addrlen;
+	int s, ret;
+
+	s = socket(AF_RTIPC, SOCK_DGRAM, proto);
+	if (s < 0)
+		return -errno;
+
+	ret = setsockopt(s, level, opt, &size, sizeof(size));
+	if (ret)
+		goto fail;
+
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sipc_family = AF_RTIPC;
+	saddr.sipc_port = -1;
+	ret = bind(s, (struct sockaddr *)&saddr, sizeof(saddr));
+	if (ret)
+		goto fail;
+
+	addrlen = sizeof(saddr);
+	ret = getsockname(s, (struct sockaddr *)&saddr, &addrlen);
+	if (ret)
+		goto fail;
+
+	*port = saddr.sipc_port;
+
+	return s;
+fail:
+	ret = -errno;
+	close(s);
+
+	return ret;
+}
+
+static int connect_to(int s, int port)
+{
+	struct sockaddr_ipc saddr;
+
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sipc_family = AF_RTIPC;
+	saddr.sipc_port = port;
+
+	if (connect(s, (struct sockaddr *)&saddr, sizeof(saddr)))
+		return -errno;
+
+	return 0;
+}
+
+/*
+ * Message n carries n + 1 bytes of value n, sent to @ports[n %
+ * nrports], or to the default peer if @ports is NULL.
+ */
+static void prep_tx(int count, const int *ports, int nrports)
+{
+	int n;
+
+	memset(&tx, 0, sizeof(tx));
+
+	for (n = 0; n < count; n++) {
+		memset(tx.buf[n], n, n + 1);
+		tx.iov[n].iov_base = tx.buf[n];
+		tx.iov[n].iov_len = n + 1;
+		tx.hdr[n].msg_hdr.msg_iov = &tx.iov[n];
+		tx.hdr[n].msg_hdr.msg_iovlen = 1;
+		if (ports == NULL)
+			continue;
+		tx.addr[n].sipc_family = AF_RTIPC;
+		tx.addr[n].sipc_port = ports[n % nrports];
+		tx.hdr[n].msg_hdr.msg_name = &tx.addr[n];
+		tx.hdr[n].msg_hdr.msg_namelen = sizeof(tx.addr[n]);
+	}
+}
+
+static void prep_rx(int count, size_t size, int named)
+{
+	int n;
+
+	memset(&rx, 0, sizeof(rx));
+
+	for (n = 0; n < count; n++) {
+		rx.iov[n].iov_base = rx.buf[n];
+		rx.iov[n].iov_len = size;
+		rx.hdr[n].msg_hdr.msg_iov = &rx.iov[n];
+		rx.hdr[n].msg_hdr.msg_iovlen = 1;
+		if (!named)
+			continue;
+		rx.hdr[n].msg_hdr.msg_name = &rx.addr[n];
+		rx.hdr[n].msg_hdr.msg_namelen = sizeof(rx.addr[n]);
+	}
+}
+
+/* Check that rx entry @n received message @m from @port. */
+static int check_rx(int n, int m, int port)
+{
+	char expected[MSG_SIZE];
+
+	memset(expected, m, m + 1);
+
+	if (!__Tassert(rx.hdr[n].msg_len == m + 1) ||
+	    !__Fassert(memcmp(rx.buf[n], expected, m + 1)))
+		return -EINVAL;
+
+	if (port >= 0 && !__Tassert(rx.addr[n].sipc_port == port))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int check_iddp_batch(void)
+{
+	int rs[2] = { -1, -1 }, rports[2], ts, tport, n, ret;
+
+	ts = open_port(IPCPROTO_IDDP, SOL_IDDP, IDDP_POOLSZ, 16384, &tport);
+	if (ts < 0)
+		return ts;
+
+	for (n = 0; n < 2; n++) {
+		rs[n] = open_port(IPCPROTO_IDDP, SOL_IDDP, IDDP_POOLSZ,
+				  16384, &rports[n]);
+		if (rs[n] < 0) {
+			ret = rs[n];
+			goto out;
+		}
+	}
+
+	/* Alternate between two receivers within the vector. */
+	prep_tx(NR_MSGS, rports, 2);
+	ret = smokey_check_errno(sendmmsg(ts, tx.hdr, NR_MSGS, MSG_DONTWAIT));
+	if (ret < 0)
+		goto out;
+	if (!__Tassert(ret == NR_MSGS)) {
+		ret = -EINVAL;
+		goto out;
+	}
+	for (n = 0; n < NR_MSGS; n++) {
+		if (!__Tassert(tx.hdr[n].msg_len == n + 1)) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	/* Each receiver gets its messages in order, all at once. */
+	prep_rx(NR_MSGS, MSG_SIZE, 1);
+	ret = smokey_check_errno(recvmmsg(rs[1], rx.hdr, NR_MSGS,
+					  MSG_DONTWAIT, NULL));
+	if (ret < 0)
+		goto out;
+	if (!__Tassert(ret == NR_MSGS / 2)) {
+		ret = -EINVAL;
+		goto out;
+	}
+	for (n = 0; n < NR_MSGS / 2; n++) {
+		ret = check_rx(n, n * 2 + 1, tport);
+		if (ret)
+			goto out;
+	}
+
+	/*
+	 * MSG_WAITFORONE must not wait for more input once
+	 * something was received.
+	 */
+	prep_rx(NR_MSGS, MSG_SIZE, 1);
+	ret = smokey_check_errno(recvmmsg(rs[0], rx.hdr, NR_MSGS,
+					  MSG_WAITFORONE, NULL));
+	if (ret < 0)
+		goto out;
+	if (!__Tassert(ret == NR_MSGS / 2)) {
+		ret = -EINVAL;
+		goto out;
+	}
+	for (n = 0; n < NR_MSGS / 2; n++) {
+		ret = check_rx(n, n * 2, tport);
+		if (ret)
+			goto out;
+	}
+
+	/*
+	 * A message larger than the buffer is read partially, the
+	 * remainder fills the next entry, followed by the messages
+	 * queued after it.
+	 */
+	ret = connect_to(ts, rports[0]);
+	if (ret)
+		goto out;
+	prep_tx(4, NULL, 0);
+	ret = smokey_check_errno(sendmmsg(ts, tx.hdr, 4, 0));
+	if (ret < 0)
+		goto out;
+	if (!__Tassert(ret == 4)) {
+		ret = -EINVAL;
+		goto out;
+	}
+	prep_rx(4, MSG_SIZE, 0);
+	rx.iov[1].iov_len = 1;
+	ret = smokey_check_errno(recvmmsg(rs[0], rx.hdr, 4,
+					  MSG_DONTWAIT, NULL));
+	if (ret < 0)
+		goto out;
+	if (!__Tassert(ret == 4) ||
+	    !__Tassert(rx.hdr[1].msg_len == 1) ||
+	    !__Tassert(rx.hdr[2].msg_len == 1) ||
+	    !__Fassert(rx.buf[1][0] != 1 || rx.buf[2][0] != 1)) {
+		ret = -EINVAL;
+		goto out;
+	}
+	ret = check_rx(0, 0, -1) ?: check_rx(3, 2, -1);
+	if (ret)
+		goto out;
+
+	/* Message 3 is left. */
+	prep_rx(NR_MSGS, MSG_SIZE, 0);
+	ret = smokey_check_errno(recvmmsg(rs[0], rx.hdr, NR_MSGS,
+					  MSG_DONTWAIT, NULL));
+	if (ret < 0)
+		goto out;
+	if (!__Tassert(ret == 1)) {
+		ret = -EINVAL;
+		goto out;
+	}
+	ret = check_rx(0, 3, -1);
+out:
+	for (n = 0; n < 2; n++)
+		if (rs[n] >= 0)
+			close(rs[n]);
+	close(ts);
+
+	return ret;
+}
+
+/* BUFP has no batch handlers, RTDM processes each message in turn. */
+static int check_bufp_fallback(void)
+{
+	int rs, ts, rport, n, ret;
+
+	rs = open_port(IPCPROTO_BUFP, SOL_BUFP, BUFP_BUFSZ, 16384, &rport);
+	if (rs < 0)
+		return rs;
+
+	ts = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_BUFP);
+	if (ts < 0) {
+		ret = -errno;
+		goto fail;
+	}
+
+	ret = connect_to(ts, rport);
+	if (ret)
+		goto out;
+
+	prep_tx(NR_MSGS, NULL, 0);
+	ret = smokey_check_errno(sendmmsg(ts, tx.hdr, NR_MSGS, 0));
+	if (ret < 0)
+		goto out;
+	if (!__Tassert(ret == NR_MSGS)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* BUFP is a byte stream, read back the exact sizes. */
+	prep_rx(NR_MSGS, MSG_SIZE, 0);
+	for (n = 0; n < NR_MSGS; n++)
+		rx.iov[n].iov_len = n + 1;
+	ret = smokey_check_errno(recvmmsg(rs, rx.hdr, NR_MSGS,
+					  MSG_DONTWAIT, NULL));
+	if (ret < 0)
+		goto out;
+	if (!__Tassert(ret == NR_MSGS)) {
+		ret = -EINVAL;
+		goto out;
+	}
+	for (n = 0; n < NR_MSGS; n++) {
+		ret = check_rx(n, n, -1);
+		if (ret)
+			break;
+	}
+out:
+	close(ts);
+fail:
+	close(rs);
+
+	return ret;
+}
+
+static int run_iddp_mmsg(struct smokey_test *t, int argc, char *const argv[])
+{
+	int ret;
+
+	ret = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_IDDP);
+	if (ret < 0) {
+		if (errno == EAFNOSUPPORT || errno == ENOPROTOOPT)
+			return -ENOSYS;
+		return -errno;
+	}
+	close(ret);
+
+	ret = check_iddp_batch();
+	if (ret)
+		return ret;
+
+	ret = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_BUFP);
+	if (ret < 0) {
+		if (errno == ENOPROTOOPT) {
+			smokey_note("BUFP unavailable, fallback not checked");
+			return 0;
+		}
+		return -errno;
+	}
+	close(ret);
+
+	return check_bufp_fallback();
+}
@@ -0,0 +1,254 @@
+/*
+ * Compare the cost of RTDM requests issued through a submission
+ * ring with the cost of individual syscalls.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <cobalt/sys/cobalt.h>
+#include <rtdm/testing.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(ioring,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(loops),
+			   SMOKEY_INT(batch),
+		   ),
+		   "Measure batched RTDM I/O cost vs. individual syscalls\n"
+		   "\tloops=<count>\tnumber of requests per round (default 100000)\n"
+		   "\tbatch=<count>\trequests per ring submission (default 32)"
+);
+
+#ifndef TFD_NONBLOCK
+#define TFD_NONBLOCK O_NONBLOCK
+#endif
+
+#define RTDMTEST_DEVICE  "/dev/rtdm/rtdm0"
+
+static int loops = 100000;
+
+static int batch = 32;
+
+static unsigned long long elapsed_ns(const struct timespec *t0,
+				     const struct timespec *t1)
+{
+	return (t1->tv_sec - t0->tv_sec) * 1000000000ULL +
+		t1->tv_nsec - t0->tv_nsec;
+}
+
+/*
+ * Reading from an idle non-blocking timerfd goes through the whole
+ * RTDM read path down to the driver, then fails with EAGAIN.
+ */
+static int run_syscalls(int tfd, unsigned long long *ns)
+{
+	unsigned long long ticks;
+	struct timespec t0, t1;
+	int n;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (n = 0; n < loops; n++) {
+		if (!smokey_assert(read(tfd, &ticks, sizeof(ticks)) < 0 &&
+				   errno == EAGAIN))
+			return -EINVAL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	*ns = elapsed_ns(&t0, &t1);
+
+	return 0;
+}
+
+static int run_ring(struct cobalt_ioring *ring, int tfd,
+		    unsigned long long *ns)
+{
+	struct cobalt_ioring_sqe *sqe;
+	struct cobalt_ioring_cqe *cqe;
+	unsigned long long ticks;
+	struct timespec t0, t1;
+	int n, m, ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (n = 0; n < loops; n += batch) {
+		for (m = 0; m < batch; m++) {
+			sqe = cobalt_ioring_get_sqe(ring);
+			if (!smokey_assert(sqe != NULL))
+				return -EINVAL;
+			sqe->opcode = COBALT_IORING_OP_READ;
+			sqe->fd = tfd;
+			sqe->addr = (unsigned long)&ticks;
+			sqe->len = sizeof(ticks);
+			sqe->user_data = n + m;
+		}
+
+		ret = smokey_check_errno(cobalt_ioring_submit(ring));
+		if (ret < 0)
+			return ret;
+		if (!smokey_assert(ret == batch))
+			return -EINVAL;
+
+		for (m = 0; m < batch; m++) {
+			cqe = cobalt_ioring_peek_cqe(ring);
+			if (!smokey_assert(cqe != NULL))
+				return -EINVAL;
+			if (!smokey_assert(cqe->user_data == n + m &&
+					   cqe->res == -EAGAIN))
+				return -EINVAL;
+			cobalt_ioring_cqe_seen(ring);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	*ns = elapsed_ns(&t0, &t1);
+
+	return 0;
+}
+
+static void prep_read(struct cobalt_ioring_sqe *sqe, int tfd,
+		      unsigned long long *ticks, int tag)
+{
+	sqe->opcode = COBALT_IORING_OP_READ;
+	sqe->fd = tfd;
+	sqe->addr = (unsigned long)ticks;
+	sqe->len = sizeof(*ticks);
+	sqe->user_data = tag;
+}
+
+/*
+ * The test driver only answers RTTST_RTIOC_RTDM_PING_SECONDARY from
+ * secondary mode, the ring must run that request from there, then
+ * go on with the next ones.
+ */
+static int run_deferred(struct cobalt_ioring *ring, int tfd)
+{
+	static const int expected[] = { -EAGAIN, 0, -EAGAIN };
+	struct cobalt_ioring_sqe *sqe[3];
+	struct cobalt_ioring_cqe *cqe;
+	unsigned long long ticks;
+	int fd, n, ret, magic = 0;
+
+	fd = open(RTDMTEST_DEVICE, O_RDWR);
+	if (fd < 0) {
+		smokey_note("deferral to secondary mode not checked "
+			    "(no %s)", RTDMTEST_DEVICE);
+		return 0;
+	}
+
+	for (n = 0; n < 3; n++) {
+		sqe[n] = cobalt_ioring_get_sqe(ring);
+		if (!smokey_assert(sqe[n] != NULL)) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	prep_read(sqe[0], tfd, &ticks, 0);
+	sqe[1]->opcode = COBALT_IORING_OP_IOCTL;
+	sqe[1]->fd = fd;
+	sqe[1]->len = RTTST_RTIOC_RTDM_PING_SECONDARY;
+	sqe[1]->addr = (unsigned long)&magic;
+	sqe[1]->user_data = 1;
+	prep_read(sqe[2], tfd, &ticks, 2);
+
+	ret = smokey_check_errno(cobalt_ioring_submit(ring));
+	if (ret < 0)
+		goto out;
+	if (!smokey_assert(ret == 3)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (n = 0; n < 3; n++) {
+		cqe = cobalt_ioring_peek_cqe(ring);
+		if (!smokey_assert(cqe != NULL) ||
+		    !smokey_assert(cqe->user_data == n &&
+				   cqe->res == expected[n])) {
+			ret = -EINVAL;
+			goto out;
+		}
+		cobalt_ioring_cqe_seen(ring);
+	}
+
+	ret = 0;
+	if (!smokey_assert(magic == RTTST_RTDM_MAGIC_SECONDARY))
+		ret = -EINVAL;
+out:
+	close(fd);
+
+	return ret;
+}
+
+static int run_ioring(struct smokey_test *t, int argc, char *const argv[])
+{
+	unsigned long long sys_ns, ring_ns;
+	struct cobalt_ioring ring;
+	struct sched_param param;
+	int tfd, ret;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(ioring, loops) &&
+	    SMOKEY_ARG_INT(ioring, loops) > 0)
+		loops = SMOKEY_ARG_INT(ioring, loops);
+
+	if (SMOKEY_ARG_ISSET(ioring, batch) &&
+	    SMOKEY_ARG_INT(ioring, batch) > 0)
+		batch = SMOKEY_ARG_INT(ioring, batch);
+
+	if (batch > COBALT_IORING_MAX_ENTRIES)
+		batch = COBALT_IORING_MAX_ENTRIES;
+
+	loops = (loops + batch - 1) / batch * batch;
+
+	/* Leave room for the deferral check. */
+	ret = cobalt_ioring_init(&ring, batch < 3 ? 3 : batch, 0);
+	if (ret && errno == ENOSYS) {
+		smokey_note("ioring skipped (no kernel support)");
+		return -ENOSYS;
+	}
+	ret = smokey_check_errno(ret);
+	if (ret)
+		return ret;
+
+	tfd = smokey_check_errno(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK));
+	if (tfd < 0) {
+		ret = tfd;
+		goto out;
+	}
+
+	param.sched_priority = 20;
+	ret = smokey_check_status(pthread_setschedparam(pthread_self(),
+							SCHED_FIFO, &param));
+	if (ret)
+		goto close;
+
+	ret = run_syscalls(tfd, &sys_ns);
+	if (ret)
+		goto close;
+
+	ret = run_ring(&ring, tfd, &ring_ns);
+	if (ret)
+		goto close;
+
+	ret = run_deferred(&ring, tfd);
+	if (ret)
+		goto close;
+
+	smokey_trace("%d requests, batches of %d", loops, batch);
+	smokey_trace(".. syscall: %6llu ns/op", sys_ns / loops);
+	smokey_trace(".. ioring:  %6llu ns/op", ring_ns / loops);
+close:
+	close(tfd);
+out:
+	cobalt_ioring_destroy(&ring);
+
+	return ret;
+}
@@ -0,0 +1,369 @@
+/*
+ * Zero-copy message queue test.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <mqueue.h>
+#include <time.h>
+#include <errno.h>
+#include <error.h>
+#include <sys/mman.h>
+#include <sys/cobalt.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(mq_zerocopy,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(msgsize),
+			   SMOKEY_INT(count),
+		   ),
+   "Check the zero-copy mode of message queues. Messages are passed\n"
+   "\tas slot indices from a pool mapped by both ends, which must\n"
+   "\tpreserve the priority ordering and the blocking semantics of\n"
+   "\tregular message queues. The same traffic is then sent with\n"
+   "\tmq_send()/mq_receive() and with the zero-copy calls, and the\n"
+   "\tthroughput of both runs is reported.\n\n"
+   "\tmsgsize=<bytes>\tmessage size (default 8192)\n"
+   "\tcount=<n>\tmessages per run (default 10000)"
+);
+
+#define MQ_NAME   "/smokey-mq-zerocopy"
+#define NR_SLOTS  8
+
+static size_t msgsize = 8192;
+
+static int count = 10000;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static mqd_t open_queue(int oflags, int zerocopy)
+{
+	struct mq_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.mq_maxmsg = NR_SLOTS;
+	attr.mq_msgsize = msgsize;
+	if (zerocopy)
+		attr.mq_flags = COBALT_MQ_ZEROCOPY;
+
+	return mq_open(MQ_NAME, oflags | O_CREAT, 0600, &attr);
+}
+
+static int check_semantics(void)
+{
+	unsigned int slot, slots[NR_SLOTS], prio, lastprio;
+	int n, seq, lastseq, pagesz;
+	char *wpool, *rpool;
+	mqd_t qw, qr, qnb;
+	size_t slotsz, poolsz;
+	ssize_t len;
+	void *p;
+
+	qw = open_queue(O_WRONLY | O_EXCL, 1);
+	if (qw == (mqd_t)-1)
+		error(1, errno, "mq_open");
+	qr = mq_open(MQ_NAME, O_RDONLY);
+	if (qr == (mqd_t)-1)
+		error(1, errno, "mq_open(O_RDONLY)");
+	qnb = mq_open(MQ_NAME, O_WRONLY | O_NONBLOCK);
+	if (qnb == (mqd_t)-1)
+		error(1, errno, "mq_open(O_NONBLOCK)");
+	mq_unlink(MQ_NAME);
+
+	wpool = cobalt_mq_map(qw, &slotsz);
+	if (wpool == NULL) {
+		if (errno == EINVAL) {
+			smokey_note("mq_zerocopy skipped (no kernel support)");
+			return -ENOSYS;
+		}
+		error(1, errno, "cobalt_mq_map(O_WRONLY)");
+	}
+	if (!smokey_assert(slotsz >= msgsize))
+		return -EPROTO;
+	rpool = cobalt_mq_map(qr, NULL);
+	if (rpool == NULL)
+		error(1, errno, "cobalt_mq_map(O_RDONLY)");
+
+	/* Read-only descriptors may not write to the pool. */
+	pagesz = getpagesize();
+	poolsz = (slotsz * NR_SLOTS + pagesz - 1) & ~(pagesz - 1);
+	p = mmap(NULL, poolsz, PROT_READ|PROT_WRITE, MAP_SHARED, qr, 0);
+	if (!smokey_assert(p == MAP_FAILED && errno == EACCES))
+		return -EPROTO;
+
+	/* Fill the queue, with interleaved priorities. */
+	for (n = 0; n < NR_SLOTS; n++) {
+		if (smokey_check_errno(cobalt_mq_reserve(qw, slots + n, NULL)) < 0)
+			return -EPROTO;
+		memset(wpool + slots[n] * slotsz, n, msgsize);
+	}
+	if (!smokey_assert(cobalt_mq_reserve(qnb, &slot, NULL) == -1 &&
+			   errno == EAGAIN))
+		return -EPROTO;
+	for (n = 0; n < NR_SLOTS; n++)
+		if (smokey_check_errno(cobalt_mq_commit(qw, slots[n],
+							msgsize - n, n % 3)) < 0)
+			return -EPROTO;
+
+	/* Only the reserving descriptor may commit a slot. */
+	if (!smokey_assert(cobalt_mq_commit(qw, slots[0], 1, 0) == -1 &&
+			   errno == EINVAL))
+		return -EPROTO;
+
+	/* Highest priority first, FIFO order among equals. */
+	for (n = 0, lastprio = -1U, lastseq = -1; n < NR_SLOTS; n++) {
+		len = cobalt_mq_consume(qr, &slot, &prio, NULL);
+		if (smokey_check_errno(len) < 0)
+			return -EPROTO;
+		seq = rpool[slot * slotsz];
+		if (!smokey_assert(prio < lastprio ||
+				   (prio == lastprio && seq > lastseq)))
+			return -EPROTO;
+		if (!smokey_assert(len == msgsize - seq && seq % 3 == prio))
+			return -EPROTO;
+		lastprio = prio;
+		lastseq = seq;
+		slots[n] = slot;
+	}
+
+	/* Consumed slots go back to the pool only once released. */
+	if (!smokey_assert(cobalt_mq_reserve(qnb, &slot, NULL) == -1 &&
+			   errno == EAGAIN))
+		return -EPROTO;
+	for (n = 0; n < NR_SLOTS; n++)
+		if (smokey_check_errno(cobalt_mq_release(qr, slots[n])) < 0)
+			return -EPROTO;
+	if (!smokey_assert(cobalt_mq_release(qr, slots[0]) == -1 &&
+			   errno == EINVAL))
+		return -EPROTO;
+
+	/* Slots held by a closed descriptor are given back. */
+	for (n = 0; n < NR_SLOTS; n++)
+		if (smokey_check_errno(cobalt_mq_reserve(qnb, slots + n, NULL)) < 0)
+			return -EPROTO;
+	if (smokey_check_errno(mq_close(qnb)) < 0)
+		return -EPROTO;
+	if (smokey_check_errno(cobalt_mq_reserve(qw, &slot, NULL)) < 0)
+		return -EPROTO;
+	if (smokey_check_errno(cobalt_mq_release(qw, slot)) < 0)
+		return -EPROTO;
+
+	cobalt_mq_unmap(qr, rpool);
+	cobalt_mq_unmap(qw, wpool);
+	mq_close(qr);
+	mq_close(qw);
+
+	return 0;
+}
+
+struct run {
+	mqd_t qr;
+	char *rpool;
+	size_t slotsz;
+	unsigned long sum;
+	int err;
+};
+
+static void *copy_receiver(void *arg)
+{
+	struct run *r = arg;
+	char *buf;
+	int n;
+
+	buf = malloc(msgsize);
+	if (buf == NULL) {
+		r->err = ENOMEM;
+		return NULL;
+	}
+
+	for (n = 0; n < count; n++) {
+		if (mq_receive(r->qr, buf, msgsize, NULL) < 0) {
+			r->err = errno;
+			break;
+		}
+		r->sum += buf[msgsize - 1];
+	}
+
+	free(buf);
+
+	return NULL;
+}
+
+static void *zc_receiver(void *arg)
+{
+	struct run *r = arg;
+	unsigned int slot;
+	char *payload;
+	int n;
+
+	for (n = 0; n < count; n++) {
+		if (cobalt_mq_consume(r->qr, &slot, NULL, NULL) < 0) {
+			r->err = errno;
+			break;
+		}
+		payload = r->rpool + slot * r->slotsz;
+		r->sum += payload[msgsize - 1];
+		cobalt_mq_release(r->qr, slot);
+	}
+
+	return NULL;
+}
+
+static int run_traffic(int zerocopy)
+{
+	struct sched_param param;
+	char *buf = NULL, *wpool = NULL, *payload;
+	unsigned long sum = 0;
+	pthread_attr_t attr;
+	long long start, ns;
+	unsigned int slot;
+	struct run r;
+	pthread_t tid;
+	int n, ret;
+	mqd_t qw;
+
+	memset(&r, 0, sizeof(r));
+	qw = open_queue(O_WRONLY | O_EXCL, zerocopy);
+	if (qw == (mqd_t)-1)
+		return errno;
+	r.qr = mq_open(MQ_NAME, O_RDONLY);
+	mq_unlink(MQ_NAME);
+	if (r.qr == (mqd_t)-1) {
+		ret = errno;
+		goto out;
+	}
+
+	if (zerocopy) {
+		wpool = cobalt_mq_map(qw, &r.slotsz);
+		r.rpool = cobalt_mq_map(r.qr, NULL);
+		if (wpool == NULL || r.rpool == NULL) {
+			ret = errno;
+			goto out;
+		}
+	} else {
+		buf = malloc(msgsize);
+		if (buf == NULL) {
+			ret = ENOMEM;
+			goto out;
+		}
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = 50;
+	pthread_attr_setschedparam(&attr, &param);
+	ret = pthread_create(&tid, &attr,
+			     zerocopy ? zc_receiver : copy_receiver, &r);
+	pthread_attr_destroy(&attr);
+	if (ret)
+		goto out;
+
+	start = now_ns();
+
+	for (n = 0; n < count; n++) {
+		if (zerocopy) {
+			if (cobalt_mq_reserve(qw, &slot, NULL)) {
+				ret = errno;
+				break;
+			}
+			payload = wpool + slot * r.slotsz;
+			memset(payload, n, msgsize);
+			if (cobalt_mq_commit(qw, slot, msgsize, 0)) {
+				ret = errno;
+				break;
+			}
+		} else {
+			memset(buf, n, msgsize);
+			if (mq_send(qw, buf, msgsize, 0)) {
+				ret = errno;
+				break;
+			}
+		}
+		sum += (char)n;
+	}
+
+	if (ret)
+		pthread_cancel(tid);
+	pthread_join(tid, NULL);
+	ns = now_ns() - start;
+
+	if (ret == 0)
+		ret = r.err;
+	if (ret == 0) {
+		smokey_trace("%s: %d messages of %zu bytes in %.3f ms, "
+			     "%.1f MB/s",
+			     zerocopy ? "zero-copy" : "copy", count, msgsize,
+			     ns / 1000000.0,
+			     (double)count * msgsize * 1000.0 / ns);
+		if (!smokey_assert(r.sum == sum))
+			ret = EPROTO;
+	}
+out:
+	if (wpool)
+		cobalt_mq_unmap(qw, wpool);
+	if (r.rpool)
+		cobalt_mq_unmap(r.qr, r.rpool);
+	free(buf);
+	if (r.qr != (mqd_t)-1)
+		mq_close(r.qr);
+	mq_close(qw);
+
+	return ret;
+}
+
+static int run_mq_zerocopy(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct sched_param param;
+	int ret;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(mq_zerocopy, msgsize)) {
+		if (SMOKEY_ARG_INT(mq_zerocopy, msgsize) < NR_SLOTS)
+			error(1, EINVAL, "msgsize=%d",
+			      SMOKEY_ARG_INT(mq_zerocopy, msgsize));
+		msgsize = SMOKEY_ARG_INT(mq_zerocopy, msgsize);
+	}
+
+	if (SMOKEY_ARG_ISSET(mq_zerocopy, count))
+		count = SMOKEY_ARG_INT(mq_zerocopy, count);
+	if (count <= 0)
+		error(1, EINVAL, "count=%d", count);
+
+	param.sched_priority = 10;
+	ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (ret) {
+		warning("pthread_setschedparam(SCHED_FIFO, 10) failed");
+		return -ret;
+	}
+
+	mq_unlink(MQ_NAME);
+
+	ret = check_semantics();
+	if (ret)
+		return ret;
+
+	ret = run_traffic(0);
+	if (ret)
+		error(1, ret, "copy run");
+
+	ret = run_traffic(1);
+	if (ret)
+		error(1, ret, "zero-copy run");
+
+	return 0;
+}
@@ -0,0 +1,253 @@
+/*
+ * Adaptive mutex spinning test.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <error.h>
+#include <sys/syscall.h>
+#include <sys/cobalt.h>
+#include <cobalt/tunables.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(mutex_spin,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(spin),
+			   SMOKEY_INT(hold),
+			   SMOKEY_INT(duration),
+		   ),
+   "Check adaptive spinning on contended mutexes. Two threads running\n"
+   "\ton distinct CPUs hammer a mutex guarding a short critical section,\n"
+   "\tfirst with spinning disabled, then enabled. Lock throughput,\n"
+   "\tworst-case acquisition latency and context switches are\n"
+   "\treported for both runs.\n\n"
+   "\tA successful test shows that mutual exclusion holds in both modes.\n"
+   "\tspin=<count>\tmax spinning rounds (default 1000)\n"
+   "\thold=<loops>\tlength of the critical section (default 100)\n"
+   "\tduration=<ms>\tlength of each run (default 1000)"
+);
+
+#define NR_THREADS  2
+
+struct spin_thread {
+	int cpu;
+	pthread_t tid;
+	unsigned long locks;
+	long long lat_max;	/* ns */
+	unsigned long long csw;
+	int err;
+};
+
+static struct spin_thread threads[NR_THREADS];
+
+static pthread_mutex_t lock;
+
+static unsigned long counter;
+
+static int hold = 100;
+
+static volatile int stop;
+
+static sem_t ready;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static unsigned long __attribute__(( noinline ))
+__do_work(unsigned long count)
+{
+	return count + 1;
+}
+
+static void __attribute__(( noinline ))
+do_work(unsigned long loops)
+{
+	unsigned long n, count = 0;
+
+	for (n = 0; n < loops; n++)
+		count = __do_work(count);
+}
+
+static void *thread_body(void *arg)
+{
+	struct spin_thread *t = arg;
+	struct cobalt_threadstat stat;
+	unsigned long long csw = 0;
+	long long start, lat;
+	cpu_set_t affinity;
+	pid_t pid;
+
+	CPU_ZERO(&affinity);
+	CPU_SET(t->cpu, &affinity);
+	t->err = -pthread_setaffinity_np(pthread_self(),
+					 sizeof(affinity), &affinity);
+	pid = syscall(SYS_gettid);
+	if (t->err == 0 && cobalt_thread_stat(pid, &stat) == 0)
+		csw = stat.csw;
+
+	sem_post(&ready);
+	if (t->err)
+		return NULL;
+
+	while (!stop) {
+		start = now_ns();
+		t->err = -pthread_mutex_lock(&lock);
+		if (t->err)
+			break;
+		lat = now_ns() - start;
+		if (lat > t->lat_max)
+			t->lat_max = lat;
+		counter++;
+		do_work(hold);
+		pthread_mutex_unlock(&lock);
+		t->locks++;
+		/* Leave some room to the other side. */
+		do_work(hold / 2);
+	}
+
+	if (cobalt_thread_stat(pid, &stat) == 0)
+		t->csw = stat.csw - csw;
+
+	return NULL;
+}
+
+static int run_threads(int spin, int duration_ms)
+{
+	unsigned long locks = 0;
+	struct sched_param param;
+	pthread_attr_t attr;
+	struct timespec ts;
+	int n, ret, nr = 0;
+
+	set_config_tunable(mutex_spin_count, spin);
+	counter = 0;
+	stop = 0;
+
+	for (n = 0; n < NR_THREADS; n++, nr++) {
+		threads[n].cpu = n;
+		threads[n].locks = 0;
+		threads[n].lat_max = 0;
+		threads[n].csw = 0;
+		threads[n].err = 0;
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		param.sched_priority = 10;
+		pthread_attr_setschedparam(&attr, &param);
+		ret = pthread_create(&threads[n].tid, &attr,
+				     thread_body, threads + n);
+		pthread_attr_destroy(&attr);
+		if (ret)
+			break;
+		sem_wait(&ready);
+	}
+
+	ts.tv_sec = duration_ms / 1000;
+	ts.tv_nsec = (duration_ms % 1000) * 1000000;
+	clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+	stop = 1;
+
+	for (n = 0; n < nr; n++) {
+		pthread_join(threads[n].tid, NULL);
+		smokey_trace("spin=%d: cpu%d, %lu locks (%lu/ms), "
+			     "max latency=%.3f us, %llu context switches",
+			     spin, threads[n].cpu, threads[n].locks,
+			     threads[n].locks / duration_ms,
+			     threads[n].lat_max / 1000.0, threads[n].csw);
+		locks += threads[n].locks;
+		if (ret == 0 && threads[n].err)
+			ret = threads[n].err;
+	}
+
+	if (ret)
+		return ret;
+
+	if (!smokey_assert(counter == locks)) {
+		smokey_warning("spin=%d: %lu locks, but counter=%lu",
+			       spin, locks, counter);
+		return EPROTO;
+	}
+
+	smokey_trace("spin=%d: %lu locks/ms overall", spin, locks / duration_ms);
+
+	return 0;
+}
+
+static int run_mutex_spin(struct smokey_test *t, int argc, char *const argv[])
+{
+	int ret, spin = 1000, duration = 1000, ospin;
+	struct sched_param param;
+	pthread_mutexattr_t mattr;
+	cpu_set_t online;
+	int n;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(mutex_spin, spin))
+		spin = SMOKEY_ARG_INT(mutex_spin, spin);
+	if (spin <= 0)
+		error(1, EINVAL, "spin=%d", spin);
+
+	if (SMOKEY_ARG_ISSET(mutex_spin, hold))
+		hold = SMOKEY_ARG_INT(mutex_spin, hold);
+	if (hold < 0)
+		error(1, EINVAL, "hold=%d", hold);
+
+	if (SMOKEY_ARG_ISSET(mutex_spin, duration))
+		duration = SMOKEY_ARG_INT(mutex_spin, duration);
+	if (duration <= 0)
+		error(1, EINVAL, "duration=%d", duration);
+
+	ret = sched_getaffinity(0, sizeof(online), &online);
+	if (ret)
+		error(1, errno, "sched_getaffinity");
+
+	for (n = 0; n < NR_THREADS; n++) {
+		if (!CPU_ISSET(n, &online)) {
+			smokey_note("mutex_spin skipped (needs CPU0-%d)",
+				    NR_THREADS - 1);
+			return -ENOSYS;
+		}
+	}
+
+	sem_init(&ready, 0, 0);
+
+	param.sched_priority = 90;
+	ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (ret) {
+		warning("pthread_setschedparam(SCHED_FIFO, 90) failed");
+		return -ret;
+	}
+
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
+	ret = pthread_mutex_init(&lock, &mattr);
+	pthread_mutexattr_destroy(&mattr);
+	if (ret)
+		error(1, ret, "pthread_mutex_init");
+
+	ospin = get_config_tunable(mutex_spin_count);
+
+	ret = run_threads(0, duration);
+	if (ret == 0)
+		ret = run_threads(spin, duration);
+
+	set_config_tunable(mutex_spin_count, ospin);
+	pthread_mutex_destroy(&lock);
+
+	return -ret;
+}
@@ -0,0 +1,408 @@
+/*
+ * RTnet AF_PACKET memory-mapped ring test.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <error.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <net/ethernet.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netpacket/packet.h>
+
+#include <sys/cobalt.h>
+#include <smokey/smokey.h>
+#include <rtnet.h>
+#include "smokey_net.h"
+
+smokey_test_plugin(net_packet_mmap,
+	SMOKEY_ARGLIST(
+		SMOKEY_INT(count),
+		SMOKEY_INT(size),
+	),
+	"Check the memory-mapped frame rings of RTnet packet sockets over\n"
+	"\tthe loopback interface. Frames are sent and received with\n"
+	"\tsend()/recv() first, then through mmap()ed RX and TX rings, and\n"
+	"\tthe throughput of both runs is reported.\n\n"
+	"\tcount=<n>\tframes per run (default 10000)\n"
+	"\tsize=<bytes>\tframe size, including the Ethernet header\n"
+	"\t\t\t(default 256)"
+);
+
+#define RTNET_DRIVER  "rt_loopback"
+#define RTNET_INTF    "rtlo"
+#define PROTO         (ETH_P_802_EX1 + 2)
+#define FRAME_SIZE    2048
+#define RING_FRAMES   64
+/* Bounded by the socket pool in copy mode. */
+#define BATCH         8
+
+static int count = 10000;
+
+static size_t size = 256;
+
+static struct ethhdr header;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void set_timeout(int sock, nanosecs_rel_t timeout)
+{
+	if (__RT(ioctl(sock, RTNET_RTIOC_TIMEOUT, &timeout)))
+		error(1, errno, "ioctl(RTNET_RTIOC_TIMEOUT)");
+}
+
+static int create_socket(void)
+{
+	struct sockaddr_ll sll;
+	struct ifreq ifr;
+	int sock, ret;
+
+	sock = smokey_check_errno(
+		__RT(socket(PF_PACKET, SOCK_RAW, htons(PROTO))));
+	if (sock < 0)
+		return sock;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strcpy(ifr.ifr_name, RTNET_INTF);
+	ret = smokey_check_errno(__RT(ioctl(sock, SIOCGIFINDEX, &ifr)));
+	if (ret < 0)
+		goto fail;
+	ret = smokey_check_errno(__RT(ioctl(sock, SIOCGIFHWADDR, &ifr)));
+	if (ret < 0)
+		goto fail;
+
+	memcpy(header.h_dest, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+	memcpy(header.h_source, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+	header.h_proto = htons(PROTO);
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(PROTO);
+	sll.sll_ifindex = ifr.ifr_ifindex;
+	ret = smokey_check_errno(
+		__RT(bind(sock, (struct sockaddr *)&sll, sizeof(sll))));
+	if (ret < 0)
+		goto fail;
+
+	/* Never wait forever for a lost frame. */
+	set_timeout(sock, 1000000000LL);
+
+	return sock;
+fail:
+	__RT(close(sock));
+	return ret;
+}
+
+static void fill_frame(void *buf, unsigned int seq)
+{
+	memcpy(buf, &header, sizeof(header));
+	memcpy(buf + sizeof(header), &seq, sizeof(seq));
+	memset(buf + sizeof(header) + sizeof(seq), seq,
+	       size - sizeof(header) - sizeof(seq));
+}
+
+static int check_frame(const void *buf, size_t len, unsigned int seq)
+{
+	const unsigned char *p = buf;
+	unsigned int rseq;
+
+	if (!smokey_assert(len == size))
+		return -EPROTO;
+
+	memcpy(&rseq, p + sizeof(header), sizeof(rseq));
+	if (!smokey_assert(rseq == seq))
+		return -EPROTO;
+
+	if (!smokey_assert(p[size - 1] == (unsigned char)seq))
+		return -EPROTO;
+
+	return 0;
+}
+
+static void report(const char *mode, long long ns)
+{
+	smokey_trace("%s: %d frames of %zu bytes in %.3f ms, %.1f MB/s, "
+		     "%.0f frames/s", mode, count, size, ns / 1000000.0,
+		     (double)count * size * 1000.0 / ns,
+		     (double)count * 1000000000.0 / ns);
+}
+
+static int run_copy(void)
+{
+	int sock, n, b, ret = 0;
+	long long start;
+	ssize_t len;
+	char *buf;
+
+	sock = create_socket();
+	if (sock < 0)
+		return sock;
+
+	buf = malloc(FRAME_SIZE);
+	if (buf == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	start = now_ns();
+
+	for (n = 0; n < count && ret == 0; n += BATCH) {
+		for (b = n; b < n + BATCH && b < count; b++) {
+			fill_frame(buf, b);
+			if (smokey_check_errno(
+				    __RT(send(sock, buf, size, 0))) < 0) {
+				ret = -errno;
+				break;
+			}
+		}
+		for (b = n; b < n + BATCH && b < count && ret == 0; b++) {
+			len = __RT(recv(sock, buf, FRAME_SIZE, 0));
+			if (smokey_check_errno(len) < 0)
+				ret = -errno;
+			else
+				ret = check_frame(buf, len, b);
+		}
+	}
+
+	if (ret == 0)
+		report("copy", now_ns() - start);
+
+	free(buf);
+out:
+	__RT(close(sock));
+
+	return ret;
+}
+
+static inline struct rtnet_frame_hdr *
+ring_frame(void *base, unsigned int slot)
+{
+	return base + slot * FRAME_SIZE;
+}
+
+static int send_kick(int sock)
+{
+	struct msghdr msg;
+
+	memset(&msg, 0, sizeof(msg));
+
+	return __RT(sendmsg(sock, &msg, 0));
+}
+
+static int rx_frame(int sock, void *rx, unsigned int *rx_head,
+		    unsigned int seq)
+{
+	struct rtnet_frame_hdr *hdr;
+	unsigned int slot;
+	int ret;
+
+	slot = *rx_head;
+	hdr = ring_frame(rx, slot);
+	if ((hdr->status & RTNET_FRAME_USER) == 0 &&
+	    smokey_check_errno(
+		    __RT(ioctl(sock, RTNET_RTIOC_RXWAIT, &slot))) < 0)
+		return -errno;
+	__sync_synchronize();
+
+	if (!smokey_assert(hdr->status == RTNET_FRAME_USER))
+		return -EPROTO;
+	if (!smokey_assert(hdr->snaplen == hdr->len &&
+			   hdr->mac == RTNET_FRAME_HDRLEN &&
+			   hdr->net == hdr->mac + ETH_HLEN &&
+			   hdr->protocol == htons(PROTO)))
+		return -EPROTO;
+
+	ret = check_frame((void *)hdr + hdr->mac, hdr->len, seq);
+
+	/* Hand the slot back to the kernel. */
+	__sync_synchronize();
+	hdr->status = RTNET_FRAME_KERNEL;
+	*rx_head = (slot + 1) % RING_FRAMES;
+
+	return ret;
+}
+
+static int run_ring(void)
+{
+	struct rtnet_ring_req req = {
+		.frame_size = FRAME_SIZE,
+		.rx_frames = RING_FRAMES,
+		.tx_frames = RING_FRAMES,
+	};
+	unsigned int rx_head = 0, tx_head = 0, slot;
+	struct rtnet_frame_hdr *hdr;
+	size_t ringsz, areasz;
+	int sock, n, b, ret;
+	long long start;
+	void *rx, *tx;
+	char buf[64];
+
+	sock = create_socket();
+	if (sock < 0)
+		return sock;
+
+	ret = __RT(ioctl(sock, RTNET_RTIOC_RING, &req));
+	if (ret) {
+		ret = -errno;
+		if (ret == -ENOTTY || ret == -EOPNOTSUPP) {
+			smokey_note("net_packet_mmap: no ring support, "
+				    "skipping ring run");
+			ret = 0;
+		}
+		goto out;
+	}
+
+	if (!smokey_assert(__RT(ioctl(sock, RTNET_RTIOC_RING, &req)) == -1 &&
+			   errno == EBUSY)) {
+		ret = -EPROTO;
+		goto out;
+	}
+
+	ringsz = ((size_t)RING_FRAMES * FRAME_SIZE + getpagesize() - 1) &
+		~((size_t)getpagesize() - 1);
+	areasz = 2 * ringsz;
+	rx = mmap(NULL, areasz, PROT_READ|PROT_WRITE, MAP_SHARED, sock, 0);
+	if (rx == MAP_FAILED) {
+		ret = -errno;
+		smokey_warning("mmap: %s", strerror(errno));
+		goto out;
+	}
+	tx = rx + ringsz;
+
+	/* Frames only go to the RX ring. */
+	if (!smokey_assert(__RT(recv(sock, buf, sizeof(buf), 0)) == -1 &&
+			   errno == EINVAL)) {
+		ret = -EPROTO;
+		goto unmap;
+	}
+
+	/* Non-blocking wait on an empty slot. */
+	set_timeout(sock, RTDM_TIMEOUT_NONE);
+	slot = 0;
+	if (!smokey_assert(__RT(ioctl(sock, RTNET_RTIOC_RXWAIT, &slot)) == -1 &&
+			   errno == EWOULDBLOCK)) {
+		ret = -EPROTO;
+		goto unmap;
+	}
+	slot = RING_FRAMES;
+	if (!smokey_assert(__RT(ioctl(sock, RTNET_RTIOC_RXWAIT, &slot)) == -1 &&
+			   errno == EINVAL)) {
+		ret = -EPROTO;
+		goto unmap;
+	}
+	set_timeout(sock, 1000000000LL);
+
+	/* Malformed TX slots are skipped, not sent. */
+	hdr = ring_frame(tx, tx_head);
+	hdr->len = 0;
+	__sync_synchronize();
+	hdr->status = RTNET_FRAME_SEND_REQUEST;
+	if (!smokey_assert(send_kick(sock) == 0 &&
+			   hdr->status == RTNET_FRAME_WRONG_FORMAT)) {
+		ret = -EPROTO;
+		goto unmap;
+	}
+	hdr->status = RTNET_FRAME_AVAILABLE;
+	tx_head = (tx_head + 1) % RING_FRAMES;
+
+	start = now_ns();
+
+	for (n = 0; n < count && ret == 0; n += BATCH) {
+		for (b = n; b < n + BATCH && b < count; b++) {
+			hdr = ring_frame(tx, tx_head);
+			if (!smokey_assert(hdr->status ==
+					   RTNET_FRAME_AVAILABLE)) {
+				ret = -EPROTO;
+				break;
+			}
+			fill_frame((void *)hdr + RTNET_FRAME_HDRLEN, b);
+			hdr->len = size;
+			__sync_synchronize();
+			hdr->status = RTNET_FRAME_SEND_REQUEST;
+			tx_head = (tx_head + 1) % RING_FRAMES;
+		}
+		if (ret)
+			break;
+		ret = send_kick(sock);
+		if (smokey_check_errno(ret) < 0) {
+			ret = -errno;
+			break;
+		}
+		if (!smokey_assert(ret == (b - n) * size)) {
+			ret = -EPROTO;
+			break;
+		}
+		ret = 0;
+		for (b = n; b < n + BATCH && b < count && ret == 0; b++)
+			ret = rx_frame(sock, rx, &rx_head, b);
+	}
+
+	if (ret == 0)
+		report("ring", now_ns() - start);
+unmap:
+	munmap(rx, areasz);
+out:
+	__RT(close(sock));
+
+	return ret;
+}
+
+static int
+run_net_packet_mmap(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct sockaddr_in peer;
+	int ret, err;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(net_packet_mmap, count))
+		count = SMOKEY_ARG_INT(net_packet_mmap, count);
+	if (count <= 0)
+		error(1, EINVAL, "count=%d", count);
+
+	if (SMOKEY_ARG_ISSET(net_packet_mmap, size)) {
+		if (SMOKEY_ARG_INT(net_packet_mmap, size) <
+		    (int)(ETH_HLEN + sizeof(unsigned int)) ||
+		    SMOKEY_ARG_INT(net_packet_mmap, size) > ETH_FRAME_LEN)
+			error(1, EINVAL, "size=%d",
+			      SMOKEY_ARG_INT(net_packet_mmap, size));
+		size = SMOKEY_ARG_INT(net_packet_mmap, size);
+	}
+
+	/* Loopback only, frames are sent to ourselves. */
+	memset(&peer, 0, sizeof(peer));
+	peer.sin_family = AF_INET;
+	peer.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	ret = smokey_net_setup(RTNET_DRIVER, RTNET_INTF,
+			       _CC_COBALT_NET_AF_PACKET, &peer);
+	if (ret)
+		return ret;
+
+	ret = run_copy();
+	if (ret == 0)
+		ret = run_ring();
+
+	err = smokey_net_teardown(RTNET_DRIVER, RTNET_INTF,
+				  _CC_COBALT_NET_AF_PACKET);
+	if (ret == 0)
+		ret = err;
+
+	return ret;
+}
@@ -0,0 +1,448 @@
+/*
+ * RTnet IPv4 network route test.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include <sys/cobalt.h>
+#include <smokey/smokey.h>
+#include <ipv4_chrdev.h>
+#include "smokey_net.h"
+
+smokey_test_plugin(net_route,
+	SMOKEY_NOARGS,
+	"Check the longest-prefix matching of RTnet network routes over\n"
+	"\tthe loopback interface: nested prefixes, default route, deletion\n"
+	"\tof routes above glue nodes, route updates seen by connected UDP\n"
+	"\tsockets, exhaustion of the route and trie node pools."
+);
+
+#define RTNET_DRIVER  "rt_loopback"
+#define RTNET_INTF    "rtlo"
+#define ROUTE_VFILE   "/proc/xenomai/rtnet/ipv4/route"
+
+/*
+ * Routes are told apart by their gateway: frames to GW_OK go out
+ * through a host route, GW_BAD has none so sending fails with
+ * EHOSTUNREACH.
+ */
+#define GW_OK         "10.254.0.1"
+#define GW_BAD        "10.254.0.2"
+
+static int rtnet_fd;
+
+static int udp_sock;
+
+struct trie_usage {
+	int routes;
+	int max_routes;
+	int nodes;
+	int max_nodes;
+};
+
+static int read_usage(struct trie_usage *u)
+{
+	int found = 0;
+	char buf[128];
+	FILE *fp;
+
+	fp = fopen(ROUTE_VFILE, "r");
+	if (fp == NULL)
+		return -errno;
+
+	while (fgets(buf, sizeof(buf), fp)) {
+		if (sscanf(buf, "Network routes allocated/total: %d/%d",
+			   &u->routes, &u->max_routes) == 2)
+			found++;
+		else if (sscanf(buf, "Network trie nodes used/total: %d/%d",
+				&u->nodes, &u->max_nodes) == 2)
+			found++;
+	}
+
+	fclose(fp);
+
+	return found == 2 ? 0 : -ENOSYS;
+}
+
+static int check_usage(int routes, int nodes)
+{
+	struct trie_usage u;
+	int ret;
+
+	ret = read_usage(&u);
+	if (ret)
+		return ret;
+
+	if (!smokey_assert(u.routes == routes && u.nodes == nodes)) {
+		smokey_warning("expected %d routes, %d nodes, got %d, %d",
+			       routes, nodes, u.routes, u.nodes);
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+static in_addr_t ip(const char *s)
+{
+	return inet_addr(s);
+}
+
+static int route_ctl(unsigned int request, const char *net,
+		     unsigned int len, const char *gw)
+{
+	struct ipv4_cmd cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	if (request == IOC_RT_NET_ROUTE_ADD) {
+		cmd.args.addnet.net_addr = ip(net);
+		cmd.args.addnet.net_mask = htonl(len ? ~0U << (32 - len) : 0);
+		cmd.args.addnet.gw_addr = ip(gw);
+	} else {
+		cmd.args.delnet.net_addr = ip(net);
+		cmd.args.delnet.net_mask = htonl(len ? ~0U << (32 - len) : 0);
+	}
+
+	return ioctl(rtnet_fd, request, &cmd) < 0 ? -errno : 0;
+}
+
+static int add_route(const char *net, unsigned int len, const char *gw)
+{
+	return smokey_check_errno(
+		route_ctl(IOC_RT_NET_ROUTE_ADD, net, len, gw));
+}
+
+static int del_route(const char *net, unsigned int len)
+{
+	return smokey_check_errno(
+		route_ctl(IOC_RT_NET_ROUTE_DELETE, net, len, NULL));
+}
+
+/* Returns 1 if @dest goes through GW_OK, 0 if it has no usable route. */
+static int probe(const char *dest)
+{
+	struct sockaddr_in sin;
+	char c = 0;
+	int ret;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(9);
+	sin.sin_addr.s_addr = ip(dest);
+
+	ret = __RT(sendto(udp_sock, &c, sizeof(c), 0,
+			  (struct sockaddr *)&sin, sizeof(sin)));
+	if (ret < 0 && errno == EHOSTUNREACH)
+		return 0;
+	if (smokey_check_errno(ret) < 0)
+		return -errno;
+
+	return 1;
+}
+
+static int expect(const char *dest, int reachable)
+{
+	int ret;
+
+	ret = probe(dest);
+	if (ret < 0)
+		return ret;
+
+	if (!smokey_assert(ret == reachable)) {
+		smokey_warning("%s should be %sreachable", dest,
+			       reachable ? "" : "un");
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+static int host_route(unsigned int request, const char *addr)
+{
+	struct ipv4_cmd cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	strcpy(cmd.head.if_name, RTNET_INTF);
+	if (request == IOC_RT_HOST_ROUTE_ADD) {
+		cmd.args.addhost.ip_addr = ip(addr);
+		cmd.args.addhost.dev_addr[0] = 0x02;
+		cmd.args.addhost.dev_addr[5] = 0x01;
+	} else
+		cmd.args.delhost.ip_addr = ip(addr);
+
+	return smokey_check_errno(ioctl(rtnet_fd, request, &cmd));
+}
+
+#define check(__expr)				\
+	do {					\
+		ret = (__expr);			\
+		if (ret)			\
+			return ret;		\
+	} while (0)
+
+static int check_lookups(void)
+{
+	int sock, ret;
+	struct sockaddr_in sin;
+	char c = 0;
+
+	/* Nested prefixes, the longest one wins. */
+	check(add_route("10.99.0.0", 16, GW_OK));
+	check(add_route("10.99.1.0", 24, GW_BAD));
+	check(add_route("10.99.1.128", 25, GW_OK));
+	check(check_usage(3, 3));
+	check(expect("10.99.2.1", 1));
+	check(expect("10.99.1.1", 0));
+	check(expect("10.99.1.200", 1));
+	check(expect("10.98.0.1", 0));
+
+	/* The default route catches everything else. */
+	check(add_route("0.0.0.0", 0, GW_OK));
+	check(check_usage(4, 4));
+	check(expect("10.98.0.1", 1));
+	check(expect("192.168.77.1", 1));
+	check(expect("10.99.1.1", 0));
+
+	/*
+	 * 10.99.1.0/24 and 10.99.4.0/24 hang off a /21 glue node,
+	 * 10.99.128.0/24 is the other child of 10.99.0.0/16.
+	 */
+	check(add_route("10.99.4.0", 24, GW_BAD));
+	check(check_usage(5, 6));
+	check(add_route("10.99.128.0", 24, GW_BAD));
+	check(check_usage(6, 7));
+	check(expect("10.99.4.1", 0));
+	check(expect("10.99.5.1", 1));
+	check(expect("10.99.128.1", 0));
+
+	/* Glue nodes are not routes. */
+	if (!smokey_assert(route_ctl(IOC_RT_NET_ROUTE_DELETE,
+				     "10.99.0.0", 21, NULL) == -ENOENT))
+		return -EPROTO;
+	if (!smokey_assert(route_ctl(IOC_RT_NET_ROUTE_DELETE,
+				     "10.99.2.0", 24, NULL) == -ENOENT))
+		return -EPROTO;
+	check(check_usage(6, 7));
+
+	/* A connected socket follows route changes. */
+	sock = smokey_check_errno(
+		__RT(socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)));
+	if (sock < 0)
+		return sock;
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(9);
+	sin.sin_addr.s_addr = ip("10.99.2.1");
+	ret = smokey_check_errno(
+		__RT(connect(sock, (struct sockaddr *)&sin, sizeof(sin))));
+	if (ret == 0)
+		ret = smokey_check_errno(__RT(send(sock, &c, sizeof(c), 0)));
+
+	/* Deleting a route with a single child moves the child up. */
+	if (ret >= 0)
+		ret = del_route("10.99.1.0", 24);
+	if (ret >= 0)
+		ret = check_usage(5, 6);
+	if (ret >= 0)
+		ret = expect("10.99.1.1", 1);
+
+	/* Updating the gateway keeps the trie as is. */
+	if (ret >= 0)
+		ret = add_route("10.99.0.0", 16, GW_BAD);
+	if (ret >= 0)
+		ret = check_usage(5, 6);
+	if (ret >= 0) {
+		ret = __RT(send(sock, &c, sizeof(c), 0));
+		if (!smokey_assert(ret < 0 && errno == EHOSTUNREACH))
+			ret = -EPROTO;
+		else
+			ret = 0;
+	}
+	__RT(close(sock));
+	if (ret < 0)
+		return ret;
+
+	check(expect("10.99.1.1", 0));
+	check(expect("10.99.1.200", 1));
+
+	/* A route with two children turns into a glue node... */
+	check(del_route("10.99.0.0", 16));
+	check(check_usage(4, 6));
+	check(expect("10.99.2.1", 1));
+	check(expect("10.99.4.1", 0));
+	check(expect("10.99.1.200", 1));
+	check(expect("10.99.128.1", 0));
+
+	/* ...which may carry a route again. */
+	check(add_route("10.99.0.0", 16, GW_BAD));
+	check(check_usage(5, 6));
+	check(expect("10.99.2.1", 0));
+	check(del_route("10.99.0.0", 16));
+
+	/* Removing a leaf drops its glue parent. */
+	check(del_route("10.99.1.128", 25));
+	check(check_usage(3, 4));
+	check(expect("10.99.1.200", 1));
+	check(expect("10.99.4.1", 0));
+	check(expect("10.99.128.1", 0));
+
+	check(del_route("10.99.4.0", 24));
+	check(check_usage(2, 2));
+	check(expect("10.99.4.1", 1));
+	check(expect("10.99.128.1", 0));
+
+	check(del_route("10.99.128.0", 24));
+	check(del_route("0.0.0.0", 0));
+	check(check_usage(0, 0));
+
+	return expect("10.99.128.1", 0);
+}
+
+static int check_exhaustion(void)
+{
+	struct trie_usage u;
+	char net[32];
+	int n, ret;
+
+	check(read_usage(&u));
+
+	for (n = 0; n < u.max_routes + 1; n++) {
+		snprintf(net, sizeof(net), "10.%d.%d.0",
+			 100 + (n >> 8), n & 0xff);
+		ret = route_ctl(IOC_RT_NET_ROUTE_ADD, net, 24, GW_OK);
+		if (ret == -ENOBUFS)
+			break;
+		if (smokey_check_errno(ret) < 0)
+			goto out;
+	}
+
+	if (!smokey_assert(n > 0 && n <= u.max_routes)) {
+		ret = -EPROTO;
+		goto out;
+	}
+
+	ret = read_usage(&u);
+	if (ret)
+		goto out;
+	if (!smokey_assert(u.routes == n && u.nodes <= 2 * n - 1)) {
+		ret = -EPROTO;
+		goto out;
+	}
+
+	/* Updates need no allocation. */
+	ret = add_route("10.100.0.0", 24, GW_BAD);
+	if (ret)
+		goto out;
+	ret = expect("10.100.0.1", 0);
+	if (ret)
+		goto out;
+	ret = expect("10.100.1.1", n > 1);
+	if (ret)
+		goto out;
+	ret = check_usage(u.routes, u.nodes);
+out:
+	while (n-- > 0) {
+		snprintf(net, sizeof(net), "10.%d.%d.0",
+			 100 + (n >> 8), n & 0xff);
+		if (del_route(net, 24) < 0 && ret == 0)
+			ret = -errno;
+	}
+
+	if (ret == 0)
+		ret = check_usage(0, 0);
+
+	return ret;
+}
+
+/* Leave no route behind when a check failed half-way. */
+static void cleanup_lookups(void)
+{
+	static const struct {
+		const char *net;
+		unsigned int len;
+	} routes[] = {
+		{ "10.99.0.0", 16 }, { "10.99.1.0", 24 }, { "10.99.1.128", 25 },
+		{ "10.99.4.0", 24 }, { "10.99.128.0", 24 }, { "0.0.0.0", 0 },
+	};
+	unsigned int n;
+
+	for (n = 0; n < sizeof(routes) / sizeof(routes[0]); n++)
+		route_ctl(IOC_RT_NET_ROUTE_DELETE, routes[n].net,
+			  routes[n].len, NULL);
+}
+
+static int run_net_route(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct trie_usage u;
+	struct sockaddr_in peer;
+	int ret, err;
+
+	/* Loopback only, frames are sent to ourselves. */
+	memset(&peer, 0, sizeof(peer));
+	peer.sin_family = AF_INET;
+	peer.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	ret = smokey_net_setup(RTNET_DRIVER, RTNET_INTF,
+			       _CC_COBALT_NET_UDP, &peer);
+	if (ret)
+		return ret;
+
+	ret = read_usage(&u);
+	if (ret) {
+		smokey_note("net_route skipped (no network routing)");
+		goto teardown;
+	}
+
+	/* Do not mess with the routes of a configured system. */
+	if (u.routes > 0) {
+		smokey_trace("%d network routes set up, skipped", u.routes);
+		goto teardown;
+	}
+
+	rtnet_fd = smokey_check_errno(open("/dev/rtnet", O_RDWR));
+	if (rtnet_fd < 0) {
+		ret = rtnet_fd;
+		goto teardown;
+	}
+
+	udp_sock = smokey_check_errno(
+		__RT(socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)));
+	if (udp_sock < 0) {
+		ret = udp_sock;
+		goto close_fd;
+	}
+
+	ret = host_route(IOC_RT_HOST_ROUTE_ADD, GW_OK);
+	if (ret < 0)
+		goto close_sock;
+
+	ret = check_lookups();
+	if (ret)
+		cleanup_lookups();
+	else
+		ret = check_exhaustion();
+
+	err = host_route(IOC_RT_HOST_ROUTE_DELETE, GW_OK);
+	if (ret == 0 && err < 0)
+		ret = err;
+close_sock:
+	__RT(close(udp_sock));
+close_fd:
+	close(rtnet_fd);
+teardown:
+	err = smokey_net_teardown(RTNET_DRIVER, RTNET_INTF,
+				  _CC_COBALT_NET_UDP);
+	if (ret == 0)
+		ret = err;
+
+	return ret;
+}
@@ -0,0 +1,499 @@
+/*
+ * RTnet early RX classifier test.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <net/ethernet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netpacket/packet.h>
+
+#include <sys/cobalt.h>
+#include <smokey/smokey.h>
+#include <rtnet.h>
+#include <rtnet_chrdev.h>
+#include "smokey_net.h"
+
+smokey_test_plugin(net_rxrule,
+	SMOKEY_NOARGS,
+	"Check the rules of the RTnet early RX classifier over the loopback\n"
+	"\tinterface: rule validation, ordering, hit counts, drop and\n"
+	"\tdelivery to packet sockets, removal of socket rules on close."
+);
+
+#define RTNET_DRIVER  "rt_loopback"
+#define RTNET_INTF    "rtlo"
+/* Out of the range used by the loopback server. */
+#define PROTO_A       (ETH_P_802_EX1 + 3)
+#define PROTO_B       (ETH_P_802_EX1 + 4)
+
+static int rtnet_fd;
+
+static int ifindex;
+
+static struct ethhdr header;
+
+static int rule_ctl(unsigned int request, int index,
+		    struct rtnet_rx_rule *rule, __u64 *hits)
+{
+	struct rtnet_core_cmd cmd;
+	int ret;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.args.rxrule.index = index;
+	if (rule)
+		cmd.args.rxrule.rule = *rule;
+
+	ret = ioctl(rtnet_fd, request, &cmd);
+	if (ret < 0)
+		return -errno;
+
+	if (request == IOC_RT_RXRULE_GET) {
+		*rule = cmd.args.rxrule.rule;
+		if (hits)
+			*hits = cmd.args.rxrule.hits;
+	}
+
+	return ret;
+}
+
+static int count_rules(void)
+{
+	struct rtnet_rx_rule rule;
+	int n;
+
+	for (n = 0; rule_ctl(IOC_RT_RXRULE_GET, n, &rule, NULL) == 0; n++)
+		;
+
+	return n;
+}
+
+static void init_rule(struct rtnet_rx_rule *rule, int action,
+		      unsigned short ethertype)
+{
+	memset(rule, 0, sizeof(*rule));
+	rule->match = RTNET_RX_MATCH_ETHTYPE;
+	rule->ethertype = ethertype;
+	rule->action = action;
+}
+
+static int create_socket(unsigned short proto)
+{
+	nanosecs_rel_t timeout = 100000000LL;
+	struct sockaddr_ll sll;
+	int sock, ret;
+
+	sock = smokey_check_errno(
+		__RT(socket(PF_PACKET, SOCK_RAW, htons(proto))));
+	if (sock < 0)
+		return sock;
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(proto);
+	sll.sll_ifindex = ifindex;
+	ret = smokey_check_errno(
+		__RT(bind(sock, (struct sockaddr *)&sll, sizeof(sll))));
+	if (ret < 0)
+		goto fail;
+
+	/* Some frames are expected not to show up. */
+	ret = smokey_check_errno(
+		__RT(ioctl(sock, RTNET_RTIOC_TIMEOUT, &timeout)));
+	if (ret < 0)
+		goto fail;
+
+	return sock;
+fail:
+	__RT(close(sock));
+
+	return ret;
+}
+
+static int send_frame(int sock, unsigned short proto)
+{
+	char buf[ETH_ZLEN];
+
+	memset(buf, 0, sizeof(buf));
+	header.h_proto = htons(proto);
+	memcpy(buf, &header, sizeof(header));
+
+	return smokey_check_errno(__RT(send(sock, buf, sizeof(buf), 0)));
+}
+
+/* Returns 1 if a frame was received, 0 on timeout. */
+static int recv_frame(int sock)
+{
+	char buf[ETH_FRAME_LEN];
+	ssize_t len;
+
+	len = __RT(recv(sock, buf, sizeof(buf), 0));
+	if (len < 0 && errno == ETIMEDOUT)
+		return 0;
+	if (smokey_check_errno(len) < 0)
+		return -errno;
+
+	return 1;
+}
+
+static int check_hits(int index, __u64 expected)
+{
+	struct rtnet_rx_rule rule;
+	__u64 hits;
+	int ret;
+
+	ret = smokey_check_errno(rule_ctl(IOC_RT_RXRULE_GET, index,
+					  &rule, &hits));
+	if (ret < 0)
+		return ret;
+
+	return smokey_assert(hits == expected) ? 0 : -EPROTO;
+}
+
+static int check_validation(int nr)
+{
+	struct rtnet_rx_rule rule;
+
+	init_rule(&rule, RTNET_RX_ACTION_DROP, PROTO_A);
+	rule.match |= 0x80;
+	if (!smokey_assert(rule_ctl(IOC_RT_RXRULE_ADD, -1,
+				    &rule, NULL) == -EINVAL))
+		return -EPROTO;
+
+	init_rule(&rule, RTNET_RX_ACTION_DROP, PROTO_A);
+	rule.match |= RTNET_RX_MATCH_SPORT;
+	rule.sport_min = 200;
+	rule.sport_max = 100;
+	if (!smokey_assert(rule_ctl(IOC_RT_RXRULE_ADD, -1,
+				    &rule, NULL) == -EINVAL))
+		return -EPROTO;
+
+	init_rule(&rule, RTNET_RX_ACTION_QUEUE, PROTO_A);
+	rule.queue = 0xffff;
+	if (!smokey_assert(rule_ctl(IOC_RT_RXRULE_ADD, -1,
+				    &rule, NULL) == -EINVAL))
+		return -EPROTO;
+
+	/* Only packet sockets may have packets delivered to them. */
+	init_rule(&rule, RTNET_RX_ACTION_DELIVER, PROTO_A);
+	if (!smokey_assert(rule_ctl(IOC_RT_RXRULE_ADD, -1,
+				    &rule, NULL) == -EINVAL))
+		return -EPROTO;
+
+	init_rule(&rule, 7, PROTO_A);
+	if (!smokey_assert(rule_ctl(IOC_RT_RXRULE_ADD, -1,
+				    &rule, NULL) == -EINVAL))
+		return -EPROTO;
+
+	if (!smokey_assert(rule_ctl(IOC_RT_RXRULE_GET, nr,
+				    &rule, NULL) == -ENOENT))
+		return -EPROTO;
+
+	if (!smokey_assert(rule_ctl(IOC_RT_RXRULE_DEL, nr,
+				    NULL, NULL) == -ENOENT))
+		return -EPROTO;
+
+	return smokey_assert(count_rules() == nr) ? 0 : -EPROTO;
+}
+
+static int check_ordering(int nr)
+{
+	struct rtnet_rx_rule rule;
+	__u64 hits;
+	int ret;
+
+	init_rule(&rule, RTNET_RX_ACTION_QUEUE, PROTO_A);
+	ret = smokey_check_errno(rule_ctl(IOC_RT_RXRULE_ADD, 0, &rule, NULL));
+	if (ret < 0)
+		return ret;
+
+	init_rule(&rule, RTNET_RX_ACTION_DROP, PROTO_B);
+	ret = smokey_check_errno(rule_ctl(IOC_RT_RXRULE_ADD, 0, &rule, NULL));
+	if (ret < 0)
+		return ret;
+
+	/* Appending past the end is fine. */
+	init_rule(&rule, RTNET_RX_ACTION_DROP, PROTO_A);
+	ret = smokey_check_errno(rule_ctl(IOC_RT_RXRULE_ADD, nr + 100,
+					  &rule, NULL));
+	if (ret < 0)
+		return ret;
+
+	if (!smokey_assert(count_rules() == nr + 3))
+		return -EPROTO;
+
+	ret = smokey_check_errno(rule_ctl(IOC_RT_RXRULE_GET, 0, &rule, &hits));
+	if (ret < 0)
+		return ret;
+	if (!smokey_assert(rule.ethertype == PROTO_B &&
+			   rule.action == RTNET_RX_ACTION_DROP && hits == 0))
+		return -EPROTO;
+
+	ret = smokey_check_errno(rule_ctl(IOC_RT_RXRULE_GET, 1, &rule, &hits));
+	if (ret < 0)
+		return ret;
+	if (!smokey_assert(rule.ethertype == PROTO_A &&
+			   rule.action == RTNET_RX_ACTION_QUEUE && hits == 0))
+		return -EPROTO;
+
+	ret = smokey_check_errno(rule_ctl(IOC_RT_RXRULE_GET, nr + 2,
+					  &rule, &hits));
+	if (ret < 0)
+		return ret;
+	if (!smokey_assert(rule.ethertype == PROTO_A &&
+			   rule.action == RTNET_RX_ACTION_DROP))
+		return -EPROTO;
+
+	ret = smokey_check_errno(rule_ctl(IOC_RT_RXRULE_DEL, nr + 2,
+					  NULL, NULL));
+	if (ret < 0)
+		return ret;
+
+	ret = smokey_check_errno(rule_ctl(IOC_RT_RXRULE_DEL, 0, NULL, NULL));
+	if (ret < 0)
+		return ret;
+
+	ret = smokey_check_errno(rule_ctl(IOC_RT_RXRULE_DEL, 0, NULL, NULL));
+	if (ret < 0)
+		return ret;
+
+	return smokey_assert(count_rules() == nr) ? 0 : -EPROTO;
+}
+
+static int check_socket_rules(int nr)
+{
+	int tx_sock, rx_sock, all_sock, ret;
+	struct rtnet_rx_rule rule;
+	__u64 hits;
+
+	tx_sock = create_socket(PROTO_A);
+	if (tx_sock < 0)
+		return tx_sock;
+
+	rx_sock = create_socket(PROTO_B);
+	if (rx_sock < 0) {
+		ret = rx_sock;
+		goto close_tx;
+	}
+
+	/* Without rules, frames go to the protocol listener. */
+	ret = send_frame(tx_sock, PROTO_A);
+	if (ret < 0)
+		goto close_rx;
+	ret = recv_frame(tx_sock);
+	if (ret < 0)
+		goto close_rx;
+	if (!smokey_assert(ret == 1)) {
+		ret = -EPROTO;
+		goto close_rx;
+	}
+
+	/* A socket cannot claim frames from a device it is not bound to. */
+	init_rule(&rule, RTNET_RX_ACTION_DELIVER, PROTO_A);
+	rule.match |= RTNET_RX_MATCH_IFINDEX;
+	rule.ifindex = ifindex + 100;
+	ret = __RT(ioctl(rx_sock, RTNET_RTIOC_RXRULE, &rule));
+	if (!smokey_assert(ret < 0 && errno == EINVAL)) {
+		ret = -EPROTO;
+		goto close_rx;
+	}
+
+	init_rule(&rule, RTNET_RX_ACTION_DELIVER, PROTO_A);
+	ret = smokey_check_errno(
+		__RT(ioctl(rx_sock, RTNET_RTIOC_RXRULE, &rule)));
+	if (ret < 0)
+		goto close_rx;
+
+	if (!smokey_assert(count_rules() == nr + 1)) {
+		ret = -EPROTO;
+		goto close_rx;
+	}
+
+	ret = smokey_check_errno(rule_ctl(IOC_RT_RXRULE_GET, nr,
+					  &rule, &hits));
+	if (ret < 0)
+		goto close_rx;
+	if (!smokey_assert(rule.action == RTNET_RX_ACTION_DELIVER &&
+			   (rule.match & RTNET_RX_MATCH_IFINDEX) &&
+			   rule.ifindex == ifindex && hits == 0)) {
+		ret = -EPROTO;
+		goto close_rx;
+	}
+
+	/* Matching frames are the rule owner's alone. */
+	ret = send_frame(tx_sock, PROTO_A);
+	if (ret < 0)
+		goto close_rx;
+	ret = recv_frame(rx_sock);
+	if (ret < 0)
+		goto close_rx;
+	if (!smokey_assert(ret == 1)) {
+		ret = -EPROTO;
+		goto close_rx;
+	}
+	ret = recv_frame(tx_sock);
+	if (ret < 0)
+		goto close_rx;
+	if (!smokey_assert(ret == 0)) {
+		ret = -EPROTO;
+		goto close_rx;
+	}
+
+	ret = check_hits(nr, 1);
+	if (ret)
+		goto close_rx;
+
+	/* The first matching rule wins. */
+	init_rule(&rule, RTNET_RX_ACTION_DROP, PROTO_A);
+	ret = smokey_check_errno(rule_ctl(IOC_RT_RXRULE_ADD, 0, &rule, NULL));
+	if (ret < 0)
+		goto close_rx;
+
+	ret = send_frame(tx_sock, PROTO_A);
+	if (ret < 0)
+		goto del_drop;
+	ret = recv_frame(rx_sock);
+	if (ret < 0)
+		goto del_drop;
+	if (!smokey_assert(ret == 0)) {
+		ret = -EPROTO;
+		goto del_drop;
+	}
+
+	ret = check_hits(0, 1);
+	if (ret)
+		goto del_drop;
+	ret = check_hits(nr + 1, 1);
+del_drop:
+	if (smokey_check_errno(rule_ctl(IOC_RT_RXRULE_DEL, 0,
+					NULL, NULL)) < 0 && ret == 0)
+		ret = -errno;
+	if (ret)
+		goto close_rx;
+
+	/* ETH_P_ALL listeners only get copies, they cannot claim frames. */
+	all_sock = __RT(socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ALL)));
+	if (all_sock >= 0) {
+		init_rule(&rule, RTNET_RX_ACTION_DELIVER, PROTO_A);
+		ret = __RT(ioctl(all_sock, RTNET_RTIOC_RXRULE, &rule));
+		if (!smokey_assert(ret < 0 && errno == EINVAL))
+			ret = -EPROTO;
+		else
+			ret = 0;
+		__RT(close(all_sock));
+		if (ret)
+			goto close_rx;
+	} else
+		smokey_trace("ETH_P_ALL check skipped");
+
+	/* Closing the socket drops its rules. */
+	ret = smokey_check_errno(__RT(close(rx_sock)));
+	if (ret < 0)
+		goto close_tx;
+
+	if (!smokey_assert(count_rules() == nr)) {
+		ret = -EPROTO;
+		goto close_tx;
+	}
+
+	ret = send_frame(tx_sock, PROTO_A);
+	if (ret < 0)
+		goto close_tx;
+	ret = recv_frame(tx_sock);
+	if (ret >= 0)
+		ret = smokey_assert(ret == 1) ? 0 : -EPROTO;
+	goto close_tx;
+
+close_rx:
+	__RT(close(rx_sock));
+close_tx:
+	__RT(close(tx_sock));
+
+	return ret;
+}
+
+static int get_interface(void)
+{
+	struct ifreq ifr;
+	int sock, ret;
+
+	sock = smokey_check_errno(
+		__RT(socket(PF_PACKET, SOCK_RAW, htons(PROTO_A))));
+	if (sock < 0)
+		return sock;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strcpy(ifr.ifr_name, RTNET_INTF);
+	ret = smokey_check_errno(__RT(ioctl(sock, SIOCGIFINDEX, &ifr)));
+	if (ret < 0)
+		goto out;
+	ifindex = ifr.ifr_ifindex;
+
+	ret = smokey_check_errno(__RT(ioctl(sock, SIOCGIFHWADDR, &ifr)));
+	if (ret < 0)
+		goto out;
+	memcpy(header.h_dest, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+	memcpy(header.h_source, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+out:
+	__RT(close(sock));
+
+	return ret;
+}
+
+static int run_net_rxrule(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct sockaddr_in peer;
+	int ret, err, nr;
+
+	/* Loopback only, frames are sent to ourselves. */
+	memset(&peer, 0, sizeof(peer));
+	peer.sin_family = AF_INET;
+	peer.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	ret = smokey_net_setup(RTNET_DRIVER, RTNET_INTF,
+			       _CC_COBALT_NET_AF_PACKET, &peer);
+	if (ret)
+		return ret;
+
+	rtnet_fd = smokey_check_errno(open("/dev/rtnet", O_RDWR));
+	if (rtnet_fd < 0) {
+		ret = rtnet_fd;
+		goto teardown;
+	}
+
+	ret = get_interface();
+	if (ret)
+		goto out;
+
+	/* Rules may have been set up when loading the stack. */
+	nr = count_rules();
+
+	ret = check_validation(nr);
+	if (ret == 0)
+		ret = check_ordering(nr);
+	if (ret)
+		goto out;
+
+	/* Preset rules could catch our frames first. */
+	if (nr > 0)
+		smokey_trace("%d rules preset, delivery checks skipped", nr);
+	else
+		ret = check_socket_rules(nr);
+out:
+	close(rtnet_fd);
+teardown:
+	err = smokey_net_teardown(RTNET_DRIVER, RTNET_INTF,
+				  _CC_COBALT_NET_AF_PACKET);
+	if (ret == 0)
+		ret = err;
+
+	return ret;
+}
@@ -0,0 +1,211 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <cobalt/sys/cobalt.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(posix_selector,
+		   SMOKEY_NOARGS,
+		   "Check Cobalt persistent selectors"
+);
+
+#define NR_TIMERS  8
+
+static int arm_timer(int fd, long ns)
+{
+	struct itimerspec its;
+
+	its.it_value.tv_sec = 0;
+	its.it_value.tv_nsec = ns;
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = 0;
+
+	return smokey_check_errno(timerfd_settime(fd, 0, &its, NULL));
+}
+
+static int check_ready(int sfd, int *tfds, unsigned int expected)
+{
+	struct cobalt_selector_event events[NR_TIMERS];
+	unsigned long long ticks;
+	unsigned int seen = 0;
+	struct timespec ts;
+	int ret, n;
+
+	ts.tv_sec = 1;
+	ts.tv_nsec = 0;
+
+	while (seen != expected) {
+		ret = smokey_check_errno(cobalt_selector_wait(sfd, events,
+							      NR_TIMERS, &ts));
+		if (ret < 0)
+			return ret;
+		if (!smokey_assert(ret > 0))
+			return -ETIMEDOUT;
+
+		for (n = 0; n < ret; n++) {
+			if (!smokey_assert(events[n].events & COBALT_SELECTOR_IN))
+				return -EINVAL;
+			if (!smokey_assert(events[n].data < NR_TIMERS))
+				return -EINVAL;
+			if (!smokey_assert(events[n].fd == tfds[events[n].data]))
+				return -EINVAL;
+			if (!smokey_assert(expected & (1U << events[n].data)))
+				return -EINVAL;
+			ret = smokey_check_errno(read(events[n].fd,
+						      &ticks, sizeof(ticks)));
+			if (ret < 0)
+				return ret;
+			seen |= 1U << events[n].data;
+		}
+	}
+
+	/* Everything was consumed, nothing may be left ready. */
+	ts.tv_sec = 0;
+	ret = smokey_check_errno(cobalt_selector_wait(sfd, events,
+						      NR_TIMERS, &ts));
+	if (ret < 0)
+		return ret;
+
+	return smokey_assert(ret == 0) ? 0 : -EINVAL;
+}
+
+static int run_posix_selector(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct cobalt_selector_event ev;
+	int tfds[NR_TIMERS], sfd, ret, n;
+
+	sfd = cobalt_selector_create(0);
+	if (sfd < 0 && errno == ENOSYS) {
+		smokey_note("posix_selector skipped (no kernel support)");
+		return -ENOSYS;
+	}
+	sfd = smokey_check_errno(sfd);
+	if (sfd < 0)
+		return sfd;
+
+	for (n = 0; n < NR_TIMERS; n++) {
+		tfds[n] = smokey_check_errno(timerfd_create(CLOCK_MONOTONIC, 0));
+		if (tfds[n] < 0)
+			return tfds[n];
+		ev.events = COBALT_SELECTOR_IN;
+		ev.data = n;
+		ret = smokey_check_errno(cobalt_selector_ctl(sfd,
+				COBALT_SELECTOR_ADD, tfds[n], &ev));
+		if (ret)
+			return ret;
+	}
+
+	/* Adding twice must be refused. */
+	ret = cobalt_selector_ctl(sfd, COBALT_SELECTOR_ADD, tfds[0], &ev);
+	if (!smokey_assert(ret < 0 && errno == EEXIST))
+		return -EINVAL;
+
+	/* Only the armed timers must show up. */
+	for (n = 0; n < NR_TIMERS; n += 2) {
+		ret = arm_timer(tfds[n], 1000000 * (n + 1));
+		if (ret)
+			return ret;
+	}
+
+	ret = check_ready(sfd, tfds, 0x55);
+	if (ret)
+		return ret;
+
+	/* A removed fd must not be reported anymore. */
+	ret = smokey_check_errno(cobalt_selector_ctl(sfd,
+				COBALT_SELECTOR_DEL, tfds[1], NULL));
+	if (ret)
+		return ret;
+
+	for (n = 0; n < 4; n++) {
+		ret = arm_timer(tfds[n], 1000000);
+		if (ret)
+			return ret;
+	}
+
+	ret = check_ready(sfd, tfds, 0xd);
+	if (ret)
+		return ret;
+
+	/* Drop interest without removing the fd. */
+	ev.events = 0;
+	ev.data = 2;
+	ret = smokey_check_errno(cobalt_selector_ctl(sfd,
+				COBALT_SELECTOR_MOD, tfds[2], &ev));
+	if (ret)
+		return ret;
+
+	ret = arm_timer(tfds[2], 1000000);
+	if (ret)
+		return ret;
+
+	ret = arm_timer(tfds[3], 2000000);
+	if (ret)
+		return ret;
+
+	ret = check_ready(sfd, tfds, 0x8);
+	if (ret)
+		return ret;
+
+	/* Closing an fd must drop its item, even if it was ready. */
+	ret = arm_timer(tfds[3], 1000000);
+	if (ret)
+		return ret;
+
+	usleep(10000);
+	close(tfds[3]);
+
+	ret = check_ready(sfd, tfds, 0);
+	if (ret)
+		return ret;
+
+	ret = cobalt_selector_ctl(sfd, COBALT_SELECTOR_DEL, tfds[3], NULL);
+	if (!smokey_assert(ret < 0 && errno == ENOENT))
+		return -EINVAL;
+
+	/* The index is free for a new fd. */
+	tfds[3] = smokey_check_errno(timerfd_create(CLOCK_MONOTONIC, 0));
+	if (tfds[3] < 0)
+		return tfds[3];
+	ev.events = COBALT_SELECTOR_IN;
+	ev.data = 3;
+	ret = smokey_check_errno(cobalt_selector_ctl(sfd,
+				COBALT_SELECTOR_ADD, tfds[3], &ev));
+	if (ret)
+		return ret;
+
+	ret = arm_timer(tfds[3], 1000000);
+	if (ret)
+		return ret;
+
+	ret = check_ready(sfd, tfds, 0x8);
+	if (ret)
+		return ret;
+
+	for (n = 0; n < NR_TIMERS; n++)
+		close(tfds[n]);
+
+	return smokey_check_errno(close(sfd));
+}
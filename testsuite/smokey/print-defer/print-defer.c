@@ -0,0 +1,159 @@
+/*
+ * Deferred rt_printf() formatting test.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <error.h>
+#include <sys/cobalt.h>
+#include <cobalt/tunables.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(print_defer,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(count),
+		   ),
+   "Check deferred formatting of rt_printf() output. The same lines\n"
+   "\tare printed from primary mode with formatting done by the\n"
+   "\tcaller, then by the printer thread, and both outputs must match\n"
+   "\tthe one of snprintf(). The cost of rt_fprintf() on the caller\n"
+   "\tside is reported for both modes.\n\n"
+   "\tcount=<n>\tcalls per timed run (default 10000)"
+);
+
+#define BATCH  64
+
+static int count = 10000;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#define print_line(__fp, __buf, __len, __fmt, __args...)		\
+	do {								\
+		rt_fprintf(__fp, __fmt, ##__args);			\
+		__len += snprintf(__buf + __len, sizeof(__buf) - __len,	\
+				  __fmt, ##__args);			\
+	} while (0)
+
+static int check_output(int deferred)
+{
+	char expected[1024], output[1024], name[16] = "smokey";
+	size_t len = 0, n;
+	FILE *fp;
+
+	fp = tmpfile();
+	if (fp == NULL)
+		error(1, errno, "tmpfile");
+
+	set_config_tunable(print_deferred, deferred);
+	cobalt_thread_harden();
+
+	print_line(fp, expected, len, "%d %u %x %o %c\n", -42, 42U, 0xbeef, 8, 'z');
+	print_line(fp, expected, len, "%ld %lld %zu %jd %td\n",
+		   -1L, 1LL << 40, sizeof(len), (intmax_t)-7, (ptrdiff_t)3);
+	print_line(fp, expected, len, "%.3f %e %g %8.2f|\n",
+		   3.14159, 1e-9, 2.5, -0.125);
+	print_line(fp, expected, len, "[%s] [%-10s] [%.3s] [%*d] [%.*s]\n",
+		   name, name, name, 6, 7, 2, name);
+	print_line(fp, expected, len, "%p %% %s\n", (void *)expected, "end");
+
+	/* The caller's copy may change once rt_printf() returned. */
+	rt_fprintf(fp, "%s\n", name);
+	strcpy(name, "changed");
+	len += snprintf(expected + len, sizeof(expected) - len, "smokey\n");
+
+	rt_print_flush_buffers();
+
+	rewind(fp);
+	n = fread(output, 1, sizeof(output) - 1, fp);
+	fclose(fp);
+	output[n] = '\0';
+
+	if (!smokey_assert(n == len && memcmp(output, expected, len) == 0)) {
+		smokey_warning("expected:\n%s", expected);
+		smokey_warning("got:\n%s", output);
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+static void time_calls(int deferred)
+{
+	long long start, ns = 0;
+	int n, m;
+	FILE *fp;
+
+	fp = fopen("/dev/null", "w");
+	if (fp == NULL)
+		error(1, errno, "fopen(/dev/null)");
+
+	set_config_tunable(print_deferred, deferred);
+
+	for (n = 0; n < count; n += BATCH) {
+		cobalt_thread_harden();
+		start = now_ns();
+		for (m = 0; m < BATCH; m++)
+			rt_fprintf(fp, "loop %d: x=%.6f y=%.6f err=%e state=%s\n",
+				   n + m, n * 0.5, m * 0.25, 1.0 / (n + m + 1),
+				   deferred ? "deferred" : "inline");
+		ns += now_ns() - start;
+		/* Leave room in the relay buffer for the next batch. */
+		rt_print_flush_buffers();
+	}
+
+	fclose(fp);
+
+	smokey_trace("%s formatting: %d calls, %.1f ns per call",
+		     deferred ? "deferred" : "inline",
+		     n, (double)ns / n);
+}
+
+static int run_print_defer(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct sched_param param;
+	int ret, odeferred;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(print_defer, count))
+		count = SMOKEY_ARG_INT(print_defer, count);
+	if (count <= 0)
+		error(1, EINVAL, "count=%d", count);
+
+	param.sched_priority = 10;
+	ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (ret) {
+		warning("pthread_setschedparam(SCHED_FIFO, 10) failed");
+		return -ret;
+	}
+
+	odeferred = get_config_tunable(print_deferred);
+
+	ret = check_output(0);
+	if (ret == 0)
+		ret = check_output(1);
+
+	if (ret == 0) {
+		time_calls(0);
+		time_calls(1);
+	}
+
+	set_config_tunable(print_deferred, odeferred);
+
+	return ret;
+}
@@ -0,0 +1,300 @@
+/*
+ * Periodic release group test.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <error.h>
+#include <sys/cobalt.h>
+#include <boilerplate/ancillaries.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(relgroup,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(period),
+			   SMOKEY_INT(duration),
+		   ),
+   "Check periodic release groups. A set of threads with harmonic\n"
+   "\tperiods is run with one periodic timer per thread first, then\n"
+   "\tfrom a single release group. Release latencies are reported\n"
+   "\tfor both runs.\n\n"
+   "\tA successful test shows that each thread is released as many\n"
+   "\ttimes from the group as from its own timer, without overrun,\n"
+   "\tand that group members are unblocked when the group is deleted.\n"
+   "\tperiod=<us>\tbase period (default 1000)\n"
+   "\tduration=<ms>\tlength of each run (default 1000)"
+);
+
+struct rel_task {
+	const char *name;
+	unsigned int mult;	/* period, in base periods */
+	pthread_t tid;
+	unsigned long releases;
+	unsigned long overruns;
+	long long lat_max;	/* ns */
+	long long lat_sum;	/* ns */
+	int err;
+};
+
+static struct rel_task tasks[] = {
+	{ .name = "relgroup-x1", .mult = 1 },
+	{ .name = "relgroup-x2", .mult = 2 },
+	{ .name = "relgroup-x4", .mult = 4 },
+	{ .name = "relgroup-x8", .mult = 8 },
+};
+
+#define NR_TASKS  (sizeof(tasks) / sizeof(tasks[0]))
+
+static long long base_period = 1000000;
+
+static long long start_date, end_date;
+
+static int group_fd = -1;
+
+static sem_t ready;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void ns_to_ts(struct timespec *ts, long long ns)
+{
+	ts->tv_sec = ns / 1000000000LL;
+	ts->tv_nsec = ns % 1000000000LL;
+}
+
+static void account_release(struct rel_task *t, long long release)
+{
+	long long lat = now_ns() - release;
+
+	if (lat > t->lat_max)
+		t->lat_max = lat;
+	t->lat_sum += lat;
+	t->releases++;
+}
+
+static void *timer_body(void *arg)
+{
+	struct rel_task *t = arg;
+	long long release, period;
+	struct timespec ts;
+
+	sem_post(&ready);
+
+	period = base_period * t->mult;
+	for (release = start_date; release < end_date; release += period) {
+		ns_to_ts(&ts, release);
+		t->err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					 &ts, NULL);
+		if (t->err)
+			break;
+		account_release(t, release);
+	}
+
+	return NULL;
+}
+
+static void *group_body(void *arg)
+{
+	struct rel_task *t = arg;
+	unsigned long overruns;
+	unsigned long long n;
+
+	if (cobalt_relgroup_join(group_fd, t->mult)) {
+		t->err = errno;
+		sem_post(&ready);
+		return NULL;
+	}
+
+	sem_post(&ready);
+
+	for (n = 0;; n++) {
+		overruns = 0;
+		if (cobalt_relgroup_wait(&overruns)) {
+			if (errno == EIDRM)
+				break;
+			if (errno != ETIMEDOUT) {
+				t->err = errno;
+				break;
+			}
+		}
+		n += overruns;
+		t->overruns += overruns;
+		account_release(t, start_date + n * t->mult * base_period);
+	}
+
+	return NULL;
+}
+
+static int create_task(struct rel_task *t, void *(*body)(void *), int prio)
+{
+	struct sched_param param;
+	pthread_attr_t attr;
+	int ret;
+
+	t->releases = 0;
+	t->overruns = 0;
+	t->lat_max = 0;
+	t->lat_sum = 0;
+	t->err = 0;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = prio;
+	pthread_attr_setschedparam(&attr, &param);
+	ret = pthread_create(&t->tid, &attr, body, t);
+	pthread_attr_destroy(&attr);
+	if (ret)
+		return ret;
+
+	pthread_setname_np(t->tid, t->name);
+	sem_wait(&ready);
+
+	return 0;
+}
+
+static int run_tasks(int group, int duration_ms)
+{
+	struct timespec idate, period, ts;
+	int n, ret = 0, nr = 0;
+
+	start_date = now_ns() + 20000000LL;
+	end_date = start_date + duration_ms * 1000000LL;
+
+	if (group) {
+		ns_to_ts(&idate, start_date);
+		ns_to_ts(&period, base_period);
+		group_fd = cobalt_relgroup_create(CLOCK_MONOTONIC,
+						  &idate, &period);
+		if (group_fd < 0)
+			return errno;
+	}
+
+	for (n = 0; n < NR_TASKS; n++, nr++) {
+		/* Rate monotonic priorities. */
+		ret = create_task(tasks + n, group ? group_body : timer_body,
+				  50 - n);
+		if (ret)
+			break;
+	}
+
+	if (group) {
+		/*
+		 * Delete the group from under the members once the
+		 * run is over, which must unblock all of them.
+		 */
+		ns_to_ts(&ts, end_date - base_period / 2);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		if (cobalt_relgroup_destroy(group_fd) && ret == 0)
+			ret = errno;
+		group_fd = -1;
+	}
+
+	for (n = 0; n < nr; n++) {
+		pthread_join(tasks[n].tid, NULL);
+		smokey_trace("%s: %s, %lu releases, %lu overruns, "
+			     "latency avg=%.3f us, max=%.3f us",
+			     group ? "group" : "timer", tasks[n].name,
+			     tasks[n].releases, tasks[n].overruns,
+			     tasks[n].releases ?
+			     tasks[n].lat_sum / 1000.0 / tasks[n].releases : 0.0,
+			     tasks[n].lat_max / 1000.0);
+		if (ret == 0 && tasks[n].err)
+			ret = tasks[n].err;
+	}
+
+	return ret;
+}
+
+static int run_relgroup(struct smokey_test *t, int argc, char *const argv[])
+{
+	unsigned long releases[NR_TASKS], overruns;
+	struct timespec idate, period;
+	struct sched_param param;
+	int ret, duration = 1000;
+	long diff;
+	int n;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(relgroup, period))
+		base_period = SMOKEY_ARG_INT(relgroup, period) * 1000LL;
+	if (base_period < 100000)
+		error(1, EINVAL, "period=%lld", base_period / 1000);
+
+	if (SMOKEY_ARG_ISSET(relgroup, duration))
+		duration = SMOKEY_ARG_INT(relgroup, duration);
+	if (duration <= 0)
+		error(1, EINVAL, "duration=%d", duration);
+
+	sem_init(&ready, 0, 0);
+
+	param.sched_priority = 90;
+	ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (ret) {
+		warning("pthread_setschedparam(SCHED_FIFO, 90) failed");
+		return -ret;
+	}
+
+	/* Bad requests must be rejected. */
+	ns_to_ts(&idate, 0);
+	ns_to_ts(&period, base_period);
+	group_fd = cobalt_relgroup_create(CLOCK_MONOTONIC, &idate, &period);
+	if (group_fd < 0) {
+		if (errno == ENOSYS)
+			return -ENOSYS;
+		error(1, errno, "cobalt_relgroup_create");
+	}
+	if (!smokey_assert(cobalt_relgroup_wait(NULL) == -1 &&
+			   errno == EWOULDBLOCK))
+		return -EPROTO;
+	if (!smokey_assert(cobalt_relgroup_join(group_fd, 0) == -1 &&
+			   errno == EINVAL))
+		return -EPROTO;
+	if (smokey_check_errno(cobalt_relgroup_destroy(group_fd)) < 0)
+		return -EPROTO;
+	group_fd = -1;
+
+	ret = run_tasks(0, duration);
+	if (ret)
+		error(1, ret, "timer run");
+
+	for (n = 0; n < NR_TASKS; n++)
+		releases[n] = tasks[n].releases;
+
+	ret = run_tasks(1, duration);
+	if (ret)
+		error(1, ret, "group run");
+
+	for (n = 0, overruns = 0; n < NR_TASKS; n++) {
+		overruns += tasks[n].overruns;
+		diff = (long)tasks[n].releases - (long)releases[n];
+		if (!smokey_assert(diff >= -1 && diff <= 1)) {
+			smokey_warning("%s: %lu releases from group, %lu from timer",
+				       tasks[n].name, tasks[n].releases,
+				       releases[n]);
+			return -EPROTO;
+		}
+	}
+
+	if (!smokey_on_vm && overruns > 0) {
+		smokey_warning("%lu overruns from group", overruns);
+		return -EPROTO;
+	}
+
+	return 0;
+}
@@ -0,0 +1,393 @@
+/*
+ * Check that cluster threads are pushed to or pulled by another CPU
+ * of their affinity set, when preempted on their own CPU.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <time.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(sched_cluster,
+		   SMOKEY_NOARGS,
+		   "Check push/pull migration of cluster threads."
+);
+
+#define MIGRATION_VFILE  "/proc/xenomai/sched/migration"
+
+/*
+ * Upper bound for busy loops. CPUs hogged in primary mode starve the
+ * host kernel, so keep this well below the Cobalt watchdog period.
+ */
+#define SPIN_LIMIT_NS    200000000ULL
+
+#define HOG_PRIO      20
+#define BLOCKER_PRIO  15
+#define CLUSTER_PRIO  10
+#define WAKER_PRIO    5
+
+struct migration_stats {
+	unsigned long pushed[CPU_SETSIZE];
+	unsigned long pulled[CPU_SETSIZE];
+};
+
+struct runner {
+	pthread_t tid;
+	int cpu;
+	int prio;
+	void *(*body)(void *arg);
+	int status;
+};
+
+static sem_t ready, go, wake;
+
+static volatile int spinning, expected_spinners;
+
+static volatile int hog_active, cluster_ran, overlap;
+
+static int read_migration_stats(struct migration_stats *stats)
+{
+	unsigned long pushed, pulled;
+	char buf[128];
+	unsigned int cpu;
+	FILE *fp;
+
+	fp = fopen(MIGRATION_VFILE, "r");
+	if (fp == NULL)
+		return -errno;
+
+	memset(stats, 0, sizeof(*stats));
+
+	/* Skip the header line. */
+	if (fgets(buf, sizeof(buf), fp) == NULL) {
+		fclose(fp);
+		return -EINVAL;
+	}
+
+	while (fgets(buf, sizeof(buf), fp)) {
+		if (sscanf(buf, "%u %lu %lu", &cpu, &pushed, &pulled) != 3 ||
+		    cpu >= CPU_SETSIZE)
+			continue;
+		stats->pushed[cpu] = pushed;
+		stats->pulled[cpu] = pulled;
+	}
+
+	fclose(fp);
+
+	return 0;
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int wait_go(void)
+{
+	int ret;
+
+	if (!__Terrno(ret, sem_post(&ready)))
+		return ret;
+
+	__Terrno(ret, sem_wait(&go));
+
+	return ret;
+}
+
+/* Keep the CPU busy until the cluster thread ran, or timeout. */
+static void spin(void)
+{
+	unsigned long long deadline = now_ns() + SPIN_LIMIT_NS;
+
+	__sync_fetch_and_add(&spinning, 1);
+
+	while (!cluster_ran && now_ns() < deadline)
+		__asm__ __volatile__("" : : : "memory");
+}
+
+static void *hog_body(void *arg)
+{
+	struct runner *r = arg;
+
+	r->status = wait_go();
+	if (r->status)
+		return NULL;
+
+	hog_active = 1;
+	spin();
+	hog_active = 0;
+
+	return NULL;
+}
+
+static void *blocker_body(void *arg)
+{
+	struct runner *r = arg;
+
+	r->status = wait_go();
+	if (r->status)
+		return NULL;
+
+	spin();
+
+	return NULL;
+}
+
+/*
+ * Wake up the cluster thread once every other runner is busy, then
+ * leave the CPU.
+ */
+static void *waker_body(void *arg)
+{
+	unsigned long long deadline;
+	struct runner *r = arg;
+
+	r->status = wait_go();
+	if (r->status)
+		return NULL;
+
+	deadline = now_ns() + SPIN_LIMIT_NS;
+	while (spinning < expected_spinners) {
+		if (now_ns() >= deadline) {
+			smokey_warning("runners did not start in time");
+			r->status = -ETIMEDOUT;
+			return NULL;
+		}
+	}
+
+	__Terrno(r->status, sem_post(&wake));
+
+	return NULL;
+}
+
+/*
+ * Block in primary mode on the CPU of the hog, the host affinity
+ * only pins the thread there until it first switches to primary
+ * mode, the Cobalt affinity spans all real-time CPUs.
+ */
+static void *cluster_body(void *arg)
+{
+	struct runner *r = arg;
+
+	__T(r->status, pthread_setmode_np(0, PTHREAD_CLUSTER, NULL));
+	sem_post(&ready);
+	if (r->status || !__Terrno(r->status, sem_wait(&wake)))
+		return NULL;
+
+	/*
+	 * Running while the hog still spins on our original CPU
+	 * means that we were moved elsewhere.
+	 */
+	overlap = hog_active;
+	cluster_ran = 1;
+
+	return NULL;
+}
+
+static int start_runner(struct runner *r)
+{
+	struct sched_param param;
+	pthread_attr_t attr;
+	cpu_set_t cpus;
+	int ret;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(r->cpu, &cpus);
+	r->status = 0;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = r->prio;
+	pthread_attr_setschedparam(&attr, &param);
+	pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+	ret = pthread_create(&r->tid, &attr, r->body, r);
+	pthread_attr_destroy(&attr);
+
+	return -ret;
+}
+
+/*
+ * Wake up a cluster thread sleeping on @cpus[0] while a higher
+ * priority hog spins there. With @pull unset, @cpus[1] runs a lower
+ * priority waker, so the cluster thread should be pushed away on
+ * wakeup. Otherwise, every other CPU runs a higher priority thread
+ * when the cluster thread wakes up, until the one on @cpus[1] leaves,
+ * which should pull the cluster thread while idling.
+ */
+static int run_scenario(const int *cpus, int nrcpus, bool pull,
+			struct migration_stats *delta)
+{
+	struct migration_stats before, after;
+	struct runner *runners;
+	int n, nr = 0, ret;
+
+	runners = calloc(nrcpus + 1, sizeof(*runners));
+	if (runners == NULL)
+		return -ENOMEM;
+
+	sem_init(&ready, 0, 0);
+	sem_init(&go, 0, 0);
+	sem_init(&wake, 0, 0);
+	spinning = 0;
+	hog_active = 0;
+	cluster_ran = 0;
+	overlap = 0;
+
+	runners[nr++] = (struct runner){
+		.cpu = cpus[0], .prio = CLUSTER_PRIO, .body = cluster_body,
+	};
+	runners[nr++] = (struct runner){
+		.cpu = cpus[0], .prio = HOG_PRIO, .body = hog_body,
+	};
+	runners[nr++] = (struct runner){
+		.cpu = cpus[1], .prio = pull ? BLOCKER_PRIO : WAKER_PRIO,
+		.body = waker_body,
+	};
+	if (pull) {
+		for (n = 2; n < nrcpus; n++)
+			runners[nr++] = (struct runner){
+				.cpu = cpus[n], .prio = BLOCKER_PRIO,
+				.body = blocker_body,
+			};
+	}
+	expected_spinners = nr - 2;
+
+	ret = read_migration_stats(&before);
+	if (ret)
+		goto out;
+
+	for (n = 0; n < nr; n++) {
+		ret = start_runner(&runners[n]);
+		if (ret) {
+			nr = n;
+			goto release;
+		}
+	}
+
+	for (n = 0; n < nr; n++) {
+		if (!__Terrno(ret, sem_wait(&ready)))
+			goto release;
+	}
+
+	/* Let the cluster thread block on its semaphore. */
+	__STD(usleep(10000));
+release:
+	if (ret) {
+		cluster_ran = 1;
+		sem_post(&wake);
+	}
+
+	/*
+	 * Runners start hogging their CPU as soon as we post, we run
+	 * at a higher priority so that we can release them all.
+	 */
+	for (n = 0; n < nr; n++)
+		sem_post(&go);
+
+	for (n = 0; n < nr; n++) {
+		pthread_join(runners[n].tid, NULL);
+		if (runners[n].status && ret == 0)
+			ret = runners[n].status;
+	}
+
+	if (ret == 0)
+		ret = read_migration_stats(&after);
+
+	if (ret == 0) {
+		for (n = 0; n < CPU_SETSIZE; n++) {
+			delta->pushed[n] = after.pushed[n] - before.pushed[n];
+			delta->pulled[n] = after.pulled[n] - before.pulled[n];
+		}
+	}
+out:
+	sem_destroy(&wake);
+	sem_destroy(&go);
+	sem_destroy(&ready);
+	free(runners);
+
+	return ret;
+}
+
+static int run_sched_cluster(struct smokey_test *t,
+			     int argc, char *const argv[])
+{
+	struct migration_stats delta;
+	struct sched_param param;
+	int *cpus, nrcpus = 0, n, ret;
+	cpu_set_t rtset;
+
+	ret = pthread_setmode_np(0, PTHREAD_CLUSTER, NULL);
+	if (ret == EINVAL) {
+		smokey_note("cluster scheduling disabled, skipped "
+			    "(CONFIG_XENO_OPT_SCHED_CLUSTER)");
+		return -ENOSYS;
+	}
+	if (!__T(ret, ret))
+		return ret;
+
+	pthread_setmode_np(PTHREAD_CLUSTER, 0, NULL);
+
+	ret = get_realtime_cpu_set(&rtset);
+	if (ret)
+		return -ENOSYS;
+
+	if (CPU_COUNT(&rtset) < 2) {
+		smokey_note("cluster migration needs two real-time CPUs, skipped");
+		return -ENOSYS;
+	}
+
+	cpus = malloc(CPU_COUNT(&rtset) * sizeof(*cpus));
+	if (cpus == NULL)
+		return -ENOMEM;
+
+	for (n = 0; n < CPU_SETSIZE; n++)
+		if (CPU_ISSET(n, &rtset))
+			cpus[nrcpus++] = n;
+
+	param.sched_priority = HOG_PRIO + 10;
+	ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (ret) {
+		ret = -ret;
+		goto out;
+	}
+
+	ret = run_scenario(cpus, nrcpus, false, &delta);
+	if (ret)
+		goto out;
+
+	smokey_trace("push: ran while preempted: %s, CPU%d pushed %lu",
+		     overlap ? "yes" : "no", cpus[0], delta.pushed[cpus[0]]);
+	if (!__Fassert(overlap == 0) ||
+	    !__Tassert(delta.pushed[cpus[0]] > 0)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = run_scenario(cpus, nrcpus, true, &delta);
+	if (ret)
+		goto out;
+
+	smokey_trace("pull: ran while preempted: %s, CPU%d pulled %lu",
+		     overlap ? "yes" : "no", cpus[1], delta.pulled[cpus[1]]);
+	if (!__Fassert(overlap == 0) ||
+	    !__Tassert(delta.pulled[cpus[1]] > 0))
+		ret = -EINVAL;
+out:
+	free(cpus);
+
+	return ret;
+}
@@ -0,0 +1,319 @@
+/*
+ * SCHED_EDF test.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <errno.h>
+#include <error.h>
+#include <sys/cobalt.h>
+#include <boilerplate/time.h>
+#include <boilerplate/ancillaries.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(sched_edf,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(load),
+			   SMOKEY_INT(duration),
+		   ),
+   "Check the SCHED_EDF scheduling policy. A set of periodic\n"
+   "\tthreads which is feasible under EDF, but not under rate\n"
+   "\tmonotonic priorities, is run as SCHED_FIFO threads first, then\n"
+   "\tas SCHED_EDF threads, all on CPU0. Each job performs a calibrated\n"
+   "\tamount of work, close to its declared runtime.\n\n"
+   "\tA successful test shows that the set is admitted by the EDF\n"
+   "\tclass, that no deadline is missed under EDF scheduling, and that\n"
+   "\tadmission control rejects a request which would exceed the CPU\n"
+   "\tbandwidth.\n"
+   "\tload=<percent>\twork performed by each job, in percent of\n"
+   "\t\t\tits runtime (default 95)\n"
+   "\tduration=<ms>\tlength of each run (default 1000)"
+);
+
+struct edf_task {
+	const char *name;
+	long long runtime;	/* ns */
+	long long period;	/* ns, also relative deadline */
+	pthread_t tid;
+	unsigned long jobs;
+	unsigned long misses;
+};
+
+/*
+ * U = 0.4 + 0.5 = 0.9, which is above the Liu & Layland bound for
+ * two tasks (0.828). Under rate monotonic priorities, the second
+ * task is preempted twice by the first one when both are released
+ * at the same time, and misses its deadline (4 + 4 + 7 > 14).
+ */
+static struct edf_task tasks[] = {
+	{ .name = "edf-10ms", .runtime = 4000000, .period = 10000000 },
+	{ .name = "edf-14ms", .runtime = 7000000, .period = 14000000 },
+};
+
+#define NR_TASKS  (sizeof(tasks) / sizeof(tasks[0]))
+
+static double loops_per_ns;
+
+static int load = 95;
+
+static long long start_date, end_date;
+
+static sem_t ready;
+
+static unsigned long __attribute__(( noinline ))
+__do_work(unsigned long count)
+{
+	return count + 1;
+}
+
+static void __attribute__(( noinline ))
+do_work(unsigned long loops)
+{
+	unsigned long n, count = 0;
+
+	for (n = 0; n < loops; n++)
+		count = __do_work(count);
+}
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void ns_to_ts(struct timespec *ts, long long ns)
+{
+	ts->tv_sec = ns / 1000000000LL;
+	ts->tv_nsec = ns % 1000000000LL;
+}
+
+static void *task_body(void *arg)
+{
+	struct edf_task *t = arg;
+	long long release, date;
+	unsigned long loops;
+	struct timespec ts;
+
+	loops = (unsigned long)(loops_per_ns * t->runtime * load / 100);
+	t->jobs = 0;
+	t->misses = 0;
+	sem_post(&ready);
+
+	for (release = start_date; release < end_date; release += t->period) {
+		ns_to_ts(&ts, release);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		do_work(loops);
+		date = now_ns();
+		if (date > release + t->period)
+			t->misses++;
+		t->jobs++;
+	}
+
+	return NULL;
+}
+
+static int create_task(struct edf_task *t, int policy, int prio)
+{
+	struct sched_param_ex param_ex;
+	pthread_attr_ex_t attr_ex;
+	int ret;
+
+	pthread_attr_init_ex(&attr_ex);
+	pthread_attr_setdetachstate_ex(&attr_ex, PTHREAD_CREATE_JOINABLE);
+	pthread_attr_setinheritsched_ex(&attr_ex, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy_ex(&attr_ex, policy);
+	param_ex.sched_priority = prio;
+	if (policy == SCHED_EDF) {
+		ns_to_ts(&param_ex.sched_edf_runtime, t->runtime);
+		ns_to_ts(&param_ex.sched_edf_deadline, t->period);
+		ns_to_ts(&param_ex.sched_edf_period, t->period);
+	}
+	pthread_attr_setschedparam_ex(&attr_ex, &param_ex);
+	ret = pthread_create_ex(&t->tid, &attr_ex, task_body, t);
+	pthread_attr_destroy_ex(&attr_ex);
+	if (ret)
+		return ret;
+
+	pthread_setname_np(t->tid, t->name);
+	sem_wait(&ready);
+
+	return 0;
+}
+
+/*
+ * Response time analysis of the task set under rate monotonic
+ * priorities (tasks[] is sorted by increasing period).
+ */
+static int rm_feasible(void)
+{
+	long long r, prev;
+	int i, j;
+
+	for (i = 0; i < NR_TASKS; i++) {
+		r = tasks[i].runtime;
+		do {
+			prev = r;
+			r = tasks[i].runtime;
+			for (j = 0; j < i; j++)
+				r += (prev + tasks[j].period - 1) /
+					tasks[j].period * tasks[j].runtime;
+		} while (r != prev && r <= tasks[i].period);
+		if (r > tasks[i].period)
+			return 0;
+	}
+
+	return 1;
+}
+
+static int run_tasks(int policy, int duration_ms, unsigned long *misses_r)
+{
+	struct sched_param_ex param_ex;
+	int n, ret = 0, nr = 0;
+
+	start_date = now_ns() + 20000000LL;
+	end_date = start_date + duration_ms * 1000000LL;
+
+	for (n = 0; n < NR_TASKS; n++, nr++) {
+		/* Rate monotonic priorities for SCHED_FIFO. */
+		ret = create_task(tasks + n, policy, 50 - n);
+		if (ret)
+			break;
+	}
+
+	/*
+	 * Our task set holds 90% of CPU0, so there is no room left for
+	 * a 20% reservation.
+	 */
+	if (ret == 0 && policy == SCHED_EDF) {
+		param_ex.sched_priority = 1;
+		ns_to_ts(&param_ex.sched_edf_runtime, 2000000);
+		ns_to_ts(&param_ex.sched_edf_deadline, 10000000);
+		ns_to_ts(&param_ex.sched_edf_period, 10000000);
+		if (!smokey_assert(pthread_setschedparam_ex(pthread_self(),
+					SCHED_EDF, &param_ex) == EBUSY))
+			ret = -EPROTO;
+	}
+
+	for (n = 0, *misses_r = 0; n < nr; n++) {
+		pthread_join(tasks[n].tid, NULL);
+		smokey_trace("%s: %s, %lu jobs, %lu deadline misses",
+			     policy == SCHED_EDF ? "edf" : "rm",
+			     tasks[n].name, tasks[n].jobs, tasks[n].misses);
+		*misses_r += tasks[n].misses;
+	}
+
+	return ret;
+}
+
+static void calibrate(void)
+{
+	const unsigned long loops = 1000000;
+	long long start, best = 0, ns;
+	int n;
+
+	for (n = 0; n < 5; n++) {
+		start = now_ns();
+		do_work(loops);
+		ns = now_ns() - start;
+		if (best == 0 || ns < best)
+			best = ns;
+	}
+
+	loops_per_ns = (double)loops / best;
+}
+
+static int run_sched_edf(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct sched_param_ex param_ex;
+	int ret, policies, duration = 1000;
+	unsigned long misses;
+	struct sched_param param;
+	cpu_set_t affinity;
+	double u = 0;
+	int n;
+
+	ret = cobalt_corectl(_CC_COBALT_GET_POLICIES, &policies, sizeof(policies));
+	if (ret || (policies & _CC_COBALT_SCHED_EDF) == 0)
+		return -ENOSYS;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(sched_edf, load))
+		load = SMOKEY_ARG_INT(sched_edf, load);
+	if (load <= 0 || load > 100)
+		error(1, EINVAL, "load=%d", load);
+
+	if (SMOKEY_ARG_ISSET(sched_edf, duration))
+		duration = SMOKEY_ARG_INT(sched_edf, duration);
+	if (duration <= 0)
+		error(1, EINVAL, "duration=%d", duration);
+
+	CPU_ZERO(&affinity);
+	CPU_SET(0, &affinity);
+	ret = sched_setaffinity(0, sizeof(affinity), &affinity);
+	if (ret)
+		error(1, errno, "sched_setaffinity");
+
+	sem_init(&ready, 0, 0);
+
+	param.sched_priority = 90;
+	ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (ret) {
+		warning("pthread_setschedparam(SCHED_FIFO, 90) failed");
+		return -ret;
+	}
+
+	/* Bad reservations must be rejected. */
+	param_ex.sched_priority = 1;
+	ns_to_ts(&param_ex.sched_edf_runtime, 2000000);
+	ns_to_ts(&param_ex.sched_edf_deadline, 1000000);
+	ns_to_ts(&param_ex.sched_edf_period, 10000000);
+	if (!smokey_assert(pthread_setschedparam_ex(pthread_self(),
+					SCHED_EDF, &param_ex) == EINVAL))
+		return -EPROTO;
+
+	calibrate();
+
+	for (n = 0; n < NR_TASKS; n++)
+		u += (double)tasks[n].runtime / tasks[n].period;
+
+	smokey_trace("U=%.3f, rate monotonic bound=%.3f, rm feasible=%s",
+		     u, NR_TASKS * (pow(2.0, 1.0 / NR_TASKS) - 1),
+		     rm_feasible() ? "yes" : "no");
+
+	ret = run_tasks(SCHED_FIFO, duration, &misses);
+	if (ret)
+		error(1, ret, "pthread_create_ex(SCHED_FIFO)");
+
+	smokey_trace("rate monotonic: %lu deadline misses", misses);
+
+	ret = run_tasks(SCHED_EDF, duration, &misses);
+	if (ret == EBUSY) {
+		smokey_note("sched_edf skipped (CONFIG_XENO_OPT_SCHED_EDF_MAXUTIL < %d%%)",
+			    (int)ceil(u * 100));
+		return -ENOSYS;
+	}
+	if (ret > 0)
+		error(1, ret, "pthread_create_ex(SCHED_EDF)");
+	if (ret < 0)
+		return ret;
+
+	smokey_trace("edf: %lu deadline misses", misses);
+
+	if (!smokey_on_vm && misses > 0) {
+		smokey_warning("EDF missed %lu deadlines at U=%.3f",
+			       misses, u);
+		return -EPROTO;
+	}
+
+	return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * Binary statistics map test.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <error.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/cobalt.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(stats_map,
+		   SMOKEY_NOARGS,
+   "Check the binary statistics map. The records of the calling\n"
+   "\tthread are looked up in the read-only mapping, then their\n"
+   "\texecution time, context switch and mode switch counters are\n"
+   "\tchecked against the activity of the thread. Slots must be\n"
+   "\treleased when threads exit."
+);
+
+#define STATS_DEVICE  "/dev/rtdm/" COBALT_STATS_DEV
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int find_slot(struct cobalt_stats *st, pid_t pid,
+		     struct cobalt_stats_threadinfo *ti)
+{
+	unsigned int slot;
+
+	for (slot = 0; slot < st->header->nr_slots; slot++)
+		if (cobalt_stats_read_thread(st, slot, ti) == 0 &&
+		    ti->pid == pid)
+			return slot;
+
+	return -1;
+}
+
+static void *thread_body(void *arg)
+{
+	pid_t *pid = arg;
+
+	*pid = syscall(SYS_gettid);
+
+	return NULL;
+}
+
+static int check_access(void)
+{
+	void *p;
+	int fd;
+
+	fd = open(STATS_DEVICE, O_RDWR);
+	if (!smokey_assert(fd < 0 && errno == EACCES))
+		return -EPROTO;
+
+	fd = open(STATS_DEVICE, O_RDONLY);
+	if (smokey_check_errno(fd) < 0)
+		return -EPROTO;
+
+	p = mmap(NULL, getpagesize(), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (!smokey_assert(p == MAP_FAILED && errno == EACCES))
+		return -EPROTO;
+
+	return 0;
+}
+
+static int run_stats_map(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct cobalt_stats_threadinfo ti, ti0;
+	struct cobalt_stats_cpuinfo ci;
+	struct sched_param param;
+	struct timespec ts;
+	struct cobalt_stats st;
+	long long start;
+	int slot, n, ret;
+	pthread_t tid;
+	pid_t pid;
+
+	if (cobalt_stats_open(&st)) {
+		if (errno == ENOENT || errno == ENODEV) {
+			smokey_note("stats_map skipped (no kernel support)");
+			return -ENOSYS;
+		}
+		error(1, errno, "cobalt_stats_open");
+	}
+
+	if (!smokey_assert(st.header->version >= COBALT_STATS_VERSION &&
+			   st.header->nr_cpus > 0 &&
+			   st.header->nr_slots > 0))
+		return -EPROTO;
+
+	ret = check_access();
+	if (ret)
+		return ret;
+
+	param.sched_priority = 10;
+	ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (ret) {
+		warning("pthread_setschedparam(SCHED_FIFO, 10) failed");
+		return -ret;
+	}
+
+	pid = syscall(SYS_gettid);
+	slot = find_slot(&st, pid, &ti0);
+	if (!smokey_assert(slot >= 0))
+		return -EPROTO;
+
+	/* We are running, so the CPU record must point at us. */
+	cobalt_thread_harden();
+	if (smokey_check_errno(cobalt_stats_read_cpu(&st, ti0.cpu, &ci)) < 0)
+		return -EPROTO;
+	if (!smokey_assert(ci.curr == slot))
+		return -EPROTO;
+
+	/* Time spent since we were switched in must be accounted. */
+	start = now_ns();
+	while (now_ns() - start < 50000000)
+		;
+	if (smokey_check_errno(cobalt_stats_read_thread(&st, slot, &ti)) < 0)
+		return -EPROTO;
+	smokey_trace("exectime grew by %llu us over 50 ms of busy loop",
+		     (ti.xtime - ti0.xtime) / 1000);
+	if (!smokey_assert(ti.xtime - ti0.xtime >= 25000000))
+		return -EPROTO;
+
+	/* Each sleep switches us out then in. */
+	ts.tv_sec = 0;
+	ts.tv_nsec = 1000000;
+	for (n = 0; n < 10; n++)
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+	ti0 = ti;
+	cobalt_stats_read_thread(&st, slot, &ti);
+	if (!smokey_assert(ti.csw - ti0.csw >= 9))
+		return -EPROTO;
+
+	/*
+	 * Relaxing is a mode switch, which is published next time
+	 * we switch out from primary mode.
+	 */
+	cobalt_thread_relax();
+	cobalt_thread_harden();
+	clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+	ti0 = ti;
+	cobalt_stats_read_thread(&st, slot, &ti);
+	if (!smokey_assert(ti.msw > ti0.msw))
+		return -EPROTO;
+
+	/* The slot of an exited thread is released. */
+	ret = pthread_create(&tid, NULL, thread_body, &pid);
+	if (ret)
+		error(1, ret, "pthread_create");
+	pthread_join(tid, NULL);
+	if (!smokey_assert(find_slot(&st, pid, &ti) < 0))
+		return -EPROTO;
+
+	cobalt_stats_close(&st);
+
+	return 0;
+}
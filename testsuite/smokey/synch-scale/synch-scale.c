@@ -0,0 +1,280 @@
+/*
+ * Measure the scalability of Cobalt mutex acquire/release with the
+ * number of CPUs.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <time.h>
+#include <cobalt/uapi/mutex.h>
+#include <asm/xenomai/syscall.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(synch_scale,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(loops),
+		   ),
+		   "Measure mutex acquire/release throughput vs. CPU count\n"
+		   "\tloops=<count>\tlock/unlock cycles per thread (default 100000)"
+);
+
+#define MAX_WORKERS  64
+
+/*
+ * Busy cycles spent holding the mutex, so that peers running on
+ * other CPUs keep finding it locked and have to go through the
+ * kernel to wait for it.
+ */
+#define HOLD_LOOPS   256
+
+struct worker {
+	pthread_t tid;
+	int cpu;
+	pthread_mutex_t *lock;
+	int (*acquire)(pthread_mutex_t *lock);
+	int (*release)(pthread_mutex_t *lock);
+	int status;
+};
+
+static struct worker workers[MAX_WORKERS];
+
+static pthread_mutex_t locks[MAX_WORKERS];
+
+static sem_t start;
+
+static int loops = 100000;
+
+/*
+ * Uncontended requests never leave the libcobalt fast path, issue
+ * them directly to the core for measuring the kernel side.
+ */
+static int kernel_lock(pthread_mutex_t *lock)
+{
+	union cobalt_mutex_union *u = (union cobalt_mutex_union *)lock;
+
+	return -XENOMAI_SYSCALL1(sc_cobalt_mutex_lock, &u->shadow_mutex);
+}
+
+static int kernel_unlock(pthread_mutex_t *lock)
+{
+	union cobalt_mutex_union *u = (union cobalt_mutex_union *)lock;
+
+	return -XENOMAI_SYSCALL1(sc_cobalt_mutex_unlock, &u->shadow_mutex);
+}
+
+static void *worker_body(void *arg)
+{
+	struct worker *w = arg;
+	cpu_set_t affinity;
+	int n, i, ret;
+
+	CPU_ZERO(&affinity);
+	CPU_SET(w->cpu, &affinity);
+	ret = sched_setaffinity(0, sizeof(affinity), &affinity);
+	if (ret) {
+		w->status = -errno;
+		return NULL;
+	}
+
+	sem_wait(&start);
+
+	for (n = 0; n < loops; n++) {
+		ret = w->acquire(w->lock);
+		if (ret)
+			break;
+		for (i = 0; i < HOLD_LOOPS; i++)
+			__asm__ __volatile__("" : : : "memory");
+		ret = w->release(w->lock);
+		if (ret)
+			break;
+	}
+
+	w->status = -ret;
+
+	return NULL;
+}
+
+static int init_locks(int count)
+{
+	pthread_mutexattr_t mattr;
+	int n, ret = 0;
+
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
+
+	for (n = 0; n < count; n++) {
+		ret = pthread_mutex_init(&locks[n], &mattr);
+		if (ret) {
+			while (--n >= 0)
+				pthread_mutex_destroy(&locks[n]);
+			break;
+		}
+	}
+
+	pthread_mutexattr_destroy(&mattr);
+
+	return -ret;
+}
+
+static void destroy_locks(int count)
+{
+	int n;
+
+	for (n = 0; n < count; n++)
+		pthread_mutex_destroy(&locks[n]);
+}
+
+/*
+ * Run @nrcpus workers, one per real-time CPU, @group workers sharing
+ * each mutex. Members of a group always run on different CPUs, so
+ * every mutex is contended unless @group is 1, while unrelated
+ * mutexes are processed concurrently on distinct CPUs. With @group
+ * set to 1, workers go through the kernel for every request.
+ */
+static int run_round(const int *cpus, int nrcpus, int group,
+		     unsigned long long *ops_per_sec)
+{
+	struct timespec t0, t1;
+	struct sched_param param;
+	pthread_attr_t attr;
+	unsigned long long ns;
+	int n, ret, nlocks;
+
+	nlocks = nrcpus / group;
+	ret = init_locks(nlocks);
+	if (ret)
+		return ret;
+
+	sem_init(&start, 0, 0);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = 10;
+	pthread_attr_setschedparam(&attr, &param);
+
+	for (n = 0; n < nrcpus; n++) {
+		workers[n].cpu = cpus[n];
+		workers[n].lock = &locks[n / group];
+		if (group == 1) {
+			workers[n].acquire = kernel_lock;
+			workers[n].release = kernel_unlock;
+		} else {
+			workers[n].acquire = pthread_mutex_lock;
+			workers[n].release = pthread_mutex_unlock;
+		}
+		workers[n].status = 0;
+		ret = pthread_create(&workers[n].tid, &attr,
+				     worker_body, &workers[n]);
+		if (ret) {
+			ret = -ret;
+			nrcpus = n;
+			goto out;
+		}
+	}
+
+	/* Let all workers settle on their CPU before starting. */
+	__STD(usleep(100000));
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (n = 0; n < nrcpus; n++)
+		sem_post(&start);
+out:
+	for (n = 0; n < nrcpus; n++) {
+		pthread_join(workers[n].tid, NULL);
+		if (workers[n].status && ret == 0)
+			ret = workers[n].status;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	pthread_attr_destroy(&attr);
+	sem_destroy(&start);
+	destroy_locks(nlocks);
+
+	if (ret)
+		return ret;
+
+	ns = (t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec;
+	*ops_per_sec = ns ? (unsigned long long)loops * nrcpus * 1000000000ULL / ns : 0;
+
+	return 0;
+}
+
+static int run_synch_scale(struct smokey_test *t,
+			   int argc, char *const argv[])
+{
+	unsigned long long ops, base_ops = 0;
+	int cpus[MAX_WORKERS], nrcpus = 0, n, ret;
+	struct sched_param param;
+	cpu_set_t rtset;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(synch_scale, loops) &&
+	    SMOKEY_ARG_INT(synch_scale, loops) > 0)
+		loops = SMOKEY_ARG_INT(synch_scale, loops);
+
+	ret = get_realtime_cpu_set(&rtset);
+	if (ret)
+		return -ENOSYS;
+
+	for (n = 0; n < CPU_SETSIZE && nrcpus < MAX_WORKERS; n++)
+		if (CPU_ISSET(n, &rtset))
+			cpus[nrcpus++] = n;
+
+	param.sched_priority = 20;
+	ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (ret)
+		return -ret;
+
+	smokey_trace("one private mutex per CPU, kernel path:");
+	for (n = 1; n <= nrcpus; n++) {
+		ret = run_round(cpus, n, 1, &ops);
+		if (ret)
+			return ret;
+		if (n == 1)
+			base_ops = ops;
+		smokey_trace(".. %2d CPU(s): %12llu ops/s, x%llu.%02llu",
+			     n, ops, base_ops ? ops / base_ops : 0,
+			     base_ops ? (ops * 100 / base_ops) % 100 : 0);
+	}
+
+	if (nrcpus < 2) {
+		smokey_trace("contended rounds need two real-time CPUs, skipped");
+		return 0;
+	}
+
+	smokey_trace("one mutex per pair of CPUs:");
+	for (n = 2; n <= nrcpus; n += 2) {
+		ret = run_round(cpus, n, 2, &ops);
+		if (ret)
+			return ret;
+		if (n == 2)
+			base_ops = ops;
+		smokey_trace(".. %2d CPU(s): %12llu ops/s, x%llu.%02llu",
+			     n, ops, base_ops ? ops / base_ops : 0,
+			     base_ops ? (ops * 100 / base_ops) % 100 : 0);
+	}
+
+	smokey_trace("one mutex shared by all CPUs:");
+	for (n = 2; n <= nrcpus; n++) {
+		ret = run_round(cpus, n, n, &ops);
+		if (ret)
+			return ret;
+		if (n == 2)
+			base_ops = ops;
+		smokey_trace(".. %2d CPU(s): %12llu ops/s, x%llu.%02llu",
+			     n, ops, base_ops ? ops / base_ops : 0,
+			     base_ops ? (ops * 100 / base_ops) % 100 : 0);
+	}
+
+	return 0;
+}
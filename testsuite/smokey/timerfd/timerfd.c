@@ -21,6 +21,8 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <errno.h>
 #include <assert.h>
@@ -357,6 +359,101 @@ static int timerfd_unblock_check(void)
 	return smokey_check_errno(close(fd));
 }
 
+/*
+ * Arm far timers first, so that they land in an otherwise empty
+ * timer queue, then near ones in scrambled order. Every near timer
+ * must fire on time while the far ones stay pending.
+ */
+#define MIXED_NEAR	8
+#define MIXED_STEP_NS	10000000	/* 10 ms between near dates */
+#define MIXED_LATE_NS	50000000	/* tolerated lateness */
+
+static int timerfd_mixed_check(void)
+{
+	static const int order[MIXED_NEAR] = { 5, 2, 7, 0, 3, 6, 1, 4 };
+	int near[MIXED_NEAR], far[2], i, n, ret = 0;
+	unsigned long long ticks;
+	struct itimerspec its;
+	struct timespec now, date[MIXED_NEAR];
+	long long late;
+
+	for (i = 0; i < 2; i++)
+		far[i] = -1;
+	for (i = 0; i < MIXED_NEAR; i++)
+		near[i] = -1;
+
+	memset(&its, 0, sizeof(its));
+
+	for (i = 0; i < 2; i++) {
+		far[i] = smokey_check_errno(timerfd_create(CLOCK_MONOTONIC,
+							   TFD_NONBLOCK));
+		if (far[i] < 0) {
+			ret = far[i];
+			goto out;
+		}
+		its.it_value.tv_sec = 30 * (i + 1);
+		ret = smokey_check_errno(timerfd_settime(far[i], 0, &its, NULL));
+		if (ret)
+			goto out;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	for (i = 0; i < MIXED_NEAR; i++) {
+		n = order[i];
+		near[n] = smokey_check_errno(timerfd_create(CLOCK_MONOTONIC, 0));
+		if (near[n] < 0) {
+			ret = near[n];
+			goto out;
+		}
+		date[n].tv_sec = now.tv_sec;
+		date[n].tv_nsec = now.tv_nsec + (n + 1) * MIXED_STEP_NS;
+		while (date[n].tv_nsec >= 1000000000) {
+			date[n].tv_nsec -= 1000000000;
+			date[n].tv_sec++;
+		}
+		its.it_value = date[n];
+		ret = smokey_check_errno(timerfd_settime(near[n], TFD_TIMER_ABSTIME,
+							 &its, NULL));
+		if (ret)
+			goto out;
+	}
+
+	for (n = 0; n < MIXED_NEAR; n++) {
+		ret = smokey_check_errno(read(near[n], &ticks, sizeof(ticks)));
+		if (ret < 0)
+			goto out;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		late = (now.tv_sec - date[n].tv_sec) * 1000000000LL +
+			now.tv_nsec - date[n].tv_nsec;
+		smokey_trace("near timer #%d fired %Ld ns late", n, late);
+		if (!smokey_assert(ticks == 1 && late >= 0 &&
+				   late < MIXED_LATE_NS)) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (!smokey_assert(read(far[i], &ticks, sizeof(ticks)) == -1 &&
+				   errno == EAGAIN)) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	ret = 0;
+out:
+	for (i = 0; i < MIXED_NEAR; i++)
+		if (near[i] >= 0)
+			close(near[i]);
+	for (i = 0; i < 2; i++)
+		if (far[i] >= 0)
+			close(far[i]);
+
+	return ret;
+}
+
 static int run_timerfd(struct smokey_test *t, int argc, char *const argv[])
 {
 	int ret;
@@ -385,5 +482,9 @@ static int run_timerfd(struct smokey_test *t, int argc, char *const argv[])
 	if (ret)
 		return ret;
 
+	ret = timerfd_mixed_check();
+	if (ret)
+		return ret;
+
 	return timerfd_unblock_check();
 }
@@ -0,0 +1,470 @@
+/*
+ * RTIPC/XDDP shared ring test.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <errno.h>
+#include <error.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <boilerplate/atomic.h>
+#include <smokey/smokey.h>
+#include <rtdm/ipc.h>
+
+smokey_test_plugin(xddp_ring,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(msgsize),
+			   SMOKEY_INT(count),
+			   SMOKEY_INT(batch),
+			   SMOKEY_INT(latency),
+		   ),
+   "Check the shared ring transport of XDDP sockets. A real-time\n"
+   "\tthread sends timestamped messages to a regular thread in\n"
+   "\tdatagram mode, in stream mode, then through a shared ring\n"
+   "\twith batched wakeups notified via eventfd. The throughput and\n"
+   "\tthe delivery latency are reported for each mode.\n\n"
+   "\tmsgsize=<bytes>\tmessage size (default 64)\n"
+   "\tcount=<n>\tmessages per run (default 100000)\n"
+   "\tbatch=<n>\tring wakeup batch (default 32)\n"
+   "\tlatency=<us>\tmax ring wakeup delay (default 1000)"
+);
+
+#define QUEUE_DEPTH  1024
+
+enum run_mode {
+	MODE_DGRAM,
+	MODE_STREAM,
+	MODE_RING,
+};
+
+static const char *mode_names[] = {
+	[MODE_DGRAM] = "datagram",
+	[MODE_STREAM] = "stream",
+	[MODE_RING] = "ring",
+};
+
+struct xddp_msg {
+	unsigned int seq;
+	long long stamp;	/* ns */
+};
+
+struct run {
+	enum run_mode mode;
+	int port;
+	unsigned int ringsz;
+	unsigned long received;
+	unsigned long retries;
+	long long lat_sum;	/* ns */
+	long long lat_max;	/* ns */
+	int err;
+};
+
+static size_t msgsize = 64;
+
+static int count = 100000;
+
+static int batch = 32;
+
+static int latency = 1000;
+
+static sem_t ready;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void account_msg(struct run *r, const void *p)
+{
+	struct xddp_msg m;
+	long long lat;
+
+	/* Payloads may not be aligned in stream mode. */
+	memcpy(&m, p, sizeof(m));
+	lat = now_ns() - m.stamp;
+	if (lat > r->lat_max)
+		r->lat_max = lat;
+	r->lat_sum += lat;
+
+	if (m.seq != r->received && r->err == 0) {
+		smokey_warning("%s: got message #%u, expected #%lu",
+			       mode_names[r->mode], m.seq, r->received);
+		r->err = EPROTO;
+	}
+
+	r->received++;
+}
+
+static int read_pipe(struct run *r, int fd, char *buf, size_t bufsz)
+{
+	size_t fill = 0, off;
+	ssize_t n;
+
+	while (r->received < count) {
+		n = read(fd, buf + fill, bufsz - fill);
+		if (n <= 0)
+			return n ? errno : EPIPE;
+		/*
+		 * Stream mode may deliver partial messages, carry the
+		 * remainder over to the next read.
+		 */
+		fill += n;
+		for (off = 0; fill - off >= msgsize; off += msgsize)
+			account_msg(r, buf + off);
+		memmove(buf, buf + off, fill - off);
+		fill -= off;
+	}
+
+	return 0;
+}
+
+static int read_ring(struct run *r, int efd, struct xddp_ring_ctl *ctl)
+{
+	char *data = (char *)ctl + getpagesize();
+	unsigned int head, tail;
+	struct xddp_ring_rec *rec;
+	uint64_t events;
+
+	head = ctl->head;
+
+	while (r->received < count) {
+		tail = ctl->tail;
+		smp_rmb();
+		if (head == tail) {
+			/* Wait for the next batch. */
+			if (read(efd, &events, sizeof(events)) != sizeof(events))
+				return errno;
+			continue;
+		}
+		while (head != tail) {
+			rec = (struct xddp_ring_rec *)
+				(data + (head & (ctl->size - 1)));
+			if ((rec->flags & XDDP_RING_PAD) == 0)
+				account_msg(r, rec + 1);
+			head += XDDP_RING_RECSZ(rec->len);
+		}
+		smp_mb();
+		ctl->head = head;
+	}
+
+	return 0;
+}
+
+static void *reader(void *arg)
+{
+	struct xddp_ring_ctl *ctl = MAP_FAILED;
+	size_t mapsz = 0, bufsz = 0;
+	struct run *r = arg;
+	char devname[32];
+	int fd, efd = -1;
+	char *buf = NULL;
+
+	snprintf(devname, sizeof(devname), "/dev/rtp%d", r->port);
+	fd = open(devname, O_RDWR);
+	if (fd < 0) {
+		r->err = errno;
+		goto out;
+	}
+
+	if (r->mode == MODE_RING) {
+		efd = eventfd(0, 0);
+		if (efd < 0 || ioctl(fd, XNPIPEIOC_SETEVENTFD, efd)) {
+			r->err = errno;
+			goto out;
+		}
+		mapsz = getpagesize() + r->ringsz;
+		ctl = mmap(NULL, mapsz, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+		if (ctl == MAP_FAILED) {
+			r->err = errno;
+			goto out;
+		}
+		if (!smokey_assert(ctl->size == r->ringsz)) {
+			r->err = EPROTO;
+			goto out;
+		}
+	} else {
+		bufsz = msgsize * 256;
+		buf = malloc(bufsz);
+		if (buf == NULL) {
+			r->err = ENOMEM;
+			goto out;
+		}
+	}
+
+out:
+	sem_post(&ready);
+
+	if (r->err == 0) {
+		if (r->mode == MODE_RING)
+			r->err = read_ring(r, efd, ctl) ?: r->err;
+		else
+			r->err = read_pipe(r, fd, buf, bufsz) ?: r->err;
+	}
+
+	if (ctl != MAP_FAILED)
+		munmap(ctl, mapsz);
+	if (efd >= 0)
+		close(efd);
+	if (fd >= 0)
+		close(fd);
+	free(buf);
+
+	return NULL;
+}
+
+static int send_msgs(struct run *r, int s)
+{
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = 100000 };
+	struct xddp_msg m;
+	int n, flags = 0;
+	ssize_t ret;
+	char *buf;
+
+	buf = calloc(1, msgsize);
+	if (buf == NULL)
+		return ENOMEM;
+
+	for (n = 0; n < count; n++) {
+		/* Let the last message flush the stream buffer. */
+		if (r->mode == MODE_STREAM)
+			flags = n < count - 1 ? MSG_MORE : 0;
+		m.seq = n;
+		for (;;) {
+			m.stamp = now_ns();
+			memcpy(buf, &m, sizeof(m));
+			ret = send(s, buf, msgsize, flags);
+			if (ret == msgsize)
+				break;
+			if (ret >= 0 || errno != ENOMEM) {
+				free(buf);
+				return ret >= 0 ? EPROTO : errno;
+			}
+			/* Out of buffer space, let the reader catch up. */
+			r->retries++;
+			clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+		}
+	}
+
+	free(buf);
+
+	return 0;
+}
+
+static int setup_socket(struct run *r)
+{
+	struct xddp_ring_setup ringreq;
+	struct sockaddr_ipc saddr;
+	socklen_t addrlen;
+	size_t len;
+	int s, ret;
+
+	s = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_XDDP);
+	if (s < 0)
+		return -errno;
+
+	switch (r->mode) {
+	case MODE_DGRAM:
+		len = QUEUE_DEPTH * (msgsize + 64);
+		ret = setsockopt(s, SOL_XDDP, XDDP_POOLSZ, &len, sizeof(len));
+		break;
+	case MODE_STREAM:
+		len = QUEUE_DEPTH * (msgsize + 64);
+		ret = setsockopt(s, SOL_XDDP, XDDP_POOLSZ, &len, sizeof(len));
+		if (ret)
+			break;
+		len = msgsize * 64;
+		ret = setsockopt(s, SOL_XDDP, XDDP_BUFSZ, &len, sizeof(len));
+		break;
+	default:
+		memset(&ringreq, 0, sizeof(ringreq));
+		if (!smokey_assert(setsockopt(s, SOL_XDDP, XDDP_RING, &ringreq,
+					      sizeof(ringreq)) == -1 &&
+				   errno == EINVAL)) {
+			ret = -1;
+			errno = EPROTO;
+			break;
+		}
+		ringreq.size = QUEUE_DEPTH * XDDP_RING_RECSZ(msgsize);
+		ringreq.batch = batch;
+		ringreq.latency = latency;
+		ret = setsockopt(s, SOL_XDDP, XDDP_RING, &ringreq,
+				 sizeof(ringreq));
+		for (r->ringsz = getpagesize(); r->ringsz < ringreq.size;)
+			r->ringsz <<= 1;
+	}
+
+	if (ret) {
+		ret = -errno;
+		goto fail;
+	}
+
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sipc_family = AF_RTIPC;
+	saddr.sipc_port = -1;
+	ret = bind(s, (struct sockaddr *)&saddr, sizeof(saddr));
+	if (ret) {
+		ret = -errno;
+		goto fail;
+	}
+
+	addrlen = sizeof(saddr);
+	ret = getsockname(s, (struct sockaddr *)&saddr, &addrlen);
+	if (ret) {
+		ret = -errno;
+		goto fail;
+	}
+	r->port = saddr.sipc_port;
+
+	if (r->mode == MODE_RING) {
+		/* The ring is set once for all, and does not stream. */
+		if (!smokey_assert(setsockopt(s, SOL_XDDP, XDDP_RING, &ringreq,
+					      sizeof(ringreq)) == -1 &&
+				   errno == EALREADY) ||
+		    !smokey_assert(send(s, &ringreq, sizeof(ringreq),
+					MSG_MORE) == -1 &&
+				   errno == EOPNOTSUPP)) {
+			ret = -EPROTO;
+			goto fail;
+		}
+	}
+
+	return s;
+fail:
+	close(s);
+
+	return ret;
+}
+
+static int run_mode(enum run_mode mode)
+{
+	struct sched_param param;
+	pthread_attr_t attr;
+	long long start, ns;
+	pthread_t tid;
+	struct run r;
+	int s, ret;
+
+	memset(&r, 0, sizeof(r));
+	r.mode = mode;
+
+	s = setup_socket(&r);
+	if (s < 0)
+		return -s;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+	param.sched_priority = 0;
+	pthread_attr_setschedparam(&attr, &param);
+	ret = pthread_create(&tid, &attr, reader, &r);
+	pthread_attr_destroy(&attr);
+	if (ret)
+		goto out;
+
+	sem_wait(&ready);
+	if (r.err) {
+		pthread_join(tid, NULL);
+		ret = r.err;
+		goto out;
+	}
+
+	start = now_ns();
+	ret = send_msgs(&r, s);
+	if (ret)
+		pthread_cancel(tid);
+	pthread_join(tid, NULL);
+	ns = now_ns() - start;
+
+	if (ret == 0)
+		ret = r.err;
+	if (ret == 0)
+		smokey_trace("%s: %d messages of %zu bytes in %.3f ms, "
+			     "%.0f msg/s, latency avg=%.3f us, max=%.3f us, "
+			     "%lu retries",
+			     mode_names[mode], count, msgsize, ns / 1000000.0,
+			     count * 1000000000.0 / ns,
+			     r.lat_sum / 1000.0 / count, r.lat_max / 1000.0,
+			     r.retries);
+out:
+	close(s);
+
+	return ret;
+}
+
+static int run_xddp_ring(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct sched_param param;
+	int ret, s;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(xddp_ring, msgsize))
+		msgsize = SMOKEY_ARG_INT(xddp_ring, msgsize);
+	if (msgsize < sizeof(struct xddp_msg) || msgsize > 65536)
+		error(1, EINVAL, "msgsize=%zu", msgsize);
+
+	if (SMOKEY_ARG_ISSET(xddp_ring, count))
+		count = SMOKEY_ARG_INT(xddp_ring, count);
+	if (count <= 0)
+		error(1, EINVAL, "count=%d", count);
+
+	if (SMOKEY_ARG_ISSET(xddp_ring, batch))
+		batch = SMOKEY_ARG_INT(xddp_ring, batch);
+	if (batch <= 0)
+		error(1, EINVAL, "batch=%d", batch);
+
+	if (SMOKEY_ARG_ISSET(xddp_ring, latency))
+		latency = SMOKEY_ARG_INT(xddp_ring, latency);
+	if (latency <= 0)
+		error(1, EINVAL, "latency=%d", latency);
+
+	s = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_XDDP);
+	if (s < 0) {
+		if (errno == EAFNOSUPPORT)
+			return -ENOSYS;
+		error(1, errno, "socket");
+	}
+	close(s);
+
+	sem_init(&ready, 0, 0);
+
+	param.sched_priority = 50;
+	ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (ret) {
+		warning("pthread_setschedparam(SCHED_FIFO, 50) failed");
+		return -ret;
+	}
+
+	ret = run_mode(MODE_DGRAM);
+	if (ret)
+		error(1, ret, "datagram run");
+
+	ret = run_mode(MODE_STREAM);
+	if (ret)
+		error(1, ret, "stream run");
+
+	ret = run_mode(MODE_RING);
+	if (ret == EINVAL) {
+		smokey_note("xddp_ring: ring mode skipped (no kernel support)");
+		return -ENOSYS;
+	}
+	if (ret)
+		error(1, ret, "ring run");
+
+	return 0;
+}
@@ -0,0 +1,336 @@
+/*
+ * Xenomai is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xenomai is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Xenomai; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <linux/types.h>
+#include <rtdm/uapi/rtdm.h>
+#include <cobalt/uapi/kernel/evtrace.h>
+
+#define EVTRACE_DEVICE  "/dev/rtdm/" COBALT_EVTRACE_DEV
+
+static const struct option base_options[] = {
+	{
+#define help_opt	0
+		.name = "help",
+		.has_arg = no_argument,
+	},
+#define file_opt	1
+	{
+		.name = "file",
+		.has_arg = required_argument,
+	},
+#define save_opt	2
+	{
+		.name = "save",
+		.has_arg = required_argument,
+	},
+#define cpu_opt		3
+	{
+		.name = "cpu",
+		.has_arg = required_argument,
+	},
+#define last_opt	4
+	{
+		.name = "last",
+		.has_arg = required_argument,
+	},
+	{ /* Sentinel */ }
+};
+
+static const char *event_names[] = {
+	[COBALT_EVTRACE_NONE] = "none",
+	[COBALT_EVTRACE_SWITCH] = "switch",
+	[COBALT_EVTRACE_TIMER] = "timer",
+	[COBALT_EVTRACE_IRQ] = "irq",
+	[COBALT_EVTRACE_CLOCK] = "clock",
+	[COBALT_EVTRACE_HARDEN] = "harden",
+	[COBALT_EVTRACE_RELAX] = "relax",
+};
+
+static inline struct cobalt_evtrace_ring *
+get_ring(void *area, const struct cobalt_evtrace_header *h, int cpu)
+{
+	return area + h->ring_offset + h->ring_size * cpu;
+}
+
+/*
+ * Copy the live rings into a private buffer. Records which may have
+ * been overwritten while we were copying are cleared, so that the
+ * snapshot only contains consistent data, whether it is decoded
+ * right away or saved for later.
+ */
+static void *take_snapshot(struct cobalt_evtrace_header *h)
+{
+	struct cobalt_evtrace_ring *live, *ring;
+	unsigned int h0, h1, seq, n;
+	void *map, *area;
+	int fd, cpu;
+
+	fd = open(EVTRACE_DEVICE, O_RDONLY);
+	if (fd < 0)
+		error(1, errno, "cannot open %s", EVTRACE_DEVICE);
+
+	if (ioctl(fd, EVTRACE_RTIOC_INFO, h))
+		error(1, errno, "cannot get trace information");
+
+	map = mmap(NULL, h->map_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		error(1, errno, "cannot map trace buffers");
+
+	area = malloc(h->map_size);
+	if (area == NULL)
+		error(1, ENOMEM, "cannot take snapshot");
+
+	memcpy(area, h, sizeof(*h));
+
+	for (cpu = 0; cpu < h->nr_cpus; cpu++) {
+		live = get_ring(map, h, cpu);
+		ring = get_ring(area, h, cpu);
+		h0 = __atomic_load_n(&live->head, __ATOMIC_ACQUIRE);
+		memcpy(ring, live, h->ring_size);
+		h1 = __atomic_load_n(&live->head, __ATOMIC_ACQUIRE);
+		ring->head = h0;
+		/*
+		 * The writer may have recycled the slots of records
+		 * h0 - nr_records up to h1 - nr_records included.
+		 */
+		n = h1 - h0 + 1;
+		if (n > h->nr_records)
+			n = h->nr_records;
+		for (seq = h0 - h->nr_records; n > 0; n--, seq++)
+			ring->recs[seq & (h->nr_records - 1)].type =
+				COBALT_EVTRACE_NONE;
+	}
+
+	munmap(map, h->map_size);
+	close(fd);
+
+	return area;
+}
+
+static void *load_snapshot(const char *path, struct cobalt_evtrace_header *h)
+{
+	void *area;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		error(1, errno, "cannot open %s", path);
+
+	if (fread(h, sizeof(*h), 1, fp) != 1 || h->magic != COBALT_EVTRACE_MAGIC)
+		error(1, 0, "%s: not an event trace", path);
+
+	area = malloc(h->map_size);
+	if (area == NULL)
+		error(1, ENOMEM, "cannot load snapshot");
+
+	rewind(fp);
+	if (fread(area, h->map_size, 1, fp) != 1)
+		error(1, 0, "%s: truncated event trace", path);
+
+	fclose(fp);
+
+	return area;
+}
+
+static void save_snapshot(const char *path, void *area,
+			  const struct cobalt_evtrace_header *h)
+{
+	FILE *fp;
+
+	fp = fopen(path, "w");
+	if (fp == NULL)
+		error(1, errno, "cannot create %s", path);
+
+	if (fwrite(area, h->map_size, 1, fp) != 1 || fclose(fp))
+		error(1, errno, "cannot write %s", path);
+}
+
+static int compare_records(const void *a, const void *b)
+{
+	const struct cobalt_evtrace_rec *ra = a, *rb = b;
+
+	if (ra->ts < rb->ts)
+		return -1;
+	if (ra->ts > rb->ts)
+		return 1;
+
+	return ra->cpu - rb->cpu;
+}
+
+static void print_record(const struct cobalt_evtrace_rec *rec,
+			 double t, double dt)
+{
+	const char *name = "?";
+
+	if (rec->type < sizeof(event_names) / sizeof(event_names[0]))
+		name = event_names[rec->type];
+
+	printf("%14.3f %+10.3f  %3u  %6d  %-7s", t, dt,
+	       rec->cpu, (int)rec->pid, name);
+
+	switch (rec->type) {
+	case COBALT_EVTRACE_SWITCH:
+		printf(" next=%d prio=%d", (int)rec->arg0, (int)rec->arg1);
+		break;
+	case COBALT_EVTRACE_TIMER:
+		printf(" late=%lld timer=%#llx", (long long)rec->arg0,
+		       (unsigned long long)rec->arg1);
+		break;
+	case COBALT_EVTRACE_IRQ:
+	case COBALT_EVTRACE_CLOCK:
+		printf(" irq=%u", (unsigned int)rec->arg0);
+		break;
+	case COBALT_EVTRACE_RELAX:
+		printf(" reason=%d", (int)rec->arg0);
+		break;
+	}
+
+	putchar('\n');
+}
+
+static void decode(void *area, const struct cobalt_evtrace_header *h,
+		   int only_cpu, unsigned int last)
+{
+	struct cobalt_evtrace_rec *recs, *rec;
+	struct cobalt_evtrace_ring *ring;
+	unsigned int n, nr = 0, seq;
+	unsigned long long t0, prev;
+	double usecs;
+	int cpu;
+
+	recs = malloc(sizeof(*recs) * h->nr_records * h->nr_cpus);
+	if (recs == NULL)
+		error(1, ENOMEM, "cannot decode trace");
+
+	for (cpu = 0; cpu < h->nr_cpus; cpu++) {
+		if (only_cpu >= 0 && cpu != only_cpu)
+			continue;
+		ring = get_ring(area, h, cpu);
+		seq = ring->head - h->nr_records;
+		for (n = 0; n < h->nr_records; n++, seq++) {
+			rec = ring->recs + (seq & (h->nr_records - 1));
+			if (rec->type != COBALT_EVTRACE_NONE)
+				recs[nr++] = *rec;
+		}
+	}
+
+	if (nr == 0) {
+		fputs("no event\n", stderr);
+		goto out;
+	}
+
+	qsort(recs, nr, sizeof(*recs), compare_records);
+
+	n = 0;
+	if (last && last < nr)
+		n = nr - last;
+
+	usecs = 1000000.0 / h->clock_freq;
+	t0 = recs[n].ts;
+	prev = t0;
+
+	printf("%14s %10s  %3s  %6s  %s\n\n",
+	       "TIME(us)", "DELTA", "CPU", "PID", "EVENT");
+
+	for (; n < nr; n++) {
+		print_record(recs + n, (recs[n].ts - t0) * usecs,
+			     (recs[n].ts - prev) * usecs);
+		prev = recs[n].ts;
+	}
+out:
+	free(recs);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: rtevtrace [options]\n");
+	fprintf(stderr, "   --file <file>		decode a saved trace instead of the live one\n");
+	fprintf(stderr, "   --save <file>		save a snapshot of the live trace\n");
+	fprintf(stderr, "   --cpu <n>		only show events from CPU <n>\n");
+	fprintf(stderr, "   --last <count>		only show the <count> most recent events\n");
+	fprintf(stderr, "   --help			print this help\n");
+}
+
+int main(int argc, char *const argv[])
+{
+	const char *trace_file = NULL, *save_file = NULL;
+	struct cobalt_evtrace_header h;
+	unsigned int last = 0;
+	int c, lindex, cpu = -1;
+	void *area;
+
+	for (;;) {
+		c = getopt_long_only(argc, argv, "", base_options, &lindex);
+		if (c == EOF)
+			break;
+		if (c == '?') {
+			usage();
+			return EINVAL;
+		}
+		if (c > 0)
+			continue;
+
+		switch (lindex) {
+		case help_opt:
+			usage();
+			exit(0);
+		case file_opt:
+			trace_file = optarg;
+			break;
+		case save_opt:
+			save_file = optarg;
+			break;
+		case cpu_opt:
+			cpu = atoi(optarg);
+			break;
+		case last_opt:
+			last = atoi(optarg);
+			break;
+		default:
+			return EINVAL;
+		}
+	}
+
+	if (trace_file) {
+		area = load_snapshot(trace_file, &h);
+	} else {
+		area = take_snapshot(&h);
+		if (save_file) {
+			save_snapshot(save_file, area, &h);
+			goto out;
+		}
+	}
+
+	if (cpu >= (int)h.nr_cpus)
+		error(1, 0, "no such CPU: %d", cpu);
+
+	decode(area, &h, cpu, last);
+out:
+	free(area);
+
+	return 0;
+}
@@ -21,32 +21,152 @@
 #include <error.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <boilerplate/atomic.h>
+#include <cobalt/uapi/kernel/stats.h>
 
 #define PROC_ACCT  "/proc/xenomai/sched/acct"
 #define PROC_PID  "/proc/%d/cmdline"
+#define STATS_DEVICE  "/dev/rtdm/" COBALT_STATS_DEV
 
 #define ACCT_FMT_1  "%u %d %lu %lu %lu %lx %Lu %Lu %Lu"
 #define ACCT_FMT_2  ACCT_FMT_1 " %[^\n]"
 #define ACCT_NFMT_1 9
 #define ACCT_NFMT_2 10
 
-int main(int argc, char *argv[])
+static void print_thread(int pid, unsigned long long exectime,
+			 const char *name)
+{
+	char cmdpath[sizeof(PROC_PID) + 32], cmdbuf[BUFSIZ];
+	unsigned int hr, min, msec, usec;
+	unsigned long long v;
+	unsigned long sec;
+	FILE *cmdfp;
+
+	snprintf(cmdpath, sizeof(cmdpath), PROC_PID, pid);
+	cmdfp = fopen(cmdpath, "r");
+
+	if (cmdfp == NULL ||
+	    fgets(cmdbuf, sizeof(cmdbuf), cmdfp) == NULL)
+		strcpy(cmdbuf, "-");
+
+	if (cmdfp)
+		fclose(cmdfp);
+
+	v = exectime;
+	sec = v / 1000000000LL;
+	v %= 1000000000LL;
+	msec = v / 1000000LL;
+	v %= 1000000LL;
+	usec = v / 1000LL;
+	hr = sec / (60 * 60);
+	sec %= (60 * 60);
+	min = sec / 60;
+	sec %= 60;
+	printf("%-6d %.3u:%.2u:%.2lu.%.3u,%.3u   %-24s %s\n",
+	       pid,
+	       hr, min, sec, msec, usec,
+	       name, cmdbuf);
+}
+
+static unsigned long long ticks_to_ns(unsigned long long ticks,
+				      unsigned long long freq)
+{
+	return ticks / freq * 1000000000ULL +
+		ticks % freq * 1000000000ULL / freq;
+}
+
+/*
+ * rtps is a plain Linux program, so the statistics map is read
+ * directly instead of going through libcobalt. The execution time
+ * shown for a running thread is the one published when it was last
+ * switched out.
+ */
+static int list_from_map(void)
+{
+	const struct cobalt_stats_thread *p;
+	const struct cobalt_stats_header *h;
+	struct cobalt_stats_thread rec;
+	unsigned int slot, seq;
+	size_t len;
+	void *map;
+	int fd, ret;
+
+	fd = open(STATS_DEVICE, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	len = sizeof(*h);
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto fail;
+
+	/* Records may only grow in later versions. */
+	h = map;
+	if (h->magic != COBALT_STATS_MAGIC ||
+	    h->thread_size < sizeof(struct cobalt_stats_thread) ||
+	    h->clock_freq == 0) {
+		munmap(map, len);
+		errno = EPROTO;
+		goto fail;
+	}
+
+	len = h->map_size;
+	munmap(map, sizeof(*h));
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto fail;
+
+	close(fd);
+	h = map;
+
+	for (slot = 0; slot < h->nr_slots; slot++) {
+		p = map + h->thread_offset + slot * h->thread_size;
+		do {
+			while ((seq = ACCESS_ONCE(p->seq)) & 1)
+				;
+			smp_rmb();
+			compiler_barrier();
+			memcpy(&rec, p, sizeof(rec));
+			smp_rmb();
+			compiler_barrier();
+		} while (ACCESS_ONCE(p->seq) != seq);
+
+		if (rec.flags & COBALT_STATS_SLOT_USED) {
+			rec.name[sizeof(rec.name) - 1] = '\0';
+			print_thread(rec.pid,
+				     ticks_to_ns(rec.exectime, h->clock_freq),
+				     rec.name);
+		}
+	}
+
+	munmap(map, len);
+
+	return 0;
+fail:
+	ret = -errno;
+	close(fd);
+
+	return ret;
+}
+
+/* Fallback for kernels without the binary statistics map. */
+static void list_from_vfile(void)
 {
-	char cmdpath[sizeof(PROC_PID) + 32], cmdbuf[BUFSIZ], acctbuf[BUFSIZ], name[64];
-	unsigned long ssw, csw, pf, state, sec;
 	unsigned long long account_period,
-		exectime_period, exectime_total, v;
-	unsigned int cpu, hr, min, msec, usec;
-	FILE *acctfp, *cmdfp;
+		exectime_period, exectime_total;
+	unsigned long ssw, csw, pf, state;
+	char acctbuf[BUFSIZ], name[64];
+	unsigned int cpu;
+	FILE *acctfp;
 	int pid;
 
 	acctfp = fopen(PROC_ACCT, "r");
 	if (acctfp == NULL)
 		error(1, errno, "cannot open %s\n", PROC_ACCT);
 
-	printf("%-6s %-17s   %-24s %s\n\n",
-	       "PID", "TIME", "THREAD", "CMD");
-
 	while (fgets(acctbuf, sizeof(acctbuf), acctfp) != NULL) {
 		if (sscanf(acctbuf, ACCT_FMT_2,
 		      &cpu, &pid, &ssw, &csw, &pf, &state,
@@ -60,32 +180,19 @@ int main(int argc, char *argv[])
 				break;
 			}
 		}
-
-		snprintf(cmdpath, sizeof(cmdpath), PROC_PID, pid);
-		cmdfp = fopen(cmdpath, "r");
-
-		if (cmdfp == NULL ||
-		    fgets(cmdbuf, sizeof(cmdbuf), cmdfp) == NULL)
-			strcpy(cmdbuf, "-");
-
-		if (cmdfp)
-			fclose(cmdfp);
-
-		v = exectime_total;
-		sec = v / 1000000000LL;
-		v %= 1000000000LL;
-		msec = v / 1000000LL;
-		v %= 1000000LL;
-		usec = v / 1000LL;
-		hr = sec / (60 * 60);
-		sec %= (60 * 60);
-		min = sec / 60;
-		sec %= 60;
-		printf("%-6d %.3u:%.2u:%.2lu.%.3u,%.3u   %-24s %s\n",
-		       pid,
-		       hr, min, sec, msec, usec,
-		       name, cmdbuf);
+		print_thread(pid, exectime_total, name);
 	}
 
+	fclose(acctfp);
+}
+
+int main(int argc, char *argv[])
+{
+	printf("%-6s %-17s   %-24s %s\n\n",
+	       "PID", "TIME", "THREAD", "CMD");
+
+	if (list_from_map())
+		list_from_vfile();
+
 	exit(0);
 }